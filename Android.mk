@@ -96,6 +96,18 @@ ifeq ($(KERNELFLINGER_ASSUME_BIOS_SECURE_BOOT),true)
     KERNELFLINGER_CFLAGS += -DASSUME_BIOS_SECURE_BOOT
 endif
 
+ifneq ($(KERNELFLINGER_LOG_BUF_SIZE),)
+    KERNELFLINGER_CFLAGS += -DLOG_BUF_SIZE=$(KERNELFLINGER_LOG_BUF_SIZE)
+endif
+
+ifeq ($(KERNELFLINGER_DISABLE_TRACE),true)
+    KERNELFLINGER_CFLAGS += -DDISABLE_TRACE
+endif
+
+ifneq ($(KERNELFLINGER_LOG_LEVEL),)
+    KERNELFLINGER_CFLAGS += -DLOG_LEVEL=LOG_LEVEL_$(call to-upper,$(KERNELFLINGER_LOG_LEVEL))
+endif
+
 KERNELFLINGER_STATIC_LIBRARIES := \
 	libuefi_ssl_static \
 	libuefi_crypto_static \
@@ -218,6 +230,7 @@ endif
 
 ifneq ($(TARGET_BUILD_VARIANT),user)
     LOCAL_SRC_FILES += unittest.c
+    LOCAL_C_INCLUDES += $(addprefix $(LOCAL_PATH)/,libadb)
 endif
 
 LOCAL_CFLAGS := $(SHARED_CFLAGS)
@@ -61,10 +61,6 @@ LOCAL_STATIC_LIBRARIES := \
 	libtransport-$(TARGET_BUILD_VARIANT) \
 	libkernelflinger-$(TARGET_BUILD_VARIANT)
 
-ifeq ($(KERNELFLINGER_USE_IPP_SHA256),true)
-    LOCAL_CFLAGS += -DUSE_IPP_SHA256
-    LOCAL_CFLAGS += -msse4 -msha
-endif
 ifneq ($(strip $(KERNELFLINGER_USE_UI)),false)
     LOCAL_CFLAGS += -DUSE_UI
 endif
@@ -80,7 +76,11 @@ LOCAL_SRC_FILES := \
     libavb/avb_kernel_cmdline_descriptor.c \
     libavb/avb_property_descriptor.c \
     libavb/avb_rsa.c \
+    libavb/avb_rsa_ipps.c \
+    libavb/avb_sha256.c \
+    libavb/avb_sha256_ipps.c \
     libavb/avb_sha512.c \
+    libavb/avb_sha512_ipps.c \
     libavb/avb_slot_verify.c \
     libavb/uefi_avb_sysdeps.c \
     libavb/uefi_avb_ops.c \
@@ -89,14 +89,6 @@ LOCAL_SRC_FILES := \
     libavb/avb_vbmeta_image.c \
     libavb_ab/avb_ab_flow.c
 
-ifeq ($(KERNELFLINGER_USE_IPP_SHA256),true)
-LOCAL_SRC_FILES += \
-    libavb/avb_sha256_ipps.c
-else
-LOCAL_SRC_FILES += \
-    libavb/avb_sha256.c
-endif
-
 LOCAL_C_INCLUDES := \
 	$(addprefix $(LOCAL_PATH)/,../libkernelflinger)
 
@@ -173,9 +173,18 @@ static void montMul(const IAvbKey* key, uint32_t* c, uint32_t* a, uint32_t* b) {
  * Input and output big-endian byte array in inout.
  */
 static void modpowF4(const IAvbKey* key, uint8_t* inout) {
-  uint32_t* a = (uint32_t*)avb_malloc(key->len * sizeof(uint32_t));
-  uint32_t* aR = (uint32_t*)avb_malloc(key->len * sizeof(uint32_t));
-  uint32_t* aaR = (uint32_t*)avb_malloc(key->len * sizeof(uint32_t));
+  uint32_t* a = NULL;
+  uint32_t* aR = NULL;
+  uint32_t* aaR = NULL;
+
+  /* Prefer the 64-bit limb implementation where it is available. */
+  if (avb_rsa_modpowF4_u64(key->n, key->rr, key->len, inout)) {
+    return;
+  }
+
+  a = (uint32_t*)avb_malloc(key->len * sizeof(uint32_t));
+  aR = (uint32_t*)avb_malloc(key->len * sizeof(uint32_t));
+  aaR = (uint32_t*)avb_malloc(key->len * sizeof(uint32_t));
   if (a == NULL || aR == NULL || aaR == NULL) {
     goto out;
   }
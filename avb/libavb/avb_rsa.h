@@ -66,6 +66,24 @@ bool avb_rsa_verify(const uint8_t* key,
                     const uint8_t* padding,
                     size_t padding_num_bytes) AVB_ATTR_WARN_UNUSED_RESULT;
 
+/* In-place public exponentiation (65537) of the big-endian |inout|
+ * buffer using 64-bit limbs. |n| and |rr| are the modulus and R^2 mod
+ * n as |len| little-endian 32-bit words. Returns false if this
+ * implementation is not available, in which case |inout| is left
+ * untouched.
+ */
+bool avb_rsa_modpowF4_u64(const uint32_t* n,
+                          const uint32_t* rr,
+                          size_t len,
+                          uint8_t* inout);
+
+/* Makes avb_rsa_verify() use the 64-bit limb implementation if |u64|
+ * is true, and its MULX/ADX multiplication if |adx| is also true and
+ * the CPU supports it. Both are used by default; this is only needed
+ * to compare the implementations.
+ */
+void avb_rsa_setup(bool u64, bool adx);
+
 #ifdef __cplusplus
 }
 #endif
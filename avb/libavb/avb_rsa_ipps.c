@@ -0,0 +1,301 @@
+/*
+ * Copyright (c) 2017, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer
+ *      in the documentation and/or other materials provided with the
+ *      distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * RSA public exponentiation (e = 65537) with 64-bit limbs.
+ *
+ * The key format is the one of avb_rsa.c: R = 2^(32 * len) is also
+ * 2^(64 * len / 2), so the pre-computed R^2 mod n stored in the key
+ * is reused as is.  Only -1 / n mod 2^64 has to be derived.
+ *
+ * Two Montgomery multiplications are provided: a portable one using
+ * 128-bit products, and one using MULX and the two independent ADCX
+ * and ADOX carry chains, selected at runtime.
+ */
+
+#include "avb_rsa.h"
+#include "avb_util.h"
+
+#ifdef __LP64__
+
+typedef unsigned __int128 uint128_t;
+
+typedef struct {
+	size_t len;		/* Length of n[] in number of uint64_t */
+	uint64_t n0inv;		/* -1 / n[0] mod 2^64 */
+	uint64_t *n;
+	uint64_t *rr;
+	uint64_t *t;		/* 2 * len + 2 words of scratch */
+} Mont64Key;
+
+typedef void (*mont_mul_t)(const Mont64Key *key, uint64_t *c,
+			   const uint64_t *a, const uint64_t *b);
+
+/* a[] -= n[], returns the borrow */
+static uint64_t sub_n(const Mont64Key *key, uint64_t *a)
+{
+	uint64_t borrow = 0;
+	size_t i;
+
+	for (i = 0; i < key->len; i++) {
+		uint128_t d = (uint128_t)a[i] - key->n[i] - borrow;
+		a[i] = (uint64_t)d;
+		borrow = (uint64_t)(d >> 64) & 1;
+	}
+
+	return borrow;
+}
+
+/* Store t[0..len] into c[], subtracting n once if t >= n. */
+static void mont_reduce_final(const Mont64Key *key, uint64_t *c,
+			      const uint64_t *t)
+{
+	uint64_t top = t[key->len];
+	size_t i;
+
+	for (i = 0; i < key->len; i++)
+		c[i] = t[i];
+
+	/* t < 2n: one subtraction is enough.  If there is a top word the
+	 * subtraction borrows out of it, otherwise compare first. */
+	if (top) {
+		sub_n(key, c);
+		return;
+	}
+
+	for (i = key->len; i;) {
+		--i;
+		if (c[i] < key->n[i])
+			return;
+		if (c[i] > key->n[i])
+			break;
+	}
+	sub_n(key, c);
+}
+
+/* Montgomery c[] = a[] * b[] / R % n, CIOS method. */
+static void mont_mul_generic(const Mont64Key *key, uint64_t *c,
+			     const uint64_t *a, const uint64_t *b)
+{
+	uint64_t *t = key->t;
+	size_t s = key->len;
+	size_t i, j;
+
+	avb_memset(t, 0, (s + 2) * sizeof(*t));
+
+	for (i = 0; i < s; i++) {
+		uint128_t acc = 0;
+		uint64_t m;
+
+		for (j = 0; j < s; j++) {
+			acc = (uint128_t)a[i] * b[j] + t[j] + (uint64_t)(acc >> 64);
+			t[j] = (uint64_t)acc;
+		}
+		acc = (uint128_t)t[s] + (uint64_t)(acc >> 64);
+		t[s] = (uint64_t)acc;
+		t[s + 1] = (uint64_t)(acc >> 64);
+
+		m = t[0] * key->n0inv;
+		acc = (uint128_t)m * key->n[0] + t[0];
+		for (j = 1; j < s; j++) {
+			acc = (uint128_t)m * key->n[j] + t[j] + (uint64_t)(acc >> 64);
+			t[j - 1] = (uint64_t)acc;
+		}
+		acc = (uint128_t)t[s] + (uint64_t)(acc >> 64);
+		t[s - 1] = (uint64_t)acc;
+		t[s] = t[s + 1] + (uint64_t)(acc >> 64);
+	}
+
+	mont_reduce_final(key, c, t);
+}
+
+/* t[0..s+1] += x * y[0..s-1].  The low halves of the products are
+ * accumulated on the ADCX (carry flag) chain and the high halves on
+ * the ADOX (overflow flag) one, so the two chains do not serialize.
+ * The loop control only uses LEA and JRCXZ, which leave both flags
+ * alone. */
+static inline void mul_add_adx(uint64_t *t, uint64_t x,
+			       const uint64_t *y, size_t s)
+{
+	asm volatile("xorl %%r8d, %%r8d\n\t"		/* clears CF and OF */
+		     "1:\n\t"
+		     "jrcxz 2f\n\t"
+		     "mulx (%[y]), %%r9, %%r10\n\t"
+		     "adcx (%[t]), %%r9\n\t"
+		     "movq %%r9, (%[t])\n\t"
+		     "adox 8(%[t]), %%r10\n\t"
+		     "movq %%r10, 8(%[t])\n\t"
+		     "leaq 8(%[y]), %[y]\n\t"
+		     "leaq 8(%[t]), %[t]\n\t"
+		     "leaq -1(%%rcx), %%rcx\n\t"
+		     "jmp 1b\n\t"
+		     "2:\n\t"
+		     "movq (%[t]), %%r9\n\t"	/* t[s] += CF */
+		     "adcx %%r8, %%r9\n\t"
+		     "movq %%r9, (%[t])\n\t"
+		     "movq 8(%[t]), %%r10\n\t"	/* t[s + 1] += OF + CF */
+		     "adox %%r8, %%r10\n\t"
+		     "adcx %%r8, %%r10\n\t"
+		     "movq %%r10, 8(%[t])\n\t"
+		     : [t] "+r" (t), [y] "+r" (y), "+c" (s)
+		     : "d" (x)
+		     : "r8", "r9", "r10", "cc", "memory");
+}
+
+/* Same as mont_mul_generic() but T slides up one word per outer
+ * iteration instead of being shifted down: it holds 2 * len + 2
+ * words and the result ends up in its upper half. */
+static void mont_mul_adx(const Mont64Key *key, uint64_t *c,
+			 const uint64_t *a, const uint64_t *b)
+{
+	uint64_t *t = key->t;
+	size_t s = key->len;
+	size_t i;
+
+	avb_memset(t, 0, (2 * s + 2) * sizeof(*t));
+
+	for (i = 0; i < s; i++, t++) {
+		mul_add_adx(t, a[i], b, s);
+		mul_add_adx(t, t[0] * key->n0inv, key->n, s);
+	}
+
+	mont_reduce_final(key, c, t);
+}
+
+static bool u64_enabled = true;
+static bool adx_enabled = true;
+static mont_mul_t mont_mul;
+
+void avb_rsa_setup(bool u64, bool adx)
+{
+	u64_enabled = u64;
+	adx_enabled = adx;
+	mont_mul = NULL;
+}
+
+static mont_mul_t select_mont_mul(void)
+{
+	if (!mont_mul) {
+		if (adx_enabled && avb_cpu_has_feature(AVB_CPU_FEATURE_ADX))
+			mont_mul = mont_mul_adx;
+		else
+			mont_mul = mont_mul_generic;
+	}
+
+	return mont_mul;
+}
+
+/* -1 / n mod 2^64 by Newton iteration; n is odd so x = n is correct
+ * to 3 bits and each step doubles the number of correct bits. */
+static uint64_t neg_inverse64(uint64_t n)
+{
+	uint64_t x = n;
+	int i;
+
+	for (i = 0; i < 5; i++)
+		x *= 2 - n * x;
+
+	return -x;
+}
+
+bool avb_rsa_modpowF4_u64(const uint32_t *n, const uint32_t *rr,
+			  size_t len, uint8_t *inout)
+{
+	mont_mul_t mont_mul = select_mont_mul();
+	Mont64Key key;
+	uint64_t *buf, *a, *aR, *aaR;
+	size_t buf_size, i, j;
+
+	if (!u64_enabled || len == 0 || len % 2)
+		return false;
+
+	/* n, rr, a, aR, aaR and the multiplication scratch buffer */
+	key.len = len / 2;
+	buf_size = (7 * key.len + 2) * sizeof(uint64_t);
+	buf = (uint64_t *)avb_malloc(buf_size);
+	if (!buf)
+		return false;
+
+	key.n = buf;
+	key.rr = key.n + key.len;
+	a = key.rr + key.len;
+	aR = a + key.len;
+	aaR = aR + key.len;
+	key.t = aaR + key.len;
+
+	for (i = 0; i < key.len; i++) {
+		key.n[i] = n[2 * i] | (uint64_t)n[2 * i + 1] << 32;
+		key.rr[i] = rr[2 * i] | (uint64_t)rr[2 * i + 1] << 32;
+	}
+	key.n0inv = neg_inverse64(key.n[0]);
+
+	/* Convert from big endian byte array to little endian word array. */
+	for (i = 0; i < key.len; i++) {
+		const uint8_t *p = inout + (key.len - 1 - i) * 8;
+		uint64_t tmp = 0;
+
+		for (j = 0; j < 8; j++)
+			tmp = tmp << 8 | p[j];
+		a[i] = tmp;
+	}
+
+	mont_mul(&key, aR, a, key.rr);		/* aR = a * RR / R mod M */
+	for (i = 0; i < 16; i += 2) {
+		mont_mul(&key, aaR, aR, aR);	/* aaR = aR * aR / R mod M */
+		mont_mul(&key, aR, aaR, aaR);	/* aR = aaR * aaR / R mod M */
+	}
+	mont_mul(&key, aaR, aR, a);		/* aaa = aR * a / R mod M */
+
+	/* Convert to big endian byte array */
+	for (i = key.len; i;) {
+		uint64_t tmp = aaR[--i];
+
+		for (j = 0; j < 8; j++)
+			*inout++ = (uint8_t)(tmp >> (56 - 8 * j));
+	}
+
+	avb_memset(buf, 0, buf_size);
+	avb_free(buf);
+	return true;
+}
+
+#else
+
+void avb_rsa_setup(bool u64, bool adx)
+{
+}
+
+bool avb_rsa_modpowF4_u64(const uint32_t *n, const uint32_t *rr,
+			  size_t len, uint8_t *inout)
+{
+	return false;
+}
+
+#endif	/* __LP64__ */
@@ -48,15 +48,6 @@ extern "C" {
 #define AVB_SHA512_BLOCK_SIZE 128
 
 /* Data structure used for SHA-256. */
-#ifdef USE_IPP_SHA256
-typedef struct __attribute__((aligned (16))){
-  uint32_t h[8];
-  uint32_t tot_len;
-  uint32_t len;
-  uint8_t block[2 * AVB_SHA256_BLOCK_SIZE];
-  uint8_t buf[AVB_SHA256_DIGEST_SIZE]; /* Used for storing the final digest. */
-} AvbSHA256Ctx;
-#else
 typedef struct {
   uint32_t h[8];
   uint32_t tot_len;
@@ -64,7 +55,6 @@ typedef struct {
   uint8_t block[2 * AVB_SHA256_BLOCK_SIZE];
   uint8_t buf[AVB_SHA256_DIGEST_SIZE]; /* Used for storing the final digest. */
 } AvbSHA256Ctx;
-#endif
 
 /* Data structure used for SHA-512. */
 typedef struct {
@@ -84,6 +74,13 @@ void avb_sha256_update(AvbSHA256Ctx* ctx, const uint8_t* data, uint32_t len);
 /* Returns the SHA-256 digest. */
 uint8_t* avb_sha256_final(AvbSHA256Ctx* ctx) AVB_ATTR_WARN_UNUSED_RESULT;
 
+/* Processes |num_blks| 64-byte blocks from |data| into |digest|
+ * using the SHA extensions. Only call if
+ * avb_cpu_has_feature(AVB_CPU_FEATURE_SHA) is true. */
+void avb_sha256_shani_transform(uint32_t* digest,
+                                const uint8_t* data,
+                                uint32_t num_blks);
+
 /* Initializes the SHA-512 context. */
 void avb_sha512_init(AvbSHA512Ctx* ctx);
 
@@ -93,6 +90,18 @@ void avb_sha512_update(AvbSHA512Ctx* ctx, const uint8_t* data, uint32_t len);
 /* Returns the SHA-512 digest. */
 uint8_t* avb_sha512_final(AvbSHA512Ctx* ctx) AVB_ATTR_WARN_UNUSED_RESULT;
 
+/* Uses the AVX2 SHA-512 block transform if |accelerated| is true and
+ * it is supported, the portable one otherwise. Only needed to compare
+ * both, the transform is otherwise selected on first use. */
+void avb_sha512_setup(bool accelerated);
+
+/* Processes |num_blks| 128-byte blocks from |data| into |digest|
+ * using AVX2. Only call if avb_cpu_has_feature(AVB_CPU_FEATURE_AVX2)
+ * is true. */
+void avb_sha512_avx2_transform(uint64_t* digest,
+                               const uint8_t* data,
+                               uint32_t num_blks);
+
 #ifdef __cplusplus
 }
 #endif
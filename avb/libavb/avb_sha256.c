@@ -134,6 +134,11 @@ static void SHA256_transform(AvbSHA256Ctx* ctx,
   int j;
 #endif
 
+  if (avb_cpu_has_feature(AVB_CPU_FEATURE_SHA)) {
+    avb_sha256_shani_transform(ctx->h, message, block_nb);
+    return;
+  }
+
   for (i = 0; i < (int)block_nb; i++) {
     sub_block = message + (i << 6);
 
@@ -28,21 +28,22 @@
  *
  */
 
+/*
+ * SHA-256 block transform using the SHA extensions.  avb_sha256.c
+ * only calls it once avb_cpu_has_feature() has reported that the CPU
+ * implements them, so this file is safe to build into every image.
+ */
+
 #include <stdint.h>
 #include <immintrin.h>
 
 #include "avb_sha.h"
 
-#define SHA256_BLOCK_SIZE       64
-#define UNPACK32(x, str)                 \
-  {                                      \
-    *((str) + 3) = (uint8_t)((x));       \
-    *((str) + 2) = (uint8_t)((x) >> 8);  \
-    *((str) + 1) = (uint8_t)((x) >> 16); \
-    *((str) + 0) = (uint8_t)((x) >> 24); \
-  }
+#define SHANI_TARGET __attribute__((target("sha,sse4.1")))
 
-static void sha256_update(uint32_t *digest, const uint8_t *data, uint32_t num_blks)
+void SHANI_TARGET avb_sha256_shani_transform(uint32_t *digest,
+					     const uint8_t *data,
+					     uint32_t num_blks)
 {
 	__m128i state0, state1;
 	__m128i msg;
@@ -251,94 +252,6 @@ static void sha256_update(uint32_t *digest, const uint8_t *data, uint32_t num_bl
 	state0 = _mm_blend_epi16(tmp, state1, 0xF0); /* DCBA */
 	state1 = _mm_alignr_epi8(state1, tmp, 8);    /* ABEF */
 
-	_mm_store_si128((__m128i *)digest, state0);
-	_mm_store_si128((__m128i *)(digest + 4), state1);
-}
-
-
-void avb_sha256_init(AvbSHA256Ctx* ctx)
-{
-	ctx->len = 0;
-
-	ctx->h[0] = 0x6A09E667UL;
-	ctx->h[1] = 0xBB67AE85UL;
-	ctx->h[2] = 0x3C6EF372UL;
-	ctx->h[3] = 0xA54FF53AUL;
-	ctx->h[4] = 0x510E527FUL;
-	ctx->h[5] = 0x9B05688CUL;
-	ctx->h[6] = 0x1F83D9ABUL;
-	ctx->h[7] = 0x5BE0CD19UL;
-}
-
-void avb_sha256_update(AvbSHA256Ctx* ctx, const uint8_t* buf, uint32_t size)
-{
-	uint32_t i;
-	uint32_t num;
-	uint32_t blocks;
-	uint32_t *digest = ctx->h;
-	uint8_t *data = (uint8_t *)ctx->block;
-	uint32_t kn = ctx->len % SHA256_BLOCK_SIZE;
-
-	ctx->len += size;
-	if (size + kn < SHA256_BLOCK_SIZE) {
-		for (i = 0; i < size; i++)
-			data[kn + i] = buf[i];
-
-		return;
-	}
-
-	if (kn != 0) {
-		num = SHA256_BLOCK_SIZE - kn;
-		for (i = 0; i < num; i++)
-			data[kn + i] = buf[i];
-
-		sha256_update(digest, data, 1);
-		buf += num;
-		size -= num;
-	}
-
-	blocks = size/SHA256_BLOCK_SIZE;
-	if (blocks > 0)
-		sha256_update(digest, buf, blocks);
-
-	num = size - blocks * SHA256_BLOCK_SIZE;
-	for (i = 0; i < num; i++)
-		data[i] = buf[i + blocks * SHA256_BLOCK_SIZE];
-}
-
-uint8_t* avb_sha256_final(AvbSHA256Ctx* ctx)
-{
-	uint32_t i;
-	uint32_t len;
-	uint8_t buffer[SHA256_BLOCK_SIZE * 2];
-	uint8_t *p8bits;
-	uint8_t *data = (uint8_t *)ctx->block;
-	uint32_t *digest = ctx->h;
-	uint64_t u64bits = (uint64_t)ctx->len * 8;
-	uint32_t kn = ctx->len % SHA256_BLOCK_SIZE;
-
-	len = kn < (int)(SHA256_BLOCK_SIZE-8) ? SHA256_BLOCK_SIZE : SHA256_BLOCK_SIZE * 2;
-
-	/* copy end of message */
-	for (i = 0; i < kn; i++)
-		buffer[i] = data[i];
-
-	/* end of message bit */
-	buffer[kn++] = 0x80;
-
-	for (i = kn; i < len - 8; i++)
-		buffer[i] = 0x00;
-
-	p8bits = (uint8_t *)(&u64bits);
-	for (i = 0; i < 8; i++)
-		buffer[i + len - 8] = p8bits[7 - i];
-
-	sha256_update(digest, buffer, len / SHA256_BLOCK_SIZE);
-
-	for (i = 0; i < 8; i++)
-            UNPACK32(digest[i], &ctx->buf[i << 2]);
-
-        return ctx->buf;
+	_mm_storeu_si128((__m128i *)digest, state0);
+	_mm_storeu_si128((__m128i *)(digest + 4), state1);
 }
-
-
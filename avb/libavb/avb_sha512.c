@@ -152,9 +152,9 @@ void avb_sha512_init(AvbSHA512Ctx* ctx) {
   ctx->tot_len = 0;
 }
 
-static void SHA512_transform(AvbSHA512Ctx* ctx,
-                             const uint8_t* message,
-                             unsigned int block_nb) {
+static void SHA512_transform_generic(AvbSHA512Ctx* ctx,
+                                     const uint8_t* message,
+                                     unsigned int block_nb) {
   uint64_t w[80];
   uint64_t wv[8];
   uint64_t t1, t2;
@@ -318,6 +318,32 @@ static void SHA512_transform(AvbSHA512Ctx* ctx,
   }
 }
 
+/* The backend is selected once, on first use, from the CPU features
+ * available at runtime, unless avb_sha512_setup() has forced it. */
+static enum { SHA512_UNKNOWN, SHA512_GENERIC, SHA512_AVX2 } backend;
+
+void avb_sha512_setup(bool accelerated) {
+  if (accelerated && avb_cpu_has_feature(AVB_CPU_FEATURE_AVX2))
+    backend = SHA512_AVX2;
+  else
+    backend = SHA512_GENERIC;
+}
+
+static void SHA512_transform(AvbSHA512Ctx* ctx,
+                             const uint8_t* message,
+                             unsigned int block_nb) {
+  if (block_nb == 0)
+    return;
+
+  if (backend == SHA512_UNKNOWN)
+    avb_sha512_setup(true);
+
+  if (backend == SHA512_AVX2)
+    avb_sha512_avx2_transform(ctx->h, message, block_nb);
+  else
+    SHA512_transform_generic(ctx, message, block_nb);
+}
+
 void avb_sha512_update(AvbSHA512Ctx* ctx, const uint8_t* data, uint32_t len) {
   unsigned int block_nb;
   unsigned int new_len, rem_len, tmp_len;
@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) 2017, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer
+ *      in the documentation and/or other materials provided with the
+ *      distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * SHA-512 block transform using AVX2 for the message schedule and
+ * BMI2 RORX for the rounds.  This file is built into every image; the
+ * vector code is only reached once avb_cpu_has_feature() has
+ * confirmed at runtime that the CPU and the firmware allow it.
+ */
+
+#include <stdint.h>
+#include <immintrin.h>
+
+#include "avb_sha.h"
+
+#define AVX2_TARGET __attribute__((target("avx2,bmi2")))
+
+#define ROTR64(x, n) (((x) >> (n)) | ((x) << (64 - (n))))
+#define CH(x, y, z) (((x) & (y)) ^ (~(x) & (z)))
+#define MAJ(x, y, z) (((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
+#define SHA512_F1(x) (ROTR64(x, 28) ^ ROTR64(x, 34) ^ ROTR64(x, 39))
+#define SHA512_F2(x) (ROTR64(x, 14) ^ ROTR64(x, 18) ^ ROTR64(x, 41))
+
+#define VROTR64(x, n) \
+	_mm_or_si128(_mm_srli_epi64(x, n), _mm_slli_epi64(x, 64 - (n)))
+#define VSHA512_F3(x) \
+	_mm_xor_si128(_mm_xor_si128(VROTR64(x, 1), VROTR64(x, 8)), \
+		      _mm_srli_epi64(x, 7))
+#define VSHA512_F4(x) \
+	_mm_xor_si128(_mm_xor_si128(VROTR64(x, 19), VROTR64(x, 61)), \
+		      _mm_srli_epi64(x, 6))
+
+#define SHA512_RND(a, b, c, d, e, f, g, h, j)				\
+	{								\
+		uint64_t t1 = h + SHA512_F2(e) + CH(e, f, g) + wk[j];	\
+		uint64_t t2 = SHA512_F1(a) + MAJ(a, b, c);		\
+		d += t1;						\
+		h = t1 + t2;						\
+	}
+
+static const uint64_t sha512_k[80] __attribute__((aligned(32))) = {
+	0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL, 0xb5c0fbcfec4d3b2fULL,
+	0xe9b5dba58189dbbcULL, 0x3956c25bf348b538ULL, 0x59f111f1b605d019ULL,
+	0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL, 0xd807aa98a3030242ULL,
+	0x12835b0145706fbeULL, 0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL,
+	0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL, 0x9bdc06a725c71235ULL,
+	0xc19bf174cf692694ULL, 0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL,
+	0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL, 0x2de92c6f592b0275ULL,
+	0x4a7484aa6ea6e483ULL, 0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL,
+	0x983e5152ee66dfabULL, 0xa831c66d2db43210ULL, 0xb00327c898fb213fULL,
+	0xbf597fc7beef0ee4ULL, 0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL,
+	0x06ca6351e003826fULL, 0x142929670a0e6e70ULL, 0x27b70a8546d22ffcULL,
+	0x2e1b21385c26c926ULL, 0x4d2c6dfc5ac42aedULL, 0x53380d139d95b3dfULL,
+	0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL, 0x81c2c92e47edaee6ULL,
+	0x92722c851482353bULL, 0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL,
+	0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL, 0xd192e819d6ef5218ULL,
+	0xd69906245565a910ULL, 0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL,
+	0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL, 0x2748774cdf8eeb99ULL,
+	0x34b0bcb5e19b48a8ULL, 0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL,
+	0x5b9cca4f7763e373ULL, 0x682e6ff3d6b2b8a3ULL, 0x748f82ee5defb2fcULL,
+	0x78a5636f43172f60ULL, 0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+	0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL, 0xbef9a3f7b2c67915ULL,
+	0xc67178f2e372532bULL, 0xca273eceea26619cULL, 0xd186b8c721c0c207ULL,
+	0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL, 0x06f067aa72176fbaULL,
+	0x0a637dc5a2c898a6ULL, 0x113f9804bef90daeULL, 0x1b710b35131c471bULL,
+	0x28db77f523047d84ULL, 0x32caab7b40c72493ULL, 0x3c9ebe0a15c9bebcULL,
+	0x431d67c49c100d4cULL, 0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL,
+	0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL
+};
+
+/* Compute W[0..79] + K[0..79] for one 128-byte block.  W[i] depends
+ * on W[i - 2], so the recurrence is evaluated two words at a time;
+ * the byte swap and the K addition are done four words at a time. */
+static void AVX2_TARGET sha512_schedule(uint64_t *wk, const uint8_t *data)
+{
+	uint64_t w[80] __attribute__((aligned(16)));
+	__m256i bswap_mask, v;
+	__m128i w16, w15, w7, w2;
+	unsigned int i;
+
+	bswap_mask = _mm256_set_epi64x(0x08090a0b0c0d0e0fULL,
+				       0x0001020304050607ULL,
+				       0x08090a0b0c0d0e0fULL,
+				       0x0001020304050607ULL);
+
+	for (i = 0; i < 16; i += 4) {
+		v = _mm256_loadu_si256((const __m256i *)(data + i * 8));
+		v = _mm256_shuffle_epi8(v, bswap_mask);
+		_mm256_storeu_si256((__m256i *)&w[i], v);
+	}
+
+	for (i = 16; i < 80; i += 2) {
+		w16 = _mm_load_si128((const __m128i *)&w[i - 16]);
+		w15 = _mm_alignr_epi8(_mm_load_si128((const __m128i *)&w[i - 14]),
+				      w16, 8);
+		w7 = _mm_alignr_epi8(_mm_load_si128((const __m128i *)&w[i - 6]),
+				     _mm_load_si128((const __m128i *)&w[i - 8]), 8);
+		w2 = _mm_load_si128((const __m128i *)&w[i - 2]);
+
+		w16 = _mm_add_epi64(w16, VSHA512_F3(w15));
+		w16 = _mm_add_epi64(w16, w7);
+		w16 = _mm_add_epi64(w16, VSHA512_F4(w2));
+		_mm_store_si128((__m128i *)&w[i], w16);
+	}
+
+	for (i = 0; i < 80; i += 4) {
+		v = _mm256_add_epi64(_mm256_loadu_si256((const __m256i *)&w[i]),
+				     _mm256_load_si256((const __m256i *)&sha512_k[i]));
+		_mm256_storeu_si256((__m256i *)&wk[i], v);
+	}
+}
+
+void AVX2_TARGET avb_sha512_avx2_transform(uint64_t *digest,
+					   const uint8_t *data,
+					   uint32_t num_blks)
+{
+	uint64_t wk[80];
+	uint64_t a, b, c, d, e, f, g, h;
+	unsigned int j;
+
+	while (num_blks > 0) {
+		sha512_schedule(wk, data);
+
+		a = digest[0];
+		b = digest[1];
+		c = digest[2];
+		d = digest[3];
+		e = digest[4];
+		f = digest[5];
+		g = digest[6];
+		h = digest[7];
+
+		for (j = 0; j < 80; j += 8) {
+			SHA512_RND(a, b, c, d, e, f, g, h, j);
+			SHA512_RND(h, a, b, c, d, e, f, g, j + 1);
+			SHA512_RND(g, h, a, b, c, d, e, f, j + 2);
+			SHA512_RND(f, g, h, a, b, c, d, e, j + 3);
+			SHA512_RND(e, f, g, h, a, b, c, d, j + 4);
+			SHA512_RND(d, e, f, g, h, a, b, c, j + 5);
+			SHA512_RND(c, d, e, f, g, h, a, b, j + 6);
+			SHA512_RND(b, c, d, e, f, g, h, a, j + 7);
+		}
+
+		digest[0] += a;
+		digest[1] += b;
+		digest[2] += c;
+		digest[3] += d;
+		digest[4] += e;
+		digest[5] += f;
+		digest[6] += g;
+		digest[7] += h;
+
+		data += AVB_SHA512_BLOCK_SIZE;
+		num_blks--;
+	}
+}
@@ -181,6 +181,7 @@ static AvbSlotVerifyResult load_and_verify_hash_partition(
     goto out;
   }
 
+  avb_trace_begin("avb_hash");
   if (avb_strcmp((const char*)hash_desc.hash_algorithm, "sha256") == 0) {
     AvbSHA256Ctx sha256_ctx;
     avb_sha256_init(&sha256_ctx);
@@ -196,10 +197,12 @@ static AvbSlotVerifyResult load_and_verify_hash_partition(
     digest = avb_sha512_final(&sha512_ctx);
     digest_len = AVB_SHA512_DIGEST_SIZE;
   } else {
+    avb_trace_end("avb_hash");
     avb_errorv(part_name, ": Unsupported hash algorithm.\n", NULL);
     ret = AVB_SLOT_VERIFY_RESULT_ERROR_INVALID_METADATA;
     goto out;
   }
+  avb_trace_end("avb_hash");
 
   if (digest_len != hash_desc.digest_len) {
     avb_errorv(
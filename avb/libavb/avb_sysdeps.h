@@ -123,6 +123,22 @@ void avb_free(void* ptr);
 /* Returns the lenght of |str|, excluding the terminating NUL-byte. */
 size_t avb_strlen(const char* str) AVB_ATTR_WARN_UNUSED_RESULT;
 
+/* Marks the beginning and the end of a boot time tracing span. |name|
+ * must be a string literal.
+ */
+void avb_trace_begin(const char* name);
+void avb_trace_end(const char* name);
+
+/* CPU features the accelerated crypto code can use. */
+typedef enum {
+  AVB_CPU_FEATURE_SHA,  /* SHA extensions and SSE4.1 */
+  AVB_CPU_FEATURE_AVX2, /* AVX2 with the AVX state enabled, and BMI2 */
+  AVB_CPU_FEATURE_ADX,  /* ADCX/ADOX, and BMI2 for MULX */
+} AvbCpuFeature;
+
+/* Returns true if |feature| is available and can be used. */
+bool avb_cpu_has_feature(AvbCpuFeature feature);
+
 #ifdef __cplusplus
 }
 #endif
@@ -50,6 +50,14 @@ size_t avb_strlen(const char* str) {
   return strlen(str);
 }
 
+void avb_trace_begin(const char* name) {}
+
+void avb_trace_end(const char* name) {}
+
+bool avb_cpu_has_feature(AvbCpuFeature feature) {
+  return false;
+}
+
 void avb_abort(void) {
   abort();
 }
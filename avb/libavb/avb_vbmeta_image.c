@@ -208,6 +208,7 @@ AvbVBMetaVerifyResult avb_vbmeta_image_verify(
     goto out;
   }
 
+  avb_trace_begin("avb_rsa");
   verification_result =
       avb_rsa_verify(auxiliary_block + h.public_key_offset,
                      h.public_key_size,
@@ -217,6 +218,7 @@ AvbVBMetaVerifyResult avb_vbmeta_image_verify(
                      h.hash_size,
                      algorithm->padding,
                      algorithm->padding_len);
+  avb_trace_end("avb_rsa");
 
   if (verification_result == 0) {
     ret = AVB_VBMETA_VERIFY_RESULT_SIGNATURE_MISMATCH;
@@ -31,6 +31,8 @@
 #include "uefi_avb_util.h"
 #include "lib.h"
 #include "log.h"
+#include "trace.h"
+#include "sha256_ipps.h"
 
 int avb_memcmp(const void* src1, const void* src2, size_t n) {
   return (int)CompareMem((VOID*)src1, (VOID*)src2, (UINTN)n);
@@ -74,6 +76,8 @@ void avb_printv(const char* message, ...) {
 void avb_abort(void) {
   avb_print("\nABORTING...\n");
   uefi_call_wrapper(BS->Stall, 1, 5 * 1000 * 1000);
+  /* The timer event draining the log must not outlive the image. */
+  log_set_sync(TRUE);
   uefi_call_wrapper(BS->Exit, 4, NULL, EFI_NOT_FOUND, 0, NULL);
   while (true) {
     ;
@@ -127,3 +131,26 @@ void avb_free(void* ptr) {
 size_t avb_strlen(const char* str) {
   return strlena((CHAR8*)str);
 }
+
+void avb_trace_begin(const char* name) {
+  TRACE_BEGIN(name);
+}
+
+void avb_trace_end(const char* name) {
+  TRACE_END(name);
+}
+
+bool avb_cpu_has_feature(AvbCpuFeature feature) {
+  switch (feature) {
+    /* Shared with the kernelflinger SHA-256 code, which logs it. */
+    case AVB_CPU_FEATURE_SHA:
+      return ippsSHA256_Supported();
+    case AVB_CPU_FEATURE_AVX2:
+      return cpu_has_feature(CPU_FEATURE_AVX2) &&
+             cpu_has_feature(CPU_FEATURE_BMI2);
+    case AVB_CPU_FEATURE_ADX:
+      return cpu_has_feature(CPU_FEATURE_ADX) &&
+             cpu_has_feature(CPU_FEATURE_BMI2);
+  }
+  return false;
+}
@@ -57,11 +57,17 @@ typedef struct adb_msg {
 } adb_msg_t;
 
 #define ADB_MIN_PAYLOAD 4096
-#define ADB_MAX_PAYLOAD 262144
+#define ADB_MAX_PAYLOAD (1024 * 1024)
 
 /* Negociated (CONNECT hand-shake) maximum buffer size */
 extern UINT32 adb_max_payload;
 
+/* Negociated (CONNECT hand-shake) delayed acknowledgment: the host
+ * gives each socket a window of bytes that can be written without
+ * waiting for an OKAY message.  OKAY messages carry the number of
+ * acknowledged bytes. */
+extern BOOLEAN adb_delayed_ack;
+
 typedef struct adb_pkt {
 	adb_msg_t msg;
 	unsigned char *data;
@@ -73,6 +79,9 @@ EFI_STATUS adb_exit();
 enum boot_target adb_get_boot_target(void);
 void adb_set_boot_target(enum boot_target bt);
 
+/* The packet is queued: its payload must stay valid until it has
+ * been sent, except if it is ADB_COPIED_PAYLOAD bytes long at most. */
+#define ADB_COPIED_PAYLOAD 16
 EFI_STATUS adb_send_pkt(adb_pkt_t *pkt, UINT32 command, UINT32 arg0, UINT32 arg1);
 
 #endif	/* _ADB_H_ */
@@ -273,6 +273,9 @@ EFI_STATUS android_image_load_partition(
                 IN const CHAR16 *label,
                 OUT VOID **bootimage_p);
 
+/* Free a boot image returned by the android_image_load_* functions. */
+void android_image_free(VOID *bootimage);
+
 EFI_STATUS android_image_load_file(
                 IN EFI_HANDLE device,
                 IN CHAR16 *loader,
@@ -321,6 +324,13 @@ UINTN bootimage_size(struct boot_img_hdr *aosp_header);
 /* Return the blob_size aligned on hdr->page_size.  */
 UINT32 pagealign(struct boot_img_hdr *hdr, UINT32 blob_size);
 
+/* Return in DATA and LEN the bytes of the boot image from OFFSET up to
+ * at most END that are contiguous in memory.  The kernel and the
+ * ramdisk of an image loaded by android_image_load_partition() are
+ * not in the image buffer. */
+void bootimage_segment(VOID *bootimage, UINTN offset, UINTN end,
+                       VOID **data, UINTN *len);
+
 #ifdef HAL_AUTODETECT
 /* Get a particular blob type out of a boot image's blobstore, stored in
  * the 'second stage' area.
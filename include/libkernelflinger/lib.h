@@ -87,6 +87,22 @@ EFI_STATUS set_efi_variable(const EFI_GUID *guid, CHAR16 *key,
 EFI_STATUS set_efi_variable_str(const EFI_GUID *guid, CHAR16 *key,
                 BOOLEAN nonvol, BOOLEAN runtime, CHAR16 *val);
 
+/* The variables are cached after their first access.  In write-back
+ * mode, the writes are only issued to the firmware by
+ * flush_efi_variables() which must be called before the firmware
+ * variables are used by anything else: reset, image start or
+ * variables enumeration.  Disabling the write-back mode flushes the
+ * pending writes. */
+void efi_variables_write_back(BOOLEAN enable);
+EFI_STATUS flush_efi_variables(void);
+
+/* Issue the pending write of KEY now, even in write-back mode. */
+EFI_STATUS flush_efi_variable(const EFI_GUID *guid, CHAR16 *key);
+
+/* Flush and forget KEY, for code accessing it through the runtime
+ * services directly. */
+EFI_STATUS uncache_efi_variable(const EFI_GUID *guid, CHAR16 *key);
+
 /*
  * File I/O
  */
@@ -202,6 +218,11 @@ VOID pause(UINTN seconds);
 
 VOID reboot(CHAR16 *target, EFI_RESET_TYPE type) __attribute__ ((noreturn));
 
+/* FLUSH is called by halt_system() and reboot() before the EFI
+ * variables are flushed, to issue the writes a module holds back.
+ * Passing NULL removes it. */
+void set_reset_flush(EFI_STATUS (*flush)(void));
+
 void *memset(void *s, int c, size_t n)
     __attribute__((weak));
 
@@ -217,6 +238,26 @@ UINT64 efi_time_to_ctime(EFI_TIME *time);
 
 VOID cpuid(UINT32 op, UINT32 reg[4]);
 
+VOID cpuid_count(UINT32 op, UINT32 subop, UINT32 reg[4]);
+
+typedef enum cpu_feature {
+        CPU_FEATURE_SSE41,
+        CPU_FEATURE_AVX2,
+        CPU_FEATURE_BMI2,
+        CPU_FEATURE_ADX,
+        CPU_FEATURE_SHA,
+        CPU_FEATURE_ERMS
+} cpu_feature_t;
+
+/* Return TRUE if FEATURE is supported by the CPU and, for the AVX
+ * based features, usable in the current execution environment. */
+BOOLEAN cpu_has_feature(cpu_feature_t feature);
+
+/* cpu_has_feature() caches the features of the first processor it
+ * runs on.  The firmware may not enable the AVX state on the
+ * application processors: this function checks the current one. */
+BOOLEAN cpu_avx_state_enabled(void);
+
 EFI_STATUS generate_random_numbers(CHAR8 *data, UINTN size);
 
 BOOLEAN no_device_unlock();
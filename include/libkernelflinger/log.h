@@ -36,11 +36,34 @@
 #include <efi.h>
 #include <ui.h>
 #include <vars.h>
+#include "log_record.h"
 
+/* Save the latest log records, at most 4096 bytes, to the LOG_VAR
+ * EFI variable.  The records reference their format strings by
+ * offset in the image: use log_var_to_text() or the kflogdecode host
+ * tool to get the messages back. */
 EFI_STATUS log_flush_to_var(BOOLEAN nonvol);
+/* Format the records of a LOG_VAR dump of SIZE bytes into a newly
+ * allocated NUL terminated string.  Return EFI_UNSUPPORTED if VAR is
+ * not a binary log and EFI_INCOMPATIBLE_VERSION if it was written by
+ * another image. */
+EFI_STATUS log_var_to_text(const VOID *var, UINTN size, CHAR8 **text, UINTN *len);
+/* Write the pending messages to the serial port now. */
+void log_flush_to_serial(void);
+/* Messages are written to the serial port by a periodic timer event.
+ * In synchronous mode they are written before log() returns, which
+ * is needed on crash paths, before ExitBootServices() and before the
+ * application exits since the timer event would outlive it. */
+void log_set_sync(BOOLEAN sync);
 
-void log(const CHAR16 *fmt, ...);
-void vlog(const CHAR16 *fmt, va_list args);
+/* Messages are stored as binary records holding the format string
+ * reference, the arguments and a TSC timestamp, and are only
+ * formatted when they are written to the serial port.  A format
+ * string which is not part of the image is copied in the record, but
+ * a format string held in a writable buffer of the image is read
+ * again when the record is formatted. */
+void log_at(UINT8 level, const CHAR16 *fmt, ...);
+void vlog_at(UINT8 level, const CHAR16 *fmt, va_list args);
 
 #ifdef __DISABLE_DEBUG_PRINT
 #define DEBUG_MESSAGES 0
@@ -52,20 +75,47 @@ void vlog(const CHAR16 *fmt, va_list args);
 #endif
 #endif
 
+/* Messages above LOG_LEVEL are compiled out.  LOG_LEVEL can be set
+ * at build time with KERNELFLINGER_LOG_LEVEL. */
+#ifndef LOG_LEVEL
 #if DEBUG_MESSAGES
+#define LOG_LEVEL LOG_LEVEL_DEBUG
+#else
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define log(fmt, ...) log_at(LOG_LEVEL_INFO, fmt, ##__VA_ARGS__)
+#define vlog(fmt, args) vlog_at(LOG_LEVEL_INFO, fmt, args)
+#else
+#define log(fmt, ...) (void)0
+#define vlog(fmt, args) (void)0
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
 #define debug(fmt, ...) do { \
-    log(fmt "\n", ##__VA_ARGS__); \
+    log_at(LOG_LEVEL_DEBUG, fmt "\n", ##__VA_ARGS__); \
 } while(0)
+#else
+#define debug(fmt, ...) (void)0
+#endif
 
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define log_error(fmt, ...) log_at(LOG_LEVEL_ERROR, fmt, ##__VA_ARGS__)
+#else
+#define log_error(fmt, ...) (void)0
+#endif
+
+#if DEBUG_MESSAGES
 #define debug_pause(x) pause(x)
 #else
-#define debug(fmt, ...) (void)0
 #define debug_pause(x) (void)(x)
 #endif
 
 #ifdef USE_UI
 #define error(x, ...) do { \
-  log(x "\n", ##__VA_ARGS__); \
+  log_error(x "\n", ##__VA_ARGS__); \
   if (ui_is_ready()) { \
     ui_error(x, ##__VA_ARGS__); \
   } else \
@@ -74,7 +124,7 @@ void vlog(const CHAR16 *fmt, va_list args);
 } while(0)
 #else
 #define error(x, ...) do { \
-  log(x "\n", ##__VA_ARGS__); \
+  log_error(x "\n", ##__VA_ARGS__); \
   log_flush_to_var(TRUE); \
 } while(0)
 #endif  /* USE_UI */
@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2017, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer
+ *      in the documentation and/or other materials provided with the
+ *      distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef _LOG_RECORD_H_
+#define _LOG_RECORD_H_
+
+/* Binary log format, shared with the kflogdecode host tool.
+ *
+ * The KernelflingerLogs EFI variable is a struct log_var_header
+ * followed by log records.  A record is a struct log_record followed
+ * by its arguments and padded to LOG_RECORD_ALIGN bytes.  Its format
+ * string is either referenced by its offset in the EFI image or, if
+ * it does not belong to the image, copied after the header as a NUL
+ * terminated ASCII string.
+ *
+ * The arguments are stored in the order the format string consumes
+ * them: 8 bytes little-endian integers for '*' and the d, u, x, X,
+ * c, p and r conversions, NUL terminated ASCII strings for s, a and
+ * D, 16 bytes for g (EFI_GUID) and t (EFI_TIME).  A record whose
+ * arguments did not fit ends early. */
+
+#include <stdint.h>
+
+#define LOG_LEVEL_NONE		0
+#define LOG_LEVEL_ERROR		1
+#define LOG_LEVEL_INFO		2
+#define LOG_LEVEL_DEBUG		3
+/* Fills the end of the ring buffer when a record does not fit */
+#define LOG_LEVEL_PADDING	0xff
+
+#define LOG_RECORD_ALIGN	8
+#define LOG_RECORD_MAX_SIZE	512
+#define LOG_RECORD_INLINE_FMT	(1 << 0)
+
+struct log_record {
+	uint16_t size;		/* Including this header and the padding */
+	uint8_t level;
+	uint8_t flags;
+	uint32_t fmt;		/* Format string offset in the image */
+	uint64_t tsc;
+} __attribute__((packed));
+
+#define LOG_VAR_MAGIC		0x474c464b	/* "KFLG" */
+#define LOG_VAR_VERSION		1
+
+struct log_var_header {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t header_size;
+	/* CRC32 of the PE section table of the image which wrote the
+	 * log, to check that the format strings are looked up in the
+	 * right image. */
+	uint32_t image_id;
+	uint32_t reserved;
+	uint64_t tsc_hz;
+} __attribute__((packed));
+
+#endif	/* _LOG_RECORD_H_ */
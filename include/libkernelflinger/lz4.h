@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2017, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer
+ *      in the documentation and/or other materials provided with the
+ *      distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef _LZ4_H_
+#define _LZ4_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* LZ4 block format, without the frame format headers.  This code
+ * has no EFI dependency so the host tools can use it too. */
+
+/* Size of the output buffer lz4_compress() needs in the worst case */
+#define LZ4_COMPRESS_BOUND(len)	((len) + (len) / 255 + 16)
+
+/* Compress SRC_LEN bytes of SRC into DST.  Return the compressed
+ * size, or 0 if it does not fit in DST_SIZE bytes. */
+size_t lz4_compress(const void *src, size_t src_len, void *dst, size_t dst_size);
+
+/* Decompress the SRC_LEN bytes block SRC into the *DST_LEN bytes of
+ * DST and set *DST_LEN to the decompressed size.  Return 0 on
+ * success, -1 if the block is malformed or does not fit in DST. */
+int lz4_decompress(const void *src, size_t src_len, void *dst, size_t *dst_len);
+
+/* LZ4 frame format, as written by the lz4 command line tool.  The
+ * header and content checksums are not verified. */
+#define LZ4_FRAME_MAGIC	0x184D2204
+
+struct lz4_frame {
+	const uint8_t *src;
+	size_t src_len;
+	size_t pos;		/* Offset of the next block in SRC */
+	uint8_t *dst;
+	size_t dst_size;
+	size_t out;		/* Decompressed bytes */
+	uint8_t flags;
+	size_t block_max;
+	uint64_t content_size;
+};
+
+/* Set *SIZE to the content size recorded in the frame header at the
+ * start of the SRC_LEN bytes of SRC.  Return -1 if SRC does not start
+ * with a frame header or if the header does not record the size. */
+int lz4_frame_content_size(const void *src, size_t src_len, uint64_t *size);
+
+/* Prepare the decompression of the SRC_LEN bytes frame SRC into the
+ * DST_SIZE bytes of DST. */
+void lz4_frame_init(struct lz4_frame *frame, const void *src, size_t src_len,
+		    void *dst, size_t dst_size);
+
+/* Decompress the blocks available in the first AVAIL bytes of the
+ * frame, so the frame can be decompressed while it is being read.
+ * Return 1 once the whole frame is decompressed, FRAME->out bytes,
+ * 0 if more data is needed and -1 if the frame is malformed, not
+ * supported or does not fit in DST. */
+int lz4_frame_decompress(struct lz4_frame *frame, size_t avail);
+
+#endif	/* _LZ4_H_ */
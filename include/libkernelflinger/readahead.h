@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2017, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer
+ *      in the documentation and/or other materials provided with the
+ *      distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef _READAHEAD_H_
+#define _READAHEAD_H_
+
+#include <efi.h>
+#include "gpt.h"
+
+/* Sequential reader of a partition range.  Several buffers are kept
+ * in flight with the Disk I/O 2 protocol when the firmware provides
+ * it so the disk keeps reading while the caller processes the
+ * previous chunk.  Without it, chunks are read synchronously. */
+struct readahead;
+
+/* Chunks are multiples of this size, except the last one. */
+#define READAHEAD_CHUNK_ALIGN	(64 * 1024)
+
+/* Prepare the reading of LEN bytes at OFFSET in the GPARTI partition
+ * and queue the first reads.  CHUNK is the size of the chunks, 0
+ * lets it be chosen from LEN and the available memory. */
+EFI_STATUS readahead_open(struct readahead **ra,
+			  struct gpt_partition_interface *gparti,
+			  UINT64 offset, UINT64 len, UINTN chunk);
+
+/* Return the next chunk in *DATA and its size in *LEN, or
+ * EFI_END_OF_FILE once the whole range has been returned.  The chunk
+ * stays valid until the next call. */
+EFI_STATUS readahead_next(struct readahead *ra, void **data, UINTN *len);
+
+/* Wait for the outstanding reads and free RA. */
+void readahead_close(struct readahead *ra);
+
+#endif	/* _READAHEAD_H_ */
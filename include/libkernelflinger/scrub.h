@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2017, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer
+ *      in the documentation and/or other materials provided with the
+ *      distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef _SCRUB_H_
+#define _SCRUB_H_
+
+#include <efi.h>
+
+/* Zero all the EfiConventionalMemory regions of the ENTRIES memory
+ * map.  The memory is handed out by chunks to all the processors
+ * with the MP Services protocol when the firmware provides it and
+ * memory_scrub_init() has been called.  The calling processor does
+ * not wait for long for the other processors once it is out of
+ * chunks: it clears their unfinished chunks itself.  Until the MP
+ * Services report the end of a job, which they cannot do while the
+ * TPL is TPL_NOTIFY or above, the next calls use the calling
+ * processor only.  On 32 bits builds, the memory above 4 GB is
+ * cleared by the calling processor through the PAE mapping which
+ * must be initialized. */
+EFI_STATUS memory_scrub(CHAR8 *entries, UINTN nr_entries, UINTN entry_sz);
+
+/* Locate the MP Services protocol and create the event memory_scrub()
+ * waits on.  This allocates memory: it must be called before getting
+ * the memory map given to memory_scrub(), which otherwise uses the
+ * calling processor only. */
+void memory_scrub_init(void);
+
+/* Restrict memory_scrub() to the calling processor when PARALLEL is
+ * FALSE, for testing purpose. */
+void memory_scrub_parallel(BOOLEAN parallel);
+
+#endif	/* _SCRUB_H_ */
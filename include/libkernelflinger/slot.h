@@ -99,6 +99,15 @@ EFI_STATUS slot_reset(void);
 /* Stores the slot AB metadata on disk. */
 EFI_STATUS slot_restore(void);
 
+/* In write-back mode, the slot AB metadata changes are kept in memory
+ * until slot_flush() and only written if the metadata on disk
+ * differs.  It must be flushed before any reset or kernel handover;
+ * halt_system() and reboot() do it while the write-back mode is
+ * enabled.  Disabling the write-back mode flushes the pending
+ * changes. */
+void slot_write_back(BOOLEAN enable);
+EFI_STATUS slot_flush(void);
+
 /* Given a boot TARGET, decrements the corresponding tries count if
  * necessary. */
 EFI_STATUS slot_boot(enum boot_target target);
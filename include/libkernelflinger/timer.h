@@ -42,7 +42,18 @@ enum TM_POINT {
 	TM_JMP_KERNEL = TIMESTAMP_MAX - 1
 };
 
+/* Time since the TSC reset */
 unsigned boottime_in_msec(void);
+uint64_t boottime_in_usec(void);
+uint64_t boottime_in_nsec(void);
+uint64_t read_tsc(void);
+/* TSC ticks per second, read from CPUID or calibrated on the first
+ * call and cached */
+uint64_t tsc_frequency(void);
+/* Convert a number of TSC ticks to nanoseconds */
+uint64_t tsc_to_ns(uint64_t ticks);
+/* Same for a counter running at HZ */
+uint64_t ticks_to_ns(uint64_t ticks, uint64_t hz);
 void set_boottime_stamp(int num);
 void format_stages_boottime(CHAR16 *time_str);
 
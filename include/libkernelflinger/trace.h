@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2017, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer
+ *      in the documentation and/or other materials provided with the
+ *      distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <efi.h>
+
+/* Boot path tracing.  TRACE_BEGIN(NAME) opens a span stamped with the
+ * TSC, TRACE_END(NAME) closes the innermost open span named NAME and
+ * the spans opened inside it.  NAME must be a string literal.  The
+ * spans can be exported in the Chrome trace event format, which
+ * chrome://tracing and Perfetto load.  Tracing is compiled out with
+ * KERNELFLINGER_DISABLE_TRACE. */
+#ifdef DISABLE_TRACE
+#define TRACE_BEGIN(name) (void)0
+#define TRACE_END(name) (void)0
+#else
+#define TRACE_BEGIN(name) trace_begin(name)
+#define TRACE_END(name) trace_end(name)
+#endif
+
+void trace_begin(const char *name);
+void trace_end(const char *name);
+
+/* Return the spans as a newly allocated Chrome trace JSON string.  If
+ * MAX_LEN is not 0, the spans which would make it longer are left
+ * out. */
+EFI_STATUS trace_to_json(CHAR8 **json, UINTN *len, UINTN max_len);
+
+/* Write in BUF a summary of the two first levels of spans for the
+ * kernel command line: comma separated "name:start+duration" items,
+ * in milliseconds since the TSC reset. */
+void trace_summary(CHAR8 *buf, UINTN size);
+
+/* Save the Chrome trace in the TRACE_VAR volatile EFI variable which
+ * the OS can read. */
+EFI_STATUS trace_save_to_var(void);
+
+#endif	/* _TRACE_H_ */
@@ -51,15 +51,21 @@ extern EFI_GRAPHICS_OUTPUT_BLT_PIXEL	COLOR_ORANGE;
 /* Image */
 typedef struct image {
 	const char *name;
+	/* Decoded from the LZ4 compressed DATA on first use */
 	EFI_GRAPHICS_OUTPUT_BLT_PIXEL *blt;
 	UINTN width;
 	UINTN height;
+	const unsigned char *data;
+	UINTN data_len;
 } ui_image_t;
 
 EFI_STATUS ui_image_draw(ui_image_t *image, UINTN x, UINTN y);
 EFI_STATUS ui_image_draw_scale(ui_image_t *image, UINTN x,
 			       UINTN y, UINTN width, UINTN height);
 ui_image_t *ui_image_get(const char *name);
+void ui_image_free_cache(void);
+extern ui_image_t ui_images[];
+extern UINTN ui_images_nb;
 
 /* Font */
 typedef struct ui_font {
@@ -68,7 +74,10 @@ typedef struct ui_font {
 	UINTN height;
 	UINTN cwidth;
 	UINTN cheight;
+	/* Decoded from the LZ4 compressed DATA on first use */
 	unsigned char *texture;
+	const unsigned char *data;
+	UINTN data_len;
 } ui_font_t;
 
 EFI_STATUS ui_font_init(void);
@@ -95,6 +104,16 @@ typedef struct ui_textarea {
 	UINTN width;
 	UINTN height;
 	EFI_GRAPHICS_OUTPUT_BLT_PIXEL *blt;
+	/* Per text line DIRTY_* flags, NULL to render everything on
+	 * each refresh */
+	UINT8 *dirty;
+	/* Lines scrolled since BLT was rendered and drawn */
+	UINTN blt_scroll;
+	UINTN screen_scroll;
+	/* Where BLT was last drawn, if it still is on the screen */
+	BOOLEAN on_screen;
+	UINTN screen_x;
+	UINTN screen_y;
 } ui_textarea_t;
 
 ui_textarea_t *ui_textarea_create(UINTN line_nb, UINTN row_nb, ui_font_t *font,
@@ -112,6 +131,10 @@ void ui_textarea_newline(ui_textarea_t *textarea, char *str,
 EFI_STATUS ui_textarea_draw_scale(ui_textarea_t *textarea, UINTN x, UINTN *y,
 				  UINTN width, UINTN height);
 EFI_STATUS ui_textarea_draw(ui_textarea_t *textarea, UINTN x, UINTN y);
+/* The screen area of TEXTAREA has been overwritten, draw it entirely
+ * next time. */
+void ui_textarea_invalidate(ui_textarea_t *textarea);
+void ui_textarea_free_glyph_cache(void);
 
 /* EFI Scan codes */
 #ifdef USE_POWER_BUTTON
@@ -180,8 +203,13 @@ void ui_get_scaled_dimension(UINTN orig_width, UINTN orig_heigth,
 			     UINTN max_width, UINTN max_height,
 			     UINTN *width, UINTN *height);
 UINT64 ui_get_blt_size(UINTN width, UINTN height);
-void ui_bilinear_scale(unsigned char *s, unsigned char *d,
-		       int sx, int sy, int dx, int dy,
-		       int depth);
+void *ui_decompress(const char *name, const unsigned char *data,
+		    UINTN data_len, UINTN len);
+EFI_STATUS ui_bilinear_scale(unsigned char *s, unsigned char *d,
+			     int sx, int sy, int dx, int dy,
+			     int depth);
+/* Let ui_bilinear_scale() use the SSE4.1 or AVX2 code when the CPU
+ * supports it, the default, or only the portable code. */
+void ui_bilinear_scale_accelerated(BOOLEAN accelerated);
 
 #endif  /* _UI_H_ */
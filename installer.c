@@ -48,6 +48,7 @@
 #include "text_parser.h"
 #include "android.h"
 #include "slot.h"
+#include "openssl_cpu.h"
 
 static BOOLEAN last_cmd_succeeded;
 static fastboot_handle fastboot_flash_cmd;
@@ -793,7 +794,7 @@ static EFI_STATUS installer_replace_functions()
 	return EFI_SUCCESS;
 }
 
-EFI_STATUS efi_main(EFI_HANDLE image, EFI_SYSTEM_TABLE *_table)
+static EFI_STATUS installer_main(EFI_HANDLE image, EFI_SYSTEM_TABLE *_table)
 {
 	EFI_STATUS ret;
 	EFI_LOADED_IMAGE *loaded_img = NULL;
@@ -805,6 +806,7 @@ EFI_STATUS efi_main(EFI_HANDLE image, EFI_SYSTEM_TABLE *_table)
 	enum boot_target target;
 
 	InitializeLib(image, _table);
+	openssl_cpu_setup(TRUE);
 	g_parent_image = image;
 
 	ret = handle_protocol(image, &LoadedImageProtocol, (void **)&loaded_img);
@@ -863,6 +865,15 @@ exit:
 	return last_cmd_succeeded ? EFI_SUCCESS : EFI_INVALID_PARAMETER;
 }
 
+EFI_STATUS efi_main(EFI_HANDLE image, EFI_SYSTEM_TABLE *_table)
+{
+	EFI_STATUS ret;
+
+	ret = installer_main(image, _table);
+	log_set_sync(TRUE);
+	return ret;
+}
+
 /* Installer transport abstraction. */
 EFI_STATUS installer_transport_start(start_callback_t start_cb,
 				     data_callback_t rx_cb,
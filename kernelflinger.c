@@ -49,6 +49,7 @@
 #include "targets.h"
 #include "unittest.h"
 #include "em.h"
+#include "openssl_cpu.h"
 #include "storage.h"
 #include "version.h"
 #include "trusty.h"
@@ -57,6 +58,7 @@
 #endif
 #include "oemvars.h"
 #include "slot.h"
+#include "trace.h"
 #ifdef RPMB_STORAGE
 #include "rpmb.h"
 #include "rpmb_storage.h"
@@ -828,6 +830,8 @@ static EFI_STATUS enter_efi_binary(CHAR16 *path, BOOLEAN delete)
                         if (EFI_ERROR(ret))
                                 efi_perror(ret, L"Couldn't delete %s", path);
                 }
+                slot_flush();
+                flush_efi_variables();
                 ret = uefi_call_wrapper(BS->StartImage, 3, image, NULL, NULL);
                 uefi_call_wrapper(BS->UnloadImage, 1, image);
         }
@@ -952,6 +956,12 @@ static EFI_STATUS load_image(VOID *bootimage, UINT8 boot_state,
                 return ret;
         }
 #endif
+        /* The slot tries counters must be on disk before the
+         * kernel is started. */
+        ret = slot_flush();
+        if (EFI_ERROR(ret))
+                return ret;
+
         debug(L"chainloading boot image, boot state is %s",
                         boot_state_to_string(boot_state));
         ret = android_image_start_buffer(g_parent_image, bootimage,
@@ -1006,7 +1016,7 @@ static VOID enter_fastboot_mode(UINT8 boot_state)
                                 set_image_oemvars_nocheck(bootimage, NULL);
                                 load_image(bootimage, BOOT_STATE_ORANGE, MEMORY, NULL);
                         }
-                        FreePool(bootimage);
+                        android_image_free(bootimage);
                         bootimage = NULL;
                         continue;
                 }
@@ -1141,8 +1151,10 @@ static void bootloader_recover_mode(UINT8 boot_state)
         die();
 }
 
+/* BOOTIMAGE, if any, is released before switching to the bootloader
+ * recover mode, which may load another image. */
 static VOID boot_error(enum ux_error_code error_code, UINT8 boot_state,
-                       UINT8 *hash, UINTN hash_size)
+                       UINT8 *hash, UINTN hash_size, VOID *bootimage)
 {
         BOOLEAN power_off = FALSE;
         enum boot_target bt;
@@ -1163,6 +1175,7 @@ static VOID boot_error(enum ux_error_code error_code, UINT8 boot_state,
 
         if (bt == CRASHMODE) {
                 debug(L"Rebooting to bootloader recover mode");
+                android_image_free(bootimage);
                 bootloader_recover_mode(boot_state);
         }
 #else
@@ -1207,11 +1220,11 @@ static void flash_bootloader_policy(void)
         if (!blpolicy_is_flashed())
                 debug(L"Bootloader Policy EFI variables are not flashed");
 out:
-        FreePool(bootimage);
+        android_image_free(bootimage);
 }
 #endif
 
-EFI_STATUS efi_main(EFI_HANDLE image, EFI_SYSTEM_TABLE *sys_table)
+static EFI_STATUS kernelflinger_main(EFI_HANDLE image, EFI_SYSTEM_TABLE *sys_table)
 {
         EFI_STATUS ret;
         CHAR16 *target_path = NULL;
@@ -1232,6 +1245,12 @@ EFI_STATUS efi_main(EFI_HANDLE image, EFI_SYSTEM_TABLE *sys_table)
 
         /* gnu-efi initialization */
         InitializeLib(image, sys_table);
+        openssl_cpu_setup(TRUE);
+        /* Flushed before anything else can look at the EFI variables
+         * or the A/B metadata: reset, kernel handover, EFI
+         * application or fastboot. */
+        efi_variables_write_back(TRUE);
+        slot_write_back(TRUE);
 
 #ifdef USE_UI
         ux_display_vendor_splash();
@@ -1263,6 +1282,8 @@ EFI_STATUS efi_main(EFI_HANDLE image, EFI_SYSTEM_TABLE *sys_table)
 
                 debug(L"I am about to reset the system");
 
+                slot_flush();
+                flush_efi_variables();
                 uefi_call_wrapper(RT->ResetSystem, 4, resetType, EFI_SUCCESS, 0,
                                 NULL);
         }
@@ -1333,7 +1354,7 @@ EFI_STATUS efi_main(EFI_HANDLE image, EFI_SYSTEM_TABLE *sys_table)
                 /* Need to warn early, before we even enter Fastboot
                  * or run EFI binaries. Set lock_prompted to true so
                  * we don't ask again later */
-                boot_error(SECURE_BOOT_CODE, boot_state, NULL, 0);
+                boot_error(SECURE_BOOT_CODE, boot_state, NULL, 0, NULL);
         } else  if (device_is_unlocked()) {
                 boot_state = BOOT_STATE_ORANGE;
                 debug(L"Device is unlocked");
@@ -1381,7 +1402,7 @@ EFI_STATUS efi_main(EFI_HANDLE image, EFI_SYSTEM_TABLE *sys_table)
          * via fastboot. Skip this UX if we already prompted earlier
          * about EFI secure boot being turned off */
         if (boot_state == BOOT_STATE_ORANGE && !lock_prompted)
-                boot_error(DEVICE_UNLOCKED_CODE, boot_state, NULL, 0);
+                boot_error(DEVICE_UNLOCKED_CODE, boot_state, NULL, 0, NULL);
 
         debug(L"Loading boot image");
 
@@ -1404,15 +1425,17 @@ EFI_STATUS efi_main(EFI_HANDLE image, EFI_SYSTEM_TABLE *sys_table)
                 if (EFI_ERROR(ret))
                         efi_perror(ret, L"Failed to compute pub key hash");
                 boot_error(BOOTIMAGE_UNTRUSTED_CODE, boot_state, hash,
-                           SHA256_DIGEST_LENGTH);
+                           SHA256_DIGEST_LENGTH, bootimage);
         }
 #endif
 
         if (boot_state == BOOT_STATE_RED) {
                 if (boot_target == RECOVERY)
-                        boot_error(BAD_RECOVERY_CODE, boot_state, NULL, 0);
+                        boot_error(BAD_RECOVERY_CODE, boot_state, NULL, 0,
+                                   bootimage);
                 else
-                        boot_error(RED_STATE_CODE, boot_state, NULL, 0);
+                        boot_error(RED_STATE_CODE, boot_state, NULL, 0,
+                                   bootimage);
         }
 
         switch (boot_target) {
@@ -1437,6 +1460,11 @@ EFI_STATUS efi_main(EFI_HANDLE image, EFI_SYSTEM_TABLE *sys_table)
         if (EFI_ERROR(ret))
                 efi_perror(ret, L"Failed to start boot image");
 
+        /* Release the image and its placement before falling back to
+         * another target or to fastboot, which may load an image. */
+        android_image_free(bootimage);
+        bootimage = NULL;
+
         switch (boot_target) {
         case NORMAL_BOOT:
         case CHARGER:
@@ -1462,5 +1490,18 @@ EFI_STATUS efi_main(EFI_HANDLE image, EFI_SYSTEM_TABLE *sys_table)
         return EFI_INVALID_PARAMETER;
 }
 
+EFI_STATUS efi_main(EFI_HANDLE image, EFI_SYSTEM_TABLE *sys_table)
+{
+        EFI_STATUS ret;
+
+        TRACE_BEGIN("kernelflinger");
+        ret = kernelflinger_main(image, sys_table);
+        TRACE_END("kernelflinger");
+        slot_write_back(FALSE);
+        efi_variables_write_back(FALSE);
+        log_set_sync(TRUE);
+        return ret;
+}
+
 /* vim: softtabstop=8:shiftwidth=8:expandtab
  */
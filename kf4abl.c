@@ -46,6 +46,8 @@
 #include "android.h"
 #include "slot.h"
 #include "timer.h"
+#include "trace.h"
+#include "openssl_cpu.h"
 #ifdef USE_AVB
 #include "avb_init.h"
 #include "libavb/libavb.h"
@@ -268,7 +270,7 @@ static EFI_STATUS enter_fastboot_mode(enum boot_target *target)
 		if (EFI_ERROR(ret)) {
 			efi_perror(ret, L"Process bootimage failed");
 			if (bootimage) {
-				FreePool(bootimage);
+				android_image_free(bootimage);
 				bootimage = NULL;
 			}
 			break;
@@ -841,12 +843,14 @@ EFI_STATUS avb_boot_android(enum boot_target boot_target, CHAR8 *abl_cmd_line)
 	if (allow_verification_error) {
 		flags |= AVB_SLOT_VERIFY_FLAGS_ALLOW_VERIFICATION_ERROR;
 	}
+	TRACE_BEGIN("avb_verify");
 	verify_result = avb_slot_verify(ops,
 					requested_partitions,
 					slot_suffix,
 					flags,
 					AVB_HASHTREE_ERROR_MODE_RESTART,
 					&slot_data);
+	TRACE_END("avb_verify");
 
 	ret = get_avb_result(slot_data,
 			    allow_verification_error,
@@ -863,12 +867,14 @@ EFI_STATUS avb_boot_android(enum boot_target boot_target, CHAR8 *abl_cmd_line)
 #ifdef USE_TRUSTY
 	if (boot_target == NORMAL_BOOT) {
 		requested_partitions[0] = "tos";
+		TRACE_BEGIN("avb_verify");
 		verify_result = avb_slot_verify(ops,
 					requested_partitions,
 					slot_suffix,
 					flags,
 					AVB_HASHTREE_ERROR_MODE_RESTART,
 					&slot_data_tos);
+		TRACE_END("avb_verify");
 
 		ret = get_avb_result(slot_data_tos,
 				    false,
@@ -1041,7 +1047,7 @@ exit:
 }
 #endif
 
-EFI_STATUS efi_main(EFI_HANDLE image, EFI_SYSTEM_TABLE *sys_table)
+static EFI_STATUS kf4abl_main(EFI_HANDLE image, EFI_SYSTEM_TABLE *sys_table)
 {
 	enum boot_target target;
 	EFI_STATUS ret;
@@ -1054,6 +1060,7 @@ EFI_STATUS efi_main(EFI_HANDLE image, EFI_SYSTEM_TABLE *sys_table)
 
 	set_boottime_stamp(TM_EFI_MAIN);
 	InitializeLib(image, sys_table);
+	openssl_cpu_setup(TRUE);
 	target = check_command_line(image, cmd_buf, sizeof(cmd_buf) - 1);
 
 #ifdef RPMB_STORAGE
@@ -1121,3 +1128,14 @@ EFI_STATUS efi_main(EFI_HANDLE image, EFI_SYSTEM_TABLE *sys_table)
 
 	return EFI_SUCCESS;
 }
+
+EFI_STATUS efi_main(EFI_HANDLE image, EFI_SYSTEM_TABLE *sys_table)
+{
+	EFI_STATUS ret;
+
+	TRACE_BEGIN("kf4abl");
+	ret = kf4abl_main(image, sys_table);
+	TRACE_END("kf4abl");
+	log_set_sync(TRUE);
+	return ret;
+}
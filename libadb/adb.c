@@ -32,6 +32,7 @@
 
 #include <lib.h>
 #include <vars.h>
+#include <slot.h>
 #include <usb.h>
 #include <tcp.h>
 #include <transport.h>
@@ -51,7 +52,10 @@
 
 /* Protocol definitions */
 #define ADB_VERSION	0x01000000
+/* From this version on, the payload checksum is not used anymore */
+#define ADB_VERSION_SKIP_CHECKSUM	0x01000001
 #define SYSTEM_TYPE	"bootloader"
+#define FEATURE_DELAYED_ACK	"delayed_ack"
 
 /* Internal data */
 typedef enum adb_state {
@@ -69,6 +73,8 @@ static adb_pkt_t adb_pkt_in;
 unsigned char in_buf[ADB_MIN_PAYLOAD];
 
 UINT32 adb_max_payload;
+BOOLEAN adb_delayed_ack;
+static UINT32 adb_version;
 
 static UINT32 adb_pkt_sum(adb_pkt_t *pkt)
 {
@@ -81,32 +87,103 @@ static UINT32 adb_pkt_sum(adb_pkt_t *pkt)
 	return sum;
 }
 
-static adb_pkt_t *delayed_pkt_data;
-EFI_STATUS adb_send_pkt(adb_pkt_t *pkt, UINT32 command, UINT32 arg0, UINT32 arg1)
+/* Some transport layer (USB in particular) might not support
+ * several writes in raw.  The packets are queued and sent one after
+ * the other, the payload being sent on the TX event of the message. */
+#define TX_QUEUE_SIZE	16
+
+static struct tx_pkt {
+	adb_msg_t msg;
+	unsigned char *data;
+	unsigned char small[ADB_COPIED_PAYLOAD];
+} tx_queue[TX_QUEUE_SIZE];
+static UINTN tx_head, tx_count;
+static BOOLEAN tx_busy, tx_payload_sent;
+/* WRTE message with a non-copied payload sent but not notified to
+ * its socket yet */
+static BOOLEAN tx_wrte_done;
+static adb_msg_t tx_wrte_msg;
+
+static void tx_complete(void)
+{
+	struct tx_pkt *tx = &tx_queue[tx_head];
+
+	if (tx->msg.command == A_WRTE && tx->data != tx->small) {
+		tx_wrte_msg = tx->msg;
+		tx_wrte_done = TRUE;
+	}
+
+	tx_head = (tx_head + 1) % TX_QUEUE_SIZE;
+	tx_count--;
+	tx_busy = FALSE;
+}
+
+/* Some transport implementation trig the TX event (TCP in
+ * particular) before transport_write() returns.  The nested calls
+ * return immediately and leave the work to the running loop which
+ * keeps the stack from growing with each packet sent. */
+static void tx_process(void)
 {
+	static BOOLEAN running;
 	EFI_STATUS ret;
 
+	if (running)
+		return;
+	running = TRUE;
+
+	for (;;) {
+		if (tx_wrte_done) {
+			tx_wrte_done = FALSE;
+			asock_write_done(tx_wrte_msg.arg0, tx_wrte_msg.arg1);
+			continue;
+		}
+
+		if (tx_busy || !tx_count)
+			break;
+
+		tx_busy = TRUE;
+		tx_payload_sent = FALSE;
+		ret = transport_write(&tx_queue[tx_head].msg, sizeof(adb_msg_t));
+		if (EFI_ERROR(ret)) {
+			efi_perror(ret, L"Failed to send adb msg");
+			tx_complete();
+		}
+	}
+
+	running = FALSE;
+}
+
+EFI_STATUS adb_send_pkt(adb_pkt_t *pkt, UINT32 command, UINT32 arg0, UINT32 arg1)
+{
+	struct tx_pkt *tx;
+
+	if (tx_count == TX_QUEUE_SIZE) {
+		error(L"adb transmit queue is full");
+		return EFI_OUT_OF_RESOURCES;
+	}
+
 	pkt->msg.command = command;
 	pkt->msg.arg0 = arg0;
 	pkt->msg.arg1 = arg1;
 
 	pkt->msg.magic = pkt->msg.command ^ 0xFFFFFFFF;
-	pkt->msg.data_check = adb_pkt_sum(pkt);
-
-	/* Some transport layer (USB in particular) might not support
-	   several writes in raw.  Wait for the TX event to send the
-	   payload.  Prepare the delayed packet before we send the
-	   first one because some transport implementation trig the TX
-	   even (TCP in particular) before the first transport_write()
-	   returns.  */
-	if (pkt->msg.data_length)
-		delayed_pkt_data = pkt;
-
-	ret = transport_write(&pkt->msg, sizeof(pkt->msg));
-	if (EFI_ERROR(ret))
-		efi_perror(ret, L"Failed to send adb msg");
+	if (adb_version >= ADB_VERSION_SKIP_CHECKSUM)
+		pkt->msg.data_check = 0;
+	else
+		pkt->msg.data_check = adb_pkt_sum(pkt);
+
+	tx = &tx_queue[(tx_head + tx_count) % TX_QUEUE_SIZE];
+	tx->msg = pkt->msg;
+	tx->data = pkt->data;
+	if (pkt->msg.data_length <= ADB_COPIED_PAYLOAD) {
+		memcpy(tx->small, pkt->data, pkt->msg.data_length);
+		tx->data = tx->small;
+	}
+	tx_count++;
+
+	tx_process();
 
-	return ret;
+	return EFI_SUCCESS;
 }
 
 static void adb_read_msg(void)
@@ -140,26 +217,55 @@ static void cmd_unsupported(adb_pkt_t *pkt)
 	error(L"'%a' adb message is not supported", cmd);
 }
 
+/* The banner is "<system type>::<key>=<value>;...", the value of
+ * the features key being a comma separated list. */
+static BOOLEAN banner_has_feature(adb_pkt_t *pkt, const char *feature)
+{
+	UINTN len = strlen((CHAR8 *)feature);
+	unsigned char *cur, *end = pkt->data + pkt->msg.data_length;
+
+	for (cur = pkt->data; cur + len <= end; cur++) {
+		if (memcmp(cur, feature, len))
+			continue;
+		if (cur != pkt->data && cur[-1] != '=' && cur[-1] != ',')
+			continue;
+		if (cur + len == end || cur[len] == ',' || cur[len] == ';' ||
+		    cur[len] == '\0')
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
 static void cmd_connect(adb_pkt_t *pkt)
 {
 	EFI_STATUS ret;
 	static adb_pkt_t out_pkt;
+	UINT32 version;
 
-	if (pkt->msg.arg0 != ADB_VERSION) {
+	/* The checksum is used until the host gets our answer */
+	adb_version = ADB_VERSION;
+
+	if (pkt->msg.arg0 < ADB_VERSION) {
 		error(L"Unsupported adb version 0x%08x", pkt->msg.arg0);
 		return;
 	}
 
+	version = min((UINT32)ADB_VERSION_SKIP_CHECKSUM, pkt->msg.arg0);
 	adb_max_payload = min((UINT32)ADB_MAX_PAYLOAD, pkt->msg.arg1);
-	debug(L"Negociated payload size is %d bytes", adb_max_payload);
+	adb_delayed_ack = banner_has_feature(pkt, FEATURE_DELAYED_ACK);
+	debug(L"Negociated version 0x%08x, payload size is %d bytes, delayed ack %a",
+	      version, adb_max_payload, adb_delayed_ack ? "enabled" : "disabled");
 
-	out_pkt.data = (unsigned char *)SYSTEM_TYPE "::";
+	out_pkt.data = (unsigned char *)SYSTEM_TYPE "::features=" FEATURE_DELAYED_ACK;
 	out_pkt.msg.data_length = strlen(out_pkt.data);
 
-	ret = adb_send_pkt(&out_pkt, pkt->msg.command, pkt->msg.arg0,
+	ret = adb_send_pkt(&out_pkt, pkt->msg.command, version,
 			   adb_max_payload);
 	if (EFI_ERROR(ret))
 		error(L"Failed to send connection packet");
+
+	adb_version = version;
 }
 
 static void cmd_open(adb_pkt_t *pkt)
@@ -185,12 +291,19 @@ static void cmd_open(adb_pkt_t *pkt)
 			break;
 		}
 
-	asock_open(pkt->msg.arg0, srv, arg);
+	/* With delayed ack, ARG1 is the initial send window */
+	asock_open(pkt->msg.arg0, srv, arg, pkt->msg.arg1);
 }
 
 static void cmd_okay(adb_pkt_t *pkt)
 {
-	asock_okay(asock_find(pkt->msg.arg1, pkt->msg.arg0));
+	INT32 acked = 0;
+
+	/* With delayed ack, the payload is the acknowledged bytes */
+	if (pkt->msg.data_length == sizeof(acked))
+		memcpy(&acked, pkt->data, sizeof(acked));
+
+	asock_okay(asock_find(pkt->msg.arg1, pkt->msg.arg0), acked);
 }
 
 static void cmd_close(adb_pkt_t *pkt)
@@ -295,11 +408,19 @@ static void adb_process_rx(void *buf, unsigned len)
 			return;
 		}
 
-		if (adb_pkt_in.msg.data_check != adb_pkt_sum(&adb_pkt_in)) {
+		if (adb_version < ADB_VERSION_SKIP_CHECKSUM &&
+		    adb_pkt_in.msg.data_check != adb_pkt_sum(&adb_pkt_in)) {
 			error(L"Corrupted data detected");
 			return;
 		}
 
+		/* Delayed ack OKAY messages have a payload */
+		if (adb_pkt_in.msg.command == A_OKAY) {
+			cmd_okay(&adb_pkt_in);
+			adb_read_msg();
+			return;
+		}
+
 		adb_state = ADB_PROCESS_MSG;
 		break;
 
@@ -311,15 +432,22 @@ static void adb_process_rx(void *buf, unsigned len)
 static void adb_process_tx(__attribute__((__unused__)) void *buf,
 			   __attribute__((__unused__)) unsigned len)
 {
+	struct tx_pkt *tx = &tx_queue[tx_head];
 	EFI_STATUS ret;
 
-	if (!delayed_pkt_data)
+	if (!tx_busy)
 		return;
 
-	ret = transport_write(delayed_pkt_data->data, delayed_pkt_data->msg.data_length);
-	delayed_pkt_data = NULL;
-	if (EFI_ERROR(ret))
+	if (tx->msg.data_length && !tx_payload_sent) {
+		tx_payload_sent = TRUE;
+		ret = transport_write(tx->data, tx->msg.data_length);
+		if (!EFI_ERROR(ret))
+			return;
 		efi_perror(ret, L"Failed to send adb payload");
+	}
+
+	tx_complete();
+	tx_process();
 }
 
 static enum boot_target exit_bt;
@@ -393,8 +521,17 @@ EFI_STATUS adb_init()
 {
 	EFI_STATUS ret;
 
+	/* The EFI variables and the misc partition may be read
+	 * directly by the adb services. */
+	slot_write_back(FALSE);
+	efi_variables_write_back(FALSE);
+
 	adb_pkt_in.data = in_buf;
 	exit_bt = UNKNOWN_TARGET;
+	adb_version = ADB_VERSION;
+	adb_delayed_ack = FALSE;
+	tx_head = tx_count = 0;
+	tx_busy = tx_wrte_done = FALSE;
 
 	ret = transport_register(ADB_TRANSPORT, ARRAY_SIZE(ADB_TRANSPORT));
 	if (EFI_ERROR(ret)) {
@@ -416,6 +553,9 @@ EFI_STATUS adb_run()
 	}
 
 	process_msg();
+	/* Catch up with a TX event which occurred while the queue
+	 * was being processed. */
+	tx_process();
 
 	return EFI_SUCCESS;
 }
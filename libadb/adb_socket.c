@@ -41,15 +41,31 @@ struct asock {
 	UINT32 remote;
 	adb_pkt_t msg;
 	adb_pkt_t wrt;
-	unsigned char data[ADB_MAX_PAYLOAD];
+	unsigned char *data;
+	/* DATA is being sent */
+	BOOLEAN writing;
+	/* Without delayed ack, WRTE message not acknowledged yet */
+	BOOLEAN wait_okay;
+	/* With delayed ack, bytes the host can still receive */
+	INT64 window;
+	/* With delayed ack, bytes received since the last OKAY */
+	UINT32 received;
 	service_t *service;
 	void *context;
 };
 
 static struct asock asocks[MAX_ADB_SOCKET];
 
+static EFI_STATUS send_ready(asock_t s, UINT32 acked)
+{
+	s->msg.data = (unsigned char *)&acked;
+	s->msg.msg.data_length = adb_delayed_ack ? sizeof(acked) : 0;
+	return adb_send_pkt(&s->msg, A_OKAY, s->local, s->remote);
+}
+
 /* Host to device */
-EFI_STATUS asock_open(UINT32 remote, service_t *service, char *arg)
+EFI_STATUS asock_open(UINT32 remote, service_t *service, char *arg,
+		      UINT32 window)
 {
 	static adb_pkt_t fail_msg = { .msg.data_length = 0 };
 	EFI_STATUS ret;
@@ -62,8 +78,9 @@ EFI_STATUS asock_open(UINT32 remote, service_t *service, char *arg)
 		goto err;
 	}
 
+	/* Skip the sockets whose DATA buffer is still being sent */
 	for (i = 0; i < ARRAY_SIZE(asocks); i++)
-		if (asocks[i].local == 0) {
+		if (asocks[i].local == 0 && !asocks[i].writing) {
 			s = &asocks[i];
 			s->local = i + 1;
 			break;
@@ -77,6 +94,15 @@ EFI_STATUS asock_open(UINT32 remote, service_t *service, char *arg)
 	s->remote = remote;
 	s->service = service;
 	s->context = NULL;
+	s->wait_okay = FALSE;
+	s->window = window;
+	s->received = 0;
+
+	s->data = AllocatePool(adb_max_payload);
+	if (!s->data) {
+		ret = EFI_OUT_OF_RESOURCES;
+		goto err;
+	}
 
 	ret = service->open(arg, &s->context);
 	if (EFI_ERROR(ret))
@@ -84,7 +110,8 @@ EFI_STATUS asock_open(UINT32 remote, service_t *service, char *arg)
 
 	debug(L"socket %d/%d created for service %a", s->local, remote, service->name);
 
-	ret = asock_send_okay(s);
+	/* The host can send one input buffer of data */
+	ret = send_ready(s, ADB_MIN_PAYLOAD);
 	if (EFI_ERROR(ret)) {
 		service->close(s);
 		efi_perror(ret, L"Failed to send OKAY message");
@@ -100,8 +127,13 @@ EFI_STATUS asock_open(UINT32 remote, service_t *service, char *arg)
 	return EFI_SUCCESS;
 
 err:
-	if (s)
+	if (s) {
+		if (s->data) {
+			FreePool(s->data);
+			s->data = NULL;
+		}
 		s->local = 0;
+	}
 	efi_perror(ret, L"Failed to open socket for %d remote", remote);
 	return adb_send_pkt(&fail_msg, A_CLSE, 0, remote);
 }
@@ -122,16 +154,26 @@ EFI_STATUS asock_close(asock_t s)
 
 	debug(L"socket %d/%d closed", s->local, s->remote);
 	s->local = 0;
+	/* The firmware might still be sending it */
+	if (!s->writing) {
+		FreePool(s->data);
+		s->data = NULL;
+	}
 
 	return EFI_SUCCESS;
 }
 
-EFI_STATUS asock_okay(asock_t s)
+EFI_STATUS asock_okay(asock_t s, INT32 acked)
 {
 	if (!s)
 		return EFI_INVALID_PARAMETER;
 
-	return s->service->okay(s);
+	if (adb_delayed_ack)
+		s->window += acked;
+	else
+		s->wait_okay = FALSE;
+
+	return asock_want_write(s);
 }
 
 EFI_STATUS asock_read(asock_t s, unsigned char *data, UINT32 length)
@@ -139,27 +181,86 @@ EFI_STATUS asock_read(asock_t s, unsigned char *data, UINT32 length)
 	if (!s)
 		return EFI_INVALID_PARAMETER;
 
+	s->received += length;
 	return s->service->read(s, data, length);
 }
 
 /* Device to host */
 EFI_STATUS asock_write(asock_t s, unsigned char *data, UINT32 length)
 {
+	EFI_STATUS ret;
+	BOOLEAN copied = length <= ADB_COPIED_PAYLOAD;
+
 	if (!s || length > adb_max_payload)
 		return EFI_INVALID_PARAMETER;
 
-	memcpy(s->data, data, length);
-	s->wrt.data = s->data;
+	if (!copied) {
+		if (s->writing)
+			return EFI_NOT_READY;
+		if (data != s->data)
+			memcpy(s->data, data, length);
+		data = s->data;
+		s->writing = TRUE;
+	}
+
+	/* The TX event might be processed before adb_send_pkt()
+	 * returns, update the state first. */
+	s->wait_okay = TRUE;
+	s->window -= length;
+
+	s->wrt.data = data;
 	s->wrt.msg.data_length = length;
-	return adb_send_pkt(&s->wrt, A_WRTE, s->local, s->remote);
+	ret = adb_send_pkt(&s->wrt, A_WRTE, s->local, s->remote);
+	if (EFI_ERROR(ret) && !copied)
+		s->writing = FALSE;
+
+	return ret;
+}
+
+void asock_write_done(UINT32 local, UINT32 remote)
+{
+	asock_t s;
+
+	if (local == 0 || local > ARRAY_SIZE(asocks))
+		return;
+
+	s = &asocks[local - 1];
+	s->writing = FALSE;
+
+	/* Closed while the WRTE message was being sent */
+	if (s->local != local || s->remote != remote) {
+		FreePool(s->data);
+		s->data = NULL;
+		return;
+	}
+
+	asock_want_write(s);
+}
+
+EFI_STATUS asock_want_write(asock_t s)
+{
+	if (!s)
+		return EFI_INVALID_PARAMETER;
+
+	if (s->writing)
+		return EFI_SUCCESS;
+
+	if (adb_delayed_ack ? s->window <= 0 : s->wait_okay)
+		return EFI_SUCCESS;
+
+	return s->service->okay(s);
 }
 
 EFI_STATUS asock_send_okay(asock_t s)
 {
+	EFI_STATUS ret;
+
 	if (!s)
 		return EFI_INVALID_PARAMETER;
 
-	return adb_send_pkt(&s->msg, A_OKAY, s->local, s->remote);
+	ret = send_ready(s, s->received);
+	s->received = 0;
+	return ret;
 }
 
 EFI_STATUS asock_send_close(asock_t s)
@@ -167,6 +268,7 @@ EFI_STATUS asock_send_close(asock_t s)
 	if (!s)
 		return EFI_INVALID_PARAMETER;
 
+	s->msg.msg.data_length = 0;
 	return adb_send_pkt(&s->msg, A_CLSE, s->local, s->remote);
 }
 
@@ -176,6 +278,11 @@ void *asock_context(asock_t s)
 	return s ? s->context : NULL;
 }
 
+unsigned char *asock_buffer(asock_t s)
+{
+	return s ? s->data : NULL;
+}
+
 asock_t asock_find(UINT32 local, UINT32 remote)
 {
 	asock_t s;
@@ -45,18 +45,26 @@ struct service;
 #define MAX_ADB_SOCKET 5
 
 /* Host to device */
-EFI_STATUS asock_open(UINT32 remote, struct service *service, char *arg);
+EFI_STATUS asock_open(UINT32 remote, struct service *service, char *arg,
+		      UINT32 window);
 EFI_STATUS asock_close(asock_t s);
-EFI_STATUS asock_okay(asock_t s);
+EFI_STATUS asock_okay(asock_t s, INT32 acked);
 EFI_STATUS asock_read(asock_t s, unsigned char *data, UINT32 length);
 
-/* Device to host */
+/* Device to host.  The service okay() callback is called each time
+ * the socket is ready for the next asock_write(): the previous one
+ * has been transmitted and the host can receive more data. */
 EFI_STATUS asock_write(asock_t s, unsigned char *data, UINT32 length);
+void asock_write_done(UINT32 local, UINT32 remote);
+/* Call the service okay() callback now if the socket is ready */
+EFI_STATUS asock_want_write(asock_t s);
 EFI_STATUS asock_send_okay(asock_t s);
 EFI_STATUS asock_send_close(asock_t s);
 
 /* Tools */
 void *asock_context(asock_t s);
+/* Buffer of adb_max_payload bytes asock_write() sends without copy */
+unsigned char *asock_buffer(asock_t s);
 asock_t asock_find(UINT32 local, UINT32 remote);
 void asock_close_all();
 
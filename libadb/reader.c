@@ -32,12 +32,16 @@
 
 #include <lib.h>
 #include <slot.h>
+#include <endian.h>
+#include <immintrin.h>
 
 #include "acpi.h"
 #ifndef __LP64__
 #include "pae.h"
 #endif
 #include "reader.h"
+#include "readahead.h"
+#include "snappy.h"
 #include "sparse_format.h"
 
 /* Memory dump shared functions.  These functions do not make any
@@ -83,6 +87,96 @@ static EFI_STATUS get_sorted_memory_map(memory_t *mem)
 	return EFI_SUCCESS;
 }
 
+/* Zero memory detection.  The memory of a crashed device is mostly
+   made of zero pages which are not worth transferring.  LEN is a
+   multiple of EFI_PAGE_SIZE and P is page aligned.  */
+#define SSE41_TARGET __attribute__((target("sse4.1")))
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+static BOOLEAN is_zero_generic(const unsigned char *p, UINT64 len)
+{
+	const UINT64 *v = (const UINT64 *)p;
+	UINT64 i;
+
+	for (i = 0; i < len / sizeof(*v); i += 8)
+		if (v[i] | v[i + 1] | v[i + 2] | v[i + 3] |
+		    v[i + 4] | v[i + 5] | v[i + 6] | v[i + 7])
+			return FALSE;
+
+	return TRUE;
+}
+
+static SSE41_TARGET BOOLEAN is_zero_sse41(const unsigned char *p, UINT64 len)
+{
+	const __m128i *v = (const __m128i *)p;
+	__m128i acc;
+	UINT64 i;
+
+	for (i = 0; i < len / sizeof(*v); i += 4) {
+		acc = _mm_or_si128(_mm_or_si128(_mm_load_si128(v + i),
+						_mm_load_si128(v + i + 1)),
+				   _mm_or_si128(_mm_load_si128(v + i + 2),
+						_mm_load_si128(v + i + 3)));
+		if (!_mm_testz_si128(acc, acc))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static AVX2_TARGET BOOLEAN is_zero_avx2(const unsigned char *p, UINT64 len)
+{
+	const __m256i *v = (const __m256i *)p;
+	__m256i acc;
+	UINT64 i;
+
+	for (i = 0; i < len / sizeof(*v); i += 4) {
+		acc = _mm256_or_si256(_mm256_or_si256(_mm256_load_si256(v + i),
+						      _mm256_load_si256(v + i + 1)),
+				      _mm256_or_si256(_mm256_load_si256(v + i + 2),
+						      _mm256_load_si256(v + i + 3)));
+		if (!_mm256_testz_si256(acc, acc))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static BOOLEAN (*is_zero)(const unsigned char *p, UINT64 len) = is_zero_generic;
+
+static void memory_select_is_zero(void)
+{
+	if (cpu_has_feature(CPU_FEATURE_AVX2))
+		is_zero = is_zero_avx2;
+	else if (cpu_has_feature(CPU_FEATURE_SSE41))
+		is_zero = is_zero_sse41;
+	else
+		is_zero = is_zero_generic;
+}
+
+static EFI_STATUS memory_is_zero(EFI_PHYSICAL_ADDRESS addr, UINT64 len, BOOLEAN *zero)
+{
+	unsigned char *buf;
+	UINT64 cur_len;
+#ifndef __LP64__
+	EFI_STATUS ret;
+#endif
+
+	for (*zero = TRUE; len && *zero; addr += cur_len, len -= cur_len) {
+		cur_len = len;
+#ifdef __LP64__
+		buf = (unsigned char *)addr;
+#else
+		ret = pae_map(addr, &buf, &cur_len);
+		if (EFI_ERROR(ret))
+			return ret;
+#endif
+		*zero = is_zero(buf, cur_len);
+	}
+
+	return EFI_SUCCESS;
+}
+
 static EFI_STATUS memory_open(reader_ctx_t *ctx, memory_t *mem,
 			      EFI_STATUS (*init)(reader_ctx_t *, void *),
 			      UINTN argc, char **argv)
@@ -125,6 +219,8 @@ static EFI_STATUS memory_open(reader_ctx_t *ctx, memory_t *mem,
 	if (EFI_ERROR(ret))
 		return ret;
 
+	memory_select_is_zero();
+
 	ret = init(ctx, mem);
 	if (EFI_ERROR(ret))
 		goto err;
@@ -170,8 +266,11 @@ static void memory_close(reader_ctx_t *ctx)
 }
 
 /* RAM reader */
-#define SIZEOF_TOTALSZ		sizeof(((chunk_header_t *)0)->total_sz)
-#define MAX_CHUNK_SIZE		(((UINT64)1 << (SIZEOF_TOTALSZ * 8)) - EFI_PAGE_SIZE)
+
+/* The sparse header holds the number of chunks so the conventional
+   memory regions are split in a fixed number of segments, each sent
+   as a RAW chunk or, if it is only made of zeros, as a FILL chunk.  */
+#define RAM_SEGMENT_SIZE	(64 * 1024)
 
 static struct ram_priv {
 	memory_t m;
@@ -180,7 +279,13 @@ static struct ram_priv {
 	UINTN chunk_nb;
 	UINTN cur_chunk;
 	struct sparse_header sheader;
+	/* Memory regions, the RAW ones are sent by segments */
 	struct chunk_header chunks[MAX_MEMORY_REGION_NB];
+	EFI_PHYSICAL_ADDRESS region_end;
+	struct {
+		struct chunk_header header;
+		UINT32 fill;
+	} segment;
 } ram_priv = {
 	.sheader = {
 		.magic = SPARSE_HEADER_MAGIC,
@@ -194,24 +299,14 @@ static struct ram_priv {
 
 static EFI_STATUS ram_add_chunk(reader_ctx_t *ctx, struct ram_priv *priv, UINT16 type, UINT64 size)
 {
-	EFI_STATUS ret = EFI_SUCCESS;
 	struct chunk_header *cur = NULL;
+	UINT64 segment_nb;
 
 	if (size % EFI_PAGE_SIZE) {
 		error(L"chunk size must be multiple of %d bytes", EFI_PAGE_SIZE);
 		return EFI_INVALID_PARAMETER;
 	}
 
-	if (type == CHUNK_TYPE_RAW) {
-		while ((UINT32)(size + sizeof(*cur)) <= size) {
-			/* Overflow detected in UINT32 total_sz field */
-			ret = ram_add_chunk(ctx, priv, type, MAX_CHUNK_SIZE);
-			if (EFI_ERROR(ret))
-				return ret;
-			size -= MAX_CHUNK_SIZE;
-		}
-	}
-
 	if (priv->chunk_nb == MAX_MEMORY_REGION_NB) {
 		error(L"Failed to allocate a new chunk");
 		return EFI_OUT_OF_RESOURCES;
@@ -222,13 +317,18 @@ static EFI_STATUS ram_add_chunk(reader_ctx_t *ctx, struct ram_priv *priv, UINT16
 	cur->chunk_type = type;
 	cur->chunk_sz = size / EFI_PAGE_SIZE;
 	cur->total_sz = sizeof(*cur);
-	ctx->len += sizeof(*cur);
+
+	/* CTX->LEN assumes all the segments are RAW chunks, it is
+	   reduced as zero segments are found.  */
 	if (type == CHUNK_TYPE_RAW) {
-		cur->total_sz += size;
-		ctx->len += size;
+		segment_nb = (size + RAM_SEGMENT_SIZE - 1) / RAM_SEGMENT_SIZE;
+		priv->sheader.total_chunks += segment_nb;
+		ctx->len += segment_nb * sizeof(*cur) + size;
+	} else {
+		priv->sheader.total_chunks++;
+		ctx->len += sizeof(*cur);
 	}
 
-	priv->sheader.total_chunks++;
 	priv->sheader.total_blks += cur->chunk_sz;
 
 	return EFI_SUCCESS;
@@ -258,7 +358,8 @@ static EFI_STATUS ram_build_chunks(reader_ctx_t *ctx, void *priv_p)
 			goto next;
 
 		/* Memory hole between two memory regions */
-		if (prev_end != entry->PhysicalStart) {
+		if (prev_end != entry->PhysicalStart &&
+		    priv->m.start < entry->PhysicalStart) {
 			if (prev_end > entry->PhysicalStart) {
 				error(L"overlap detected, aborting");
 				goto err;
@@ -325,6 +426,39 @@ static EFI_STATUS ram_open(reader_ctx_t *ctx, UINTN argc, char **argv)
 	return memory_open(ctx, &ram_priv.m, ram_build_chunks, argc, argv);
 }
 
+static EFI_STATUS ram_start_segment(reader_ctx_t *ctx, struct ram_priv *priv,
+				     unsigned char **buf, UINT64 *len)
+{
+	struct chunk_header *chunk = &priv->segment.header;
+	EFI_STATUS ret;
+	BOOLEAN zero;
+	UINT64 size;
+
+	size = min((UINT64)RAM_SEGMENT_SIZE, priv->region_end - priv->m.cur);
+	ret = memory_is_zero(priv->m.cur, size, &zero);
+	if (EFI_ERROR(ret))
+		return ret;
+
+	chunk->chunk_sz = size / EFI_PAGE_SIZE;
+	*buf = (unsigned char *)&priv->segment;
+
+	if (zero) {
+		chunk->chunk_type = CHUNK_TYPE_FILL;
+		chunk->total_sz = sizeof(priv->segment);
+		priv->segment.fill = 0;
+		*len = sizeof(priv->segment);
+		ctx->len -= size - sizeof(priv->segment.fill);
+		priv->m.cur = priv->m.cur_end = priv->m.cur + size;
+		return EFI_SUCCESS;
+	}
+
+	chunk->chunk_type = CHUNK_TYPE_RAW;
+	chunk->total_sz = sizeof(*chunk) + size;
+	*len = sizeof(*chunk);
+	priv->m.cur_end = priv->m.cur + size;
+	return EFI_SUCCESS;
+}
+
 static EFI_STATUS ram_read(reader_ctx_t *ctx, unsigned char **buf, UINT64 *len)
 {
 	struct ram_priv *priv = ctx->private;
@@ -338,22 +472,33 @@ static EFI_STATUS ram_read(reader_ctx_t *ctx, unsigned char **buf, UINT64 *len)
 		*buf = (unsigned char *)&priv->sheader;
 		*len = sizeof(priv->sheader);
 		priv->m.cur = priv->m.cur_end = priv->m.start;
+		priv->region_end = priv->m.start;
 		return EFI_SUCCESS;
 	}
 
 	/* Start new chunk */
 	if (priv->m.cur == priv->m.cur_end) {
-		if (priv->cur_chunk == priv->chunk_nb || *len < sizeof(*priv->chunks)) {
+		if (*len < sizeof(priv->segment)) {
+			error(L"Invalid parameter in %a", __func__);
+			return EFI_INVALID_PARAMETER;
+		}
+
+		if (priv->m.cur != priv->region_end)
+			return ram_start_segment(ctx, priv, buf, len);
+
+		if (priv->cur_chunk == priv->chunk_nb) {
 			error(L"Invalid parameter in %a", __func__);
 			return EFI_INVALID_PARAMETER;
 		}
 
 		chunk = &priv->chunks[priv->cur_chunk++];
+		priv->region_end = priv->m.cur + chunk->chunk_sz * EFI_PAGE_SIZE;
+		if (chunk->chunk_type == CHUNK_TYPE_RAW)
+			return ram_start_segment(ctx, priv, buf, len);
+
 		*buf = (unsigned char *)chunk;
 		*len = sizeof(*chunk);
-		priv->m.cur_end = priv->m.cur + chunk->chunk_sz * EFI_PAGE_SIZE;
-		if (chunk->chunk_type != CHUNK_TYPE_RAW)
-			priv->m.cur = priv->m.cur_end;
+		priv->m.cur = priv->m.cur_end = priv->region_end;
 		return EFI_SUCCESS;
 	}
 
@@ -590,16 +735,415 @@ static EFI_STATUS vmcore_read(reader_ctx_t *ctx, unsigned char **buf, UINT64 *le
 	return memory_read_current(&priv->m, buf, len);
 }
 
-/* Partition reader */
-#define PART_READER_BUF_SIZE (10 * 1024 * 1024)
+/* Compressed VMCore reader.  The memory regions of the vmcore reader
+   are exported in the kdump-compressed format of makedumpfile, in its
+   "flattened" variant: a sequence of (offset, size) segments which do
+   not have to be in the file order.  It allows to send the page
+   descriptors after the compressed pages they point to.
+
+   The pages are compressed one by one with snappy, the fastest of the
+   compression formats the crash utility supports, and all the zero
+   pages share the same page data.  This reader does not make any
+   dynamic memory allocation either.  */
+#define FLAT_SIGNATURE		"makedumpfile"
+#define FLAT_HEADER_SIZE	4096
+#define FLAT_TYPE		1
+#define FLAT_VERSION		1
+#define FLAT_END		((UINT64)-1)
+
+#define KDUMP_SIGNATURE		"KDUMP   "
+#define KDUMP_HEADER_VERSION	6
+#define KDUMP_BLOCK_SIZE	EFI_PAGE_SIZE
+#define KDUMP_COMPRESSED_SNAPPY	0x4
+#define KDUMP_BATCH_PAGES	32
+#define UTS_LEN			65
+
+#pragma pack(1)
+/* Flattened format headers are big-endian */
+typedef struct flat_header {
+	char signature[16];
+	UINT64 type;
+	UINT64 version;
+} flat_header_t;
+
+typedef struct flat_segment {
+	UINT64 offset;
+	UINT64 size;
+} flat_segment_t;
+
+/* Linux x86_64 struct disk_dump_header */
+typedef struct kdump_header {
+	char signature[8];
+	INT32 header_version;
+	struct {
+		char sysname[UTS_LEN];
+		char nodename[UTS_LEN];
+		char release[UTS_LEN];
+		char version[UTS_LEN];
+		char machine[UTS_LEN];
+		char domainname[UTS_LEN];
+	} utsname;
+	char pad[6];
+	UINT64 timestamp_sec;
+	UINT64 timestamp_usec;
+	UINT32 status;
+	INT32 block_size;
+	INT32 sub_hdr_size;		/* In blocks */
+	UINT32 bitmap_blocks;
+	UINT32 max_mapnr;		/* Obsolete, see max_mapnr_64 */
+	UINT32 total_ram_blocks;
+	UINT32 device_blocks;
+	UINT32 written_blocks;
+	UINT32 current_cpu;
+	INT32 nr_cpus;
+} kdump_header_t;
+
+/* Linux x86_64 struct kdump_sub_header */
+typedef struct kdump_sub_header {
+	UINT64 phys_base;
+	INT32 dump_level;
+	INT32 split;
+	UINT64 start_pfn;		/* Obsolete, see start_pfn_64 */
+	UINT64 end_pfn;			/* Obsolete, see end_pfn_64 */
+	UINT64 offset_vmcoreinfo;
+	UINT64 size_vmcoreinfo;
+	UINT64 offset_note;
+	UINT64 size_note;
+	UINT64 offset_eraseinfo;
+	UINT64 size_eraseinfo;
+	UINT64 start_pfn_64;
+	UINT64 end_pfn_64;
+	UINT64 max_mapnr_64;
+} kdump_sub_header_t;
+
+typedef struct page_desc {
+	UINT64 offset;			/* Offset of the page data */
+	UINT32 size;			/* Size of the page data */
+	UINT32 flags;			/* Compression format */
+	UINT64 page_flags;
+} page_desc_t;
+#pragma pack()
+
+typedef enum kdump_step {
+	KDUMP_HEADERS,
+	KDUMP_BITMAPS,
+	KDUMP_ZERO_PAGE,
+	KDUMP_PAGES,
+	KDUMP_END,
+	KDUMP_DONE
+} kdump_step_t;
+
+#define KDUMP_MAX_PIECES	4
+
+static struct kdump_priv {
+	struct vmcore_priv vmcore;
+
+	UINT64 max_mapnr;
+	UINT64 bitmap_sz;		/* Size of each of the two bitmaps */
+	UINT64 desc_offset;
+	UINT64 data_offset;
+
+	/* Streaming state */
+	kdump_step_t step;
+	UINT64 pfn;
+	UINT64 desc_cur;
+	UINT64 data_cur;
+	struct {
+		unsigned char *buf;
+		UINT64 len;
+	} piece[KDUMP_MAX_PIECES];
+	UINTN piece_nb;
+	UINTN cur_piece;
+	flat_segment_t seg[KDUMP_MAX_PIECES / 2];
+
+	/* Output buffers */
+	struct {
+		flat_header_t flat;
+		UINT8 flat_pad[FLAT_HEADER_SIZE - sizeof(flat_header_t)];
+		flat_segment_t seg;
+		kdump_header_t dump;
+		UINT8 dump_pad[KDUMP_BLOCK_SIZE - sizeof(kdump_header_t)];
+		kdump_sub_header_t sub;
+		UINT8 sub_pad[KDUMP_BLOCK_SIZE - sizeof(kdump_sub_header_t)];
+	} __attribute__((packed)) headers;
+	UINT8 block[KDUMP_BLOCK_SIZE];
+	page_desc_t desc[KDUMP_BATCH_PAGES];
+	UINT8 data[KDUMP_BATCH_PAGES * KDUMP_BLOCK_SIZE];
+} kdump_priv = {
+	.headers = {
+		.flat = { .signature = FLAT_SIGNATURE },
+		.dump = {
+			.signature = KDUMP_SIGNATURE,
+			.header_version = KDUMP_HEADER_VERSION,
+			.utsname = {
+				.sysname = "Linux",
+				.machine = "x86_64"
+			},
+			.status = KDUMP_COMPRESSED_SNAPPY,
+			.block_size = KDUMP_BLOCK_SIZE,
+			.sub_hdr_size = 1,
+			.nr_cpus = 1
+		}
+	}
+};
+
+static EFI_STATUS kdump_build_header(reader_ctx_t *ctx, void *priv_p)
+{
+	struct kdump_priv *priv = priv_p;
+	kdump_header_t *dump = &priv->headers.dump;
+	kdump_sub_header_t *sub = &priv->headers.sub;
+	elf64_phdr_t *last;
+	UINT64 page_nb = 0, batch_nb, bitmap_blocks;
+	EFI_STATUS ret;
+	EFI_TIME now;
+	UINTN i;
+
+	ret = vmcore_build_header(ctx, &priv->vmcore);
+	if (EFI_ERROR(ret))
+		return ret;
+
+	for (i = 1; i < priv->vmcore.hdr.phnum; i++)
+		page_nb += priv->vmcore.phdr[i].memsz / KDUMP_BLOCK_SIZE;
+	batch_nb = (page_nb + KDUMP_BATCH_PAGES - 1) / KDUMP_BATCH_PAGES;
+
+	last = &priv->vmcore.phdr[priv->vmcore.hdr.phnum - 1];
+	priv->max_mapnr = (last->paddr + last->memsz) / KDUMP_BLOCK_SIZE;
+	bitmap_blocks = (priv->max_mapnr + KDUMP_BLOCK_SIZE * 8 - 1) /
+		(KDUMP_BLOCK_SIZE * 8);
+	priv->bitmap_sz = bitmap_blocks * KDUMP_BLOCK_SIZE;
+
+	/* Dump file layout: header, sub header, bitmaps, page
+	   descriptors and page data starting with the zero page */
+	priv->desc_offset = (2 + 2 * bitmap_blocks) * KDUMP_BLOCK_SIZE;
+	priv->data_offset = priv->desc_offset + page_nb * sizeof(page_desc_t);
+
+	priv->headers.flat.type = htobe64(FLAT_TYPE);
+	priv->headers.flat.version = htobe64(FLAT_VERSION);
+	priv->headers.seg.offset = htobe64(0);
+	priv->headers.seg.size = htobe64(2 * KDUMP_BLOCK_SIZE);
+
+	ret = uefi_call_wrapper(RT->GetTime, 2, &now, NULL);
+	dump->timestamp_sec = EFI_ERROR(ret) ? 0 : efi_time_to_ctime(&now);
+	dump->bitmap_blocks = 2 * bitmap_blocks;
+	dump->max_mapnr = min(priv->max_mapnr, (UINT64)0xffffffff);
+
+	sub->end_pfn = sub->end_pfn_64 = priv->max_mapnr;
+	sub->max_mapnr_64 = priv->max_mapnr;
+
+	/* Upper bound: all the pages are sent uncompressed.  CTX->LEN
+	   is reduced as the pages are compressed.  */
+	ctx->len = sizeof(priv->headers) +
+		sizeof(flat_segment_t) + 2 * priv->bitmap_sz +
+		sizeof(flat_segment_t) + KDUMP_BLOCK_SIZE +
+		batch_nb * 2 * sizeof(flat_segment_t) +
+		page_nb * (KDUMP_BLOCK_SIZE + sizeof(page_desc_t)) +
+		sizeof(flat_segment_t);
+
+	return EFI_SUCCESS;
+}
 
+static EFI_STATUS kdump_open(reader_ctx_t *ctx, UINTN argc, char **argv)
+{
+	return memory_open(ctx, &kdump_priv.vmcore.m, kdump_build_header, argc, argv);
+}
+
+static void kdump_add_piece(struct kdump_priv *priv, void *buf, UINT64 len)
+{
+	priv->piece[priv->piece_nb].buf = buf;
+	priv->piece[priv->piece_nb].len = len;
+	priv->piece_nb++;
+}
+
+static void kdump_add_segment(struct kdump_priv *priv, UINT64 offset,
+			      void *buf, UINT64 len)
+{
+	flat_segment_t *seg = &priv->seg[priv->piece_nb / 2];
+
+	seg->offset = htobe64(offset);
+	seg->size = htobe64(len);
+	kdump_add_piece(priv, seg, sizeof(*seg));
+	if (buf)
+		kdump_add_piece(priv, buf, len);
+}
+
+/* Both the bitmap of the valid pages and the one of the dumped
+   pages are made of the conventional memory pages.  */
+static void kdump_fill_bitmap_block(struct kdump_priv *priv)
+{
+	UINT64 first, last, start, end, pfn;
+	elf64_phdr_t *phdr;
+	UINTN i, rem;
+
+	/* There are less than 2^32 page frames: DivU64x32() suits,
+	 * there is no libgcc on ia32. */
+	DivU64x32(priv->pfn, priv->bitmap_sz * 8, &rem);
+	first = rem;
+	last = first + KDUMP_BLOCK_SIZE * 8;
+
+	memset(priv->block, 0, sizeof(priv->block));
+	for (i = 1; i < priv->vmcore.hdr.phnum; i++) {
+		phdr = &priv->vmcore.phdr[i];
+		start = max(phdr->paddr / KDUMP_BLOCK_SIZE, first);
+		end = min((phdr->paddr + phdr->memsz) / KDUMP_BLOCK_SIZE, last);
+		for (pfn = start; pfn < end; pfn++)
+			priv->block[(pfn - first) / 8] |= 1 << (pfn % 8);
+	}
+}
+
+static EFI_STATUS kdump_map_page(UINT64 pfn, unsigned char **page)
+{
+#ifdef __LP64__
+	*page = (unsigned char *)(pfn * KDUMP_BLOCK_SIZE);
+	return EFI_SUCCESS;
+#else
+	UINT64 len = KDUMP_BLOCK_SIZE;
+
+	return pae_map(pfn * KDUMP_BLOCK_SIZE, page, &len);
+#endif
+}
+
+static EFI_STATUS kdump_compress_pages(reader_ctx_t *ctx, struct kdump_priv *priv)
+{
+	elf64_phdr_t *phdr = &priv->vmcore.phdr[priv->vmcore.cur_phdr];
+	UINT64 data_len = 0, size;
+	unsigned char *page;
+	page_desc_t *desc;
+	EFI_STATUS ret;
+	UINTN n;
+
+	for (n = 0; n < KDUMP_BATCH_PAGES && priv->step == KDUMP_PAGES; n++) {
+		ret = kdump_map_page(priv->pfn, &page);
+		if (EFI_ERROR(ret))
+			return ret;
+
+		desc = &priv->desc[n];
+		desc->page_flags = 0;
+		if (is_zero(page, KDUMP_BLOCK_SIZE)) {
+			desc->offset = priv->data_offset;
+			desc->size = KDUMP_BLOCK_SIZE;
+			desc->flags = 0;
+		} else {
+			desc->offset = priv->data_cur + data_len;
+			size = snappy_compress(page, KDUMP_BLOCK_SIZE,
+					       priv->data + data_len,
+					       KDUMP_BLOCK_SIZE - 1);
+			if (size) {
+				desc->flags = KDUMP_COMPRESSED_SNAPPY;
+			} else {
+				size = KDUMP_BLOCK_SIZE;
+				memcpy(priv->data + data_len, page, size);
+				desc->flags = 0;
+			}
+			desc->size = size;
+			data_len += size;
+		}
+
+		/* Move to the next page */
+		priv->pfn++;
+		if (priv->pfn == (phdr->paddr + phdr->memsz) / KDUMP_BLOCK_SIZE) {
+			priv->vmcore.cur_phdr++;
+			if (priv->vmcore.cur_phdr == priv->vmcore.hdr.phnum) {
+				priv->step = KDUMP_END;
+				continue;
+			}
+			phdr++;
+			priv->pfn = phdr->paddr / KDUMP_BLOCK_SIZE;
+		}
+	}
+
+	ctx->len -= n * KDUMP_BLOCK_SIZE - data_len;
+	if (data_len)
+		kdump_add_segment(priv, priv->data_cur, priv->data, data_len);
+	else
+		ctx->len -= sizeof(flat_segment_t);
+	kdump_add_segment(priv, priv->desc_cur, priv->desc, n * sizeof(*desc));
+
+	priv->data_cur += data_len;
+	priv->desc_cur += n * sizeof(*desc);
+	return EFI_SUCCESS;
+}
+
+static EFI_STATUS kdump_next_pieces(reader_ctx_t *ctx, struct kdump_priv *priv)
+{
+	priv->piece_nb = priv->cur_piece = 0;
+
+	switch (priv->step) {
+	case KDUMP_HEADERS:
+		kdump_add_piece(priv, &priv->headers, sizeof(priv->headers));
+		priv->step = KDUMP_BITMAPS;
+		priv->pfn = 0;
+		return EFI_SUCCESS;
+
+	case KDUMP_BITMAPS:
+		if (priv->pfn == 0)
+			kdump_add_segment(priv, 2 * KDUMP_BLOCK_SIZE, NULL,
+					  2 * priv->bitmap_sz);
+		kdump_fill_bitmap_block(priv);
+		kdump_add_piece(priv, priv->block, sizeof(priv->block));
+		priv->pfn += KDUMP_BLOCK_SIZE * 8;
+		if (priv->pfn == 2 * priv->bitmap_sz * 8)
+			priv->step = KDUMP_ZERO_PAGE;
+		return EFI_SUCCESS;
+
+	case KDUMP_ZERO_PAGE:
+		memset(priv->block, 0, sizeof(priv->block));
+		kdump_add_segment(priv, priv->data_offset, priv->block,
+				  sizeof(priv->block));
+		priv->step = KDUMP_PAGES;
+		priv->vmcore.cur_phdr = 1;
+		priv->pfn = priv->vmcore.phdr[1].paddr / KDUMP_BLOCK_SIZE;
+		priv->desc_cur = priv->desc_offset;
+		priv->data_cur = priv->data_offset + KDUMP_BLOCK_SIZE;
+		return EFI_SUCCESS;
+
+	case KDUMP_PAGES:
+		return kdump_compress_pages(ctx, priv);
+
+	case KDUMP_END:
+		kdump_add_segment(priv, FLAT_END, NULL, FLAT_END);
+		priv->step = KDUMP_DONE;
+		return EFI_SUCCESS;
+
+	default:
+		error(L"Invalid parameter in %a", __func__);
+		return EFI_INVALID_PARAMETER;
+	}
+}
+
+static EFI_STATUS kdump_read(reader_ctx_t *ctx, unsigned char **buf, UINT64 *len)
+{
+	struct kdump_priv *priv = ctx->private;
+	EFI_STATUS ret;
+
+	if (ctx->cur == 0) {
+		priv->step = KDUMP_HEADERS;
+		priv->piece_nb = priv->cur_piece = 0;
+	}
+
+	while (priv->cur_piece == priv->piece_nb) {
+		ret = kdump_next_pieces(ctx, priv);
+		if (EFI_ERROR(ret))
+			return ret;
+	}
+
+	*len = min(*len, priv->piece[priv->cur_piece].len);
+	*buf = priv->piece[priv->cur_piece].buf;
+	priv->piece[priv->cur_piece].buf += *len;
+	priv->piece[priv->cur_piece].len -= *len;
+	if (!priv->piece[priv->cur_piece].len)
+		priv->cur_piece++;
+
+	return EFI_SUCCESS;
+}
+
+/* Partition reader.  The partition is read ahead so the disk keeps
+   reading while the previous chunk is being sent.  */
 struct part_priv {
 	struct gpt_partition_interface gparti;
-	BOOLEAN need_more_data;
-	unsigned char buf[PART_READER_BUF_SIZE];
+	struct readahead *ra;
+	unsigned char *buf;
 	UINTN buf_cur;
 	UINTN buf_len;
-	UINT64 offset;
 };
 
 static EFI_STATUS _part_open(reader_ctx_t *ctx, UINTN argc, char **argv, logical_unit_t log_unit)
@@ -613,11 +1157,10 @@ static EFI_STATUS _part_open(reader_ctx_t *ctx, UINTN argc, char **argv, logical
 	if (argc < 1 || argc > 3)
 		return EFI_INVALID_PARAMETER;
 
-	priv = ctx->private = AllocatePool(sizeof(*priv));
+	priv = ctx->private = AllocateZeroPool(sizeof(*priv));
 	if (!priv)
 		return EFI_OUT_OF_RESOURCES;
 
-
 	partname = stra_to_str((CHAR8 *)argv[0]);
 	if (!partname) {
 		error(L"Failed to convert partition name to CHAR16");
@@ -632,7 +1175,6 @@ static EFI_STATUS _part_open(reader_ctx_t *ctx, UINTN argc, char **argv, logical
 		goto err;
 	}
 
-	priv->offset = gparti->part.starting_lba * gparti->bio->Media->BlockSize;
 	length = (gparti->part.ending_lba + 1 - gparti->part.starting_lba) *
 		gparti->bio->Media->BlockSize;
 
@@ -651,10 +1193,6 @@ static EFI_STATUS _part_open(reader_ctx_t *ctx, UINTN argc, char **argv, logical
 			goto err;
 	}
 
-	priv->buf_cur = 0;
-	priv->buf_len = 0;
-	priv->need_more_data = TRUE;
-
 	return EFI_SUCCESS;
 
 err:
@@ -677,29 +1215,39 @@ static EFI_STATUS part_read(reader_ctx_t *ctx, unsigned char **buf, UINT64 *len)
 	EFI_STATUS ret;
 	struct part_priv *priv = ctx->private;
 
-	if (priv->need_more_data) {
-		priv->buf_len = min(sizeof(priv->buf), ctx->len - ctx->cur);
-		ret = uefi_call_wrapper(priv->gparti.dio->ReadDisk, 5, priv->gparti.dio,
-					priv->gparti.bio->Media->MediaId,
-					priv->offset + ctx->cur, priv->buf_len, priv->buf);
+	/* The reader is also opened to get the size of the
+	   partition, only queue the reads on the first read.  */
+	if (!priv->ra) {
+		ret = readahead_open(&priv->ra, &priv->gparti, ctx->cur,
+				     ctx->len - ctx->cur, 0);
 		if (EFI_ERROR(ret)) {
 			efi_perror(ret, L"Failed to read partition");
 			return ret;
 		}
+	}
 
-		priv->need_more_data = FALSE;
+	if (priv->buf_cur == priv->buf_len) {
+		ret = readahead_next(priv->ra, (void **)&priv->buf, &priv->buf_len);
+		if (EFI_ERROR(ret))
+			return ret;
 		priv->buf_cur = 0;
 	}
 
-	*len = min(*len, priv->buf_len - priv->buf_cur);
+	*len = min(*len, (UINT64)(priv->buf_len - priv->buf_cur));
 	*buf = priv->buf + priv->buf_cur;
 	priv->buf_cur += *len;
-	if (priv->buf_cur == priv->buf_len)
-		priv->need_more_data = TRUE;
 
 	return EFI_SUCCESS;
 }
 
+static void part_close(reader_ctx_t *ctx)
+{
+	struct part_priv *priv = ctx->private;
+
+	readahead_close(priv->ra);
+	FreePool(priv);
+}
+
 /* ACPI table reader */
 static EFI_STATUS acpi_open(reader_ctx_t *ctx, UINTN argc, char **argv)
 {
@@ -1008,9 +1556,10 @@ struct reader {
 } READERS[] = {
 	{ "ram",		ram_open,			ram_read,		memory_close },
 	{ "vmcore",		vmcore_open,			vmcore_read,		memory_close },
+	{ "vmcore-compressed",	kdump_open,			kdump_read,		memory_close },
 	{ "acpi",		acpi_open,			read_from_private,	NULL },
-	{ "part",		part_open,			part_read,		free_private },
-	{ "factory-part",	factory_part_open,		part_read,		free_private },
+	{ "part",		part_open,			part_read,		part_close },
+	{ "factory-part",	factory_part_open,		part_read,		part_close },
 	{ "efivar",		efivar_open,			read_from_private,	free_private },
 	{ "mbr",		mbr_open,			read_from_private,	free_private },
 	{ "gpt-header",		gpt_header_open,		read_from_private,	free_private },
@@ -74,8 +74,7 @@ typedef union {
 typedef struct {
 	state_t state;
 	reader_ctx_t reader_ctx;
-	BOOLEAN need_more_data;
-	unsigned char *buf;
+	unsigned char *buf;	/* Last chunk read, partially sent */
 	UINT64 buf_cur;
 	UINT64 buf_len;
 	UINT64 sent;
@@ -126,60 +125,63 @@ static EFI_STATUS sync_service_close(asock_t s)
 	return EFI_SUCCESS;
 }
 
-static EFI_STATUS send_done(asock_t s, sync_ctx_t *ctx)
-{
-	sync_msg_t msg;
-
-	reader_close(&ctx->reader_ctx);
-
-	ctx->state = ESTABLISHED;
-
-	msg.req.id = ID_DONE;
-	msg.req.namelen = 0;
-	return asock_write(s, (unsigned char *)&msg, sizeof(msg.req));
-}
-
 #define DATA_PROGRESS_THRESHOLD (5 * 1024 * 1024)
 
+/* The sync protocol is a stream: fill the WRTE message payload with
+ * as many DATA chunks as possible, followed by the DONE message once
+ * everything has been read.  The readers are always asked for
+ * SYNC_DATA_MAX bytes as some of them cannot return less at the start
+ * of a header or a segment: a chunk which does not fit in the payload
+ * is continued in the next one. */
 static EFI_STATUS send_more_data(asock_t s, sync_ctx_t *ctx)
 {
 	EFI_STATUS ret;
-	UINT32 sent;
+	unsigned char *payload = asock_buffer(s);
+	UINT32 len = 0, n;
 	sync_msg_t msg;
 
-	/* Need to load more data. */
-	if (ctx->need_more_data) {
-		ctx->buf_len = SYNC_DATA_MAX;
-
-		ret = reader_read(&ctx->reader_ctx, &ctx->buf, &ctx->buf_len);
-		if (EFI_ERROR(ret))
-			return ret;
-		if (ctx->buf_len == 0) /* No more data to send. */
-			return send_done(s, ctx);
+	while (len < adb_max_payload) {
+		if (ctx->buf_cur == ctx->buf_len) {
+			if (adb_max_payload - len < sizeof(msg.data))
+				break;
+
+			ctx->buf_cur = 0;
+			ctx->buf_len = SYNC_DATA_MAX;
+			ret = reader_read(&ctx->reader_ctx, &ctx->buf, &ctx->buf_len);
+			if (EFI_ERROR(ret)) {
+				ctx->buf_len = 0;
+				return ret;
+			}
+
+			if (ctx->buf_len == 0) { /* No more data to send. */
+				reader_close(&ctx->reader_ctx);
+				ctx->state = ESTABLISHED;
+
+				msg.req.id = ID_DONE;
+				msg.req.namelen = 0;
+				memcpy(payload + len, &msg, sizeof(msg.req));
+				len += sizeof(msg.req);
+				break;
+			}
+
+			msg.data.id = ID_DATA;
+			msg.data.size = ctx->buf_len;
+			memcpy(payload + len, &msg, sizeof(msg.data));
+			len += sizeof(msg.data);
+		}
 
-		msg.data.id = ID_DATA;
-		msg.data.size = ctx->buf_len;
-		ctx->buf_cur = 0;
-		ctx->need_more_data = FALSE;
+		n = min((UINT64)(adb_max_payload - len), ctx->buf_len - ctx->buf_cur);
+		memcpy(payload + len, ctx->buf + ctx->buf_cur, n);
+		ctx->buf_cur += n;
+		len += n;
 
-		return asock_write(s, (unsigned char *)&msg, sizeof(msg.data));
+		ctx->sent += n;
+		if (ctx->sent >= DATA_PROGRESS_THRESHOLD &&
+		    ctx->sent % DATA_PROGRESS_THRESHOLD < n)
+			debug(L"%d MB have been sent", ctx->sent / 1024 / 1024);
 	}
 
-	sent = min((UINTN)adb_max_payload, ctx->buf_len - ctx->buf_cur);
-	ret = asock_write(s, ctx->buf + ctx->buf_cur, sent);
-	if (EFI_ERROR(ret))
-		return ret;
-
-	ctx->buf_cur = ctx->buf_cur + sent;
-	if (ctx->buf_cur == ctx->buf_len)
-		ctx->need_more_data = TRUE;
-
-	ctx->sent += sent;
-	if (ctx->sent >= DATA_PROGRESS_THRESHOLD &&
-	    ctx->sent % DATA_PROGRESS_THRESHOLD < sent)
-		debug(L"%d MB have been sent", ctx->sent / 1024 / 1024);
-
-	return ret;
+	return asock_write(s, payload, len);
 }
 
 static EFI_STATUS sync_service_okay(asock_t s)
@@ -253,11 +255,11 @@ static EFI_STATUS sync_service_recv(asock_t s, sync_ctx_t *ctx, unsigned char *d
 	if (EFI_ERROR(ret))
 		return ret;
 
+	ctx->buf_cur = ctx->buf_len = 0;
 	ctx->sent = 0;
 	ctx->state = SENDING_DATA;
-	ctx->need_more_data = TRUE;
 
-	return send_more_data(s, ctx);
+	return asock_want_write(s);
 }
 
 static EFI_STATUS sync_service_read(asock_t s, unsigned char *data, UINT32 length)
@@ -54,7 +54,8 @@ LOCAL_MODULE := libfastboot-for-installer-$(TARGET_BUILD_VARIANT)
 LOCAL_CFLAGS := $(SHARED_CFLAGS)
 LOCAL_STATIC_LIBRARIES := $(SHARED_STATIC_LIBRARIES)
 LOCAL_EXPORT_C_INCLUDE_DIRS := $(SHARED_EXPORT_C_INCLUDE_DIRS)
-LOCAL_C_INCLUDES := $(SHARED_C_INCLUDES)
+LOCAL_C_INCLUDES := $(SHARED_C_INCLUDES) \
+	$(addprefix $(LOCAL_PATH)/../,avb)
 LOCAL_SRC_FILES := $(SHARED_SRC_FILES)
 
 include $(BUILD_EFI_STATIC_LIBRARY)
@@ -1282,6 +1282,10 @@ EFI_STATUS fastboot_start(void **bootimage, void **efiimage, UINTN *imagesize,
 	fastboot_target = UNKNOWN_TARGET;
 	*target = UNKNOWN_TARGET;
 
+	/* Fastboot commands change the device state through EFI
+	 * variables and the A/B metadata, do not defer their writes. */
+	slot_write_back(FALSE);
+	efi_variables_write_back(FALSE);
 	fastboot_init();
 
 	/* In case user still holding it from answering a UX prompt
@@ -49,6 +49,7 @@
 #include "fastboot_oem.h"
 #include "intel_variables.h"
 #include "text_parser.h"
+#include "trace.h"
 #ifdef USE_SLOT
 #include "libavb/libavb.h"
 #include "libavb/uefi_avb_ops.h"
@@ -254,7 +255,12 @@ static void cmd_oem_gethashes(INTN argc, CHAR8 **argv)
 	EFI_STATUS ret;
 	UINTN i;
 
-	if (argc == 2) {
+	/* "verity" checks the hashtree root of the filesystems instead
+	 * of hashing them. */
+	set_hashtree_check(FALSE);
+	if (argc == 2 && !strcmp(argv[1], (CHAR8 *)"verity"))
+		set_hashtree_check(TRUE);
+	else if (argc == 2) {
 		ret = set_hash_algorithm(argv[1]);
 		if (EFI_ERROR(ret)) {
 			fastboot_fail("Fail to set the algorithm, %r", ret);
@@ -459,7 +465,8 @@ static void cmd_oem_get_logs(INTN argc, __attribute__((__unused__)) CHAR8 **argv
 	EFI_STATUS ret;
 	UINT32 flags;
 	char *buf;
-	UINTN size;
+	CHAR8 *text;
+	UINTN size, len;
 
 	if (argc != 1) {
 		fastboot_fail("Invalid parameter");
@@ -472,6 +479,22 @@ static void cmd_oem_get_logs(INTN argc, __attribute__((__unused__)) CHAR8 **argv
 		return;
 	}
 
+	ret = log_var_to_text(buf, size, &text, &len);
+	if (ret == EFI_INCOMPATIBLE_VERSION) {
+		FreePool(buf);
+		fastboot_fail("Logs written by another image, use kflogdecode");
+		return;
+	}
+	if (ret == EFI_SUCCESS) {
+		FreePool(buf);
+		buf = (char *)text;
+		size = len;
+	} else if (ret != EFI_UNSUPPORTED) {
+		FreePool(buf);
+		fastboot_fail("Failed to decode log buffer, %r", ret);
+		return;
+	}
+
 	ret = parse_text_buffer(buf, size, fastboot_info_long_string, NULL);
 	FreePool(buf);
 	if (EFI_ERROR(ret)) {
@@ -482,6 +505,28 @@ static void cmd_oem_get_logs(INTN argc, __attribute__((__unused__)) CHAR8 **argv
 	fastboot_okay("");
 }
 
+static void cmd_oem_get_trace(INTN argc, __attribute__((__unused__)) CHAR8 **argv)
+{
+	EFI_STATUS ret;
+	CHAR8 *json;
+	UINTN len;
+
+	if (argc != 1) {
+		fastboot_fail("Invalid parameter");
+		return;
+	}
+
+	ret = trace_to_json(&json, &len, 0);
+	if (EFI_ERROR(ret)) {
+		fastboot_fail("Failed to export the trace, %r", ret);
+		return;
+	}
+
+	fastboot_info_long_string((char *)json, NULL);
+	FreePool(json);
+	fastboot_okay("");
+}
+
 static void cmd_oem(INTN argc, CHAR8 **argv)
 {
 	if (argc < 2) {
@@ -541,6 +586,7 @@ static struct fastboot_cmd COMMANDS[] = {
 #endif
 	{ "get-hashes",			LOCKED,		cmd_oem_gethashes  },
 	{ "get-provisioning-logs",	LOCKED,		cmd_oem_get_logs },
+	{ "get-trace",			LOCKED,		cmd_oem_get_trace },
 #ifdef BOOTLOADER_POLICY
 	{ "get-action-nonce",		LOCKED,		cmd_oem_get_action_nonce }
 #endif
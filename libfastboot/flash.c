@@ -49,6 +49,7 @@
 #include "vars.h"
 #include "bootloader.h"
 #include "authenticated_action.h"
+#include "hashes.h"
 #if defined(IOC_USE_SLCAN) || defined(IOC_USE_CBC)
 #include "ioc_uart_protocol.h"
 #endif
@@ -460,6 +461,8 @@ EFI_STATUS flash(VOID *data, UINTN size, CHAR16 *label)
 {
 	UINTN i;
 
+	invalidate_hash_cache();
+
 #ifndef USER
 	/* special case for writing inside esp partition */
 	CHAR16 esp[] = L"/ESP/";
@@ -535,6 +538,8 @@ EFI_STATUS erase_by_label(CHAR16 *label)
 {
 	EFI_STATUS ret;
 
+	invalidate_hash_cache();
+
 	ret = gpt_get_partition_by_label(label, &gparti, LOGICAL_UNIT_USER);
 	if (EFI_ERROR(ret)) {
 		efi_perror(ret, L"Failed to get partition %s", label);
@@ -559,6 +564,8 @@ EFI_STATUS garbage_disk(void)
 	VOID *aligned_chunk;
 	UINTN size;
 
+	invalidate_hash_cache();
+
 	ret = gpt_get_root_disk(&gparti, LOGICAL_UNIT_USER);
 	if (EFI_ERROR(ret)) {
 		efi_perror(ret, L"Failed to get disk information");
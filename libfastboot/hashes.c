@@ -44,6 +44,12 @@
 #include "android.h"
 #include "signature.h"
 #include "security.h"
+#include "sha256_mb.h"
+#include "readahead.h"
+#include "timer.h"
+#ifdef USE_AVB
+#include "libavb/libavb.h"
+#endif
 
 static struct algorithm {
 	const CHAR8 *name;
@@ -54,7 +60,10 @@ static struct algorithm {
 };
 
 static const EVP_MD *selected_md;
+/* Throughput of the last partition hashing, in MB/s */
+static UINT64 hash_rate;
 static unsigned int hash_len;
+static BOOLEAN hashtree_check;
 
 #define BOOTLOADER_2ND_IAS_OFFSET  0x7D0000
 static UINT64 iasoffset = 0;
@@ -83,18 +92,9 @@ out:
 	return ret;
 }
 
-static void hash_buffer(CHAR8 *buffer, UINT64 len, CHAR8 *hash)
+void set_hashtree_check(BOOLEAN enable)
 {
-	EVP_MD_CTX mdctx;
-
-	if (!selected_md)
-		set_hash_algorithm(NULL);
-
-	EVP_MD_CTX_init(&mdctx);
-	EVP_DigestInit_ex(&mdctx, selected_md, NULL);
-	EVP_DigestUpdate(&mdctx, buffer, len);
-	EVP_DigestFinal_ex(&mdctx, hash, NULL);
-	EVP_MD_CTX_cleanup(&mdctx);
+	hashtree_check = enable;
 }
 
 static EFI_STATUS report_hash(const CHAR16 *base, const CHAR16 *name, CHAR8 *hash)
@@ -110,6 +110,10 @@ static EFI_STATUS report_hash(const CHAR16 *base, const CHAR16 *name, CHAR8 *has
 
 	fastboot_info("target: %s%s", base, name);
 	fastboot_info("hash: %a", hashstr);
+	if (hash_rate) {
+		fastboot_info("rate: %lld MB/s", hash_rate);
+		hash_rate = 0;
+	}
 
 	return EFI_SUCCESS;
 }
@@ -117,43 +121,130 @@ static EFI_STATUS report_hash(const CHAR16 *base, const CHAR16 *name, CHAR8 *has
 #define MAX_DIR 10
 #define MAX_FILENAME_LEN (256 * sizeof(CHAR16))
 #define DIR_BUFFER_SIZE (MAX_DIR * MAX_FILENAME_LEN)
+#define ESP_PREFIX L"/bootloader/"
+#define ESP_READ_SIZE (1024 * 1024)
 static CHAR16 *path;
 static CHAR16 *subname[MAX_DIR];
 static INTN subdir;
 
-static EFI_STATUS hash_file(EFI_FILE *dir, EFI_FILE_INFO *fi)
+struct esp_file {
+	CHAR16 *name;		/* Relative to the ESP root, '/' separated */
+	UINT64 size;
+	EFI_TIME mtime;
+	struct esp_file *next;
+};
+
+/* Digests of the ESP files computed by previous oem get-hashes
+ * commands.  Flashing and erasing drop it, see
+ * invalidate_hash_cache(). */
+struct esp_hash {
+	struct esp_file file;
+	const EVP_MD *md;
+	CHAR8 hash[EVP_MAX_MD_SIZE];
+	struct esp_hash *next;
+};
+static struct esp_hash *esp_hash_cache;
+
+static void free_esp_files(struct esp_file *files)
+{
+	struct esp_file *next;
+
+	for (; files; files = next) {
+		next = files->next;
+		FreePool(files->name);
+		FreePool(files);
+	}
+}
+
+void invalidate_hash_cache(void)
+{
+	struct esp_hash *next;
+
+	for (; esp_hash_cache; esp_hash_cache = next) {
+		next = esp_hash_cache->next;
+		FreePool(esp_hash_cache->file.name);
+		FreePool(esp_hash_cache);
+	}
+}
+
+static struct esp_hash *lookup_esp_hash(struct esp_file *file)
+{
+	struct esp_hash *h;
+
+	for (h = esp_hash_cache; h; h = h->next)
+		if (h->md == selected_md && h->file.size == file->size &&
+		    !memcmp(&h->file.mtime, &file->mtime, sizeof(file->mtime)) &&
+		    !StrCmp(h->file.name, file->name))
+			return h;
+
+	return NULL;
+}
+
+static void cache_esp_hash(struct esp_file *file, CHAR8 *hash)
+{
+	struct esp_hash *h;
+
+	h = AllocateZeroPool(sizeof(*h));
+	if (!h)
+		return;
+
+	h->file = *file;
+	h->file.name = StrDuplicate(file->name);
+	if (!h->file.name) {
+		FreePool(h);
+		return;
+	}
+	h->md = selected_md;
+	memcpy(h->hash, hash, hash_len);
+	h->next = esp_hash_cache;
+	esp_hash_cache = h;
+}
+
+static EFI_STATUS hash_file(EFI_FILE *root, struct esp_file *f, void *buffer)
 {
+	EVP_MD_CTX mdctx;
 	EFI_FILE *file;
-	void *data;
+	CHAR16 *name, *p;
 	CHAR8 hash[EVP_MAX_MD_SIZE];
-	EFI_STATUS ret;
+	UINT64 offset;
 	UINTN size;
+	EFI_STATUS ret;
 
-	if (!fi->Size) {
-		hash_buffer(NULL, 0, hash);
-		return report_hash(path, fi->FileName, hash);
-	}
+	name = StrDuplicate(f->name);
+	if (!name)
+		return EFI_OUT_OF_RESOURCES;
+	for (p = name; *p; p++)
+		if (*p == L'/')
+			*p = L'\\';
 
-	ret = uefi_call_wrapper(dir->Open, 5, dir, &file, fi->FileName, EFI_FILE_MODE_READ, 0);
-	if (EFI_ERROR(ret))
+	ret = uefi_call_wrapper(root->Open, 5, root, &file, name, EFI_FILE_MODE_READ, 0);
+	FreePool(name);
+	if (EFI_ERROR(ret)) {
+		efi_perror(ret, L"Cannot open %s", f->name);
 		return ret;
+	}
 
-	size = fi->FileSize;
-
-	data = AllocatePool(size);
-	if (!data)
-		goto close;
+	EVP_MD_CTX_init(&mdctx);
+	EVP_DigestInit_ex(&mdctx, selected_md, NULL);
 
-	ret = uefi_call_wrapper(file->Read, 3, file, &size, data);
-	if (EFI_ERROR(ret))
-		goto free;
+	for (offset = 0; offset < f->size; offset += size) {
+		size = min(f->size - offset, (UINT64)ESP_READ_SIZE);
+		ret = uefi_call_wrapper(file->Read, 3, file, &size, buffer);
+		if (EFI_ERROR(ret))
+			goto out;
+		if (!size) {
+			ret = EFI_END_OF_FILE;
+			goto out;
+		}
+		EVP_DigestUpdate(&mdctx, buffer, size);
+	}
+	EVP_DigestFinal_ex(&mdctx, hash, NULL);
 
-	hash_buffer(data, size, hash);
-	ret = report_hash(path, fi->FileName, hash);
+	cache_esp_hash(f, hash);
+	ret = report_hash(ESP_PREFIX, f->name, hash);
 
-free:
-	FreePool(data);
-close:
+out:
+	EVP_MD_CTX_cleanup(&mdctx);
 	uefi_call_wrapper(file->Close, 1, file);
 	return ret;
 }
@@ -167,7 +258,7 @@ close:
 	path = AllocateZeroPool(DIR_BUFFER_SIZE);
 	if (!path)
 		return;
-	StrCat(path, L"/bootloader/");
+	StrCat(path, ESP_PREFIX);
  }
 
 static void freepath(void)
@@ -206,27 +297,43 @@ static void popdir(void)
 	freepath();
 }
 
-static EFI_STATUS get_esp_hash(void)
+static EFI_STATUS add_esp_file(struct esp_file ***tail, EFI_FILE_INFO *fi)
+{
+	struct esp_file *f;
+
+	if (!path)
+		return EFI_OUT_OF_RESOURCES;
+
+	f = AllocateZeroPool(sizeof(*f));
+	if (!f)
+		return EFI_OUT_OF_RESOURCES;
+
+	f->name = PoolPrint(L"%s%s", path + StrLen(ESP_PREFIX), fi->FileName);
+	if (!f->name) {
+		FreePool(f);
+		return EFI_OUT_OF_RESOURCES;
+	}
+	f->size = fi->FileSize;
+	f->mtime = fi->ModificationTime;
+
+	**tail = f;
+	*tail = &f->next;
+	return EFI_SUCCESS;
+}
+
+/* Walk the ESP and list its files in *FILES. */
+static EFI_STATUS list_esp_files(EFI_FILE *root, struct esp_file **files)
 {
 	EFI_STATUS ret;
-	EFI_FILE_IO_INTERFACE *io;
 	EFI_FILE *dirs[MAX_DIR];
 	CHAR8 buf[sizeof(EFI_FILE_INFO) + MAX_FILENAME_LEN];
 	EFI_FILE_INFO *fi = (EFI_FILE_INFO *) buf;
+	struct esp_file **tail = files;
 	UINTN size = sizeof(buf);
 
-	ret = get_esp_fs(&io);
-	if (EFI_ERROR(ret)) {
-		efi_perror(ret, L"Failed to get partition ESP");
-		return ret;
-	}
-
+	*files = NULL;
 	subdir = 0;
-	ret = uefi_call_wrapper(io->OpenVolume, 2, io, &dirs[subdir]);
-	if (EFI_ERROR(ret)) {
-		efi_perror(ret, L"Failed to open root directory");
-		return ret;
-	}
+	dirs[subdir] = root;
 	initpath();
 	do {
 		size = sizeof(buf);
@@ -239,7 +346,8 @@ static EFI_STATUS get_esp_hash(void)
 		if (!size && subdir >= 0) {
 			/* size is 0 means there are no more files/dir in current directory
 			 * so if we are in a subdir, go back 1 level */
-			uefi_call_wrapper(dirs[subdir]->Close, 1, dirs[subdir]);
+			if (subdir > 0)
+				uefi_call_wrapper(dirs[subdir]->Close, 1, dirs[subdir]);
 			popdir();
 			subdir--;
 			continue;
@@ -264,9 +372,13 @@ static EFI_STATUS get_esp_hash(void)
 				subdir--;
 			}
 		} else {
-			ret = hash_file(dirs[subdir], fi);
+			ret = add_esp_file(&tail, fi);
 			if (EFI_ERROR(ret)) {
+				for (; subdir > 0; subdir--)
+					uefi_call_wrapper(dirs[subdir]->Close, 1, dirs[subdir]);
 				freepath();
+				free_esp_files(*files);
+				*files = NULL;
 				return ret;
 			}
 		}
@@ -274,6 +386,64 @@ static EFI_STATUS get_esp_hash(void)
 	return EFI_SUCCESS;
 }
 
+/* The directory walk is done first so that the files are then read
+ * back to back, with a single read buffer.  Files whose path, size
+ * and modification time did not change since a previous call are not
+ * read again. */
+static EFI_STATUS get_esp_hash(void)
+{
+	EFI_STATUS ret;
+	EFI_FILE_IO_INTERFACE *io;
+	EFI_FILE *root;
+	struct esp_file *files, *f;
+	struct esp_hash *cached;
+	void *buffer = NULL;
+
+	ret = get_esp_fs(&io);
+	if (EFI_ERROR(ret)) {
+		efi_perror(ret, L"Failed to get partition ESP");
+		return ret;
+	}
+
+	ret = uefi_call_wrapper(io->OpenVolume, 2, io, &root);
+	if (EFI_ERROR(ret)) {
+		efi_perror(ret, L"Failed to open root directory");
+		return ret;
+	}
+
+	ret = list_esp_files(root, &files);
+	if (EFI_ERROR(ret))
+		goto close;
+
+	if (!selected_md)
+		set_hash_algorithm(NULL);
+
+	for (f = files; f; f = f->next) {
+		cached = lookup_esp_hash(f);
+		if (cached) {
+			ret = report_hash(ESP_PREFIX, f->name, cached->hash);
+		} else {
+			if (!buffer) {
+				buffer = AllocatePool(ESP_READ_SIZE);
+				if (!buffer) {
+					ret = EFI_OUT_OF_RESOURCES;
+					break;
+				}
+			}
+			ret = hash_file(root, f, buffer);
+		}
+		if (EFI_ERROR(ret))
+			break;
+	}
+
+	if (buffer)
+		FreePool(buffer);
+	free_esp_files(files);
+close:
+	uefi_call_wrapper(root->Close, 1, root);
+	return ret;
+}
+
 EFI_STATUS get_bootloader_hash(__attribute__((__unused__)) const CHAR16 *label)
 {
 	EFI_STATUS ret;
@@ -364,8 +534,13 @@ struct squashfs_super_block {
 
 struct fec_header {
 	UINT32 magic;
+	UINT32 version;
+	UINT32 size;
+	UINT32 roots;
+	UINT32 fec_size;
+	UINT64 inp_size;
 	/* [...] */
-};
+} __attribute__((packed));
 
 #ifndef USE_AVB
 /* adapted from build_verity_tree.cpp */
@@ -425,38 +600,51 @@ static EFI_STATUS read_partition(struct gpt_partition_interface *gparti, UINT64
 	return ret;
 }
 
-#define CHUNK 1024 * 1024
-#define MIN(a, b) ((a < b) ? (a) : (b))
+static void update_hash_rate(UINT64 len, UINT64 start)
+{
+	UINT64 elapsed = boottime_in_usec() - start;
+
+	/* Bytes per microsecond are megabytes per second.  No libgcc
+	 * on ia32: DivU64x32() takes a UINTN divisor. */
+	elapsed = min(elapsed, (UINT64)(UINT32)-1);
+	hash_rate = elapsed ? DivU64x32(len, elapsed, NULL) : 0;
+}
+
 static EFI_STATUS hash_partition(struct gpt_partition_interface *gparti, UINT64 len, CHAR8 *hash)
 {
 	EVP_MD_CTX mdctx;
-	CHAR8 *buffer;
-	UINT64 offset;
-	UINT64 chunklen;
-	EFI_STATUS ret = EFI_INVALID_PARAMETER;
+	struct readahead *ra;
+	void *data;
+	UINTN chunklen;
+	UINT64 start;
+	EFI_STATUS ret;
 
-	buffer = AllocatePool(CHUNK);
-	if (!buffer)
-		return EFI_OUT_OF_RESOURCES;
+	if (!len)
+		return EFI_INVALID_PARAMETER;
 
 	if (!selected_md)
 		set_hash_algorithm(NULL);
 
+	start = boottime_in_usec();
+	ret = readahead_open(&ra, gparti, 0, len, 0);
+	if (EFI_ERROR(ret))
+		return ret;
+
 	EVP_MD_CTX_init(&mdctx);
 	EVP_DigestInit_ex(&mdctx, selected_md, NULL);
 
-	for (offset = 0; offset < len; offset += CHUNK) {
-		chunklen = MIN(len - offset, CHUNK);
-		ret = read_partition(gparti, offset, chunklen, buffer);
-		if (EFI_ERROR(ret))
-			goto free;
-		EVP_DigestUpdate(&mdctx, buffer, chunklen);
-	}
+	while ((ret = readahead_next(ra, &data, &chunklen)) == EFI_SUCCESS)
+		EVP_DigestUpdate(&mdctx, data, chunklen);
+	if (ret != EFI_END_OF_FILE)
+		goto free;
+
 	EVP_DigestFinal_ex(&mdctx, hash, NULL);
+	update_hash_rate(len, start);
+	ret = EFI_SUCCESS;
 
 free:
 	EVP_MD_CTX_cleanup(&mdctx);
-	FreePool(buffer);
+	readahead_close(ra);
 	return ret;
 }
 
@@ -753,6 +941,424 @@ static EFI_STATUS check_fec_header(struct gpt_partition_interface *gparti, UINT6
 }
 #endif
 
+/*
+ * dm-verity hash tree check
+ *
+ * Every data block is hashed with the salt, the digests are packed
+ * into hash blocks which are hashed the same way, level after level,
+ * until a single block remains whose digest is the root.  Only one
+ * hash block per level is kept in memory: data digests are pushed in
+ * level 0 and a full block is hashed and pushed in the level above.
+ */
+
+#define VERITY_MAX_SALT_SIZE 256
+#define VERITY_MAX_LEVELS 8
+#define VERITY_CHUNK_BLOCKS 256
+
+struct hashtree_params {
+	UINT64 data_size;
+	UINT8 salt[VERITY_MAX_SALT_SIZE];
+	UINTN salt_len;
+	UINT8 root[VERITY_HASH_SIZE];
+};
+
+struct hashtree_builder {
+	const struct hashtree_params *params;
+	UINTN levels;
+	UINT8 *level[VERITY_MAX_LEVELS];
+	UINTN count[VERITY_MAX_LEVELS];
+};
+
+static void hashtree_hash_block(struct hashtree_builder *b, const UINT8 *block,
+				UINT8 *digest)
+{
+	sha256_mb(b->params->salt, b->params->salt_len, &block,
+		  VERITY_BLOCK_SIZE, 1, digest);
+}
+
+static void hashtree_add(struct hashtree_builder *b, UINTN lvl, const UINT8 *digest)
+{
+	UINT8 next[VERITY_HASH_SIZE];
+
+	memcpy(b->level[lvl] + b->count[lvl] * VERITY_HASH_SIZE, digest,
+	       VERITY_HASH_SIZE);
+	if (++b->count[lvl] < VERITY_HASHES_PER_BLOCK || lvl == b->levels - 1)
+		return;
+
+	hashtree_hash_block(b, b->level[lvl], next);
+	b->count[lvl] = 0;
+	hashtree_add(b, lvl + 1, next);
+}
+
+static void hashtree_final(struct hashtree_builder *b, UINT8 *root)
+{
+	UINT8 digest[VERITY_HASH_SIZE];
+	UINTN used, lvl;
+
+	for (lvl = 0; lvl < b->levels; lvl++) {
+		if (lvl < b->levels - 1 && !b->count[lvl])
+			continue;
+
+		used = b->count[lvl] * VERITY_HASH_SIZE;
+		memset(b->level[lvl] + used, 0, VERITY_BLOCK_SIZE - used);
+		hashtree_hash_block(b, b->level[lvl], digest);
+		b->count[lvl] = 0;
+
+		if (lvl == b->levels - 1)
+			memcpy(root, digest, VERITY_HASH_SIZE);
+		else
+			hashtree_add(b, lvl + 1, digest);
+	}
+}
+
+static void hashtree_add_blocks(struct hashtree_builder *b, const UINT8 *data,
+				UINTN nb, UINT8 *digests)
+{
+	const UINT8 *blocks[VERITY_CHUNK_BLOCKS];
+	UINTN i;
+
+	for (i = 0; i < nb; i++)
+		blocks[i] = data + i * VERITY_BLOCK_SIZE;
+
+	sha256_mb(b->params->salt, b->params->salt_len, blocks,
+		  VERITY_BLOCK_SIZE, nb, digests);
+	for (i = 0; i < nb; i++)
+		hashtree_add(b, 0, digests + i * VERITY_HASH_SIZE);
+}
+
+static EFI_STATUS compute_hashtree_root(struct gpt_partition_interface *gparti,
+					const struct hashtree_params *params,
+					UINT8 *root)
+{
+	struct hashtree_builder b;
+	struct readahead *ra;
+	UINT8 *buffer, *digests, *data;
+	UINTN i, nb, chunklen;
+	UINT64 nb_blocks, start;
+	EFI_STATUS ret;
+
+	memset(&b, 0, sizeof(b));
+	b.params = params;
+	nb_blocks = DIV_ROUND_UP(params->data_size, VERITY_BLOCK_SIZE);
+	do {
+		nb_blocks = DIV_ROUND_UP(nb_blocks, VERITY_HASHES_PER_BLOCK);
+		b.levels++;
+	} while (nb_blocks > 1 && b.levels < VERITY_MAX_LEVELS);
+	if (nb_blocks > 1)
+		return EFI_UNSUPPORTED;
+
+	/* One block per level and one to zero pad a partial last block */
+	buffer = AllocatePool((b.levels + 1) * VERITY_BLOCK_SIZE);
+	if (!buffer)
+		return EFI_OUT_OF_RESOURCES;
+	digests = AllocatePool(VERITY_CHUNK_BLOCKS * VERITY_HASH_SIZE);
+	if (!digests) {
+		FreePool(buffer);
+		return EFI_OUT_OF_RESOURCES;
+	}
+
+	for (i = 0; i < b.levels; i++)
+		b.level[i] = buffer + (i + 1) * VERITY_BLOCK_SIZE;
+
+	start = boottime_in_usec();
+	ret = readahead_open(&ra, gparti, 0, params->data_size, 0);
+	if (EFI_ERROR(ret))
+		goto out;
+
+	while ((ret = readahead_next(ra, (void **)&data, &chunklen)) == EFI_SUCCESS) {
+		while (chunklen >= VERITY_BLOCK_SIZE) {
+			nb = min(chunklen / VERITY_BLOCK_SIZE,
+				 (UINTN)VERITY_CHUNK_BLOCKS);
+			hashtree_add_blocks(&b, data, nb, digests);
+			data += nb * VERITY_BLOCK_SIZE;
+			chunklen -= nb * VERITY_BLOCK_SIZE;
+		}
+
+		/* Only the last chunk may end with a partial block. */
+		if (chunklen) {
+			memcpy(buffer, data, chunklen);
+			memset(buffer + chunklen, 0, VERITY_BLOCK_SIZE - chunklen);
+			hashtree_add_blocks(&b, buffer, 1, digests);
+		}
+	}
+	readahead_close(ra);
+	if (ret != EFI_END_OF_FILE)
+		goto out;
+
+	hashtree_final(&b, root);
+	update_hash_rate(params->data_size, start);
+	ret = EFI_SUCCESS;
+
+out:
+	FreePool(digests);
+	FreePool(buffer);
+	return ret;
+}
+
+#ifdef USE_AVB
+struct hashtree_lookup {
+	struct hashtree_params *params;
+	EFI_STATUS ret;
+};
+
+static bool get_hashtree_descriptor(const AvbDescriptor *descriptor,
+				    void *user_data)
+{
+	struct hashtree_lookup *lookup = user_data;
+	struct hashtree_params *params = lookup->params;
+	AvbHashtreeDescriptor desc;
+	const UINT8 *salt;
+
+	if (avb_be64toh(descriptor->tag) != AVB_DESCRIPTOR_TAG_HASHTREE)
+		return true;
+
+	if (!avb_hashtree_descriptor_validate_and_byteswap(
+		    (const AvbHashtreeDescriptor *)descriptor, &desc)) {
+		lookup->ret = EFI_COMPROMISED_DATA;
+		return false;
+	}
+
+	desc.hash_algorithm[sizeof(desc.hash_algorithm) - 1] = '\0';
+	if (strcmp(desc.hash_algorithm, (CHAR8 *)"sha256") ||
+	    desc.data_block_size != VERITY_BLOCK_SIZE ||
+	    desc.hash_block_size != VERITY_BLOCK_SIZE ||
+	    desc.salt_len > sizeof(params->salt) ||
+	    desc.root_digest_len != VERITY_HASH_SIZE) {
+		error(L"Unsupported hashtree %a, block size %d/%d",
+		      desc.hash_algorithm, desc.data_block_size,
+		      desc.hash_block_size);
+		lookup->ret = EFI_UNSUPPORTED;
+		return false;
+	}
+
+	salt = (const UINT8 *)descriptor + sizeof(desc) + desc.partition_name_len;
+	params->data_size = desc.image_size;
+	params->salt_len = desc.salt_len;
+	memcpy(params->salt, salt, desc.salt_len);
+	memcpy(params->root, salt + desc.salt_len, VERITY_HASH_SIZE);
+
+	lookup->ret = EFI_SUCCESS;
+	return false;
+}
+
+/* The hashtree descriptor is in the vbmeta blob that avbtool appends
+ * to the partition, located by the footer in its last bytes. */
+static EFI_STATUS get_hashtree_params(struct gpt_partition_interface *gparti,
+				      __attribute__((__unused__)) UINT64 fs_len,
+				      struct hashtree_params *params)
+{
+	struct hashtree_lookup lookup = { params, EFI_NOT_FOUND };
+	AvbVBMetaVerifyResult vbmeta_ret;
+	AvbFooter raw, footer;
+	UINT8 *vbmeta;
+	EFI_STATUS ret;
+
+	ret = read_partition(gparti, part_size(gparti) - AVB_FOOTER_SIZE,
+			     sizeof(raw), &raw);
+	if (EFI_ERROR(ret))
+		return ret;
+
+	if (!avb_footer_validate_and_byteswap(&raw, &footer))
+		return EFI_NOT_FOUND;
+
+	if (footer.vbmeta_size > 64 * 1024)
+		return EFI_COMPROMISED_DATA;
+
+	vbmeta = AllocatePool(footer.vbmeta_size);
+	if (!vbmeta)
+		return EFI_OUT_OF_RESOURCES;
+
+	ret = read_partition(gparti, footer.vbmeta_offset, footer.vbmeta_size,
+			     vbmeta);
+	if (EFI_ERROR(ret))
+		goto out;
+
+	/* The signature, if any, is checked against the trusted key at
+	 * boot time.  Here it only has to be consistent. */
+	vbmeta_ret = avb_vbmeta_image_verify(vbmeta, footer.vbmeta_size,
+					     NULL, NULL);
+	if (vbmeta_ret != AVB_VBMETA_VERIFY_RESULT_OK &&
+	    vbmeta_ret != AVB_VBMETA_VERIFY_RESULT_OK_NOT_SIGNED) {
+		error(L"Invalid vbmeta in %s", gparti->part.name);
+		ret = EFI_COMPROMISED_DATA;
+		goto out;
+	}
+
+	avb_descriptor_foreach(vbmeta, footer.vbmeta_size,
+			       get_hashtree_descriptor, &lookup);
+	ret = lookup.ret;
+
+out:
+	FreePool(vbmeta);
+	return ret;
+}
+#else
+struct verity_metadata_header {
+	UINT32 magic;
+	UINT32 protocol_version;
+	UINT8 signature[256];
+	UINT32 table_length;
+} __attribute__((packed));
+
+static EFI_STATUS hex_to_bytes(const CHAR8 *str, UINT8 *bytes, UINTN length)
+{
+	CHAR8 byte[3] = { 0 };
+	char *end;
+	UINTN i;
+
+	if (strlen(str) != length * 2)
+		return EFI_INVALID_PARAMETER;
+
+	for (i = 0; i < length; i++) {
+		memcpy(byte, str + 2 * i, 2);
+		bytes[i] = strtoul((char *)byte, &end, 16);
+		if (*end)
+			return EFI_INVALID_PARAMETER;
+	}
+
+	return EFI_SUCCESS;
+}
+
+/* The verity table is a dm-verity target line:
+ * <version> <data_dev> <hash_dev> <data_block_size> <hash_block_size>
+ * <num_data_blocks> <hash_start_block> <algorithm> <digest> <salt> */
+static EFI_STATUS parse_verity_table(char *table, struct hashtree_params *params)
+{
+	char *fields[10];
+	char *saveptr, *token;
+	UINTN i = 0;
+	EFI_STATUS ret;
+
+	for (token = strtok_r(table, " \n", &saveptr);
+	     token && i < ARRAY_SIZE(fields);
+	     token = strtok_r(NULL, " \n", &saveptr))
+		fields[i++] = token;
+
+	if (i != ARRAY_SIZE(fields))
+		return EFI_INVALID_PARAMETER;
+
+	if (strtoul(fields[3], NULL, 10) != VERITY_BLOCK_SIZE ||
+	    strtoul(fields[4], NULL, 10) != VERITY_BLOCK_SIZE ||
+	    strcmp((CHAR8 *)fields[7], (CHAR8 *)"sha256")) {
+		error(L"Unsupported verity table %a %a %a", fields[3],
+		      fields[4], fields[7]);
+		return EFI_UNSUPPORTED;
+	}
+
+	params->data_size = strtoull(fields[5], NULL, 10) * VERITY_BLOCK_SIZE;
+
+	ret = hex_to_bytes((CHAR8 *)fields[8], params->root, VERITY_HASH_SIZE);
+	if (EFI_ERROR(ret))
+		return ret;
+
+	/* "-" stands for no salt */
+	params->salt_len = 0;
+	if (!strcmp((CHAR8 *)fields[9], (CHAR8 *)"-"))
+		return EFI_SUCCESS;
+
+	params->salt_len = strlen((CHAR8 *)fields[9]) / 2;
+	if (params->salt_len > sizeof(params->salt))
+		return EFI_UNSUPPORTED;
+
+	return hex_to_bytes((CHAR8 *)fields[9], params->salt, params->salt_len);
+}
+
+/* The verity metadata block is right after the filesystem, at the
+ * end of the partition or before the FEC data depending on the
+ * layout, see check_verity_header(). */
+static EFI_STATUS get_hashtree_params(struct gpt_partition_interface *gparti,
+				      UINT64 fs_len,
+				      struct hashtree_params *params)
+{
+	struct verity_metadata_header *hdr;
+	struct fec_header fec;
+	UINT64 offsets[3];
+	UINTN i, nb_offsets = 0;
+	char *table;
+	EFI_STATUS ret;
+
+	offsets[nb_offsets++] = fs_len;
+	offsets[nb_offsets++] = part_size(gparti) - VERITY_METADATA_SIZE;
+	ret = read_partition(gparti, part_size(gparti) - FEC_BLOCK_SIZE,
+			     sizeof(fec), &fec);
+	if (!EFI_ERROR(ret) && fec.magic == FEC_MAGIC &&
+	    fec.inp_size >= VERITY_METADATA_SIZE)
+		offsets[nb_offsets++] = fec.inp_size - VERITY_METADATA_SIZE;
+
+	hdr = AllocatePool(VERITY_METADATA_SIZE + 1);
+	if (!hdr)
+		return EFI_OUT_OF_RESOURCES;
+
+	ret = EFI_NOT_FOUND;
+	for (i = 0; i < nb_offsets; i++) {
+		if (EFI_ERROR(read_partition(gparti, offsets[i],
+					     VERITY_METADATA_SIZE, hdr)))
+			continue;
+		if (hdr->magic == VERITY_METADATA_MAGIC_NUMBER &&
+		    !hdr->protocol_version)
+			break;
+	}
+	if (i == nb_offsets)
+		goto out;
+
+	if (hdr->table_length > VERITY_METADATA_SIZE - sizeof(*hdr)) {
+		ret = EFI_COMPROMISED_DATA;
+		goto out;
+	}
+
+	table = (char *)(hdr + 1);
+	table[hdr->table_length] = '\0';
+	ret = parse_verity_table(table, params);
+
+out:
+	FreePool(hdr);
+	return ret;
+}
+#endif
+
+static EFI_STATUS check_hashtree(struct gpt_partition_interface *gparti, UINT64 fs_len)
+{
+	struct hashtree_params params;
+	UINT8 root[VERITY_HASH_SIZE];
+	CHAR8 rootstr[VERITY_HASH_SIZE * 2 + 1];
+	EFI_STATUS ret;
+
+	ret = get_hashtree_params(gparti, fs_len, &params);
+	if (EFI_ERROR(ret)) {
+		efi_perror(ret, L"No usable hashtree found in %s", gparti->part.name);
+		return ret;
+	}
+
+	if (!params.data_size || params.data_size > part_size(gparti)) {
+		error(L"Invalid hashtree data size %lld", params.data_size);
+		return EFI_COMPROMISED_DATA;
+	}
+
+	ret = compute_hashtree_root(gparti, &params, root);
+	if (EFI_ERROR(ret)) {
+		efi_perror(ret, L"Failed to compute the %s hashtree", gparti->part.name);
+		return ret;
+	}
+
+	ret = bytes_to_hex_stra(root, sizeof(root), rootstr, sizeof(rootstr));
+	if (EFI_ERROR(ret))
+		return ret;
+
+	fastboot_info("target: /%s", gparti->part.name);
+	fastboot_info("hashtree: %a", rootstr);
+	if (hash_rate) {
+		fastboot_info("rate: %lld MB/s", hash_rate);
+		hash_rate = 0;
+	}
+
+	if (memcmp(root, params.root, sizeof(root))) {
+		error(L"%s hashtree root does not match", gparti->part.name);
+		return EFI_COMPROMISED_DATA;
+	}
+
+	return EFI_SUCCESS;
+}
+
 EFI_STATUS get_fs_hash(const CHAR16 *label)
 {
 	static struct supported_fs {
@@ -788,6 +1394,11 @@ EFI_STATUS get_fs_hash(const CHAR16 *label)
 		return ret;
 	}
 
+	/* The bootloader image has no dm-verity hashtree, it is
+	 * hashed as a whole. */
+	if (hashtree_check && strcmp((CHAR8*)SUPPORTED_FS[i].name, (CHAR8*)"Ias"))
+		return check_hashtree(&gparti, fs_len);
+
 #ifdef USE_AVB
 	if (strcmp((CHAR8*)SUPPORTED_FS[i].name, (CHAR8*)"Ias"))
 		fs_len = part_size(&gparti);
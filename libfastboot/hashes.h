@@ -42,5 +42,7 @@ EFI_STATUS get_boot_image_hash(const CHAR16 *label);
 EFI_STATUS get_bootloader_hash(const CHAR16 *label);
 EFI_STATUS get_fs_hash(const CHAR16 *label);
 EFI_STATUS set_hash_algorithm(const CHAR8 *algo);
+void set_hashtree_check(BOOLEAN enable);
+void invalidate_hash_cache(void);
 
 #endif	/* _HASHES_H_ */
@@ -68,11 +68,6 @@ ifeq ($(KERNELFLINGER_DISABLE_DEBUG_PRINT),true)
     LOCAL_CFLAGS += -D__DISABLE_DEBUG_PRINT
 endif
 
-ifeq ($(KERNELFLINGER_USE_IPP_SHA256),true)
-    LOCAL_CFLAGS += -DUSE_IPP_SHA256
-    LOCAL_CFLAGS += -msse4 -msha
-endif
-
 LOCAL_SRC_FILES := \
 	android.c \
 	efilinux.c \
@@ -101,7 +96,14 @@ LOCAL_SRC_FILES := \
 	qsort.c \
 	rpmb.c \
 	timer.c \
-	nvme.c
+	nvme.c \
+	sha256_ipps.c \
+	sha256_mb.c \
+	readahead.c \
+	trace.c \
+	lz4.c \
+	snappy.c \
+	scrub.c
 ifeq ($(or $(IOC_USE_SLCAN),$(IOC_USE_CBC)),true)
         LOCAL_SRC_FILES += ioc_can.c
 endif
@@ -125,10 +127,6 @@ else
     LOCAL_SRC_FILES += slot.c
 endif
 
-ifeq ($(KERNELFLINGER_USE_IPP_SHA256),true)
-    LOCAL_SRC_FILES += sha256_ipps.c
-endif
-
 ifneq ($(strip $(KERNELFLINGER_USE_UI)),false)
     LOCAL_SRC_FILES += \
 	ui.c \
@@ -136,6 +134,7 @@ ifneq ($(strip $(KERNELFLINGER_USE_UI)),false)
 	ui_font.c \
 	ui_textarea.c \
 	ui_image.c \
+	ui_scale.c \
 	ui_boot_menu.c \
 	ui_confirm.c
 else
@@ -51,7 +51,11 @@
 #endif
 #include "slot.h"
 #include "pae.h"
+#include "scrub.h"
 #include "timer.h"
+#include "trace.h"
+#include "lz4.h"
+#include "readahead.h"
 #ifdef USE_AVB
 #include "avb_init.h"
 #endif
@@ -419,6 +423,14 @@ static inline EFI_STATUS handover_jump(EFI_HANDLE image,
                 return ret;
         }
 
+        /* The timer event draining the log does not survive
+         * ExitBootServices(). */
+        log_set_sync(TRUE);
+        ret = slot_flush();
+        flush_efi_variables();
+        if (EFI_ERROR(ret))
+                return ret;
+
         /* According to UEFI specification 2.4 Chapter 6.4
          * EFI_BOOT_SERVICES.ExitBootServices(), Firmware
          * implementation may choose to do a partial shutdown of the
@@ -487,6 +499,114 @@ UINTN bootimage_size(struct boot_img_hdr *aosp_header)
 }
 
 
+/* Part of a boot image loaded outside of the image buffer. */
+struct placed_range {
+        UINTN offset;           /* Offset in the boot image */
+        UINTN size;
+        EFI_PHYSICAL_ADDRESS addr;
+        UINTN len;              /* Size of the data at ADDR */
+        /* The range is an LZ4 frame, read in the image buffer and
+         * decompressed at ADDR */
+        BOOLEAN compressed;
+};
+
+/* Boot image read by android_image_load_partition() with the kernel
+ * and the ramdisk read directly at their final addresses.  The
+ * corresponding ranges of the image buffer are left uninitialized.
+ * The descriptor is only keyed on the image buffer address: it must
+ * be reset on every load failure and the image must be released with
+ * android_image_free(), otherwise an unrelated image later allocated
+ * at the same address would be taken for the placed one. */
+static struct {
+        VOID *bootimage;
+        struct placed_range kernel;
+        UINT64 kernel_alloc_size;
+        struct placed_range ramdisk;
+} placed;
+
+static BOOLEAN is_placed(VOID *bootimage)
+{
+        return bootimage && placed.bootimage == bootimage;
+}
+
+static void release_placed(void)
+{
+        if (placed.kernel.addr)
+                efree(placed.kernel.addr, placed.kernel_alloc_size);
+        if (placed.ramdisk.addr)
+                efree(placed.ramdisk.addr, placed.ramdisk.len);
+        memset(&placed, 0, sizeof(placed));
+}
+
+void bootimage_segment(VOID *bootimage, UINTN offset, UINTN end,
+                       VOID **data, UINTN *len)
+{
+        struct placed_range *ranges[] = { &placed.kernel, &placed.ramdisk };
+        struct placed_range *r;
+        UINTN i, next = end;
+
+        *data = (UINT8 *)bootimage + offset;
+
+        for (i = 0; is_placed(bootimage) && i < ARRAY_SIZE(ranges); i++) {
+                r = ranges[i];
+                if (!r->size || r->compressed)
+                        continue;
+                if (offset >= r->offset && offset < r->offset + r->size) {
+                        *data = (VOID *)(UINTN)(r->addr + offset - r->offset);
+                        next = min(next, r->offset + r->size);
+                } else if (offset < r->offset)
+                        next = min(next, r->offset);
+        }
+
+        *len = next - offset;
+}
+
+void android_image_free(VOID *bootimage)
+{
+        if (!bootimage)
+                return;
+
+        if (is_placed(bootimage))
+                release_placed();
+        FreePool(bootimage);
+}
+
+/* The kernel payload and the ramdisk may be stored as LZ4 frames.
+ * The kernel setup sectors are never compressed. */
+static BOOLEAN is_lz4(const VOID *data, UINTN len)
+{
+        return len >= sizeof(UINT32) && *(const UINT32 *)data == LZ4_FRAME_MAGIC;
+}
+
+/* Return the decompressed size of a ramdisk stored as an LZ4 frame
+ * recording it, 0 otherwise.  Frames without the size are passed to
+ * the kernel as is. */
+static UINT32 lz4_ramdisk_size(const VOID *data, UINTN len)
+{
+        UINT64 size;
+
+        if (lz4_frame_content_size(data, len, &size) || size > 0xffffffff)
+                return 0;
+        return size;
+}
+
+static EFI_STATUS decompress_lz4(const VOID *src, UINTN len, VOID *dst,
+                                 UINTN dst_size, UINTN *out)
+{
+        struct lz4_frame frame;
+
+        lz4_frame_init(&frame, src, len, dst, dst_size);
+        if (lz4_frame_decompress(&frame, len) != 1) {
+                error(L"Failed to decompress the LZ4 frame");
+                return EFI_INVALID_PARAMETER;
+        }
+
+        if (out)
+                *out = frame.out;
+        return EFI_SUCCESS;
+}
+
+
 struct boot_img_hdr *get_bootimage_header(VOID *bootimage_blob)
 {
         struct boot_img_hdr *hdr;
@@ -501,11 +621,29 @@ struct boot_img_hdr *get_bootimage_header(VOID *bootimage_blob)
 }
 
 
+static EFI_STATUS allocate_ramdisk(struct boot_params *bp, UINT32 rsize,
+                                   EFI_PHYSICAL_ADDRESS *ramdisk_addr)
+{
+        EFI_STATUS ret;
+
+        ret = emalloc(rsize, 0x1000, ramdisk_addr, FALSE);
+        if (EFI_ERROR(ret))
+                return ret;
+
+        if ((UINTN)*ramdisk_addr > bp->hdr.ramdisk_max) {
+                error(L"Ramdisk address is too high!");
+                efree(*ramdisk_addr, rsize);
+                return EFI_OUT_OF_RESOURCES;
+        }
+
+        return EFI_SUCCESS;
+}
+
 static EFI_STATUS setup_ramdisk(UINT8 *bootimage)
 {
         struct boot_img_hdr *aosp_header;
         struct boot_params *bp;
-        UINT32 roffset, rsize;
+        UINT32 roffset, rsize, lz4_size;
         EFI_PHYSICAL_ADDRESS ramdisk_addr;
         EFI_STATUS ret;
 
@@ -520,18 +658,29 @@ static EFI_STATUS setup_ramdisk(UINT8 *bootimage)
                 return EFI_SUCCESS; // no ramdisk, so nothing to do
         }
 
-        bp->hdr.ramdisk_len = rsize;
-        debug(L"ramdisk size %d", rsize);
-        ret = emalloc(rsize, 0x1000, &ramdisk_addr, FALSE);
+        if (is_placed(bootimage)) {
+                debug(L"ramdisk size %d", placed.ramdisk.len);
+                bp->hdr.ramdisk_len = placed.ramdisk.len;
+                bp->hdr.ramdisk_start = (UINT32)placed.ramdisk.addr;
+                return EFI_SUCCESS;
+        }
+
+        lz4_size = lz4_ramdisk_size(bootimage + roffset, rsize);
+        bp->hdr.ramdisk_len = lz4_size ? lz4_size : rsize;
+        debug(L"ramdisk size %d", bp->hdr.ramdisk_len);
+        ret = allocate_ramdisk(bp, bp->hdr.ramdisk_len, &ramdisk_addr);
         if (EFI_ERROR(ret))
                 return ret;
 
-        if ((UINTN)ramdisk_addr > bp->hdr.ramdisk_max) {
-                error(L"Ramdisk address is too high!");
-                efree(ramdisk_addr, rsize);
-                return EFI_OUT_OF_RESOURCES;
-        }
-        memcpy((VOID *)(UINTN)ramdisk_addr, bootimage + roffset, rsize);
+        if (lz4_size) {
+                ret = decompress_lz4(bootimage + roffset, rsize,
+                                     (VOID *)(UINTN)ramdisk_addr, lz4_size, NULL);
+                if (EFI_ERROR(ret)) {
+                        efree(ramdisk_addr, lz4_size);
+                        return ret;
+                }
+        } else
+                memcpy((VOID *)(UINTN)ramdisk_addr, bootimage + roffset, rsize);
         bp->hdr.ramdisk_start = (UINT32)(UINTN)ramdisk_addr;
         return EFI_SUCCESS;
 }
@@ -941,6 +1090,7 @@ static EFI_STATUS setup_command_line(
         char   *serialno = NULL;
         CHAR16 *serialport = NULL;
         CHAR16 *bootreason = NULL;
+        CHAR8 trace_str[128];
 
         EFI_PHYSICAL_ADDRESS cmdline_addr;
         CHAR8 *cmdline;
@@ -1051,6 +1201,14 @@ static EFI_STATUS setup_command_line(
                         goto out;
         }
 
+        trace_summary(trace_str, sizeof(trace_str));
+        if (trace_str[0]) {
+                ret = prepend_command_line(&cmdline16, L"androidboot.kftrace=%a",
+                                           trace_str);
+                if (EFI_ERROR(ret))
+                        goto out;
+        }
+
 #ifndef __SUPPORT_ABL_BOOT
         if ((boot_target == NORMAL_BOOT || boot_target == CHARGER || boot_target == MEMORY) &&
 #else
@@ -1120,6 +1278,25 @@ static void setup_screen_info_from_gop(struct screen_info *pinfo)
         pinfo->lfb_linelength = gop->Mode->Info->PixelsPerScanLine * 4;
 }
 
+static EFI_STATUS allocate_kernel(struct boot_params *buf,
+                                  EFI_PHYSICAL_ADDRESS *kernel_start)
+{
+        EFI_STATUS ret;
+
+        *kernel_start = buf->hdr.pref_address;
+        ret = allocate_pages(AllocateAddress, EfiLoaderData,
+                             EFI_SIZE_TO_PAGES(buf->hdr.init_size), kernel_start);
+        if (!EFI_ERROR(ret))
+                return EFI_SUCCESS;
+
+        /*
+         * We failed to allocate the preferred address, so
+         * just allocate some memory and hope for the best.
+         */
+        return emalloc(buf->hdr.init_size, buf->hdr.kernel_alignment,
+                       kernel_start, FALSE);
+}
+
 static EFI_STATUS handover_kernel(CHAR8 *bootimage, EFI_HANDLE parent_image)
 {
         EFI_PHYSICAL_ADDRESS kernel_start;
@@ -1134,6 +1311,8 @@ static EFI_STATUS handover_kernel(CHAR8 *bootimage, EFI_HANDLE parent_image)
         UINT32 ksize;
         UINT32 koffset;
 
+        TRACE_BEGIN("handover");
+
         aosp_header = (struct boot_img_hdr *)bootimage;
         buf = (struct boot_params *)(bootimage + aosp_header->page_size);
 
@@ -1142,27 +1321,27 @@ static EFI_STATUS handover_kernel(CHAR8 *bootimage, EFI_HANDLE parent_image)
         setup_sectors++; /* Add boot sector */
         setup_size = (UINT32)setup_sectors * 512;
         ksize = aosp_header->kernel_size - setup_size;
-        kernel_start = buf->hdr.pref_address;
         init_size = buf->hdr.init_size;
         buf->hdr.loader_id = 0x1;
         memset(&buf->screen_info, 0x0, sizeof(buf->screen_info));
 
         setup_screen_info_from_gop(&buf->screen_info);
 
-        ret = allocate_pages(AllocateAddress, EfiLoaderData,
-                             EFI_SIZE_TO_PAGES(init_size), &kernel_start);
-        if (EFI_ERROR(ret)) {
-                /*
-                 * We failed to allocate the preferred address, so
-                 * just allocate some memory and hope for the best.
-                 */
-                ret = emalloc(init_size, buf->hdr.kernel_alignment, &kernel_start,
-                              FALSE);
+        if (is_placed(bootimage))
+                kernel_start = placed.kernel.addr;
+        else {
+                ret = allocate_kernel(buf, &kernel_start);
                 if (EFI_ERROR(ret))
                         return ret;
-        }
 
-        memcpy((CHAR8 *)(UINTN)kernel_start, bootimage + koffset + setup_size, ksize);
+                if (is_lz4(bootimage + koffset + setup_size, ksize)) {
+                        ret = decompress_lz4(bootimage + koffset + setup_size, ksize,
+                                             (VOID *)(UINTN)kernel_start, init_size, NULL);
+                        if (EFI_ERROR(ret))
+                                goto out;
+                } else
+                        memcpy((CHAR8 *)(UINTN)kernel_start, bootimage + koffset + setup_size, ksize);
+        }
 
         boot_addr = 0x3fffffff;
         ret = allocate_pages(AllocateMaxAddress, EfiLoaderData,
@@ -1181,6 +1360,8 @@ static EFI_STATUS handover_kernel(CHAR8 *bootimage, EFI_HANDLE parent_image)
         /* Free UI resources. */
         ui_free();
 
+        TRACE_END("handover");
+        trace_save_to_var();
         log_flush_to_var(FALSE);
 
         boot_params = (struct boot_params *)(UINTN)boot_addr;
@@ -1196,7 +1377,210 @@ static EFI_STATUS handover_kernel(CHAR8 *bootimage, EFI_HANDLE parent_image)
 
         free_pages(boot_addr, EFI_SIZE_TO_PAGES(16384));
 out:
-        efree(kernel_start, ksize);
+        if (!is_placed(bootimage))
+                efree(kernel_start, init_size);
+        return ret;
+}
+
+static EFI_STATUS read_partition(struct gpt_partition_interface *gpart,
+                                 UINT64 offset, UINTN len, VOID *data)
+{
+        EFI_STATUS ret;
+
+        if (!len)
+                return EFI_SUCCESS;
+
+        ret = uefi_call_wrapper(gpart->dio->ReadDisk, 5, gpart->dio,
+                                gpart->bio->Media->MediaId,
+                                gpart->part.starting_lba * gpart->bio->Media->BlockSize + offset,
+                                len, data);
+        if (EFI_ERROR(ret))
+                efi_perror(ret, L"ReadDisk");
+
+        return ret;
+}
+
+/* Read the LEN bytes LZ4 frame at OFFSET of the partition into IMAGE
+ * and decompress it to the DST_SIZE bytes of DST as it arrives, while
+ * the next chunks are being read.  Set *OUT to the decompressed
+ * size.
+ *
+ * The frame is decompressed before the boot image signature is
+ * verified: the decoder never reads past the frame nor writes past
+ * DST_SIZE and it fails on any malformed input (see the lz4test host
+ * tool).  The decompressed data is only booted once the image, which
+ * holds the frame in IMAGE, has been verified. */
+static EFI_STATUS load_lz4(struct gpt_partition_interface *gpart,
+                           UINT64 offset, UINTN len, UINT8 *image,
+                           VOID *dst, UINTN dst_size, UINTN *out)
+{
+        struct lz4_frame frame;
+        struct readahead *ra;
+        UINTN done = 0, chunk;
+        VOID *data;
+        EFI_STATUS ret;
+        int status = 0;
+
+        ret = readahead_open(&ra, gpart, offset, len, 0);
+        if (EFI_ERROR(ret))
+                return ret;
+
+        /* The whole range is read even if the frame ends early, it is
+         * part of the signed image. */
+        lz4_frame_init(&frame, image, len, dst, dst_size);
+        for (;;) {
+                ret = readahead_next(ra, &data, &chunk);
+                if (ret == EFI_END_OF_FILE)
+                        break;
+                if (EFI_ERROR(ret))
+                        goto out;
+
+                memcpy(image + done, data, chunk);
+                done += chunk;
+                if (!status)
+                        status = lz4_frame_decompress(&frame, done);
+        }
+
+        if (status != 1) {
+                error(L"Failed to decompress the LZ4 frame");
+                ret = EFI_INVALID_PARAMETER;
+                goto out;
+        }
+
+        *out = frame.out;
+        ret = EFI_SUCCESS;
+out:
+        readahead_close(ra);
+        return ret;
+}
+
+static EFI_STATUS load_range(struct gpt_partition_interface *gpart,
+                             UINT8 *bootimage, struct placed_range *r,
+                             UINTN dst_size)
+{
+        if (r->compressed)
+                return load_lz4(gpart, r->offset, r->size, bootimage + r->offset,
+                                (VOID *)(UINTN)r->addr, dst_size, &r->len);
+
+        r->len = r->size;
+        return read_partition(gpart, r->offset, r->size, (VOID *)(UINTN)r->addr);
+}
+
+/* Read the boot image in the IMG_SIZE bytes BOOTIMAGE buffer except
+ * for the kernel and the ramdisk which are read, or decompressed, at
+ * the addresses they are booted from.  Return EFI_UNSUPPORTED if the
+ * image cannot be loaded this way. */
+static EFI_STATUS load_placed(struct gpt_partition_interface *gpart,
+                              UINT8 *bootimage, UINTN img_size)
+{
+        struct boot_img_hdr *aosp_header = (struct boot_img_hdr *)bootimage;
+        struct boot_params *buf;
+        UINTN page_size, setup_size, kernel_end, roffset;
+        UINT8 head[16];
+        EFI_STATUS ret;
+
+#ifdef __SUPPORT_ABL_BOOT
+        /* The ABL handover copies the kernel to a fixed address and
+         * boots the ramdisk from the image buffer. */
+        return EFI_UNSUPPORTED;
+#endif
+        /* The loader keeps track of a single image. */
+        if (placed.bootimage)
+                return EFI_UNSUPPORTED;
+
+        /* The setup header is in the first two sectors of the kernel */
+        page_size = aosp_header->page_size;
+        if (aosp_header->kernel_size < 2 * 512)
+                return EFI_UNSUPPORTED;
+
+        ret = read_partition(gpart, 0, page_size + 2 * 512, bootimage);
+        if (EFI_ERROR(ret))
+                return ret;
+
+        buf = (struct boot_params *)(bootimage + page_size);
+        if (buf->hdr.signature != 0xAA55 || buf->hdr.header != SETUP_HDR ||
+            buf->hdr.version < 0x20c || !buf->hdr.relocatable_kernel)
+                return EFI_UNSUPPORTED;
+
+        setup_size = ((UINTN)buf->hdr.setup_secs + 1) * 512;
+        if (setup_size > aosp_header->kernel_size)
+                return EFI_UNSUPPORTED;
+
+        ret = read_partition(gpart, page_size + 2 * 512, setup_size - 2 * 512,
+                             bootimage + page_size + 2 * 512);
+        if (EFI_ERROR(ret))
+                return ret;
+
+        placed.kernel.offset = page_size + setup_size;
+        placed.kernel.size = aosp_header->kernel_size - setup_size;
+        placed.kernel_alloc_size = buf->hdr.init_size;
+        if (placed.kernel.size > placed.kernel_alloc_size)
+                goto unsupported;
+        ret = read_partition(gpart, placed.kernel.offset,
+                             min(placed.kernel.size, sizeof(head)), head);
+        if (EFI_ERROR(ret))
+                goto err;
+        placed.kernel.compressed = is_lz4(head, min(placed.kernel.size, sizeof(head)));
+        ret = allocate_kernel(buf, &placed.kernel.addr);
+        if (EFI_ERROR(ret)) {
+                placed.kernel.addr = 0;
+                goto unsupported;
+        }
+
+        roffset = page_size + pagealign(aosp_header, aosp_header->kernel_size);
+        if (aosp_header->ramdisk_size) {
+                placed.ramdisk.offset = roffset;
+                placed.ramdisk.size = aosp_header->ramdisk_size;
+                ret = read_partition(gpart, placed.ramdisk.offset,
+                                     min(placed.ramdisk.size, sizeof(head)), head);
+                if (EFI_ERROR(ret))
+                        goto err;
+                placed.ramdisk.len = lz4_ramdisk_size(head, min(placed.ramdisk.size,
+                                                                sizeof(head)));
+                placed.ramdisk.compressed = placed.ramdisk.len != 0;
+                if (!placed.ramdisk.compressed)
+                        placed.ramdisk.len = placed.ramdisk.size;
+                ret = allocate_ramdisk(buf, placed.ramdisk.len, &placed.ramdisk.addr);
+                if (EFI_ERROR(ret)) {
+                        placed.ramdisk.addr = 0;
+                        goto unsupported;
+                }
+        }
+        placed.bootimage = bootimage;
+
+        debug(L"Reading the %akernel (%d bytes) at 0x%lx",
+              placed.kernel.compressed ? "compressed " : "",
+              placed.kernel.size, placed.kernel.addr);
+        ret = load_range(gpart, bootimage, &placed.kernel, placed.kernel_alloc_size);
+        if (EFI_ERROR(ret))
+                goto err;
+
+        debug(L"Reading the %aramdisk (%d bytes) at 0x%lx",
+              placed.ramdisk.compressed ? "compressed " : "",
+              placed.ramdisk.size, placed.ramdisk.addr);
+        ret = load_range(gpart, bootimage, &placed.ramdisk, placed.ramdisk.len);
+        if (EFI_ERROR(ret))
+                goto err;
+
+        /* The paddings, the second stage and the signature */
+        kernel_end = page_size + aosp_header->kernel_size;
+        ret = read_partition(gpart, kernel_end, roffset - kernel_end,
+                             bootimage + kernel_end);
+        if (EFI_ERROR(ret))
+                goto err;
+
+        roffset += aosp_header->ramdisk_size;
+        ret = read_partition(gpart, roffset, img_size - roffset,
+                             bootimage + roffset);
+        if (EFI_ERROR(ret))
+                goto err;
+
+        return EFI_SUCCESS;
+
+unsupported:
+        ret = EFI_UNSUPPORTED;
+err:
+        release_placed();
         return ret;
 }
 
@@ -1204,13 +1588,11 @@ EFI_STATUS android_image_load_partition(
                 IN const CHAR16 *label,
                 OUT VOID **bootimage_p)
 {
-        UINT32 MediaId;
         UINT32 img_size;
         VOID *bootimage;
         EFI_STATUS ret;
         struct boot_img_hdr aosp_header;
         struct gpt_partition_interface gpart;
-        UINTN partition_start;
 
         *bootimage_p = NULL;
         ret = gpt_get_partition_by_label(label, &gpart, LOGICAL_UNIT_USER);
@@ -1218,17 +1600,11 @@ EFI_STATUS android_image_load_partition(
                 error(L"Partition %s not found", label);
                 return ret;
         }
-        MediaId = gpart.bio->Media->MediaId;
-        partition_start = gpart.part.starting_lba * gpart.bio->Media->BlockSize;
 
         debug(L"Reading boot image header");
-        ret = uefi_call_wrapper(gpart.dio->ReadDisk, 5, gpart.dio, MediaId,
-                                partition_start,
-                                sizeof(aosp_header), &aosp_header);
-        if (EFI_ERROR(ret)) {
-                efi_perror(ret, L"ReadDisk (header)");
+        ret = read_partition(&gpart, 0, sizeof(aosp_header), &aosp_header);
+        if (EFI_ERROR(ret))
                 return ret;
-        }
         if (memcmp(aosp_header.magic, BOOT_MAGIC, BOOT_MAGIC_SIZE)) {
                 error(L"This partition does not appear to contain an Android boot image");
                 return EFI_INVALID_PARAMETER;
@@ -1239,12 +1615,13 @@ EFI_STATUS android_image_load_partition(
         if (!bootimage)
                 return EFI_OUT_OF_RESOURCES;
 
-        debug(L"Reading full boot image (%d bytes)", img_size);
-        ret = uefi_call_wrapper(gpart.dio->ReadDisk, 5, gpart.dio, MediaId, partition_start,
-                                img_size, bootimage);
+        ret = load_placed(&gpart, bootimage, img_size);
+        if (ret == EFI_UNSUPPORTED) {
+                debug(L"Reading full boot image (%d bytes)", img_size);
+                ret = read_partition(&gpart, 0, img_size, bootimage);
+        }
         if (EFI_ERROR(ret)) {
-                efi_perror(ret, L"ReadDisk");
-                FreePool(bootimage);
+                android_image_free(bootimage);
                 return ret;
         }
 
@@ -1478,12 +1855,14 @@ EFI_STATUS android_image_load_partition_avb(
         if (allow_verification_error)
                 flags |= AVB_SLOT_VERIFY_FLAGS_ALLOW_VERIFICATION_ERROR;
 
+        TRACE_BEGIN("avb_verify");
         verify_result = avb_slot_verify(ops,
                         requested_partitions,
                         slot_suffix,
                         flags,
                         AVB_HASHTREE_ERROR_MODE_RESTART,
                         &slot_data);
+        TRACE_END("avb_verify");
 
         debug(L"avb_slot_verify ret %d\n", verify_result);
 
@@ -1573,7 +1952,8 @@ EFI_STATUS android_image_start_buffer(
         ret = handover_kernel(bootimage, parent_image);
         efi_perror(ret, L"handover_kernel");
 
-        efree(buf->hdr.ramdisk_start, buf->hdr.ramdisk_len);
+        if (!is_placed(bootimage))
+                efree(buf->hdr.ramdisk_start, buf->hdr.ramdisk_len);
         buf->hdr.ramdisk_start = 0;
         buf->hdr.ramdisk_len = 0;
 out_cmdline:
@@ -1659,10 +2039,10 @@ EFI_STATUS android_clear_memory()
         UINTN nr_entries, key, entry_sz;
         CHAR8 *mem_entries;
         UINT32 entry_ver;
-        UINTN i;
-        CHAR8 *mem_map;
         EFI_TPL OldTpl;
 
+        memory_scrub_init();
+
         OldTpl = uefi_call_wrapper(BS->RaiseTPL, 1, TPL_NOTIFY);
         mem_entries = (CHAR8 *)LibMemoryMap(&nr_entries, &key, &entry_sz, &entry_ver);
         if (!mem_entries) {
@@ -1671,7 +2051,6 @@ EFI_STATUS android_clear_memory()
         }
 
         sort_memory_map(mem_entries, nr_entries, entry_sz);
-        mem_map = mem_entries;
 
 #ifndef __LP64__
         ret = pae_init(mem_entries, nr_entries, entry_sz);
@@ -1679,39 +2058,14 @@ EFI_STATUS android_clear_memory()
                 goto err;
 #endif
 
-        for (i = 0; i < nr_entries; mem_entries += entry_sz, i++) {
-                EFI_MEMORY_DESCRIPTOR *entry;
-                EFI_PHYSICAL_ADDRESS start;
-                UINT64 map_sz, len;
-                void *buf;
-
-                entry = (EFI_MEMORY_DESCRIPTOR *)mem_entries;
-                if (entry->Type != EfiConventionalMemory)
-                        continue;
-
-                start = entry->PhysicalStart;
-                map_sz = entry->NumberOfPages * EFI_PAGE_SIZE;
-
-                for (; map_sz > 0; map_sz -= len, start += len) {
-                        len = map_sz;
-#ifdef __LP64__
-                        buf = (void *)start;
-#else
-                        ret = pae_map(start, (unsigned char **)&buf, &len);
-                        if (EFI_ERROR(ret))
-                                goto pae_err;
-#endif
-                        uefi_call_wrapper(BS->SetMem, 3, buf, len, 0);
-                }
-        }
+        ret = memory_scrub(mem_entries, nr_entries, entry_sz);
 
 #ifndef __LP64__
-pae_err:
         pae_exit();
 err:
 #endif
         uefi_call_wrapper(BS->RestoreTPL, 1, OldTpl);
-        FreePool((void *)mem_map);
+        FreePool((void *)mem_entries);
         return ret;
 }
 
@@ -1808,6 +2162,7 @@ static EFI_STATUS setup_command_line_abl(
         UINTN abl_cmd_len = 0;
         CHAR8 time_str8[64] = "";
         CHAR16 time_str16[32] = L"";
+        CHAR8 trace_str[128];
 
         if (abl_cmd_line != NULL)
                abl_cmd_len = strlen(abl_cmd_line);
@@ -1923,10 +2278,10 @@ static EFI_STATUS setup_command_line_abl(
                 goto out;
         avb_cmd_len = strlen((const CHAR8 *)slot_data->cmdline);
         /* +256: for extra cmd line */
-        cmdsize = cmdlen + avb_cmd_len + abl_cmd_len + 256;
+        cmdsize = cmdlen + avb_cmd_len + abl_cmd_len + 256 + sizeof(trace_str);
 #else
         /* +256: for extra cmd line */
-        cmdsize = cmdlen + abl_cmd_len + 256;
+        cmdsize = cmdlen + abl_cmd_len + 256 + sizeof(trace_str);
 #endif
         cmdline_addr = (EFI_PHYSICAL_ADDRESS)((UINTN)AllocatePool(cmdsize));
         if (cmdline_addr == 0) {
@@ -1963,6 +2318,10 @@ static EFI_STATUS setup_command_line_abl(
         str_to_stra(time_str8, time_str16, StrLen(time_str16) + 1);
         cmdline_add_item(cmdline, cmdsize, (const CHAR8 *)"androidboot.boottime", time_str8);
 
+        trace_summary(trace_str, sizeof(trace_str));
+        if (trace_str[0])
+                cmdline_add_item(cmdline, cmdsize, (const CHAR8 *)"androidboot.kftrace", trace_str);
+
         buf->hdr.cmd_line_ptr = (UINT32)(UINTN)cmdline;
         ret = EFI_SUCCESS;
 out:
@@ -2033,6 +2392,8 @@ static EFI_STATUS handover_kernel_abl(CHAR8 *bootimage)
         UINT32 ksize;
         UINT32 koffset;
 
+        TRACE_BEGIN("handover");
+
         aosp_header = (struct boot_img_hdr *)bootimage;
         buf = (struct boot_params *)(bootimage + aosp_header->page_size);
 
@@ -2062,6 +2423,7 @@ static EFI_STATUS handover_kernel_abl(CHAR8 *bootimage)
         boot_params->hdr.loader_id = 0xFF;
         boot_params->hdr.load_flags = 1;
 
+        TRACE_END("handover");
         ret = handover_jump_abl(boot_params, kernel_start);
         /* Shouldn't get here */
         efi_perror(ret, L"handover to Linux kernel has failed");
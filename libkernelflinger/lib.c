@@ -65,6 +65,7 @@
 
 #include <efi.h>
 #include <efilib.h>
+#include <immintrin.h>
 
 #include "lib.h"
 #include "vars.h"
@@ -365,14 +366,94 @@ int efi_snprintf(CHAR8 *str, UINTN size, const CHAR8 *format, ...)
 }
 
 
-EFI_STATUS get_efi_variable(const EFI_GUID *guid, CHAR16 *key,
-                UINTN *size_p, VOID **data_p, UINT32 *flags_p)
+/* EFI variables cache.  The boot flow reads the same variables many
+ * times and, on some firmwares, each access is a slow SPI or SMM
+ * round trip.  Variables are kept in memory after their first access,
+ * including the ones which do not exist.  Writes go through to the
+ * firmware unless the write-back mode is enabled, in which case they
+ * are held until flush_efi_variables(). */
+struct efi_var {
+        struct efi_var *next;
+        EFI_GUID guid;
+        CHAR16 *name;
+        BOOLEAN exists;
+        UINT32 flags;
+        UINTN size;
+        VOID *data;
+        /* The firmware copy is outdated, fw_flags are its attributes */
+        BOOLEAN dirty;
+        BOOLEAN fw_exists;
+        UINT32 fw_flags;
+};
+
+static struct efi_var *efi_vars;
+static BOOLEAN efi_vars_write_back;
+
+static struct efi_var *efi_var_lookup(const EFI_GUID *guid, CHAR16 *key)
+{
+        struct efi_var *var;
+
+        for (var = efi_vars; var; var = var->next)
+                if (!memcmp(&var->guid, guid, sizeof(var->guid)) &&
+                    !StrCmp(var->name, key))
+                        return var;
+
+        return NULL;
+}
+
+static struct efi_var *efi_var_new(const EFI_GUID *guid, CHAR16 *key)
+{
+        struct efi_var *var;
+
+        var = AllocateZeroPool(sizeof(*var));
+        if (!var)
+                return NULL;
+
+        var->name = StrDuplicate(key);
+        if (!var->name) {
+                FreePool(var);
+                return NULL;
+        }
+
+        memcpy(&var->guid, guid, sizeof(var->guid));
+        var->next = efi_vars;
+        efi_vars = var;
+        return var;
+}
+
+static void efi_var_drop(struct efi_var *var)
 {
+        struct efi_var **p;
+
+        for (p = &efi_vars; *p; p = &(*p)->next)
+                if (*p == var) {
+                        *p = var->next;
+                        break;
+                }
+
+        if (var->data)
+                FreePool(var->data);
+        FreePool(var->name);
+        FreePool(var);
+}
+
+/* Return the cache entry of KEY, reading it from the firmware on
+ * the first access. */
+static EFI_STATUS efi_var_get(const EFI_GUID *guid, CHAR16 *key,
+                              struct efi_var **var_p)
+{
+        struct efi_var *var;
         VOID *data;
         UINTN size;
         UINT32 flags;
         EFI_STATUS ret;
 
+        var = efi_var_lookup(guid, key);
+        if (var) {
+                *var_p = var;
+                return EFI_SUCCESS;
+        }
+
         size = 1024; /* Arbitrary starting value */
         data = AllocatePool(size);
         if (!data)
@@ -389,15 +470,201 @@ EFI_STATUS get_efi_variable(const EFI_GUID *guid, CHAR16 *key,
                                         &flags, &size, data);
         }
 
-        if (EFI_ERROR(ret)) {
+        if (EFI_ERROR(ret) && ret != EFI_NOT_FOUND)
+                goto err;
+
+        var = efi_var_new(guid, key);
+        if (!var) {
+                ret = EFI_OUT_OF_RESOURCES;
+                goto err;
+        }
+
+        if (ret == EFI_NOT_FOUND || !size) {
                 FreePool(data);
-                return ret;
+                *var_p = var;
+                return EFI_SUCCESS;
         }
 
+        var->exists = var->fw_exists = TRUE;
+        var->flags = var->fw_flags = flags;
+        var->size = size;
+        var->data = data;
+        *var_p = var;
+        return EFI_SUCCESS;
+
+err:
+        FreePool(data);
+        return ret;
+}
+
+static EFI_STATUS efi_var_write(struct efi_var *var)
+{
+        EFI_STATUS ret;
+
+        /* Storage attributes are only applied to a variable when creating the
+         * variable. If a preexisting variable is rewritten with different
+         * attributes, the result is indeterminate and may vary between
+         * implementations. The correct method of changing the attributes of a
+         * variable is to delete the variable and recreate it with different
+         * attributes. */
+        if (var->fw_exists && (!var->exists || var->fw_flags != var->flags)) {
+                ret = uefi_call_wrapper(RT->SetVariable, 5, var->name,
+                                        &var->guid, 0, 0, NULL);
+                if (EFI_ERROR(ret) && ret != EFI_NOT_FOUND) {
+                        efi_perror(ret, L"Couldn't clear EFI variable");
+                        return ret;
+                }
+                var->fw_exists = FALSE;
+        }
+
+        if (var->exists) {
+                ret = uefi_call_wrapper(RT->SetVariable, 5, var->name,
+                                        &var->guid, var->flags,
+                                        var->size, var->data);
+                if (EFI_ERROR(ret))
+                        return ret;
+                var->fw_exists = TRUE;
+                var->fw_flags = var->flags;
+        }
+
+        var->dirty = FALSE;
+        return EFI_SUCCESS;
+}
+
+/* On failure, the firmware state is unknown: the entry is dropped so
+ * that the next access reads it again. */
+static EFI_STATUS efi_var_flush(struct efi_var *var)
+{
+        EFI_STATUS ret;
+
+        if (!var->dirty)
+                return EFI_SUCCESS;
+
+        ret = efi_var_write(var);
+        if (EFI_ERROR(ret))
+                efi_var_drop(var);
+
+        return ret;
+}
+
+static EFI_STATUS efi_var_update(struct efi_var *var, UINTN size,
+                                 VOID *data, UINT32 flags)
+{
+        VOID *copy = NULL;
+
+        if (!size && !var->exists)
+                return EFI_SUCCESS;
+
+        if (size && var->exists && var->flags == flags &&
+            var->size == size && !memcmp(var->data, data, size))
+                return EFI_SUCCESS;
+
+        if (size) {
+                copy = AllocatePool(size);
+                if (!copy)
+                        return EFI_OUT_OF_RESOURCES;
+                memcpy(copy, data, size);
+        }
+
+        if (var->data)
+                FreePool(var->data);
+        var->exists = size != 0;
+        var->flags = flags;
+        var->size = size;
+        var->data = copy;
+        var->dirty = TRUE;
+
+        if (efi_vars_write_back)
+                return EFI_SUCCESS;
+
+        return efi_var_flush(var);
+}
+
+
+void efi_variables_write_back(BOOLEAN enable)
+{
+        if (!enable)
+                flush_efi_variables();
+        efi_vars_write_back = enable;
+}
+
+
+EFI_STATUS flush_efi_variables(void)
+{
+        struct efi_var *var, *next;
+        EFI_STATUS ret, status = EFI_SUCCESS;
+
+        for (var = efi_vars; var; var = next) {
+                next = var->next;
+                if (!var->dirty)
+                        continue;
+                ret = efi_var_write(var);
+                if (EFI_ERROR(ret)) {
+                        efi_perror(ret, L"Failed to write the %s EFI variable",
+                                   var->name);
+                        efi_var_drop(var);
+                        if (!EFI_ERROR(status))
+                                status = ret;
+                }
+        }
+
+        return status;
+}
+
+
+EFI_STATUS flush_efi_variable(const EFI_GUID *guid, CHAR16 *key)
+{
+        struct efi_var *var;
+
+        var = efi_var_lookup(guid, key);
+        if (!var)
+                return EFI_SUCCESS;
+
+        return efi_var_flush(var);
+}
+
+
+EFI_STATUS uncache_efi_variable(const EFI_GUID *guid, CHAR16 *key)
+{
+        struct efi_var *var;
+        EFI_STATUS ret;
+
+        var = efi_var_lookup(guid, key);
+        if (!var)
+                return EFI_SUCCESS;
+
+        ret = efi_var_flush(var);
+        if (EFI_ERROR(ret))
+                return ret;
+
+        efi_var_drop(var);
+        return EFI_SUCCESS;
+}
+
+
+EFI_STATUS get_efi_variable(const EFI_GUID *guid, CHAR16 *key,
+                UINTN *size_p, VOID **data_p, UINT32 *flags_p)
+{
+        struct efi_var *var;
+        VOID *data;
+        EFI_STATUS ret;
+
+        ret = efi_var_get(guid, key, &var);
+        if (EFI_ERROR(ret))
+                return ret;
+
+        if (!var->exists)
+                return EFI_NOT_FOUND;
+
+        data = AllocatePool(var->size);
+        if (!data)
+                return EFI_OUT_OF_RESOURCES;
+        memcpy(data, var->data, var->size);
+
         if (size_p)
-                *size_p = size;
+                *size_p = var->size;
         if (flags_p)
-                *flags_p = flags;
+                *flags_p = var->flags;
         *data_p = data;
 
         return EFI_SUCCESS;
@@ -498,50 +765,34 @@ out:
 
 EFI_STATUS del_efi_variable(const EFI_GUID *guid, CHAR16 *key)
 {
+        struct efi_var *var;
         EFI_STATUS ret;
 
-        ret = uefi_call_wrapper(RT->SetVariable, 5, key, (EFI_GUID *)guid, 0, 0, NULL);
-        if (ret == EFI_NOT_FOUND)
-                return EFI_SUCCESS;
+        ret = efi_var_get(guid, key, &var);
+        if (EFI_ERROR(ret))
+                return ret;
 
-        return ret;
+        return efi_var_update(var, 0, NULL, 0);
 }
 
 
 EFI_STATUS set_efi_variable(const EFI_GUID *guid, CHAR16 *key,
                 UINTN size, VOID *data, BOOLEAN nonvol, BOOLEAN runtime)
 {
+        struct efi_var *var;
         EFI_STATUS ret;
-        UINT32 curflags, flags = EFI_VARIABLE_BOOTSERVICE_ACCESS;
-        UINTN cursize;
-        VOID *curdata;
+        UINT32 flags = EFI_VARIABLE_BOOTSERVICE_ACCESS;
 
         if (nonvol)
                 flags |= EFI_VARIABLE_NON_VOLATILE;
         if (runtime)
                 flags |= EFI_VARIABLE_RUNTIME_ACCESS;
 
-        /* Storage attributes are only applied to a variable when creating the
-         * variable. If a preexisting variable is rewritten with different
-         * attributes, the result is indeterminate and may vary between
-         * implementations. The correct method of changing the attributes of a
-         * variable is to delete the variable and recreate it with different
-         * attributes. */
-        ret = get_efi_variable((EFI_GUID *)guid, key, &cursize, &curdata, &curflags);
-        if (EFI_ERROR(ret) && ret != EFI_NOT_FOUND)
+        ret = efi_var_get(guid, key, &var);
+        if (EFI_ERROR(ret))
                 return ret;
-        if (ret == EFI_SUCCESS)
-                FreePool(curdata);
-        if (ret == EFI_SUCCESS && curflags != flags) {
-                ret = del_efi_variable((EFI_GUID *)guid, key);
-                if (EFI_ERROR(ret)) {
-                        efi_perror(ret, L"Couldn't clear EFI variable");
-                        return ret;
-                }
-        }
 
-        return uefi_call_wrapper(RT->SetVariable, 5, key, (EFI_GUID *)guid, flags,
-                                 size, data);
+        return efi_var_update(var, size, data, flags);
 }
 
 
@@ -869,8 +1120,20 @@ VOID pause(UINTN seconds)
 }
 
 
+static EFI_STATUS (*reset_flush)(void);
+
+void set_reset_flush(EFI_STATUS (*flush)(void))
+{
+        reset_flush = flush;
+}
+
+
 VOID halt_system(VOID)
 {
+        log_set_sync(TRUE);
+        if (reset_flush)
+                reset_flush();
+        flush_efi_variables();
         uefi_call_wrapper(RT->ResetSystem, 4, EfiResetShutdown, EFI_SUCCESS,
                           0, NULL);
         error(L"Failed to halt the device ... looping forever");
@@ -882,6 +1145,7 @@ VOID reboot(CHAR16 *target, EFI_RESET_TYPE type)
 {
         EFI_STATUS ret;
 
+        log_set_sync(TRUE);
         if (target) {
                 ret = set_efi_variable_str(&loader_guid, LOADER_ENTRY_ONESHOT,
                                            TRUE, TRUE, target);
@@ -892,6 +1156,9 @@ VOID reboot(CHAR16 *target, EFI_RESET_TYPE type)
                 }
         }
 
+        if (reset_flush)
+                reset_flush();
+        flush_efi_variables();
         uefi_call_wrapper(RT->ResetSystem, 4, type, EFI_SUCCESS,
                           0, target);
         error(L"Failed to reboot the device ... looping forever");
@@ -923,40 +1190,250 @@ EFI_STATUS alloc_aligned(VOID **free_addr, VOID **aligned_addr,
         return EFI_SUCCESS;
 }
 
-int memcmp(const void *s1, const void *s2, size_t n)
+/*
+ * Memory functions.  They are under every boot image copy and every
+ * UI blit so they are specialized by size: the small sizes use
+ * overlapping word accesses, the mid sizes AVX2 when available and
+ * the large sizes the REP MOVSB/STOSB instructions when the CPU has
+ * the Enhanced REP MOVSB/STOSB (ERMS) feature.
+ */
+#define MEM_SMALL       16
+#define MEM_LARGE       2048
+
+#define AVX2_TARGET     __attribute__((target("avx2")))
+/* Keep the compiler from turning the loops below into calls to the
+ * functions they implement. */
+#define NO_LIBCALL      __attribute__((optimize("no-tree-loop-distribute-patterns")))
+
+typedef UINT16 __attribute__((may_alias, aligned(1))) unaligned_u16;
+typedef UINT32 __attribute__((may_alias, aligned(1))) unaligned_u32;
+typedef UINT64 __attribute__((may_alias, aligned(1))) unaligned_u64;
+
+#define LOAD(type, p)           (*(const type *)(p))
+#define STORE(type, p, v)       (*(type *)(p) = (v))
+
+/* All the loads happen before the stores, the buffers may overlap. */
+static inline void copy_small(UINT8 *d, const UINT8 *s, size_t n)
 {
-        return CompareMem(s1, s2, n);
+        UINT64 head, tail;
+
+        if (n >= 8) {
+                head = LOAD(unaligned_u64, s);
+                tail = LOAD(unaligned_u64, s + n - 8);
+                STORE(unaligned_u64, d, head);
+                STORE(unaligned_u64, d + n - 8, tail);
+        } else if (n >= 4) {
+                head = LOAD(unaligned_u32, s);
+                tail = LOAD(unaligned_u32, s + n - 4);
+                STORE(unaligned_u32, d, head);
+                STORE(unaligned_u32, d + n - 4, tail);
+        } else if (n >= 2) {
+                head = LOAD(unaligned_u16, s);
+                tail = LOAD(unaligned_u16, s + n - 2);
+                STORE(unaligned_u16, d, head);
+                STORE(unaligned_u16, d + n - 2, tail);
+        } else if (n)
+                *d = *s;
 }
 
-void *memset(void *s, int c, size_t n)
+static inline void rep_movsb(UINT8 *d, const UINT8 *s, size_t n)
 {
-        SetMem(s, n, (UINT8)c);
-        return s;
+        asm volatile("rep movsb"
+                     : "+D" (d), "+S" (s), "+c" (n)
+                     :: "memory");
+}
+
+static inline void rep_stosb(UINT8 *d, UINT8 c, size_t n)
+{
+        asm volatile("rep stosb"
+                     : "+D" (d), "+c" (n)
+                     : "a" (c)
+                     : "memory");
+}
+
+/* Forward copies, N >= MEM_SMALL.  They are also correct for
+ * overlapping buffers as long as D is below S: the last bytes are
+ * loaded before the first store. */
+static NO_LIBCALL void copy_forward_words(UINT8 *d, const UINT8 *s, size_t n)
+{
+        UINT64 tail0 = LOAD(unaligned_u64, s + n - 16);
+        UINT64 tail1 = LOAD(unaligned_u64, s + n - 8);
+        size_t i;
+
+        for (i = 0; i + 16 < n; i += 8)
+                STORE(unaligned_u64, d + i, LOAD(unaligned_u64, s + i));
+        STORE(unaligned_u64, d + n - 16, tail0);
+        STORE(unaligned_u64, d + n - 8, tail1);
+}
+
+static AVX2_TARGET NO_LIBCALL void copy_forward_avx2(UINT8 *d, const UINT8 *s, size_t n)
+{
+        __m256i tail = _mm256_loadu_si256((const __m256i *)(s + n - 32));
+        size_t i;
+
+        for (i = 0; i + 32 < n; i += 32)
+                _mm256_storeu_si256((__m256i *)(d + i),
+                                    _mm256_loadu_si256((const __m256i *)(s + i)));
+        _mm256_storeu_si256((__m256i *)(d + n - 32), tail);
+}
+
+/* Backward copies, N >= MEM_SMALL, for overlapping buffers with D
+ * above S. */
+static NO_LIBCALL void copy_backward_words(UINT8 *d, const UINT8 *s, size_t n)
+{
+        UINT64 head0 = LOAD(unaligned_u64, s);
+        UINT64 head1 = LOAD(unaligned_u64, s + 8);
+        size_t i;
+
+        for (i = n; i > 16; i -= 8)
+                STORE(unaligned_u64, d + i - 8, LOAD(unaligned_u64, s + i - 8));
+        STORE(unaligned_u64, d, head0);
+        STORE(unaligned_u64, d + 8, head1);
+}
+
+static AVX2_TARGET NO_LIBCALL void copy_backward_avx2(UINT8 *d, const UINT8 *s, size_t n)
+{
+        __m256i head = _mm256_loadu_si256((const __m256i *)s);
+        size_t i;
+
+        for (i = n; i > 32; i -= 32)
+                _mm256_storeu_si256((__m256i *)(d + i - 32),
+                                    _mm256_loadu_si256((const __m256i *)(s + i - 32)));
+        _mm256_storeu_si256((__m256i *)d, head);
+}
+
+static void copy_forward(UINT8 *d, const UINT8 *s, size_t n)
+{
+        if (n < MEM_SMALL)
+                copy_small(d, s, n);
+        else if (n >= MEM_LARGE && cpu_has_feature(CPU_FEATURE_ERMS))
+                rep_movsb(d, s, n);
+        else if (n >= 32 && cpu_has_feature(CPU_FEATURE_AVX2))
+                copy_forward_avx2(d, s, n);
+        else
+                copy_forward_words(d, s, n);
 }
 
 void *memcpy(void *dest, const void *source, size_t count)
 {
-        CopyMem(dest, source, (UINTN)count);
+        copy_forward(dest, source, count);
         return dest;
 }
 
 void *memmove(void *dst, const void *src, size_t n)
 {
-        size_t offs;
-        ssize_t i;
+        UINT8 *d = dst;
+        const UINT8 *s = src;
+
+        if (d <= s || d >= s + n)
+                copy_forward(d, s, n);
+        else if (n < MEM_SMALL)
+                copy_small(d, s, n);
+        else if (n >= 32 && cpu_has_feature(CPU_FEATURE_AVX2))
+                copy_backward_avx2(d, s, n);
+        else
+                copy_backward_words(d, s, n);
+
+        return dst;
+}
+
+static NO_LIBCALL void set_words(UINT8 *d, UINT64 v, size_t n)
+{
+        size_t i;
 
-        if (src > dst)
-                return memcpy(dst, src, n);
+        for (i = 0; i + 8 < n; i += 8)
+                STORE(unaligned_u64, d + i, v);
+        STORE(unaligned_u64, d + n - 8, v);
+}
 
-        offs = n - (n % sizeof(unsigned long));
+static AVX2_TARGET NO_LIBCALL void set_avx2(UINT8 *d, UINT8 c, size_t n)
+{
+        __m256i v = _mm256_set1_epi8(c);
+        size_t i;
 
-        for (i = (n % sizeof(unsigned long)) - 1; i >= 0; i--)
-                ((UINT8 *)dst)[i + offs] = ((UINT8 *)src)[i + offs];
+        for (i = 0; i + 32 < n; i += 32)
+                _mm256_storeu_si256((__m256i *)(d + i), v);
+        _mm256_storeu_si256((__m256i *)(d + n - 32), v);
+}
 
-        for (i = n / sizeof(unsigned long) - 1; i >= 0; i--)
-                ((unsigned long *)dst)[i] = ((unsigned long *)src)[i];
+void *memset(void *s, int c, size_t n)
+{
+        UINT64 v = (UINT8)c * 0x0101010101010101ULL;
+        UINT8 *d = s;
 
-        return dst;
+        if (n >= 8)
+                ;
+        else if (n >= 4) {
+                STORE(unaligned_u32, d, v);
+                STORE(unaligned_u32, d + n - 4, v);
+                return s;
+        } else {
+                if (n >= 2)
+                        STORE(unaligned_u16, d + n - 2, v);
+                if (n)
+                        *d = c;
+                return s;
+        }
+
+        if (n >= MEM_LARGE && cpu_has_feature(CPU_FEATURE_ERMS))
+                rep_stosb(d, c, n);
+        else if (n >= 32 && cpu_has_feature(CPU_FEATURE_AVX2))
+                set_avx2(d, c, n);
+        else
+                set_words(d, v, n);
+
+        return s;
+}
+
+/* Difference of the first differing bytes of the little-endian
+ * words A and B. */
+static inline int word_diff(UINT64 a, UINT64 b)
+{
+        unsigned shift = __builtin_ctzll(a ^ b) & ~7;
+
+        return (int)((a >> shift) & 0xff) - (int)((b >> shift) & 0xff);
+}
+
+static AVX2_TARGET size_t cmp_avx2(const UINT8 *a, const UINT8 *b, size_t n)
+{
+        UINT32 mask;
+        size_t i;
+
+        for (i = 0; i + 32 <= n; i += 32) {
+                mask = _mm256_movemask_epi8(
+                        _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(a + i)),
+                                          _mm256_loadu_si256((const __m256i *)(b + i))));
+                if (mask != 0xffffffff)
+                        return i + __builtin_ctz(~mask);
+        }
+
+        return i;
+}
+
+int memcmp(const void *s1, const void *s2, size_t n)
+{
+        const UINT8 *a = s1, *b = s2;
+        UINT64 wa, wb;
+        size_t i = 0;
+
+        if (n >= 32 && cpu_has_feature(CPU_FEATURE_AVX2)) {
+                i = cmp_avx2(a, b, n);
+                if (i < n && a[i] != b[i])
+                        return (int)a[i] - (int)b[i];
+        }
+
+        for (; i + 8 <= n; i += 8) {
+                wa = LOAD(unaligned_u64, a + i);
+                wb = LOAD(unaligned_u64, b + i);
+                if (wa != wb)
+                        return word_diff(wa, wb);
+        }
+
+        for (; i < n; i++)
+                if (a[i] != b[i])
+                        return (int)a[i] - (int)b[i];
+
+        return 0;
 }
 
 static int compare_memory_descriptor(const void *a, const void *b)
@@ -1004,25 +1481,106 @@ UINT64 efi_time_to_ctime(EFI_TIME *time)
                 + (time->Minute * 60) + time->Second;
 }
 
-VOID cpuid(UINT32 op, UINT32 reg[4])
+VOID cpuid_count(UINT32 op, UINT32 subop, UINT32 reg[4])
 {
 #if __LP64__
         asm volatile("xchg{q}\t{%%}rbx, %q1\n\t"
                      "cpuid\n\t"
                      "xchg{q}\t{%%}rbx, %q1\n\t"
                      : "=a" (reg[0]), "=&r" (reg[1]), "=c" (reg[2]), "=d" (reg[3])
-                     : "a" (op));
+                     : "a" (op), "c" (subop));
 #else
         asm volatile("pushl %%ebx      \n\t" /* save %ebx */
                      "cpuid            \n\t"
                      "movl %%ebx, %1   \n\t" /* save what cpuid just put in %ebx */
                      "popl %%ebx       \n\t" /* restore the old %ebx */
                      : "=a"(reg[0]), "=r"(reg[1]), "=c"(reg[2]), "=d"(reg[3])
-                     : "a"(op)
+                     : "a"(op), "c"(subop)
                      : "cc");
 #endif
 }
 
+VOID cpuid(UINT32 op, UINT32 reg[4])
+{
+        cpuid_count(op, 0, reg);
+}
+
+#define CPUID1_ECX_SSE41        (1 << 19)
+#define CPUID1_ECX_OSXSAVE      (1 << 27)
+#define CPUID1_ECX_AVX          (1 << 28)
+#define CPUID7_EBX_AVX2         (1 << 5)
+#define CPUID7_EBX_BMI2         (1 << 8)
+#define CPUID7_EBX_ERMS         (1 << 9)
+#define CPUID7_EBX_ADX          (1 << 19)
+#define CPUID7_EBX_SHA          (1 << 29)
+#define XCR0_SSE_AVX_STATE      0x6
+
+static UINT64 xgetbv(UINT32 index)
+{
+        UINT32 eax, edx;
+
+        asm volatile("xgetbv" : "=a" (eax), "=d" (edx) : "c" (index));
+        return ((UINT64)edx << 32) | eax;
+}
+
+/* The firmware may leave CR4.OSXSAVE or the YMM state in XCR0
+ * disabled, in which case AVX instructions fault even though CPUID
+ * advertises them. */
+static BOOLEAN os_has_avx_state(UINT32 cpuid1_ecx)
+{
+        if ((cpuid1_ecx & (CPUID1_ECX_OSXSAVE | CPUID1_ECX_AVX)) !=
+            (CPUID1_ECX_OSXSAVE | CPUID1_ECX_AVX))
+                return FALSE;
+
+        return (xgetbv(0) & XCR0_SSE_AVX_STATE) == XCR0_SSE_AVX_STATE;
+}
+
+BOOLEAN cpu_has_feature(cpu_feature_t feature)
+{
+        static UINT32 features;
+        static BOOLEAN initialized;
+        UINT32 reg[4], max_leaf, leaf1_ecx;
+        BOOLEAN avx;
+
+        if (initialized)
+                return !!(features & (1 << feature));
+
+        cpuid(0, reg);
+        max_leaf = reg[0];
+
+        cpuid(1, reg);
+        leaf1_ecx = reg[2];
+        avx = os_has_avx_state(leaf1_ecx);
+
+        if (leaf1_ecx & CPUID1_ECX_SSE41)
+                features |= 1 << CPU_FEATURE_SSE41;
+
+        if (max_leaf >= 7) {
+                cpuid_count(7, 0, reg);
+                if (avx && (reg[1] & CPUID7_EBX_AVX2))
+                        features |= 1 << CPU_FEATURE_AVX2;
+                if (reg[1] & CPUID7_EBX_BMI2)
+                        features |= 1 << CPU_FEATURE_BMI2;
+                if (reg[1] & CPUID7_EBX_ADX)
+                        features |= 1 << CPU_FEATURE_ADX;
+                if (reg[1] & CPUID7_EBX_SHA)
+                        features |= 1 << CPU_FEATURE_SHA;
+                if (reg[1] & CPUID7_EBX_ERMS)
+                        features |= 1 << CPU_FEATURE_ERMS;
+        }
+
+        initialized = TRUE;
+        return !!(features & (1 << feature));
+}
+
+BOOLEAN cpu_avx_state_enabled(void)
+{
+        UINT32 reg[4];
+
+        cpuid(1, reg);
+        return os_has_avx_state(reg[2]);
+}
+
 EFI_STATUS generate_random_numbers(CHAR8 *data, UINTN size)
 {
 #define RDRAND_SUPPORT (1 << 30)
@@ -29,13 +29,14 @@
  * OF THE POSSIBILITY OF SUCH DAMAGE.
  *
  */
-
 #include <efi.h>
 #include <efilib.h>
 
 #include "log.h"
 #include "lib.h"
 #include "vars.h"
+#include "timer.h"
+#include "uefi_utils.h"
 
 static SERIAL_IO_INTERFACE *serial;
 
@@ -46,19 +47,467 @@ static SERIAL_IO_INTERFACE *serial;
 #define SERIAL_DATA_BITS	8
 #define SERIAL_STOP_BITS	1
 
-#define BUFFER_SIZE 128
-static CHAR16 buf16[BUFFER_SIZE];
-static CHAR8 buf8[BUFFER_SIZE];
+/* Longest formatted message */
+#define LOG_LINE_MAX		256
+/* Longest format string copied in a record */
+#define LOG_INLINE_FMT_MAX	128
 
+/* Records are appended to LOG_BUF and formatted and written to the
+ * serial port later, by a periodic timer event, so that logging does
+ * not stall on the serial port.  LOG_BUF_SIZE can be set at build
+ * time with KERNELFLINGER_LOG_BUF_SIZE. */
+#ifndef LOG_BUF_SIZE
 #define LOG_BUF_SIZE 4096
-static CHAR8 log_buf[LOG_BUF_SIZE];
-static UINTN pos, last_pos;
+#endif
+#if LOG_BUF_SIZE < 2 * LOG_RECORD_MAX_SIZE || LOG_BUF_SIZE % LOG_RECORD_ALIGN
+#error "LOG_BUF_SIZE must be a multiple of 8 holding at least two records"
+#endif
+static UINT8 log_buf[LOG_BUF_SIZE] __attribute__((aligned(LOG_RECORD_ALIGN)));
+
+/* At most the last LOG_VAR_SIZE bytes are saved in the EFI variable */
+#define LOG_VAR_SIZE		4096
+/* 10 ms, in 100 ns units */
+#define LOG_DRAIN_PERIOD	100000
+
+/* Number of bytes ever appended to LOG_BUF, position of the oldest
+ * record still in LOG_BUF and of the next record to write to the
+ * serial port.  The timer event only moves SERIAL_TAIL and the
+ * logging functions only move HEAD and OLDEST so that the event can
+ * interrupt them at any time. */
+static volatile UINT64 head, oldest, serial_tail;
+static volatile BOOLEAN draining;
+static BOOLEAN sync_log;
+static EFI_EVENT drain_event;
+
+#define barrier() asm volatile("" ::: "memory")
+
+#define RECORD_STRIDE(size) ALIGN((UINTN)(size), LOG_RECORD_ALIGN)
+
+/* Location of the format strings referenced by the records */
+static UINT8 *image_base;
+static UINT64 image_size;
+static UINT32 image_id;
+static UINT64 tsc_hz;
+
+static void image_init(void)
+{
+	static BOOLEAN initialized;
+	EFI_LOADED_IMAGE *image;
+	EFI_STATUS ret;
+	UINT8 *base;
+	UINT32 pe, sections, len;
+
+	if (initialized)
+		return;
+	initialized = TRUE;
+
+	tsc_hz = tsc_frequency();
+
+	if (!LibImageHandle)
+		return;
+
+	ret = uefi_call_wrapper(BS->HandleProtocol, 3, LibImageHandle,
+				&LoadedImageProtocol, (VOID **)&image);
+	if (EFI_ERROR(ret))
+		return;
+
+	/* The image is identified by the CRC32 of its PE section
+	 * table which, unlike the optional header, is loaded
+	 * unmodified. */
+	base = image->ImageBase;
+	if (image->ImageSize < 0x40 || base[0] != 'M' || base[1] != 'Z')
+		return;
+	pe = *(UINT32 *)(base + 0x3c);
+	if (pe > image->ImageSize - 24 || memcmp(base + pe, "PE\0\0", 4))
+		return;
+	sections = pe + 24 + *(UINT16 *)(base + pe + 20);
+	len = *(UINT16 *)(base + pe + 6) * 40;
+	if (sections + len > image->ImageSize)
+		return;
+
+	ret = uefi_call_wrapper(BS->CalculateCrc32, 3, base + sections,
+				len, &image_id);
+	if (EFI_ERROR(ret))
+		return;
+
+	image_base = base;
+	image_size = image->ImageSize;
+}
+
+static struct log_record *ring_record(UINT64 pos)
+{
+	return (struct log_record *)(log_buf + pos % LOG_BUF_SIZE);
+}
+
+static UINTN ring_stride(UINT64 pos)
+{
+	return RECORD_STRIDE(ring_record(pos)->size);
+}
+
+struct record_writer {
+	UINT8 *data;
+	UINTN len;
+	UINTN size;
+	BOOLEAN full;
+};
+
+static void put_bytes(struct record_writer *w, const VOID *data, UINTN len)
+{
+	if (w->full || len > w->size - w->len) {
+		w->full = TRUE;
+		return;
+	}
+	memcpy(w->data + w->len, data, len);
+	w->len += len;
+}
+
+static void put_u64(struct record_writer *w, UINT64 value)
+{
+	put_bytes(w, &value, sizeof(value));
+}
+
+/* Store STR16 or STR8 as a NUL terminated ASCII string, truncated to
+ * the space left. */
+static void put_str(struct record_writer *w, const CHAR16 *str16,
+		    const CHAR8 *str8)
+{
+	CHAR16 c;
+
+	if (w->full || w->len == w->size) {
+		w->full = TRUE;
+		return;
+	}
+
+	if (!str16 && !str8)
+		str8 = (CHAR8 *)"(null)";
+
+	for (;;) {
+		c = str16 ? *str16++ : *str8++;
+		if (!c || w->len == w->size - 1)
+			break;
+		w->data[w->len++] = c > 0x7f ? '?' : c;
+	}
+	if (c)
+		w->full = TRUE;
+	w->data[w->len++] = '\0';
+}
+
+/* Characters which do not terminate a conversion specification in
+ * gnu-efi Print() formats, '*' excepted. */
+static BOOLEAN is_modifier(CHAR16 c)
+{
+	return (c >= '0' && c <= '9') || c == '-' || c == ',' ||
+		c == '.' || c == 'l' || c == 'h';
+}
+
+/* Store the arguments the way gnu-efi Print() consumes them. */
+static void put_args(struct record_writer *w, const CHAR16 *fmt,
+		     va_list args)
+{
+	static const UINT8 zero[16];
+	EFI_DEVICE_PATH *path;
+	CHAR16 *str;
+	BOOLEAN lng;
+	VOID *ptr;
+
+	for (; *fmt && !w->full; fmt++) {
+		if (*fmt != '%')
+			continue;
+
+		lng = FALSE;
+		for (fmt++; *fmt == '*' || is_modifier(*fmt); fmt++) {
+			if (*fmt == 'l')
+				lng = TRUE;
+			else if (*fmt == '*')
+				put_u64(w, va_arg(args, UINTN));
+		}
+
+		switch (*fmt) {
+		case '\0':
+			return;
+		case 'd':
+			put_u64(w, lng ? va_arg(args, INT64) :
+				(INT64)va_arg(args, INTN));
+			break;
+		case 'u':
+		case 'x':
+		case 'X':
+			put_u64(w, lng ? va_arg(args, UINT64) :
+				(UINT64)va_arg(args, UINTN));
+			break;
+		case 'c':
+		case 'r':
+			put_u64(w, va_arg(args, UINTN));
+			break;
+		case 'p':
+			put_u64(w, (UINTN)va_arg(args, VOID *));
+			break;
+		case 's':
+			str = va_arg(args, CHAR16 *);
+			put_str(w, str, NULL);
+			break;
+		case 'a':
+			put_str(w, NULL, va_arg(args, CHAR8 *));
+			break;
+		case 'D':
+			path = va_arg(args, EFI_DEVICE_PATH *);
+			str = path ? DevicePathToStr(path) : NULL;
+			put_str(w, str, NULL);
+			if (str)
+				FreePool(str);
+			break;
+		case 'g':
+		case 't':
+			ptr = va_arg(args, VOID *);
+			put_bytes(w, ptr ? ptr : zero, sizeof(zero));
+			break;
+		}
+	}
+}
+
+struct record_reader {
+	const UINT8 *data;
+	UINTN len;
+};
+
+static BOOLEAN get_bytes(struct record_reader *r, VOID *data, UINTN len)
+{
+	if (r->len < len)
+		return FALSE;
+	memcpy(data, r->data, len);
+	r->data += len;
+	r->len -= len;
+	return TRUE;
+}
+
+static const CHAR8 *get_str(struct record_reader *r)
+{
+	const CHAR8 *str = (const CHAR8 *)r->data;
+	UINTN len;
+
+	for (len = 0; len < r->len; len++)
+		if (!str[len]) {
+			r->data += len + 1;
+			r->len -= len + 1;
+			return str;
+		}
+
+	return NULL;
+}
+
+static void serial_write(CHAR8 *buf, UINTN len)
+{
+	EFI_STATUS ret;
+	UINTN n;
+
+	while (len) {
+		n = len;
+		ret = uefi_call_wrapper(serial->Write, 3, serial, &n, buf);
+		/* Drop what cannot be written */
+		if ((EFI_ERROR(ret) && ret != EFI_TIMEOUT) || !n)
+			return;
+		buf += n;
+		len -= n;
+	}
+}
+
+/* Formatted messages are written by LOG_LINE_MAX characters chunks */
+struct log_text {
+	CHAR8 buf[LOG_LINE_MAX];
+	UINTN len;
+	BOOLEAN line_start;
+	UINT64 tsc;
+	UINT64 tsc_hz;
+	void (*flush)(struct log_text *t);
+	/* log_var_to_text() output */
+	CHAR8 *text;
+	UINTN text_len;
+	UINTN text_size;
+	EFI_STATUS status;
+};
+
+static void text_putc(struct log_text *t, CHAR16 c)
+{
+	CHAR16 stamp[32];
+	UINTN i, ns;
+	UINT64 sec;
+
+	if (t->line_start && t->tsc_hz) {
+		t->line_start = FALSE;
+		sec = DivU64x32(ticks_to_ns(t->tsc, t->tsc_hz), 1000000000, &ns);
+		SPrint(stamp, sizeof(stamp), L"[%5ld.%06ld] ",
+		       sec, (UINT64)(ns / 1000));
+		for (i = 0; stamp[i]; i++)
+			text_putc(t, stamp[i]);
+	}
+
+	if (t->len == sizeof(t->buf))
+		t->flush(t);
+
+	t->buf[t->len++] = c > 0x7f ? '?' : c;
+	if (c == '\n')
+		t->line_start = TRUE;
+}
+
+static void text_to_serial(struct log_text *t)
+{
+	serial_write(t->buf, t->len);
+	t->len = 0;
+}
+
+static void text_to_pool(struct log_text *t)
+{
+	UINTN size;
+
+	if (EFI_ERROR(t->status))
+		return;
+
+	/* Keep room for the NUL termination character */
+	if (t->text_len + t->len >= t->text_size) {
+		size = max(t->text_size * 2, t->text_len + t->len + 1);
+		t->text = ReallocatePool(t->text, t->text_size, size);
+		if (!t->text) {
+			t->status = EFI_OUT_OF_RESOURCES;
+			return;
+		}
+		t->text_size = size;
+	}
+
+	memcpy(t->text + t->text_len, t->buf, t->len);
+	t->text_len += t->len;
+	t->len = 0;
+}
+
+static void text_puts(struct log_text *t, const CHAR16 *str)
+{
+	while (*str)
+		text_putc(t, *str++);
+}
+
+/* Format the argument of the conversion SPEC, ending with CONV, in
+ * OUT.  Return FALSE if the record ended before the argument. */
+static BOOLEAN format_arg(struct record_reader *r, CHAR16 *spec, CHAR16 conv,
+			  BOOLEAN lng, CHAR16 *out, UINTN size)
+{
+	union {
+		EFI_GUID guid;
+		EFI_TIME time;
+		UINT64 value;
+	} arg;
+	const CHAR8 *str;
+
+	switch (conv) {
+	case 'd':
+	case 'u':
+	case 'x':
+	case 'X':
+	case 'c':
+	case 'r':
+	case 'p':
+		if (!get_bytes(r, &arg.value, sizeof(arg.value)))
+			return FALSE;
+		if (conv == 'p')
+			SPrint(out, size, spec, (VOID *)(UINTN)arg.value);
+		else if (lng)
+			SPrint(out, size, spec, arg.value);
+		else
+			SPrint(out, size, spec, (UINTN)arg.value);
+		break;
+	case 's':
+	case 'a':
+	case 'D':
+		str = get_str(r);
+		if (!str)
+			return FALSE;
+		SPrint(out, size, spec, str);
+		break;
+	case 'g':
+	case 't':
+		if (!get_bytes(r, &arg, 16))
+			return FALSE;
+		SPrint(out, size, spec, &arg);
+		break;
+	default:
+		SPrint(out, size, spec);
+		break;
+	}
+
+	return TRUE;
+}
+
+static void format_record(struct log_text *t, const struct log_record *rec)
+{
+	struct record_reader r = {
+		.data = (const UINT8 *)(rec + 1),
+		.len = rec->size - sizeof(*rec)
+	};
+	const CHAR16 *fmt16 = NULL;
+	const CHAR8 *fmt8 = NULL;
+	CHAR16 spec[32], out[LOG_RECORD_MAX_SIZE];
+	BOOLEAN lng, missing = FALSE;
+	UINT64 width;
+	UINTN i, n;
+	CHAR16 c;
+
+	if (rec->flags & LOG_RECORD_INLINE_FMT) {
+		fmt8 = get_str(&r);
+		if (!fmt8)
+			return;
+	} else {
+		if (!image_base || rec->fmt >= image_size)
+			return;
+		fmt16 = (const CHAR16 *)(image_base + rec->fmt);
+	}
+	t->tsc = rec->tsc;
+
+#define FMT(i) (fmt8 ? (CHAR16)fmt8[i] : fmt16[i])
+	for (i = 0; (c = FMT(i)); i++) {
+		if (c != '%') {
+			text_putc(t, c);
+			continue;
+		}
+
+		/* Rebuild the conversion specification with the '*'
+		 * widths expanded and the strings stored as ASCII. */
+		spec[0] = '%';
+		n = 1;
+		lng = FALSE;
+		for (i++; (c = FMT(i)) == '*' || is_modifier(c); i++) {
+			if (n >= ARRAY_SIZE(spec) - 22)
+				continue;
+			if (c != '*') {
+				lng = lng || c == 'l';
+				spec[n++] = c;
+			} else if (get_bytes(&r, &width, sizeof(width)))
+				n += SPrint(spec + n, sizeof(spec) - n * sizeof(*spec),
+					    L"%ld", width);
+			else
+				missing = TRUE;
+		}
+		if (!c)
+			break;
+		spec[n++] = c == 's' || c == 'D' ? 'a' : c;
+		spec[n] = '\0';
+
+		if (missing)
+			continue;
+		if (!format_arg(&r, spec, c, lng, out, sizeof(out))) {
+			missing = TRUE;
+			text_puts(t, L"...");
+			continue;
+		}
+		text_puts(t, out);
+	}
+#undef FMT
+}
 
 EFI_STATUS log_flush_to_var(BOOLEAN nonvol)
 {
 	static volatile BOOLEAN running;
+	struct log_var_header *hdr;
 	EFI_STATUS ret;
-	CHAR8 *buf, *cur;
+	UINT64 pos, start, end;
+	UINT8 *buf;
 	UINTN size;
 
 	if (running)
@@ -71,47 +520,235 @@ EFI_STATUS log_flush_to_var(BOOLEAN nonvol)
 		return EFI_SUCCESS;
 #endif
 
-	if (last_pos) {		/* Manage roll-over */
-		size = last_pos < pos ? pos : last_pos;
-
-		cur = buf = AllocatePool(size);
-		if (!buf) {
-			ret = EFI_OUT_OF_RESOURCES;
-			goto out;
-		}
+	/* Keep the latest records which fit in the variable */
+	end = head;
+	size = sizeof(*hdr);
+	for (pos = oldest; pos != end; pos += ring_stride(pos))
+		if (ring_record(pos)->level != LOG_LEVEL_PADDING)
+			size += ring_stride(pos);
+	for (start = oldest; size > LOG_VAR_SIZE; start += ring_stride(start))
+		if (ring_record(start)->level != LOG_LEVEL_PADDING)
+			size -= ring_stride(start);
+
+	buf = AllocatePool(size);
+	if (!buf) {
+		ret = EFI_OUT_OF_RESOURCES;
+		goto out;
+	}
 
-		if (pos < last_pos) {
-			memcpy(buf, log_buf + pos, last_pos - pos);
-			cur += last_pos - pos;
-		}
-		memcpy(cur, log_buf, pos);
-	} else {
-		size = pos;
-		buf = log_buf;
+	hdr = (struct log_var_header *)buf;
+	hdr->magic = LOG_VAR_MAGIC;
+	hdr->version = LOG_VAR_VERSION;
+	hdr->header_size = sizeof(*hdr);
+	hdr->image_id = image_id;
+	hdr->reserved = 0;
+	hdr->tsc_hz = tsc_hz;
+
+	size = sizeof(*hdr);
+	for (pos = start; pos != end; pos += ring_stride(pos)) {
+		if (ring_record(pos)->level == LOG_LEVEL_PADDING)
+			continue;
+		memcpy(buf + size, ring_record(pos), ring_stride(pos));
+		size += ring_stride(pos);
 	}
 
 	ret = set_efi_variable(&loader_guid, LOG_VAR,
 			       size, buf, nonvol, TRUE);
-	if (last_pos)
-		FreePool(buf);
+	FreePool(buf);
+
+	/* The non-volatile log must survive a watchdog reset or a
+	 * power loss: do not leave it to the EFI variables
+	 * write-back.  This also covers the messages logged while
+	 * flush_efi_variables() is walking the variables. */
+	if (!EFI_ERROR(ret) && nonvol)
+		ret = flush_efi_variable(&loader_guid, LOG_VAR);
 
 out:
 	running = FALSE;
 	return ret;
 }
 
-static void log_append_to_buffer(CHAR8 *msg, UINTN length)
+EFI_STATUS log_var_to_text(const VOID *var, UINTN size, CHAR8 **text, UINTN *len)
 {
-	if (length > LOG_BUF_SIZE)
+	const struct log_var_header *hdr = var;
+	const struct log_record *rec;
+	struct log_text t = {
+		.line_start = TRUE,
+		.flush = text_to_pool,
+		.status = EFI_SUCCESS
+	};
+	UINTN pos;
+
+	if (size < sizeof(*hdr) || hdr->magic != LOG_VAR_MAGIC ||
+	    hdr->header_size < sizeof(*hdr) || hdr->header_size > size)
+		return EFI_UNSUPPORTED;
+
+	image_init();
+	if (hdr->version != LOG_VAR_VERSION || !image_base ||
+	    hdr->image_id != image_id)
+		return EFI_INCOMPATIBLE_VERSION;
+
+	t.tsc_hz = hdr->tsc_hz;
+
+	for (pos = hdr->header_size; size - pos >= sizeof(*rec);
+	     pos += RECORD_STRIDE(rec->size)) {
+		rec = (const struct log_record *)((const UINT8 *)var + pos);
+		if (rec->size < sizeof(*rec) || rec->size > size - pos)
+			break;
+		if (rec->level != LOG_LEVEL_PADDING)
+			format_record(&t, rec);
+		if (RECORD_STRIDE(rec->size) >= size - pos)
+			break;
+	}
+	text_to_pool(&t);
+	if (EFI_ERROR(t.status)) {
+		if (t.text)
+			FreePool(t.text);
+		return t.status;
+	}
+	if (!t.text)
+		t.text = AllocateZeroPool(1);
+	else
+		t.text[t.text_len] = '\0';
+	if (!t.text)
+		return EFI_OUT_OF_RESOURCES;
+
+	*text = t.text;
+	*len = t.text_len;
+	return EFI_SUCCESS;
+}
+
+void log_flush_to_serial(void)
+{
+	static UINT64 rec_buf[LOG_RECORD_MAX_SIZE / sizeof(UINT64)];
+	static struct log_text t = {
+		.line_start = TRUE,
+		.flush = text_to_serial
+	};
+	struct log_record *rec = (struct log_record *)rec_buf;
+	UINT64 pos;
+	UINTN off, size;
+
+	/* Either not initialized or interrupting a drain, which is
+	 * going to write what has been appended in the meantime. */
+	if (!serial || draining)
 		return;
 
-	if (pos + length >= LOG_BUF_SIZE) {
-		last_pos = pos;
-		pos = 0;
+	draining = TRUE;
+	t.tsc_hz = tsc_hz;
+	while ((pos = serial_tail) != head) {
+		/* Records overwritten while we were interrupted */
+		if (pos < oldest) {
+			serial_tail = oldest;
+			continue;
+		}
+
+		off = pos % LOG_BUF_SIZE;
+		memcpy(rec, log_buf + off, min(sizeof(*rec), LOG_BUF_SIZE - off));
+		size = rec->size;
+		if (rec->level != LOG_LEVEL_PADDING &&
+		    size >= sizeof(*rec) && size <= LOG_RECORD_MAX_SIZE)
+			memcpy(rec, log_buf + off, size);
+		barrier();
+		if (pos < oldest)
+			continue;
+
+		if (!size || (rec->level != LOG_LEVEL_PADDING &&
+			      (size < sizeof(*rec) || size > LOG_RECORD_MAX_SIZE))) {
+			serial_tail = head;
+			break;
+		}
+
+		serial_tail = pos + RECORD_STRIDE(size);
+		if (rec->level == LOG_LEVEL_PADDING)
+			continue;
+
+		format_record(&t, rec);
+		text_to_serial(&t);
+	}
+	draining = FALSE;
+}
+
+static void log_append_record(const struct log_record *rec)
+{
+	struct log_record *pad;
+	UINTN stride, pad_size = 0;
+
+	/* Records are never split at the end of LOG_BUF */
+	stride = RECORD_STRIDE(rec->size);
+	if (head % LOG_BUF_SIZE + stride > LOG_BUF_SIZE)
+		pad_size = LOG_BUF_SIZE - head % LOG_BUF_SIZE;
+
+	/* Do not overwrite what has not reached the serial port yet */
+	if (head + pad_size + stride - serial_tail > LOG_BUF_SIZE)
+		log_flush_to_serial();
+
+	while (head + pad_size + stride - oldest > LOG_BUF_SIZE)
+		oldest += ring_stride(oldest);
+	barrier();
+
+	if (pad_size) {
+		pad = ring_record(head);
+		pad->size = pad_size;
+		pad->level = LOG_LEVEL_PADDING;
+		barrier();
+		head += pad_size;
 	}
 
-	memcpy(log_buf + pos, msg, length);
-	pos += length;
+	memcpy(ring_record(head), rec, rec->size);
+	barrier();
+	head += stride;
+}
+
+static void EFIAPI log_drain_notify(__attribute__((__unused__)) EFI_EVENT evt,
+				    __attribute__((__unused__)) void *ctx)
+{
+	log_flush_to_serial();
+}
+static void start_drain_event(void)
+{
+	EFI_STATUS ret;
+
+	ret = uefi_call_wrapper(BS->CreateEvent, 5,
+				EVT_TIMER | EVT_NOTIFY_SIGNAL,
+				TPL_CALLBACK,
+				log_drain_notify,
+				NULL,
+				&drain_event);
+	if (EFI_ERROR(ret))
+		goto err;
+
+	ret = uefi_call_wrapper(BS->SetTimer, 3, drain_event,
+				TimerPeriodic, LOG_DRAIN_PERIOD);
+	if (EFI_ERROR(ret)) {
+		uefi_call_wrapper(BS->CloseEvent, 1, drain_event);
+		goto err;
+	}
+	return;
+
+err:
+	/* Log synchronously */
+	drain_event = NULL;
+	sync_log = TRUE;
+}
+
+void log_set_sync(BOOLEAN sync)
+{
+	if (sync == sync_log)
+		return;
+
+	sync_log = sync;
+	if (!sync) {
+		if (serial)
+			start_drain_event();
+		return;
+	}
+
+	if (drain_event) {
+		uefi_call_wrapper(BS->CloseEvent, 1, drain_event);
+		drain_event = NULL;
+	}
+	log_flush_to_serial();
 }
 
 static EFI_STATUS serial_init()
@@ -119,10 +756,15 @@ static EFI_STATUS serial_init()
 	EFI_STATUS ret;
 	EFI_GUID guid = SERIAL_IO_PROTOCOL;
 
+	image_init();
+
 	ret = LibLocateProtocol(&guid, (void **)&serial);
 	if (EFI_ERROR(ret))
 		return ret;
 
+	if (!sync_log)
+		start_drain_event();
+
 	ret = uefi_call_wrapper(serial->SetAttributes, 7, serial,
 				SERIAL_BAUD_RATE, SERIAL_FIFO_DEPTH,
 				SERIAL_TIMEOUT, SERIAL_PARITY,
@@ -137,34 +779,49 @@ static EFI_STATUS serial_init()
 	return EFI_SUCCESS;
 }
 
-void vlog(const CHAR16 *fmt, va_list args)
+void vlog_at(UINT8 level, const CHAR16 *fmt, va_list args)
 {
-	UINTN length;
+	UINT64 buf[LOG_RECORD_MAX_SIZE / sizeof(UINT64)];
+	struct log_record *rec = (struct log_record *)buf;
+	struct record_writer w = {
+		.data = (UINT8 *)buf,
+		.len = sizeof(*rec),
+		.size = sizeof(buf)
+	};
 
 	if (!serial && EFI_ERROR(serial_init()))
 		return;
 
-	length = VSPrint(buf16, sizeof(buf16), (CHAR16 *)fmt, args) + 1;
+	rec->level = level;
+	rec->flags = 0;
+	rec->fmt = 0;
+	rec->tsc = read_tsc();
+
+	if (image_base && (UINT8 *)fmt >= image_base &&
+	    (UINT8 *)fmt < image_base + image_size)
+		rec->fmt = (UINT8 *)fmt - image_base;
+	else {
+		/* Built at run-time, keep a copy */
+		rec->flags |= LOG_RECORD_INLINE_FMT;
+		w.size = w.len + LOG_INLINE_FMT_MAX;
+		put_str(&w, fmt, NULL);
+		w.size = sizeof(buf);
+		w.full = FALSE;
+	}
 
-	if (EFI_ERROR(str_to_stra(buf8, buf16, length)))
-		return;
+	put_args(&w, fmt, args);
+	rec->size = w.len;
+	log_append_record(rec);
 
-	/* Drop the NUL termination character */
-	length--;
-	if (EFI_ERROR(uefi_call_wrapper(serial->Write, 3, serial, &length, buf8)))
-		return;
-
-	log_append_to_buffer(buf8, length);
+	if (sync_log)
+		log_flush_to_serial();
 }
 
-void log(const CHAR16 *fmt, ...)
+void log_at(UINT8 level, const CHAR16 *fmt, ...)
 {
 	va_list args;
 
-	if (!serial && EFI_ERROR(serial_init()))
-		return;
-
 	va_start(args, fmt);
-	vlog(fmt, args);
+	vlog_at(level, fmt, args);
 	va_end(args);
 }
@@ -0,0 +1,397 @@
+/*
+ * Copyright (c) 2017, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer
+ *      in the documentation and/or other materials provided with the
+ *      distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "lz4.h"
+
+#define MIN_MATCH		4
+/* The format requires the last 5 bytes to be literals and the last
+ * match to start 12 bytes before the end at least. */
+#define LAST_LITERALS		5
+#define MF_LIMIT		12
+#define MAX_OFFSET		65535
+
+#define HASH_BITS		12
+
+static inline uint32_t read32(const uint8_t *p)
+{
+	return (uint32_t)p[0] | (uint32_t)p[1] << 8 |
+		(uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline uint32_t hash(uint32_t v)
+{
+	return (v * 2654435761U) >> (32 - HASH_BITS);
+}
+
+static inline void copy_bytes(uint8_t *dst, const uint8_t *src, size_t len)
+{
+	while (len--)
+		*dst++ = *src++;
+}
+
+typedef uint64_t __attribute__((may_alias, aligned(1))) unaligned_u64;
+
+static inline void copy8(uint8_t *dst, const uint8_t *src)
+{
+	*(unaligned_u64 *)dst = *(const unaligned_u64 *)src;
+}
+
+/* Copy LEN bytes by 16 bytes steps: up to WILD_COPY - 1 bytes past
+ * the end of SRC and DST are read and written.  DST may follow SRC by
+ * 8 bytes or more. */
+#define WILD_COPY		16
+
+static inline void wild_copy(uint8_t *dst, const uint8_t *src, size_t len)
+{
+	uint8_t *end = dst + len;
+
+	do {
+		copy8(dst, src);
+		copy8(dst + 8, src + 8);
+		dst += 16;
+		src += 16;
+	} while (dst < end);
+}
+
+/* Write the 15 or more remainder of a length field */
+static uint8_t *put_length(uint8_t *op, const uint8_t *oend, size_t len)
+{
+	for (; len >= 255; len -= 255) {
+		if (op == oend)
+			return NULL;
+		*op++ = 255;
+	}
+	if (op == oend)
+		return NULL;
+	*op++ = len;
+	return op;
+}
+
+static uint8_t *put_sequence(uint8_t *op, const uint8_t *oend,
+			     const uint8_t *literals, size_t literals_len,
+			     size_t offset, size_t match_len)
+{
+	uint8_t *token;
+
+	if (op == oend)
+		return NULL;
+	token = op++;
+	*token = (literals_len < 15 ? literals_len : 15) << 4;
+	if (literals_len >= 15) {
+		op = put_length(op, oend, literals_len - 15);
+		if (!op)
+			return NULL;
+	}
+	if ((size_t)(oend - op) < literals_len)
+		return NULL;
+	copy_bytes(op, literals, literals_len);
+	op += literals_len;
+
+	if (!match_len)
+		return op;
+
+	if (oend - op < 2)
+		return NULL;
+	*op++ = offset;
+	*op++ = offset >> 8;
+	match_len -= MIN_MATCH;
+	*token |= match_len < 15 ? match_len : 15;
+	if (match_len >= 15)
+		op = put_length(op, oend, match_len - 15);
+	return op;
+}
+
+size_t lz4_compress(const void *src, size_t src_len, void *dst, size_t dst_size)
+{
+	uint32_t table[1 << HASH_BITS];
+	const uint8_t *base = src;
+	const uint8_t *ip = base, *anchor = base, *match;
+	const uint8_t *iend = base + src_len;
+	const uint8_t *mflimit = iend - MF_LIMIT;
+	const uint8_t *matchlimit = iend - LAST_LITERALS;
+	uint8_t *op = dst, *oend = op + dst_size;
+	size_t len;
+	uint32_t h;
+
+	for (h = 0; h < (1 << HASH_BITS); h++)
+		table[h] = 0;
+
+	if (src_len >= MF_LIMIT + 1) {
+		for (ip++; ip < mflimit; ) {
+			h = hash(read32(ip));
+			match = base + table[h];
+			table[h] = ip - base;
+			if (ip - match > MAX_OFFSET || read32(match) != read32(ip)) {
+				ip++;
+				continue;
+			}
+
+			/* Extend the match backward then forward */
+			while (ip > anchor && match > base && ip[-1] == match[-1]) {
+				ip--;
+				match--;
+			}
+			for (len = MIN_MATCH; ip + len < matchlimit &&
+				     ip[len] == match[len]; len++)
+				;
+
+			op = put_sequence(op, oend, anchor, ip - anchor,
+					  ip - match, len);
+			if (!op)
+				return 0;
+			ip += len;
+			anchor = ip;
+			if (ip < mflimit)
+				table[hash(read32(ip - 2))] = ip - 2 - base;
+		}
+	}
+
+	op = put_sequence(op, oend, anchor, iend - anchor, 0, 0);
+	if (!op)
+		return 0;
+	return op - (uint8_t *)dst;
+}
+
+/* Read the 15 or more remainder of a length field */
+static int get_length(const uint8_t **ip, const uint8_t *iend, size_t *len)
+{
+	uint8_t b;
+
+	do {
+		if (*ip == iend)
+			return -1;
+		b = *(*ip)++;
+		*len += b;
+	} while (b == 255);
+	return 0;
+}
+
+/* Decompress the block [IP, IEND) at OP.  Matches may reference the
+ * output down to BASE.  Return the end of the output or NULL if the
+ * block is malformed or does not fit before OEND. */
+static uint8_t *decompress_block(const uint8_t *ip, const uint8_t *iend,
+				 uint8_t *op, uint8_t *oend, const uint8_t *base)
+{
+	const uint8_t *match;
+	size_t len, offset;
+	uint8_t token;
+
+	for (;;) {
+		if (ip == iend)
+			return NULL;
+		token = *ip++;
+
+		len = token >> 4;
+		if (len == 15 && get_length(&ip, iend, &len))
+			return NULL;
+		if ((size_t)(iend - ip) < len || (size_t)(oend - op) < len)
+			return NULL;
+		if ((size_t)(iend - ip) >= len + WILD_COPY &&
+		    (size_t)(oend - op) >= len + WILD_COPY)
+			wild_copy(op, ip, len);
+		else
+			copy_bytes(op, ip, len);
+		op += len;
+		ip += len;
+
+		/* The last sequence has no match */
+		if (ip == iend)
+			break;
+
+		if (iend - ip < 2)
+			return NULL;
+		offset = ip[0] | ip[1] << 8;
+		ip += 2;
+		if (!offset || offset > (size_t)(op - base))
+			return NULL;
+		match = op - offset;
+
+		len = token & 15;
+		if (len == 15 && get_length(&ip, iend, &len))
+			return NULL;
+		len += MIN_MATCH;
+		if ((size_t)(oend - op) < len)
+			return NULL;
+		/* The match may overlap the output */
+		if (offset >= 8 && (size_t)(oend - op) >= len + WILD_COPY)
+			wild_copy(op, match, len);
+		else
+			copy_bytes(op, match, len);
+		op += len;
+	}
+
+	return op;
+}
+
+int lz4_decompress(const void *src, size_t src_len, void *dst, size_t *dst_len)
+{
+	uint8_t *end;
+
+	end = decompress_block(src, (const uint8_t *)src + src_len,
+			       dst, (uint8_t *)dst + *dst_len, dst);
+	if (!end)
+		return -1;
+
+	*dst_len = end - (uint8_t *)dst;
+	return 0;
+}
+
+#define FLG_VERSION_MASK	0xc0
+#define FLG_VERSION		0x40
+#define FLG_BLOCK_INDEP		0x20
+#define FLG_BLOCK_CHECKSUM	0x10
+#define FLG_CONTENT_SIZE	0x08
+#define FLG_CONTENT_CHECKSUM	0x04
+#define FLG_RESERVED		0x02
+#define FLG_DICT_ID		0x01
+
+#define BD_RESERVED		0x8f
+
+#define BLOCK_UNCOMPRESSED	0x80000000
+
+static inline uint64_t read64(const uint8_t *p)
+{
+	return read32(p) | (uint64_t)read32(p + 4) << 32;
+}
+
+/* Parse the frame header of the SRC_LEN bytes of SRC.  Return the
+ * header size or 0 if it is not a supported frame header. */
+static size_t parse_header(const uint8_t *src, size_t src_len, uint8_t *flags,
+			   size_t *block_max, uint64_t *content_size)
+{
+	size_t len = 7;
+	uint8_t bd;
+
+	if (src_len < len || read32(src) != LZ4_FRAME_MAGIC)
+		return 0;
+
+	*flags = src[4];
+	bd = src[5];
+	if ((*flags & FLG_VERSION_MASK) != FLG_VERSION ||
+	    (*flags & (FLG_RESERVED | FLG_DICT_ID)) || (bd & BD_RESERVED) ||
+	    (bd >> 4) < 4 || (bd >> 4) > 7)
+		return 0;
+	*block_max = (size_t)1 << (8 + 2 * (bd >> 4));
+
+	*content_size = 0;
+	if (*flags & FLG_CONTENT_SIZE) {
+		len += 8;
+		if (src_len < len)
+			return 0;
+		*content_size = read64(src + 6);
+	}
+
+	/* The header checksum is not verified: the frames are
+	 * authenticated as part of their container. */
+	return len;
+}
+
+int lz4_frame_content_size(const void *src, size_t src_len, uint64_t *size)
+{
+	size_t block_max;
+	uint8_t flags;
+
+	if (!parse_header(src, src_len, &flags, &block_max, size) ||
+	    !(flags & FLG_CONTENT_SIZE))
+		return -1;
+	return 0;
+}
+
+void lz4_frame_init(struct lz4_frame *frame, const void *src, size_t src_len,
+		    void *dst, size_t dst_size)
+{
+	frame->src = src;
+	frame->src_len = src_len;
+	frame->pos = 0;
+	frame->dst = dst;
+	frame->dst_size = dst_size;
+	frame->out = 0;
+	frame->block_max = 0;
+}
+
+int lz4_frame_decompress(struct lz4_frame *frame, size_t avail)
+{
+	const uint8_t *block, *base;
+	uint32_t size;
+	size_t len, trailer;
+	uint8_t *end;
+
+	avail = avail < frame->src_len ? avail : frame->src_len;
+
+	if (!frame->block_max) {
+		frame->pos = parse_header(frame->src, avail, &frame->flags,
+					  &frame->block_max, &frame->content_size);
+		if (!frame->pos)
+			return avail == frame->src_len || avail >= 15 ? -1 : 0;
+	}
+
+	trailer = frame->flags & FLG_BLOCK_CHECKSUM ? 4 : 0;
+	for (;;) {
+		if (avail - frame->pos < 4)
+			return avail == frame->src_len ? -1 : 0;
+		size = read32(frame->src + frame->pos);
+
+		if (!size) {
+			len = 4 + (frame->flags & FLG_CONTENT_CHECKSUM ? 4 : 0);
+			if (avail - frame->pos < len)
+				return avail == frame->src_len ? -1 : 0;
+			frame->pos += len;
+			if ((frame->flags & FLG_CONTENT_SIZE) &&
+			    frame->out != frame->content_size)
+				return -1;
+			return 1;
+		}
+
+		len = size & ~BLOCK_UNCOMPRESSED;
+		if (len > frame->block_max)
+			return -1;
+		if (avail - frame->pos < 4 + len + trailer)
+			return avail == frame->src_len ? -1 : 0;
+
+		block = frame->src + frame->pos + 4;
+		if (size & BLOCK_UNCOMPRESSED) {
+			if (frame->dst_size - frame->out < len)
+				return -1;
+			copy_bytes(frame->dst + frame->out, block, len);
+			end = frame->dst + frame->out + len;
+		} else {
+			base = frame->flags & FLG_BLOCK_INDEP ?
+				frame->dst + frame->out : frame->dst;
+			end = decompress_block(block, block + len,
+					       frame->dst + frame->out,
+					       frame->dst + frame->dst_size, base);
+			if (!end)
+				return -1;
+		}
+
+		frame->out = end - frame->dst;
+		frame->pos += 4 + len + trailer;
+	}
+}
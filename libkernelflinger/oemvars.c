@@ -251,6 +251,9 @@ static EFI_STATUS parse_line(char *line, VOID *context)
 	}
 
 	debug(L"Setting oemvar: %a", var);
+	/* Attributes such as authenticated writes are beyond the
+	 * set_efi_variable() scope. */
+	uncache_efi_variable(&ctx->guid, varname);
 	ret = uefi_call_wrapper(RT->SetVariable, 5, varname,
 				&ctx->guid, attributes,
 				vallen, val);
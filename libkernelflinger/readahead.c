@@ -0,0 +1,246 @@
+/*
+ * Copyright (c) 2017, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer
+ *      in the documentation and/or other materials provided with the
+ *      distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <efi.h>
+#include <efilib.h>
+
+#include "lib.h"
+#include "gpt.h"
+#include "uefi_utils.h"
+#include "readahead.h"
+#include "protocol/DiskIo2.h"
+
+#define READAHEAD_BUFFERS	3
+#define READAHEAD_MIN_CHUNK	(1024 * 1024)
+#define READAHEAD_MAX_CHUNK	(8 * 1024 * 1024)
+
+struct readahead_buffer {
+	UINT8 *data;
+	UINTN len;
+	EFI_DISK_IO2_TOKEN token;
+	BOOLEAN pending;
+	EFI_STATUS status;
+};
+
+struct readahead {
+	EFI_DISK_IO *dio;
+	EFI_DISK_IO2_PROTOCOL *dio2;
+	UINT32 media_id;
+	UINT64 next;		/* Disk offset of the next chunk to queue */
+	UINT64 end;
+	UINTN chunk;
+	/* Chunk N uses buffer N % READAHEAD_BUFFERS */
+	UINTN issued;
+	UINTN consumed;
+	struct readahead_buffer buf[READAHEAD_BUFFERS];
+};
+
+static void queue_read(struct readahead *ra)
+{
+	struct readahead_buffer *b = &ra->buf[ra->issued % READAHEAD_BUFFERS];
+	EFI_STATUS ret;
+
+	b->len = min((UINT64)ra->chunk, ra->end - ra->next);
+	b->pending = FALSE;
+
+	if (ra->dio2) {
+		b->token.TransactionStatus = EFI_SUCCESS;
+		ret = uefi_call_wrapper(ra->dio2->ReadDiskEx, 6, ra->dio2,
+					ra->media_id, ra->next, &b->token,
+					b->len, b->data);
+		if (ret == EFI_SUCCESS) {
+			b->pending = TRUE;
+			goto queued;
+		}
+		/* Some implementations only do blocking I/O */
+		debug(L"Asynchronous read failed: %r, reading synchronously", ret);
+		ra->dio2 = NULL;
+	}
+
+	b->status = uefi_call_wrapper(ra->dio->ReadDisk, 5, ra->dio,
+				      ra->media_id, ra->next, b->len, b->data);
+
+queued:
+	ra->next += b->len;
+	ra->issued++;
+}
+
+static void fill_queue(struct readahead *ra)
+{
+	while (ra->next < ra->end &&
+	       ra->issued < ra->consumed + READAHEAD_BUFFERS)
+		queue_read(ra);
+}
+
+static void wait_read(struct readahead_buffer *b)
+{
+	EFI_STATUS ret;
+	UINTN index;
+
+	if (!b->pending)
+		return;
+
+	ret = uefi_call_wrapper(BS->WaitForEvent, 3, 1, &b->token.Event, &index);
+	b->status = EFI_ERROR(ret) ? ret : b->token.TransactionStatus;
+	b->pending = FALSE;
+}
+
+static UINTN default_chunk(UINT64 len)
+{
+	UINT64 chunk = ALIGN(len / 16, READAHEAD_MIN_CHUNK);
+
+	return min(max(chunk, (UINT64)READAHEAD_MIN_CHUNK),
+		   (UINT64)READAHEAD_MAX_CHUNK);
+}
+
+static void free_buffers(struct readahead *ra)
+{
+	UINTN i;
+
+	for (i = 0; i < READAHEAD_BUFFERS; i++) {
+		if (ra->buf[i].token.Event)
+			uefi_call_wrapper(BS->CloseEvent, 1, ra->buf[i].token.Event);
+		if (ra->buf[i].data)
+			FreePool(ra->buf[i].data);
+	}
+	FreePool(ra);
+}
+
+EFI_STATUS readahead_open(struct readahead **ra_p,
+			  struct gpt_partition_interface *gparti,
+			  UINT64 offset, UINT64 len, UINTN chunk)
+{
+	static EFI_GUID dio2_guid = EFI_DISK_IO2_PROTOCOL_GUID;
+	struct readahead *ra;
+	UINT64 part_off, part_len;
+	EFI_STATUS ret;
+	UINTN i;
+
+	part_off = gparti->part.starting_lba * gparti->bio->Media->BlockSize;
+	part_len = (gparti->part.ending_lba + 1 - gparti->part.starting_lba) *
+		gparti->bio->Media->BlockSize;
+	if (offset > part_len || len > part_len - offset) {
+		debug(L"attempt to read outside of partition %s, (len %lld offset %lld partition len %lld)",
+		      gparti->part.name, len, offset, part_len);
+		return EFI_END_OF_MEDIA;
+	}
+
+	ra = AllocateZeroPool(sizeof(*ra));
+	if (!ra)
+		return EFI_OUT_OF_RESOURCES;
+
+	ra->dio = gparti->dio;
+	ra->media_id = gparti->bio->Media->MediaId;
+	ra->next = part_off + offset;
+	ra->end = ra->next + len;
+
+	ra->chunk = chunk ? ALIGN(chunk, READAHEAD_CHUNK_ALIGN) : default_chunk(len);
+	ra->chunk = min((UINT64)ra->chunk, max(ALIGN(len, READAHEAD_CHUNK_ALIGN),
+					       (UINT64)READAHEAD_CHUNK_ALIGN));
+
+	/* Shrink the chunks rather than fail on a fragmented heap. */
+	for (;;) {
+		for (i = 0; i < READAHEAD_BUFFERS; i++) {
+			ra->buf[i].data = AllocatePool(ra->chunk);
+			if (!ra->buf[i].data)
+				break;
+		}
+		if (i == READAHEAD_BUFFERS)
+			break;
+		while (i--) {
+			FreePool(ra->buf[i].data);
+			ra->buf[i].data = NULL;
+		}
+		if (ra->chunk <= READAHEAD_CHUNK_ALIGN) {
+			FreePool(ra);
+			return EFI_OUT_OF_RESOURCES;
+		}
+		ra->chunk = ALIGN(ra->chunk / 2, READAHEAD_CHUNK_ALIGN);
+	}
+
+	ret = uefi_call_wrapper(BS->HandleProtocol, 3, gparti->handle,
+				&dio2_guid, (VOID **)&ra->dio2);
+	if (EFI_ERROR(ret))
+		ra->dio2 = NULL;
+
+	for (i = 0; ra->dio2 && i < READAHEAD_BUFFERS; i++) {
+		ret = uefi_call_wrapper(BS->CreateEvent, 5, 0, 0, NULL, NULL,
+					&ra->buf[i].token.Event);
+		if (EFI_ERROR(ret)) {
+			efi_perror(ret, L"Failed to create read event");
+			ra->dio2 = NULL;
+		}
+	}
+
+	debug(L"Reading %lld bytes by %d bytes chunks, %a", len, ra->chunk,
+	      ra->dio2 ? "asynchronously" : "synchronously");
+
+	fill_queue(ra);
+	*ra_p = ra;
+	return EFI_SUCCESS;
+}
+
+EFI_STATUS readahead_next(struct readahead *ra, void **data, UINTN *len)
+{
+	struct readahead_buffer *b;
+
+	/* The chunk returned last time is released, reuse its buffer. */
+	fill_queue(ra);
+
+	if (ra->consumed == ra->issued)
+		return EFI_END_OF_FILE;
+
+	b = &ra->buf[ra->consumed % READAHEAD_BUFFERS];
+	ra->consumed++;
+
+	wait_read(b);
+	if (EFI_ERROR(b->status)) {
+		efi_perror(b->status, L"Failed to read the partition");
+		return b->status;
+	}
+
+	*data = b->data;
+	*len = b->len;
+	return EFI_SUCCESS;
+}
+
+void readahead_close(struct readahead *ra)
+{
+	UINTN i;
+
+	if (!ra)
+		return;
+
+	/* The firmware still owns the buffers of the pending reads. */
+	for (i = 0; i < READAHEAD_BUFFERS; i++)
+		wait_read(&ra->buf[i]);
+
+	free_buffers(ra);
+}
@@ -0,0 +1,362 @@
+/*
+ * Copyright (c) 2017, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer
+ *      in the documentation and/or other materials provided with the
+ *      distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <efi.h>
+#include <efilib.h>
+#include <immintrin.h>
+
+#include "lib.h"
+#include "scrub.h"
+#ifndef __LP64__
+#include "pae.h"
+#endif
+#include "protocol/MpService.h"
+
+/* The processors take the memory to clear by chunks of this size,
+ * doubled until there are at most SCRUB_MAX_CHUNKS of them */
+#define SCRUB_CHUNK_SHIFT	26
+#define SCRUB_MAX_CHUNKS	1024
+
+/* Once the boot processor is out of chunks, each application
+ * processor has at most one chunk left to clear.  The boot processor
+ * waits that long for them, in microseconds, before clearing the
+ * unfinished chunks itself. */
+#define SCRUB_AP_WAIT		(1000 * 1000)
+#define SCRUB_AP_POLL		10
+
+/* The MP Services reset the application processors still running
+ * after this many microseconds */
+#define SCRUB_MP_TIMEOUT	(30 * 1000 * 1000)
+
+#ifdef __LP64__
+#define DIRECT_LIMIT		((EFI_PHYSICAL_ADDRESS)-1)
+#else
+/* The application processors do not share the PAE mapping */
+#define DIRECT_LIMIT		((EFI_PHYSICAL_ADDRESS)1 << 32)
+#endif
+
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+typedef void (*clear_t)(unsigned char *buf, UINTN len);
+
+struct scrub_job {
+	CHAR8 *entries;
+	UINTN nr_entries;
+	UINTN entry_sz;
+	BOOLEAN avx2;
+	UINTN chunk_shift;
+	UINTN nr_chunks;
+	/* Index of the next chunk to clear */
+	volatile UINTN next;
+	/* Number of application processors done with the job */
+	volatile UINTN aps_done;
+	volatile BOOLEAN chunk_done[SCRUB_MAX_CHUNKS];
+};
+
+static BOOLEAN parallel = TRUE;
+static EFI_MP_SERVICES_PROTOCOL *mp;
+static EFI_EVENT aps_event;
+static UINTN nr_aps;
+/* The application processors may not be done with the last job, see
+ * aps_available() */
+static BOOLEAN aps_busy;
+static UINTN *failed_cpus;
+
+void memory_scrub_parallel(BOOLEAN enable)
+{
+	parallel = enable;
+}
+
+static void clear_stosb(unsigned char *buf, UINTN len)
+{
+	asm volatile("rep stosb"
+		     : "+D" (buf), "+c" (len)
+		     : "a" (0)
+		     : "memory");
+}
+
+/* Non-temporal stores do not pull the cleared memory into the
+ * caches. */
+static AVX2_TARGET void clear_avx2(unsigned char *buf, UINTN len)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i *p = (__m256i *)buf;
+
+	for (; len >= 4 * sizeof(*p); len -= 4 * sizeof(*p), p += 4) {
+		_mm256_stream_si256(p, zero);
+		_mm256_stream_si256(p + 1, zero);
+		_mm256_stream_si256(p + 2, zero);
+		_mm256_stream_si256(p + 3, zero);
+	}
+	_mm_sfence();
+
+	clear_stosb((unsigned char *)p, len);
+}
+
+static clear_t select_clear(struct scrub_job *job)
+{
+	return job->avx2 && cpu_avx_state_enabled() ? clear_avx2 : clear_stosb;
+}
+
+static EFI_MEMORY_DESCRIPTOR *conventional_entry(struct scrub_job *job, UINTN i)
+{
+	EFI_MEMORY_DESCRIPTOR *entry;
+
+	entry = (EFI_MEMORY_DESCRIPTOR *)(job->entries + i * job->entry_sz);
+	return entry->Type == EfiConventionalMemory ? entry : NULL;
+}
+
+static UINT64 direct_length(EFI_MEMORY_DESCRIPTOR *entry)
+{
+	return min(entry->NumberOfPages * EFI_PAGE_SIZE,
+		   DIRECT_LIMIT - entry->PhysicalStart);
+}
+
+static void init_job(struct scrub_job *job, CHAR8 *entries,
+		     UINTN nr_entries, UINTN entry_sz)
+{
+	EFI_MEMORY_DESCRIPTOR *entry;
+	UINT64 total = 0;
+	UINTN i;
+
+	job->entries = entries;
+	job->nr_entries = nr_entries;
+	job->entry_sz = entry_sz;
+	job->avx2 = cpu_has_feature(CPU_FEATURE_AVX2);
+	job->next = 0;
+	job->aps_done = 0;
+
+	for (i = 0; i < nr_entries; i++) {
+		entry = conventional_entry(job, i);
+		if (entry && entry->PhysicalStart < DIRECT_LIMIT)
+			total += direct_length(entry);
+	}
+
+	job->chunk_shift = SCRUB_CHUNK_SHIFT;
+	while (total > (UINT64)SCRUB_MAX_CHUNKS << job->chunk_shift)
+		job->chunk_shift++;
+	job->nr_chunks = (total + ((UINT64)1 << job->chunk_shift) - 1)
+		>> job->chunk_shift;
+
+	for (i = 0; i < job->nr_chunks; i++)
+		job->chunk_done[i] = FALSE;
+}
+
+/* Clear the INDEX chunk of the directly addressable conventional
+ * memory, the regions being laid end to end. */
+static void clear_chunk(struct scrub_job *job, UINTN index, clear_t clear)
+{
+	UINT64 chunk_start = (UINT64)index << job->chunk_shift;
+	UINT64 chunk_end = chunk_start + ((UINT64)1 << job->chunk_shift);
+	UINT64 pos = 0, start, end;
+	EFI_MEMORY_DESCRIPTOR *entry;
+	EFI_PHYSICAL_ADDRESS addr;
+	UINT64 len;
+	UINTN i;
+
+	for (i = 0; i < job->nr_entries && pos < chunk_end; i++) {
+		entry = conventional_entry(job, i);
+		if (!entry || entry->PhysicalStart >= DIRECT_LIMIT)
+			continue;
+
+		addr = entry->PhysicalStart;
+		len = direct_length(entry);
+
+		start = max(pos, chunk_start);
+		end = min(pos + len, chunk_end);
+		if (start < end)
+			clear((unsigned char *)(UINTN)(addr + start - pos), end - start);
+		pos += len;
+	}
+
+	job->chunk_done[index] = TRUE;
+}
+
+static void scrub_chunks(struct scrub_job *job)
+{
+	clear_t clear = select_clear(job);
+	UINTN index;
+
+	while ((index = __sync_fetch_and_add(&job->next, 1)) < job->nr_chunks)
+		clear_chunk(job, index, clear);
+}
+
+static void EFIAPI scrub_worker(VOID *arg)
+{
+	struct scrub_job *job = arg;
+
+	scrub_chunks(job);
+	__sync_fetch_and_add(&job->aps_done, 1);
+}
+
+/* The MP Services signal the event, from a TPL_NOTIFY timer, once the
+ * application processors are done with a job or have been reset
+ * after SCRUB_MP_TIMEOUT.  Until then, they refuse any other job
+ * with EFI_NOT_READY, and the job structure may still be in use.
+ * The signal of the last job is consumed here, before a new job is
+ * submitted: it cannot be waited for at the end of a job since that
+ * timer does not run if the caller has raised the TPL to
+ * TPL_NOTIFY. */
+static BOOLEAN aps_available(void)
+{
+	UINTN *cpu;
+
+	if (!aps_busy)
+		return TRUE;
+
+	if (uefi_call_wrapper(BS->CheckEvent, 1, aps_event) != EFI_SUCCESS)
+		return FALSE;
+
+	aps_busy = FALSE;
+	if (failed_cpus) {
+		for (cpu = failed_cpus; *cpu != END_OF_CPU_LIST; cpu++)
+			error(L"Processor %d has been reset while clearing memory",
+			      (UINT32)*cpu);
+		FreePool(failed_cpus);
+		failed_cpus = NULL;
+	}
+
+	return TRUE;
+}
+
+#ifndef __LP64__
+static EFI_STATUS clear_above_4G(struct scrub_job *job)
+{
+	clear_t clear = select_clear(job);
+	EFI_MEMORY_DESCRIPTOR *entry;
+	EFI_PHYSICAL_ADDRESS start, end;
+	unsigned char *buf;
+	EFI_STATUS ret;
+	UINT64 len;
+	UINTN i;
+
+	for (i = 0; i < job->nr_entries; i++) {
+		entry = conventional_entry(job, i);
+		if (!entry)
+			continue;
+
+		start = max(entry->PhysicalStart, DIRECT_LIMIT);
+		end = entry->PhysicalStart + entry->NumberOfPages * EFI_PAGE_SIZE;
+		for (; start < end; start += len) {
+			len = end - start;
+			ret = pae_map(start, &buf, &len);
+			if (EFI_ERROR(ret))
+				return ret;
+			clear(buf, len);
+		}
+	}
+
+	return EFI_SUCCESS;
+}
+#endif
+
+void memory_scrub_init(void)
+{
+	static EFI_GUID mp_guid = EFI_MP_SERVICES_PROTOCOL_GUID;
+	EFI_MP_SERVICES_PROTOCOL *protocol;
+	UINTN nr_cpus, nr_enabled;
+	EFI_STATUS ret;
+
+	if (mp)
+		return;
+
+	ret = uefi_call_wrapper(BS->LocateProtocol, 3, &mp_guid,
+				NULL, (VOID **)&protocol);
+	if (EFI_ERROR(ret))
+		return;
+
+	ret = uefi_call_wrapper(protocol->GetNumberOfProcessors, 3, protocol,
+				&nr_cpus, &nr_enabled);
+	if (EFI_ERROR(ret)) {
+		efi_perror(ret, L"Failed to get the number of processors");
+		return;
+	}
+	if (nr_enabled < 2)
+		return;
+
+	ret = uefi_call_wrapper(BS->CreateEvent, 5, 0, 0, NULL, NULL,
+				&aps_event);
+	if (EFI_ERROR(ret)) {
+		efi_perror(ret, L"Failed to create the processors event");
+		return;
+	}
+
+	nr_aps = nr_enabled - 1;
+	mp = protocol;
+}
+
+EFI_STATUS memory_scrub(CHAR8 *entries, UINTN nr_entries, UINTN entry_sz)
+{
+	/* The application processors may outlive a call if they do
+	 * not finish in time */
+	static struct scrub_job aps_job;
+	struct scrub_job bsp_job, *job = &bsp_job;
+	BOOLEAN aps_started = FALSE;
+	EFI_STATUS ret;
+	UINTN i, waited;
+
+	if (parallel && mp && aps_available())
+		job = &aps_job;
+	init_job(job, entries, nr_entries, entry_sz);
+
+	/* The application processors run in non-blocking mode so that
+	 * this processor clears memory along with them. */
+	if (job == &aps_job) {
+		ret = uefi_call_wrapper(mp->StartupAllAPs, 7, mp,
+					scrub_worker, FALSE, aps_event,
+					SCRUB_MP_TIMEOUT, job, &failed_cpus);
+		if (!EFI_ERROR(ret))
+			aps_busy = aps_started = TRUE;
+		else if (ret != EFI_NOT_STARTED && ret != EFI_NOT_READY)
+			efi_perror(ret, L"Failed to start the application processors");
+	}
+
+	scrub_chunks(job);
+
+	if (aps_started) {
+		for (waited = 0; job->aps_done < nr_aps && waited < SCRUB_AP_WAIT;
+		     waited += SCRUB_AP_POLL)
+			uefi_call_wrapper(BS->Stall, 1, SCRUB_AP_POLL);
+		if (job->aps_done < nr_aps)
+			error(L"%d processors did not finish clearing memory",
+			      (UINT32)(nr_aps - job->aps_done));
+
+		/* Chunks an application processor was stuck on */
+		for (i = 0; i < job->nr_chunks; i++)
+			if (!job->chunk_done[i])
+				clear_chunk(job, i, select_clear(job));
+	}
+
+#ifndef __LP64__
+	return clear_above_4G(job);
+#else
+	return EFI_SUCCESS;
+#endif
+}
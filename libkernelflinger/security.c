@@ -51,9 +51,7 @@
 #define SETUP_MODE_VAR	        L"SetupMode"
 #define SECURE_BOOT_VAR         L"SecureBoot"
 
-#ifdef USE_IPP_SHA256
 #include "sha256_ipps.h"
-#endif
 
 /* OsSecureBoot is *not* a standard EFI_GLOBAL variable
  *
@@ -152,6 +150,18 @@ static EFI_STATUS get_hash_buffer(UINTN nid, VOID **hash, UINTN *hashsz)
 
 
 
+/* Feed the IMGSIZE bytes of BOOTIMAGE to UPDATE, one contiguous
+ * segment at a time. */
+#define update_bootimage(update, ctx, bootimage, imgsize) do {          \
+                VOID *data;                                             \
+                UINTN offset, len;                                      \
+                for (offset = 0; offset < (imgsize); offset += len) {   \
+                        bootimage_segment(bootimage, offset, imgsize,   \
+                                          &data, &len);                 \
+                        update(ctx, data, len);                         \
+                }                                                       \
+        } while (0)
+
 static EFI_STATUS hash_bootimage(struct boot_signature *bs,
                 VOID *bootimage, UINTN imgsize, void **hash, UINTN *hashsz)
 {
@@ -171,7 +181,7 @@ static EFI_STATUS hash_bootimage(struct boot_signature *bs,
                 if (1 != SHA1_Init(&sha_ctx))
                         break;
 
-                SHA1_Update(&sha_ctx, bootimage, imgsize);
+                update_bootimage(SHA1_Update, &sha_ctx, bootimage, imgsize);
                 SHA1_Update(&sha_ctx, bs->attributes.data,
                                 bs->attributes.data_sz);
                 SHA1_Final(*hash, &sha_ctx);
@@ -180,25 +190,24 @@ static EFI_STATUS hash_bootimage(struct boot_signature *bs,
                 return EFI_SUCCESS;
         }
         case NID_sha256WithRSAEncryption:
-#ifdef USE_IPP_SHA256
-        {
-                SHA256_IPPS_CTX ctx;
-
-                ippsSHA256_Init(&ctx);
-                ippsSHA256_Update(&ctx, bootimage, imgsize);
-                ippsSHA256_Update(&ctx, (uint8_t *)bs->attributes.data,
-                                    bs->attributes.data_sz);
-                ippsSHA256_Final(&ctx, (uint32_t *)*hash);
-                return EFI_SUCCESS;
-        }
-#else
         {
                 SHA256_CTX sha_ctx;
+                SHA256_IPPS_CTX ipps_ctx;
+
+                if (ippsSHA256_Supported()) {
+                        ippsSHA256_Init(&ipps_ctx);
+                        update_bootimage(ippsSHA256_Update, &ipps_ctx, bootimage, imgsize);
+                        ippsSHA256_Update(&ipps_ctx, (uint8_t *)bs->attributes.data,
+                                          bs->attributes.data_sz);
+                        ippsSHA256_Final(&ipps_ctx, (uint32_t *)*hash);
+                        OPENSSL_cleanse(&ipps_ctx, sizeof(ipps_ctx));
+                        return EFI_SUCCESS;
+                }
 
                 if (1 != SHA256_Init(&sha_ctx))
                         break;
 
-                SHA256_Update(&sha_ctx, bootimage, imgsize);
+                update_bootimage(SHA256_Update, &sha_ctx, bootimage, imgsize);
                 SHA256_Update(&sha_ctx, bs->attributes.data,
                                 bs->attributes.data_sz);
                 SHA256_Final(*hash, &sha_ctx);
@@ -206,7 +215,6 @@ static EFI_STATUS hash_bootimage(struct boot_signature *bs,
 
                 return EFI_SUCCESS;
         }
-#endif
         case NID_sha512WithRSAEncryption:
         {
                 SHA512_CTX sha_ctx;
@@ -214,7 +222,7 @@ static EFI_STATUS hash_bootimage(struct boot_signature *bs,
                 if (1 != SHA512_Init(&sha_ctx))
                         break;
 
-                SHA512_Update(&sha_ctx, bootimage, imgsize);
+                update_bootimage(SHA512_Update, &sha_ctx, bootimage, imgsize);
                 SHA512_Update(&sha_ctx, bs->attributes.data,
                                 bs->attributes.data_sz);
                 SHA512_Final(*hash, &sha_ctx);
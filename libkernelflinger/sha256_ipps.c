@@ -28,18 +28,24 @@
  *
  */
 
+#include <efi.h>
+#include <efilib.h>
 #include <stdint.h>
 #include <immintrin.h>
 
+#include "lib.h"
 #include "sha256_ipps.h"
 
+#define SHANI_TARGET __attribute__((target("sha,sse4.1")))
+
 #define SHA256_BLOCK_SIZE       64
 #define SHA_SWAP32(l) (((l) >> 24) | \
 			(((l) & 0x00ff0000) >> 8) | \
 			(((l) & 0x0000ff00) << 8) | \
 			((l) << 24))
 
-static void sha256_update(uint32_t *digest, uint8_t *data, uint32_t num_blks)
+static void SHANI_TARGET sha256_update(uint32_t *digest, uint8_t *data,
+				       uint32_t num_blks)
 {
 	__m128i state0, state1;
 	__m128i msg;
@@ -253,6 +259,23 @@ static void sha256_update(uint32_t *digest, uint8_t *data, uint32_t num_blks)
 }
 
 
+int ippsSHA256_Supported(void)
+{
+	static enum { SHA256_UNKNOWN, SHA256_GENERIC, SHA256_SHANI } backend;
+
+	if (backend == SHA256_UNKNOWN) {
+		if (cpu_has_feature(CPU_FEATURE_SHA) &&
+		    cpu_has_feature(CPU_FEATURE_SSE41))
+			backend = SHA256_SHANI;
+		else
+			backend = SHA256_GENERIC;
+		log(L"SHA-256 backend: %s\n",
+		    backend == SHA256_SHANI ? L"SHA-NI" : L"generic");
+	}
+
+	return backend == SHA256_SHANI;
+}
+
 void ippsSHA256_Init(SHA256_IPPS_CTX *ctx)
 {
 	ctx->len = 0;
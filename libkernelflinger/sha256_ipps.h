@@ -40,6 +40,10 @@ typedef struct __attribute__((aligned (16))) __sha256_ipps {
 }
 SHA256_IPPS_CTX;
 
+/* Return non-zero if the CPU implements the SHA extensions.  The
+ * other ippsSHA256_* functions must not be called otherwise. */
+int ippsSHA256_Supported(void);
+
 void ippsSHA256_Init(SHA256_IPPS_CTX *ctx);
 void ippsSHA256_Update(SHA256_IPPS_CTX *ctx, uint8_t *buf, int size);
 void ippsSHA256_Final(SHA256_IPPS_CTX *ctx, uint32_t *out);
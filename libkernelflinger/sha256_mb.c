@@ -0,0 +1,313 @@
+/*
+ * Copyright (c) 2017, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer
+ *      in the documentation and/or other materials provided with the
+ *      distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Multi-buffer SHA-256: eight independent messages of the same length
+ * are hashed together, one per 32-bit lane of the AVX2 registers.
+ * This is what dm-verity hash trees need, every data block being
+ * hashed on its own with the same salt.  It runs about five times as
+ * fast as the portable code but still slower than the SHA extensions,
+ * so it is only used on CPUs which have AVX2 but not SHA-NI.
+ */
+
+#include <efi.h>
+#include <efilib.h>
+#include <stdint.h>
+#include <immintrin.h>
+#include <openssl/sha.h>
+#include <openssl/mem.h>
+
+#include "lib.h"
+#include "sha256_ipps.h"
+#include "sha256_mb.h"
+
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+#define SHA256_BLOCK_SIZE	64
+
+static const uint32_t sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+	0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+	0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+	0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+	0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+	0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static const uint32_t sha256_h0[8] = {
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+	0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+#define VROTR(x, n) \
+	_mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+#define VXOR3(x, y, z) _mm256_xor_si256(_mm256_xor_si256(x, y), z)
+
+#define VSIGMA0(x) VXOR3(VROTR(x, 2), VROTR(x, 13), VROTR(x, 22))
+#define VSIGMA1(x) VXOR3(VROTR(x, 6), VROTR(x, 11), VROTR(x, 25))
+#define VSIG0(x) VXOR3(VROTR(x, 7), VROTR(x, 18), _mm256_srli_epi32(x, 3))
+#define VSIG1(x) VXOR3(VROTR(x, 17), VROTR(x, 19), _mm256_srli_epi32(x, 10))
+
+#define VCH(e, f, g) \
+	_mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g))
+#define VMAJ(a, b, c)							\
+	_mm256_or_si256(_mm256_and_si256(a, b),				\
+			_mm256_and_si256(c, _mm256_or_si256(a, b)))
+
+#define VADD3(x, y, z) _mm256_add_epi32(_mm256_add_epi32(x, y), z)
+
+#define SHA256_MB_RND(a, b, c, d, e, f, g, h, w, j)			\
+	{								\
+		__m256i t1 = VADD3(h, VSIGMA1(e), VCH(e, f, g));	\
+		__m256i t2 = _mm256_add_epi32(VSIGMA0(a), VMAJ(a, b, c)); \
+		t1 = VADD3(t1, w, _mm256_set1_epi32(sha256_k[j]));	\
+		d = _mm256_add_epi32(d, t1);				\
+		h = _mm256_add_epi32(t1, t2);				\
+	}
+
+/* Load eight big endian words from each of the eight lanes and turn
+ * them into eight vectors holding the same word of every lane. */
+static inline void AVX2_TARGET load_transpose(__m256i *w, const uint8_t **p,
+					      unsigned int offset)
+{
+	const __m256i bswap_mask =
+		_mm256_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL,
+				  0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+	__m256i r[8], t[8], u[8];
+	unsigned int i;
+
+	for (i = 0; i < 8; i++) {
+		r[i] = _mm256_loadu_si256((const __m256i *)(p[i] + offset));
+		r[i] = _mm256_shuffle_epi8(r[i], bswap_mask);
+	}
+
+	for (i = 0; i < 8; i += 2) {
+		t[i] = _mm256_unpacklo_epi32(r[i], r[i + 1]);
+		t[i + 1] = _mm256_unpackhi_epi32(r[i], r[i + 1]);
+	}
+
+	for (i = 0; i < 8; i += 4) {
+		u[i] = _mm256_unpacklo_epi64(t[i], t[i + 2]);
+		u[i + 1] = _mm256_unpackhi_epi64(t[i], t[i + 2]);
+		u[i + 2] = _mm256_unpacklo_epi64(t[i + 1], t[i + 3]);
+		u[i + 3] = _mm256_unpackhi_epi64(t[i + 1], t[i + 3]);
+	}
+
+	for (i = 0; i < 4; i++) {
+		w[i] = _mm256_permute2x128_si256(u[i], u[i + 4], 0x20);
+		w[i + 4] = _mm256_permute2x128_si256(u[i], u[i + 4], 0x31);
+	}
+}
+
+static void AVX2_TARGET sha256_mb_block(__m256i *state, const uint8_t **p)
+{
+	__m256i w[16];
+	__m256i a, b, c, d, e, f, g, h;
+	unsigned int j, k;
+
+	load_transpose(w, p, 0);
+	load_transpose(w + 8, p, 32);
+
+	a = state[0];
+	b = state[1];
+	c = state[2];
+	d = state[3];
+	e = state[4];
+	f = state[5];
+	g = state[6];
+	h = state[7];
+
+	for (j = 0; j < 64; j += 8) {
+		if (j >= 16) {
+			for (k = 0; k < 8; k++) {
+				unsigned int i = j + k;
+
+				w[i & 15] = _mm256_add_epi32(
+					VADD3(w[i & 15], VSIG0(w[(i + 1) & 15]),
+					      w[(i + 9) & 15]),
+					VSIG1(w[(i + 14) & 15]));
+			}
+		}
+		SHA256_MB_RND(a, b, c, d, e, f, g, h, w[(j + 0) & 15], j + 0);
+		SHA256_MB_RND(h, a, b, c, d, e, f, g, w[(j + 1) & 15], j + 1);
+		SHA256_MB_RND(g, h, a, b, c, d, e, f, w[(j + 2) & 15], j + 2);
+		SHA256_MB_RND(f, g, h, a, b, c, d, e, w[(j + 3) & 15], j + 3);
+		SHA256_MB_RND(e, f, g, h, a, b, c, d, w[(j + 4) & 15], j + 4);
+		SHA256_MB_RND(d, e, f, g, h, a, b, c, w[(j + 5) & 15], j + 5);
+		SHA256_MB_RND(c, d, e, f, g, h, a, b, w[(j + 6) & 15], j + 6);
+		SHA256_MB_RND(b, c, d, e, f, g, h, a, w[(j + 7) & 15], j + 7);
+	}
+
+	state[0] = _mm256_add_epi32(state[0], a);
+	state[1] = _mm256_add_epi32(state[1], b);
+	state[2] = _mm256_add_epi32(state[2], c);
+	state[3] = _mm256_add_epi32(state[3], d);
+	state[4] = _mm256_add_epi32(state[4], e);
+	state[5] = _mm256_add_epi32(state[5], f);
+	state[6] = _mm256_add_epi32(state[6], g);
+	state[7] = _mm256_add_epi32(state[7], h);
+}
+
+/* Return a pointer to the 64-byte block BLK of PREFIX || DATA padded
+ * as SHA-256 mandates.  Blocks lying entirely in DATA are used in
+ * place, the other ones are assembled in TMP. */
+static const uint8_t *get_block(uint8_t *tmp, UINTN blk,
+				const UINT8 *prefix, UINTN prefix_len,
+				const UINT8 *data, UINTN len)
+{
+	UINTN total = prefix_len + len;
+	UINTN start = blk * SHA256_BLOCK_SIZE;
+	UINTN pos, n;
+	uint64_t bits;
+	int i;
+
+	if (start >= prefix_len && start + SHA256_BLOCK_SIZE <= total)
+		return data + start - prefix_len;
+
+	memset(tmp, 0, SHA256_BLOCK_SIZE);
+
+	pos = start;
+	if (pos < prefix_len) {
+		n = min(prefix_len - pos, (UINTN)SHA256_BLOCK_SIZE);
+		memcpy(tmp, prefix + pos, n);
+		pos += n;
+	}
+	if (pos < total && pos < start + SHA256_BLOCK_SIZE) {
+		n = min(total - pos, start + SHA256_BLOCK_SIZE - pos);
+		memcpy(tmp + pos - start, data + pos - prefix_len, n);
+		pos += n;
+	}
+	if (pos == total && pos < start + SHA256_BLOCK_SIZE)
+		tmp[pos - start] = 0x80;
+
+	/* The length goes at the end of the last block. */
+	if ((total + 8) / SHA256_BLOCK_SIZE == blk) {
+		bits = (uint64_t)total * 8;
+		for (i = 0; i < 8; i++)
+			tmp[SHA256_BLOCK_SIZE - 1 - i] = bits >> (8 * i);
+	}
+
+	return tmp;
+}
+
+static void AVX2_TARGET sha256_mb_avx2(const UINT8 *prefix, UINTN prefix_len,
+				       const UINT8 **data, UINTN len,
+				       UINTN num, UINT8 *digests)
+{
+	uint8_t tmp[SHA256_MB_LANES][SHA256_BLOCK_SIZE];
+	uint32_t out[8][SHA256_MB_LANES] __attribute__((aligned(32)));
+	const uint8_t *p[SHA256_MB_LANES];
+	__m256i state[8];
+	UINTN blk, num_blks, lane, i;
+
+	/* Message, 0x80 marker and 64-bit length. */
+	num_blks = (prefix_len + len + 8) / SHA256_BLOCK_SIZE + 1;
+
+	for (i = 0; i < 8; i++)
+		state[i] = _mm256_set1_epi32(sha256_h0[i]);
+
+	for (blk = 0; blk < num_blks; blk++) {
+		/* Unused lanes hash the first buffer again. */
+		for (lane = 0; lane < SHA256_MB_LANES; lane++)
+			p[lane] = get_block(tmp[lane], blk, prefix, prefix_len,
+					    data[lane < num ? lane : 0], len);
+		sha256_mb_block(state, p);
+	}
+
+	for (i = 0; i < 8; i++)
+		_mm256_store_si256((__m256i *)out[i], state[i]);
+
+	for (lane = 0; lane < num; lane++, digests += SHA256_MB_DIGEST_SIZE)
+		for (i = 0; i < 8; i++) {
+			digests[4 * i] = out[i][lane] >> 24;
+			digests[4 * i + 1] = out[i][lane] >> 16;
+			digests[4 * i + 2] = out[i][lane] >> 8;
+			digests[4 * i + 3] = out[i][lane];
+		}
+}
+
+static void sha256_one(const UINT8 *prefix, UINTN prefix_len,
+		       const UINT8 *data, UINTN len, UINT8 *digest)
+{
+	SHA256_IPPS_CTX ipps_ctx;
+	SHA256_CTX sha_ctx;
+
+	if (ippsSHA256_Supported()) {
+		ippsSHA256_Init(&ipps_ctx);
+		ippsSHA256_Update(&ipps_ctx, (uint8_t *)prefix, prefix_len);
+		ippsSHA256_Update(&ipps_ctx, (uint8_t *)data, len);
+		ippsSHA256_Final(&ipps_ctx, (uint32_t *)digest);
+		return;
+	}
+
+	SHA256_Init(&sha_ctx);
+	SHA256_Update(&sha_ctx, prefix, prefix_len);
+	SHA256_Update(&sha_ctx, data, len);
+	SHA256_Final(digest, &sha_ctx);
+	OPENSSL_cleanse(&sha_ctx, sizeof(sha_ctx));
+}
+
+void sha256_mb(const UINT8 *prefix, UINTN prefix_len,
+	       const UINT8 **data, UINTN len, UINTN num, UINT8 *digests)
+{
+	static enum {
+		MB_UNKNOWN,
+		MB_AVX2,
+		MB_NONE
+	} backend = MB_UNKNOWN;
+	UINTN n;
+
+	/* The SHA extensions hash one buffer faster than AVX2 hashes
+	 * eight, lanes are only worth it on CPUs lacking them. */
+	if (backend == MB_UNKNOWN) {
+		if (!ippsSHA256_Supported() && cpu_has_feature(CPU_FEATURE_AVX2))
+			backend = MB_AVX2;
+		else
+			backend = MB_NONE;
+		debug(L"SHA-256 multi-buffer: %a",
+		      backend == MB_AVX2 ? "AVX2" : "none");
+	}
+
+	while (num > 1 && backend == MB_AVX2) {
+		n = min(num, (UINTN)SHA256_MB_LANES);
+		sha256_mb_avx2(prefix, prefix_len, data, len, n, digests);
+		data += n;
+		num -= n;
+		digests += n * SHA256_MB_DIGEST_SIZE;
+	}
+
+	for (; num; num--, data++, digests += SHA256_MB_DIGEST_SIZE)
+		sha256_one(prefix, prefix_len, *data, len, digests);
+}
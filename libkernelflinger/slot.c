@@ -63,6 +63,14 @@ static char *cur_suffix;	/* Point to one of the suffixes, or
 static boot_ctrl_t boot_ctrl;
 static slot_metadata_t *slots = boot_ctrl.slot_info;
 
+/* Copy of the A/B metadata stored on disk, used to skip the writes
+ * which would not change it.  In write-back mode, write_boot_ctrl()
+ * only marks BOOT_CTRL dirty and slot_flush() writes it. */
+static boot_ctrl_t disk_boot_ctrl;
+static BOOLEAN disk_boot_ctrl_valid;
+static BOOLEAN boot_ctrl_dirty;
+static BOOLEAN write_back;
+
 static const CHAR16 *label_with_suffix(const CHAR16 *label, const char *suffix)
 {
 	static CHAR16 res_label[MAX_LABEL_LEN];
@@ -123,10 +131,15 @@ static inline EFI_STATUS sync_boot_ctrl(BOOLEAN out)
 	offset = gparti.part.starting_lba * gparti.bio->Media->BlockSize +
 		offsetof(struct bootloader_message_ab, slot_suffix);
 
-	return uefi_call_wrapper((out ? gparti.dio->ReadDisk : gparti.dio->WriteDisk),
-				 5, gparti.dio,
-				 gparti.bio->Media->MediaId,
-				 offset, sizeof(boot_ctrl), &boot_ctrl);
+	ret = uefi_call_wrapper((out ? gparti.dio->ReadDisk : gparti.dio->WriteDisk),
+				5, gparti.dio,
+				gparti.bio->Media->MediaId,
+				offset, sizeof(boot_ctrl), &boot_ctrl);
+	disk_boot_ctrl_valid = !EFI_ERROR(ret);
+	if (disk_boot_ctrl_valid)
+		memcpy(&disk_boot_ctrl, &boot_ctrl, sizeof(disk_boot_ctrl));
+
+	return ret;
 }
 
 static EFI_STATUS read_boot_ctrl(void)
@@ -147,11 +160,14 @@ static EFI_STATUS slot_crc32(UINT32 *crc32)
 	return ret;
 }
 
-static EFI_STATUS write_boot_ctrl(void)
+static EFI_STATUS flush_boot_ctrl(void)
 {
 	EFI_STATUS ret;
 	UINT32 crc32;
 
+	if (!boot_ctrl_dirty)
+		return EFI_SUCCESS;
+
 	if (boot_ctrl.magic == BOOT_CTRL_MAGIC) {
 		ret = slot_crc32(&crc32);
 		if (EFI_ERROR(ret))
@@ -159,7 +175,25 @@ static EFI_STATUS write_boot_ctrl(void)
 		boot_ctrl.crc32_le = htole32(crc32);
 	}
 
-	return sync_boot_ctrl(FALSE);
+	if (!disk_boot_ctrl_valid ||
+	    memcmp(&boot_ctrl, &disk_boot_ctrl, sizeof(boot_ctrl))) {
+		/* Keep BOOT_CTRL dirty so that the write is retried */
+		ret = sync_boot_ctrl(FALSE);
+		if (EFI_ERROR(ret))
+			return ret;
+	}
+
+	boot_ctrl_dirty = FALSE;
+	return EFI_SUCCESS;
+}
+
+static EFI_STATUS write_boot_ctrl(void)
+{
+	boot_ctrl_dirty = TRUE;
+	if (write_back)
+		return EFI_SUCCESS;
+
+	return flush_boot_ctrl();
 }
 
 static BOOLEAN is_suffix(const char *suffix)
@@ -521,9 +555,30 @@ EFI_STATUS slot_reset(void)
 
 EFI_STATUS slot_restore(void)
 {
+	/* The partition has been overwritten. */
+	disk_boot_ctrl_valid = FALSE;
 	return use_slot() ? write_boot_ctrl() : EFI_SUCCESS;
 }
 
+EFI_STATUS slot_flush(void)
+{
+	EFI_STATUS ret;
+
+	ret = flush_boot_ctrl();
+	if (EFI_ERROR(ret))
+		efi_perror(ret, L"Failed to write A/B metadata");
+
+	return ret;
+}
+
+void slot_write_back(BOOLEAN enable)
+{
+	if (!enable)
+		slot_flush();
+	write_back = enable;
+	set_reset_flush(enable ? slot_flush : NULL);
+}
+
 EFI_STATUS slot_boot(enum boot_target target)
 {
 	slot_metadata_t *slot;
@@ -39,6 +39,7 @@
 #include <endian.h>
 #include <libavb_ab.h>
 #include <uefi_avb_ops.h>
+#include <trace.h>
 
 /* Constants.  */
 const CHAR16 *SLOT_STORAGE_PART = MISC_LABEL;
@@ -69,6 +70,67 @@ static AvbOps *ops;
 static boot_ctrl_t boot_ctrl;
 static AvbABSlotData *slots = boot_ctrl.slots;
 
+/* avb_ab_flow() and the slot accessors read and write the A/B
+ * metadata several times per boot.  It is read from the disk once,
+ * kept in AB_DATA and only written if it differs from the disk copy.
+ * In write-back mode, the writes are deferred until slot_flush(). */
+static boot_ctrl_t ab_data;
+static BOOLEAN ab_data_cached;
+static BOOLEAN ab_data_dirty;
+static boot_ctrl_t disk_ab_data;
+static BOOLEAN disk_ab_data_valid;
+static BOOLEAN write_back;
+
+static AvbIOResult cached_ab_data_read(AvbABOps *ab_ops, AvbABData *data)
+{
+	AvbIOResult io_ret;
+
+	if (!ab_data_cached) {
+		io_ret = avb_ab_data_read(ab_ops, &ab_data);
+		if (io_ret != AVB_IO_RESULT_OK)
+			return io_ret;
+		memcpy(&disk_ab_data, &ab_data, sizeof(disk_ab_data));
+		disk_ab_data_valid = TRUE;
+		ab_data_cached = TRUE;
+	}
+
+	memcpy(data, &ab_data, sizeof(*data));
+	return AVB_IO_RESULT_OK;
+}
+
+static AvbIOResult flush_ab_data(void)
+{
+	AvbIOResult io_ret;
+
+	if (!ab_data_dirty)
+		return AVB_IO_RESULT_OK;
+
+	if (!disk_ab_data_valid ||
+	    memcmp(&ab_data, &disk_ab_data, sizeof(ab_data))) {
+		/* Keep AB_DATA dirty so that the write is retried */
+		io_ret = avb_ab_data_write(&ab_ops, &ab_data);
+		disk_ab_data_valid = io_ret == AVB_IO_RESULT_OK;
+		if (!disk_ab_data_valid)
+			return io_ret;
+		memcpy(&disk_ab_data, &ab_data, sizeof(disk_ab_data));
+	}
+
+	ab_data_dirty = FALSE;
+	return AVB_IO_RESULT_OK;
+}
+
+static AvbIOResult cached_ab_data_write(__attribute__((__unused__)) AvbABOps *ab_ops,
+					const AvbABData *data)
+{
+	memcpy(&ab_data, data, sizeof(ab_data));
+	ab_data_cached = TRUE;
+	ab_data_dirty = TRUE;
+	if (write_back)
+		return AVB_IO_RESULT_OK;
+
+	return flush_ab_data();
+}
+
 static const CHAR16 *label_with_suffix(const CHAR16 *label, const char *suffix)
 {
 	static CHAR16 res_label[MAX_LABEL_LEN] = {'\0'};
@@ -118,9 +180,9 @@ UINTN get_part_nb_slot(const CHAR16 *label)
 static inline EFI_STATUS sync_boot_ctrl(BOOLEAN out)
 {
 	if (out)
-		avb_ab_data_read(&ab_ops, &boot_ctrl);
+		cached_ab_data_read(&ab_ops, &boot_ctrl);
 	else
-		avb_ab_data_write(&ab_ops, &boot_ctrl);
+		cached_ab_data_write(&ab_ops, &boot_ctrl);
 
 	return EFI_SUCCESS;
 }
@@ -244,8 +306,8 @@ EFI_STATUS slot_init(void)
 		error(L"Error allocating AvbOps when slot_init.");
 
 	ab_ops.ops = ops;
-	ab_ops.read_ab_metadata = avb_ab_data_read;
-	ab_ops.write_ab_metadata = avb_ab_data_write;
+	ab_ops.read_ab_metadata = cached_ab_data_read;
+	ab_ops.write_ab_metadata = cached_ab_data_write;
 	cur_suffix = NULL;
 	avb_ab_data_init(&boot_ctrl);
 
@@ -351,8 +413,10 @@ const char *slot_get_active(void)
 		debug(L"slot_get_active direct return %a", cur_suffix);
 		return cur_suffix;
 	}
+	TRACE_BEGIN("avb_ab_flow");
 	avb_ab_flow(&ab_ops, requested_partitions, AVB_SLOT_VERIFY_FLAGS_ALLOW_VERIFICATION_ERROR,\
 			AVB_HASHTREE_ERROR_MODE_RESTART, &data);
+	TRACE_END("avb_ab_flow");
 	if (!data)
 		return NULL;
 
@@ -389,8 +453,10 @@ EFI_STATUS slot_set_active(const char *suffix)
 	 */
 
 	avb_ab_mark_slot_active(&ab_ops, SUFFIX_INDEX(suffix));
+	TRACE_BEGIN("avb_ab_flow");
 	avb_ab_flow(&ab_ops, requested_partitions, AVB_SLOT_VERIFY_FLAGS_ALLOW_VERIFICATION_ERROR,\
 			AVB_HASHTREE_ERROR_MODE_RESTART, &data);
+	TRACE_END("avb_ab_flow");
 	if (!data)
 		return EFI_SUCCESS;
 
@@ -499,10 +565,13 @@ EFI_STATUS slot_reset(void)
 	}
 
 	ab_ops.ops = ops;
-	ab_ops.read_ab_metadata = avb_ab_data_read;
-	ab_ops.write_ab_metadata = avb_ab_data_write;
+	ab_ops.read_ab_metadata = cached_ab_data_read;
+	ab_ops.write_ab_metadata = cached_ab_data_write;
 	cur_suffix = NULL;
 	avb_ab_data_init(&boot_ctrl);
+	/* The partition table may have changed, read it again. */
+	flush_ab_data();
+	ab_data_cached = FALSE;
 
 	ret = read_boot_ctrl();
 	if (EFI_ERROR(ret)) {
@@ -538,9 +607,29 @@ EFI_STATUS slot_reset(void)
 
 EFI_STATUS slot_restore(void)
 {
+	/* The partition has been overwritten. */
+	disk_ab_data_valid = FALSE;
 	return use_slot() ? write_boot_ctrl() : EFI_SUCCESS;
 }
 
+EFI_STATUS slot_flush(void)
+{
+	if (flush_ab_data() != AVB_IO_RESULT_OK) {
+		error(L"Failed to write A/B metadata");
+		return EFI_DEVICE_ERROR;
+	}
+
+	return EFI_SUCCESS;
+}
+
+void slot_write_back(BOOLEAN enable)
+{
+	if (!enable)
+		slot_flush();
+	write_back = enable;
+	set_reset_flush(enable ? slot_flush : NULL);
+}
+
 EFI_STATUS slot_boot_failed(enum boot_target target)
 {
 	EFI_STATUS ret;
@@ -0,0 +1,190 @@
+/*
+ * Copyright (c) 2017, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer
+ *      in the documentation and/or other materials provided with the
+ *      distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "snappy.h"
+
+#define MIN_MATCH		4
+#define MAX_COPY_LEN		64
+#define MAX_OFFSET		65535
+
+#define TAG_LITERAL		0
+#define TAG_COPY_1		1
+#define TAG_COPY_2		2
+
+#define HASH_BITS		12
+
+static inline uint32_t read32(const uint8_t *p)
+{
+	return (uint32_t)p[0] | (uint32_t)p[1] << 8 |
+		(uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline uint32_t hash(uint32_t v)
+{
+	return (v * 2654435761U) >> (32 - HASH_BITS);
+}
+
+static inline void copy_bytes(uint8_t *dst, const uint8_t *src, size_t len)
+{
+	while (len--)
+		*dst++ = *src++;
+}
+
+static uint8_t *put_varint(uint8_t *op, const uint8_t *oend, uint32_t v)
+{
+	for (; v >= 0x80; v >>= 7) {
+		if (op == oend)
+			return NULL;
+		*op++ = v | 0x80;
+	}
+	if (op == oend)
+		return NULL;
+	*op++ = v;
+	return op;
+}
+
+static uint8_t *put_literal(uint8_t *op, const uint8_t *oend,
+			    const uint8_t *literals, size_t len)
+{
+	uint32_t n = len - 1;
+	size_t bytes;
+
+	if (!len)
+		return op;
+
+	/* From 61 bytes, the length is stored in the 1 to 4 next bytes */
+	if (n < 60)
+		bytes = 0;
+	else if (n < (1 << 8))
+		bytes = 1;
+	else if (n < (1 << 16))
+		bytes = 2;
+	else if (n < (1 << 24))
+		bytes = 3;
+	else
+		bytes = 4;
+
+	if ((size_t)(oend - op) < 1 + bytes + len)
+		return NULL;
+
+	*op++ = (bytes ? 59 + bytes : n) << 2 | TAG_LITERAL;
+	for (; bytes; bytes--, n >>= 8)
+		*op++ = n;
+
+	copy_bytes(op, literals, len);
+	return op + len;
+}
+
+static uint8_t *put_copy(uint8_t *op, const uint8_t *oend,
+			 size_t offset, size_t len)
+{
+	if (oend - op < 3)
+		return NULL;
+
+	if (len < 12 && offset < 2048) {
+		*op++ = (offset >> 8) << 5 | (len - 4) << 2 | TAG_COPY_1;
+		*op++ = offset;
+		return op;
+	}
+
+	*op++ = (len - 1) << 2 | TAG_COPY_2;
+	*op++ = offset;
+	*op++ = offset >> 8;
+	return op;
+}
+
+/* A copy element is at most 64 bytes long.  Longer matches are
+ * split, leaving at least MIN_MATCH bytes to the last element. */
+static uint8_t *put_match(uint8_t *op, const uint8_t *oend,
+			  size_t offset, size_t len)
+{
+	for (; op && len >= MAX_COPY_LEN + MIN_MATCH; len -= MAX_COPY_LEN)
+		op = put_copy(op, oend, offset, MAX_COPY_LEN);
+	if (op && len > MAX_COPY_LEN) {
+		op = put_copy(op, oend, offset, MAX_COPY_LEN - MIN_MATCH);
+		len -= MAX_COPY_LEN - MIN_MATCH;
+	}
+	return op ? put_copy(op, oend, offset, len) : NULL;
+}
+
+size_t snappy_compress(const void *src, size_t src_len, void *dst, size_t dst_size)
+{
+	uint32_t table[1 << HASH_BITS];
+	const uint8_t *base = src;
+	const uint8_t *ip = base, *anchor = base, *match;
+	const uint8_t *iend = base + src_len;
+	const uint8_t *mflimit = iend - MIN_MATCH;
+	uint8_t *op = dst, *oend = op + dst_size;
+	size_t len;
+	uint32_t h;
+
+	for (h = 0; h < (1 << HASH_BITS); h++)
+		table[h] = 0;
+
+	op = put_varint(op, oend, src_len);
+	if (!op)
+		return 0;
+
+	if (src_len > MIN_MATCH) {
+		for (ip++; ip <= mflimit; ) {
+			h = hash(read32(ip));
+			match = base + table[h];
+			table[h] = ip - base;
+			if (ip - match > MAX_OFFSET || read32(match) != read32(ip)) {
+				ip++;
+				continue;
+			}
+
+			/* Extend the match backward then forward */
+			while (ip > anchor && match > base && ip[-1] == match[-1]) {
+				ip--;
+				match--;
+			}
+			for (len = MIN_MATCH; ip + len < iend &&
+				     ip[len] == match[len]; len++)
+				;
+
+			op = put_literal(op, oend, anchor, ip - anchor);
+			if (op)
+				op = put_match(op, oend, ip - match, len);
+			if (!op)
+				return 0;
+			ip += len;
+			anchor = ip;
+			if (ip <= mflimit)
+				table[hash(read32(ip - 2))] = ip - 2 - base;
+		}
+	}
+
+	op = put_literal(op, oend, anchor, iend - anchor);
+	if (!op)
+		return 0;
+	return op - (uint8_t *)dst;
+}
@@ -34,6 +34,7 @@
 #include <lib.h>
 #include "storage.h"
 #include "pci.h"
+#include "trace.h"
 #include "protocol/EraseBlock.h"
 
 static struct storage *cur_storage;
@@ -87,7 +88,7 @@ static EFI_STATUS identify_storage(EFI_DEVICE_PATH *device_path,
 	return EFI_UNSUPPORTED;
 }
 
-EFI_STATUS identify_boot_device(enum storage_type filter)
+static EFI_STATUS find_boot_device(enum storage_type filter)
 {
 	EFI_STATUS ret;
 	EFI_HANDLE *handles;
@@ -151,6 +152,17 @@ EFI_STATUS identify_boot_device(enum storage_type filter)
 	return EFI_SUCCESS;
 }
 
+EFI_STATUS identify_boot_device(enum storage_type filter)
+{
+	EFI_STATUS ret;
+
+	TRACE_BEGIN("storage_probe");
+	ret = find_boot_device(filter);
+	TRACE_END("storage_probe");
+
+	return ret;
+}
+
 static BOOLEAN valid_storage(void)
 {
 	if (!initialized) {
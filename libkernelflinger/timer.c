@@ -39,6 +39,10 @@
 #define BOOT_SATGE_FIRMWARE L"LFW"
 #define BOOT_SATGE_OSLOADER L"LOS"
 
+#define MSR_PLATFORM_INFO	0xce
+/* Length of the TSC calibration against the firmware Stall() */
+#define TSC_CALIBRATION_US	20000
+
 //Array for recording boot time of every stage
 unsigned bt_stamp[TIMESTAMP_MAX];
 
@@ -71,32 +75,123 @@ __RDTSC (void)
 	return (uint64_t) hi << 32 | lo;
 }
 
-static uint16_t get_cpu_freq(void)
+static BOOLEAN is_intel_cpu(void)
+{
+	UINT32 reg[4];
+
+	cpuid(0, reg);
+	/* "GenuineIntel" in EBX, EDX, ECX */
+	return reg[1] == 0x756e6547 && reg[3] == 0x49656e69 &&
+		reg[2] == 0x6c65746e;
+}
+
+/* The TSC runs at the crystal clock frequency times the ratio
+ * reported by CPUID leaf 0x15.  Some CPUs report the ratio but not
+ * the crystal frequency: the nominal frequency of leaf 0x16 is then
+ * used as an approximation of the TSC rate, they are usually but not
+ * always the same. */
+static uint64_t tsc_frequency_from_cpuid(void)
+{
+	UINT32 reg[4], max_leaf;
+
+	cpuid(0, reg);
+	max_leaf = reg[0];
+
+	if (max_leaf >= 0x15) {
+		cpuid(0x15, reg);
+		if (reg[0] && reg[1] && reg[2])
+			return DivU64x32((uint64_t)reg[2] * reg[1], reg[0], NULL);
+	}
+
+	if (max_leaf >= 0x16) {
+		cpuid(0x16, reg);
+		if (reg[0] & 0xffff)
+			return (uint64_t)(reg[0] & 0xffff) * 1000000;
+	}
+
+	return 0;
+}
+
+/* Maximum non-turbo ratio times the 100 MHz bus clock */
+static uint64_t tsc_frequency_from_msr(void)
 {
-	uint16_t cpu_freq;
-	unsigned max_nb_ratio;
 	msr_t platform_info;
 
-	platform_info.val = __RDMSR (0xce);
-	max_nb_ratio = (platform_info.lo >> 8) & 0xff;
-	cpu_freq = 100 * max_nb_ratio;
+	platform_info.val = __RDMSR(MSR_PLATFORM_INFO);
+	return (uint64_t)((platform_info.lo >> 8) & 0xff) * 100000000;
+}
+
+static uint64_t tsc_frequency_from_stall(void)
+{
+	uint64_t start, end;
 
-	return cpu_freq;
+	if (!BS)
+		return 0;
+
+	start = __RDTSC();
+	uefi_call_wrapper(BS->Stall, 1, TSC_CALIBRATION_US);
+	end = __RDTSC();
+
+	return (end - start) * (1000000 / TSC_CALIBRATION_US);
 }
 
-unsigned boottime_in_msec(void)
+uint64_t tsc_frequency(void)
 {
-	unsigned tick;
-	unsigned bt_us, bt_ms;
-	unsigned cpu_freq;
+	static uint64_t tsc_hz;
 
-	cpu_freq = get_cpu_freq();
+	if (tsc_hz)
+		return tsc_hz;
 
-	tick = __RDTSC();
-	bt_us = (((unsigned) (tick >> 6)) / cpu_freq) << 6;
-	bt_ms = bt_us / 1000;
+	if (is_intel_cpu()) {
+		tsc_hz = tsc_frequency_from_cpuid();
+		if (!tsc_hz)
+			tsc_hz = tsc_frequency_from_msr();
+	}
+	if (!tsc_hz)
+		tsc_hz = tsc_frequency_from_stall();
 
-	return bt_ms;
+	return tsc_hz;
+}
+
+uint64_t read_tsc(void)
+{
+	return __RDTSC();
+}
+
+uint64_t ticks_to_ns(uint64_t ticks, uint64_t hz)
+{
+	UINTN khz, rem;
+	uint64_t ns;
+
+	/* The ia32 build does not link libgcc, 64-bit divisions go
+	 * through DivU64x32() whose divisor is a UINTN: kilohertz fit. */
+	khz = DivU64x32(hz, 1000, NULL);
+	if (!khz)
+		return 0;
+
+	/* Split the division so the multiplication cannot overflow */
+	ns = DivU64x32(ticks, khz, &rem) * 1000000;
+	return ns + DivU64x32((uint64_t)rem * 1000000, khz, NULL);
+}
+
+uint64_t tsc_to_ns(uint64_t ticks)
+{
+	return ticks_to_ns(ticks, tsc_frequency());
+}
+
+uint64_t boottime_in_nsec(void)
+{
+	return tsc_to_ns(__RDTSC());
+}
+
+uint64_t boottime_in_usec(void)
+{
+	return DivU64x32(boottime_in_nsec(), 1000, NULL);
+}
+
+unsigned boottime_in_msec(void)
+{
+	return DivU64x32(boottime_in_nsec(), 1000000, NULL);
 }
 
 void set_boottime_stamp(int num)
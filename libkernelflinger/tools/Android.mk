@@ -3,10 +3,54 @@ LOCAL_PATH:= $(call my-dir)
 ################################
 include $(CLEAR_VARS)
 
-LOCAL_SRC_FILES := png2c.c
+LOCAL_SRC_FILES := png2c.c ../lz4.c
 LOCAL_STATIC_LIBRARIES := libpng libz
 LOCAL_C_INCLUDES += external/libpng
-LOCAL_CFLAGS += -O2 -g -Wall -Werror -pedantic
+# Not -I: the other libkernelflinger headers shadow the system ones
+LOCAL_CFLAGS += -O2 -g -Wall -Werror -pedantic \
+	-iquote $(LOCAL_PATH)/../../include/libkernelflinger
 LOCAL_MODULE := png2c
 
 include $(BUILD_HOST_EXECUTABLE)
+
+################################
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := kflogdecode.c
+LOCAL_STATIC_LIBRARIES := libz
+LOCAL_CFLAGS += -O2 -g -Wall -Werror -pedantic
+LOCAL_MODULE := kflogdecode
+
+include $(BUILD_HOST_EXECUTABLE)
+
+################################
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := lz4test.c ../lz4.c
+LOCAL_CFLAGS += -O2 -g -Wall -Werror -pedantic \
+	-iquote $(LOCAL_PATH)/../../include/libkernelflinger
+LOCAL_MODULE := lz4test
+
+include $(BUILD_HOST_EXECUTABLE)
+
+################################
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := scrubtest.c ../scrub.c
+# The stand-in EFI headers of host/ shadow the libkernelflinger lib.h
+LOCAL_CFLAGS += -O2 -g -Wall -Werror \
+	-iquote $(LOCAL_PATH)/host -I $(LOCAL_PATH)/host \
+	-iquote $(LOCAL_PATH)/../../include/libkernelflinger
+LOCAL_LDLIBS += -lpthread
+LOCAL_MODULE := scrubtest
+
+include $(BUILD_HOST_EXECUTABLE)
+
+################################
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := scalebench.c ../ui_scale.c
+LOCAL_CFLAGS += -O2 -g -Wall -Werror -I $(LOCAL_PATH)/host
+LOCAL_MODULE := scalebench
+
+include $(BUILD_HOST_EXECUTABLE)
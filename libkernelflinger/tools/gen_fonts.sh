@@ -9,7 +9,7 @@ echo -e "$header" > $output
 for file in ${images[*]}
 do
     name=$(basename ${file%_font.png})
-    png2c -i $file -o - -f GRAY -p "__"$name >> $output
+    png2c -i $file -o - -f GRAY -p "__"$name -c >> $output
 done
 
 echo -en "\nui_font_t ui_fonts[] = {" >> $output
@@ -28,7 +28,7 @@ do
     cheight=$(echo $name | cut -d 'x' -f 2 | cut -d '_' -f 1)
     width=$(file $file | cut -d ' ' -f 5)
     height=$(file $file | cut -d ' ' -f 7 | sed 's/,//')
-    echo -en "$prefix\n\t{ \"$name\", $width, $height, $cwidth, $cheight, __"$name"_dat }" >> $output
+    echo -en "$prefix\n\t{ \"$name\", $width, $height, $cwidth, $cheight, NULL, __"$name"_dat, sizeof(__"$name"_dat) }" >> $output
     fonts_nb=$((fonts_nb+1))
 done
 echo -e "\n};" >> $output
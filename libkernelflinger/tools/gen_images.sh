@@ -9,7 +9,7 @@ echo -e "$header" > $output
 for file in ${images[*]}
 do
     name=$(basename ${file%.png})
-    png2c -i $file -o - -f BGRA -p $name >> $output
+    png2c -i $file -o - -f BGRA -p $name -c >> $output
 done
 
 echo "ui_image_t ui_images[] = {" >> $output
@@ -25,6 +25,6 @@ do
 
     width=$(file $file | cut -d ' ' -f 5)
     height=$(file $file | cut -d ' ' -f 7 | sed 's/,//')
-    echo -en "$prefix\n\t{ \"$name\", (EFI_GRAPHICS_OUTPUT_BLT_PIXEL *)"$name"_dat, $width, $height }" >> $output
+    echo -en "$prefix\n\t{ \"$name\", NULL, $width, $height, "$name"_dat, sizeof("$name"_dat) }" >> $output
 done
 echo -e "\n};" >> $output
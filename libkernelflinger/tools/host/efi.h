@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2017, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer
+ *      in the documentation and/or other materials provided with the
+ *      distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/* Minimal stand-in of the gnu-efi efi.h for the host tools built
+ * with libkernelflinger sources. */
+
+#ifndef _EFI_H_
+#define _EFI_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef int8_t INT8;
+typedef int16_t INT16;
+typedef int32_t INT32;
+typedef int64_t INT64;
+typedef uint8_t UINT8;
+typedef uint16_t UINT16;
+typedef uint32_t UINT32;
+typedef uint64_t UINT64;
+typedef intptr_t INTN;
+typedef uintptr_t UINTN;
+typedef unsigned char BOOLEAN;
+typedef char CHAR8;
+typedef uint16_t CHAR16;
+typedef void VOID;
+
+typedef UINTN EFI_STATUS;
+typedef UINTN EFI_TPL;
+typedef VOID *EFI_EVENT;
+typedef UINT64 EFI_PHYSICAL_ADDRESS;
+
+typedef struct {
+	UINT32 Data1;
+	UINT16 Data2;
+	UINT16 Data3;
+	UINT8 Data4[8];
+} EFI_GUID;
+
+typedef struct {
+	UINT32 Type;
+	UINT32 Pad;
+	EFI_PHYSICAL_ADDRESS PhysicalStart;
+	UINT64 VirtualStart;
+	UINT64 NumberOfPages;
+	UINT64 Attribute;
+} EFI_MEMORY_DESCRIPTOR;
+
+#define IN
+#define OUT
+#define OPTIONAL
+#define EFIAPI
+
+#define TRUE	1
+#define FALSE	0
+
+#define EFIERR(a)		((EFI_STATUS)(a) | ((EFI_STATUS)1 << 63))
+#define EFI_ERROR(a)		((INTN)(a) < 0)
+#define EFI_SUCCESS		0
+#define EFI_INVALID_PARAMETER	EFIERR(2)
+#define EFI_NOT_READY		EFIERR(6)
+#define EFI_OUT_OF_RESOURCES	EFIERR(9)
+#define EFI_NOT_STARTED		EFIERR(19)
+
+#define EfiConventionalMemory	7
+#define EfiBootServicesData	4
+#define EFI_PAGE_SIZE		4096
+
+#define TPL_APPLICATION		4
+#define TPL_CALLBACK		8
+#define TPL_NOTIFY		16
+#define TPL_HIGH_LEVEL		31
+
+#endif	/* _EFI_H_ */
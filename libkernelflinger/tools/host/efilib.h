@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2017, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer
+ *      in the documentation and/or other materials provided with the
+ *      distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/* Minimal stand-in of the gnu-efi efilib.h for the host tools built
+ * with libkernelflinger sources: the boot services they use. */
+
+#ifndef _EFILIB_H_
+#define _EFILIB_H_
+
+#include "efi.h"
+
+typedef struct {
+	EFI_STATUS (*LocateProtocol)(EFI_GUID *protocol, VOID *registration,
+				     VOID **interface);
+	EFI_STATUS (*CreateEvent)(UINT32 type, EFI_TPL tpl, VOID *notify,
+				  VOID *context, EFI_EVENT *event);
+	EFI_STATUS (*CheckEvent)(EFI_EVENT event);
+	EFI_STATUS (*Stall)(UINTN microseconds);
+} EFI_BOOT_SERVICES;
+
+extern EFI_BOOT_SERVICES *BS;
+
+#define uefi_call_wrapper(func, va_num, ...) func(__VA_ARGS__)
+
+#define AllocatePool malloc
+#define FreePool free
+
+#endif	/* _EFILIB_H_ */
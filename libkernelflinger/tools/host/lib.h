@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2017, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer
+ *      in the documentation and/or other materials provided with the
+ *      distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/* Minimal stand-in of the kernelflinger lib.h for the host tools
+ * built with libkernelflinger sources. */
+
+#ifndef _LIB_H_
+#define _LIB_H_
+
+#include <wchar.h>
+
+#include "efi.h"
+#include "efilib.h"
+
+#define ARRAY_SIZE(x) (sizeof(x) / sizeof(*x))
+
+#define max(a,b) \
+   ({ __typeof__ (a) _a = (a); \
+       __typeof__ (b) _b = (b); \
+     _a > _b ? _a : _b; })
+
+#define min(a,b) \
+   ({ __typeof__ (a) _a = (a); \
+       __typeof__ (b) _b = (b); \
+     _a < _b ? _a : _b; })
+
+typedef enum {
+	CPU_FEATURE_SSE41,
+	CPU_FEATURE_AVX2,
+	CPU_FEATURE_BMI2,
+	CPU_FEATURE_ADX,
+	CPU_FEATURE_SHA,
+	CPU_FEATURE_ERMS
+} cpu_feature_t;
+
+BOOLEAN cpu_has_feature(cpu_feature_t feature);
+BOOLEAN cpu_avx_state_enabled(void);
+
+/* The messages are reported without their arguments */
+void host_error(const wchar_t *fmt);
+
+#define error(fmt, ...) host_error(fmt)
+#define efi_perror(ret, fmt, ...) host_error(fmt)
+
+#endif	/* _LIB_H_ */
@@ -0,0 +1,657 @@
+/*
+ * Copyright (c) 2017, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer
+ *      in the documentation and/or other materials provided with the
+ *      distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+/* Turn a dump of the KernelflingerLogs EFI variable back into text.
+ * The records only hold the offsets of their format strings in the
+ * EFI image, which must be the one that wrote the log. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <libgen.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <zlib.h>
+
+#include "../../include/libkernelflinger/log_record.h"
+
+#define ARRAY_SIZE(x) (sizeof(x) / sizeof(*x))
+
+/* Longest formatted conversion */
+#define ITEM_MAX 256
+
+static char *program_name;
+
+static void usage(int status)
+{
+	printf("Usage: %s -i FILE [-l LEVEL] [-o FILE] LOG\n",
+	       basename((char *)program_name));
+	printf("\
+Decode the LOG dump of the KernelflingerLogs EFI variable.\n\
+  -i, --image=FILE              EFI application which wrote the log\n\
+  -l, --level=LEVEL             only print the messages up to LEVEL:\n\
+                                error, info or debug (default)\n\
+  -o, --output-file=FILE        write the messages into FILE instead of\n\
+                                printing them\n\
+  -h, --help                    display this help\n\
+");
+	exit(status);
+}
+
+static void error(const char *s)
+{
+	perror(s);
+	exit(EXIT_FAILURE);
+}
+
+static void fatal(const char *s)
+{
+	fprintf(stderr, "%s: %s\n", basename(program_name), s);
+	exit(EXIT_FAILURE);
+}
+
+static unsigned char *read_file(const char *path, size_t *size)
+{
+	unsigned char *data = NULL;
+	size_t len = 0, n;
+	FILE *f;
+
+	f = strcmp(path, "-") ? fopen(path, "rb") : stdin;
+	if (!f)
+		error(path);
+
+	do {
+		data = realloc(data, len + 65536);
+		if (!data)
+			error("Failed to allocate buffer");
+		n = fread(data + len, 1, 65536, f);
+		len += n;
+	} while (n);
+
+	if (ferror(f))
+		error(path);
+	if (f != stdin)
+		fclose(f);
+
+	*size = len;
+	return data;
+}
+
+static uint16_t get16(const unsigned char *p)
+{
+	return p[0] | p[1] << 8;
+}
+
+static uint32_t get32(const unsigned char *p)
+{
+	return get16(p) | (uint32_t)get16(p + 2) << 16;
+}
+
+static uint64_t get64(const unsigned char *p)
+{
+	return get32(p) | (uint64_t)get32(p + 4) << 32;
+}
+
+struct image {
+	unsigned char *data;
+	size_t size;
+	const unsigned char *sections;
+	unsigned int nb_sections;
+	uint32_t id;
+};
+
+static void load_image(struct image *image, const char *path)
+{
+	uint32_t pe;
+	size_t table;
+
+	image->data = read_file(path, &image->size);
+	if (image->size < 0x40 || memcmp(image->data, "MZ", 2))
+		fatal("The image is not a PE file");
+
+	pe = get32(image->data + 0x3c);
+	if (pe > image->size - 24 || memcmp(image->data + pe, "PE\0\0", 4))
+		fatal("The image is not a PE file");
+
+	table = pe + 24 + get16(image->data + pe + 20);
+	image->nb_sections = get16(image->data + pe + 6);
+	if (table + image->nb_sections * 40 > image->size)
+		fatal("The image section table is truncated");
+
+	image->sections = image->data + table;
+	image->id = crc32(0, image->sections, image->nb_sections * 40);
+}
+
+/* Return the CHAR16 string at relative virtual address RVA or NULL. */
+static const unsigned char *image_string(struct image *image, uint32_t rva,
+					 size_t *max_len)
+{
+	const unsigned char *s;
+	uint32_t vaddr, raw_size, raw_off;
+	unsigned int i;
+
+	for (i = 0; i < image->nb_sections; i++) {
+		s = image->sections + i * 40;
+		vaddr = get32(s + 12);
+		raw_size = get32(s + 16);
+		raw_off = get32(s + 20);
+		if (rva < vaddr || rva - vaddr >= raw_size ||
+		    raw_off + raw_size > image->size)
+			continue;
+		*max_len = (raw_size - (rva - vaddr)) / 2;
+		return image->data + raw_off + rva - vaddr;
+	}
+
+	return NULL;
+}
+
+/* Output of the formatted messages */
+struct text {
+	FILE *f;
+	bool line_start;
+	uint64_t tsc;
+	uint64_t tsc_hz;
+};
+
+static void text_putc(struct text *t, unsigned int c)
+{
+	if (t->line_start && t->tsc_hz) {
+		t->line_start = false;
+		fprintf(t->f, "[%5llu.%06llu] ",
+			(unsigned long long)(t->tsc / t->tsc_hz),
+			(unsigned long long)((t->tsc % t->tsc_hz) * 1000000 / t->tsc_hz));
+	}
+
+	fputc(c > 0x7f ? '?' : c, t->f);
+	if (c == '\n')
+		t->line_start = true;
+}
+
+static void text_puts(struct text *t, const char *s)
+{
+	while (*s)
+		text_putc(t, (unsigned char)*s++);
+}
+
+/* Conversion specification, as parsed by gnu-efi _Print() */
+struct item {
+	size_t width;
+	size_t field_width;
+	bool field_width_set;
+	char pad;
+	bool pad_before;
+	bool comma;
+	bool lng;
+};
+
+/* Write STR the way gnu-efi PItem() does. */
+static void put_item(struct text *t, struct item *item, const char *str)
+{
+	size_t len, i, field_width = item->field_width;
+
+	len = strlen(str);
+	if (item->field_width_set && len > field_width)
+		len = field_width;
+	if (!item->field_width_set)
+		field_width = len;
+	if (len > item->width)
+		item->width = len;
+
+	if (item->pad_before)
+		for (i = item->width; i < field_width; i++)
+			text_putc(t, item->pad);
+	for (i = len; i < item->width; i++)
+		text_putc(t, item->pad);
+	for (i = 0; i < len; i++)
+		text_putc(t, (unsigned char)str[i]);
+	if (!item->pad_before)
+		for (i = item->width; i < field_width; i++)
+			text_putc(t, item->pad);
+}
+
+static void value_to_string(char *buf, bool comma, int64_t value)
+{
+	char digits[32];
+	uint64_t v = value < 0 ? -(uint64_t)value : (uint64_t)value;
+	size_t n = 0, i = 0, count = 0;
+
+	do {
+		if (comma && count && count % 3 == 0)
+			digits[n++] = ',';
+		digits[n++] = '0' + v % 10;
+		count++;
+		v /= 10;
+	} while (v);
+
+	if (value < 0)
+		buf[i++] = '-';
+	while (n)
+		buf[i++] = digits[--n];
+	buf[i] = '\0';
+}
+
+static void unsigned_to_string(char *buf, bool comma, uint64_t value)
+{
+	char digits[32];
+	size_t n = 0, i = 0, count = 0;
+
+	do {
+		if (comma && count && count % 3 == 0)
+			digits[n++] = ',';
+		digits[n++] = '0' + value % 10;
+		count++;
+		value /= 10;
+	} while (value);
+
+	while (n)
+		buf[i++] = digits[--n];
+	buf[i] = '\0';
+}
+
+static void value_to_hex(char *buf, uint64_t value)
+{
+	snprintf(buf, ITEM_MAX, "%llX", (unsigned long long)value);
+}
+
+static const char *status_string(uint64_t status)
+{
+	static const char *errors[] = {
+		"Success", "Load Error", "Invalid Parameter", "Unsupported",
+		"Bad Buffer Size", "Buffer Too Small", "Not Ready",
+		"Device Error", "Write Protected", "Out of Resources",
+		"Volume Corrupt", "Volume Full", "No Media", "Media changed",
+		"Not Found", "Access Denied", "No Response", "No mapping",
+		"Time out", "Not started", "Already started", "Aborted",
+		"ICMP Error", "TFTP Error", "Protocol Error",
+		"Incompatible Version", "Security Violation", "CRC Error",
+		"End of Media", "", "", "End of File", "Invalid Language",
+		"Compromised Data"
+	};
+	static const char *warnings[] = {
+		"Success", "Warning Unknown Glyph", "Warning Delete Failure",
+		"Warning Write Failure", "Warning Buffer Too Small"
+	};
+	/* The records hold 64 bits values, whatever the image */
+	uint64_t error_bit = 1ULL << 63;
+
+	if ((status & error_bit) || (status & 0x80000000 && !(status >> 32))) {
+		status &= 0x7fffffff;
+		if (status < ARRAY_SIZE(errors) && errors[status][0])
+			return errors[status];
+		return NULL;
+	}
+	if (status < ARRAY_SIZE(warnings))
+		return warnings[status];
+	return NULL;
+}
+
+struct record_reader {
+	const unsigned char *data;
+	size_t len;
+};
+
+static bool get_value(struct record_reader *r, uint64_t *value)
+{
+	if (r->len < 8)
+		return false;
+	*value = get64(r->data);
+	r->data += 8;
+	r->len -= 8;
+	return true;
+}
+
+static const char *get_str(struct record_reader *r)
+{
+	const char *str = (const char *)r->data;
+	size_t len = strnlen(str, r->len);
+
+	if (len == r->len)
+		return NULL;
+	r->data += len + 1;
+	r->len -= len + 1;
+	return str;
+}
+
+static bool get_blob(struct record_reader *r, const unsigned char **blob)
+{
+	if (r->len < 16)
+		return false;
+	*blob = r->data;
+	r->data += 16;
+	r->len -= 16;
+	return true;
+}
+
+/* Format string, either CHAR16 from the image or inline ASCII */
+struct format {
+	const unsigned char *wide;
+	const char *ascii;
+	size_t len;
+};
+
+static unsigned int fmt_char(struct format *fmt, size_t i)
+{
+	if (i >= fmt->len)
+		return 0;
+	return fmt->wide ? get16(fmt->wide + 2 * i) : (unsigned char)fmt->ascii[i];
+}
+
+static bool format_conversion(struct text *t, struct record_reader *r,
+			      struct item *item, unsigned int conv)
+{
+	char buf[ITEM_MAX];
+	const unsigned char *b = NULL;
+	const char *str;
+	uint64_t value = 0;
+	unsigned int hour;
+
+	switch (conv) {
+	case 'd':
+	case 'u':
+	case 'x':
+	case 'X':
+	case 'c':
+	case 'r':
+	case 'p':
+		if (!get_value(r, &value))
+			return false;
+		break;
+	case 's':
+	case 'a':
+	case 'D':
+		str = get_str(r);
+		if (!str)
+			return false;
+		put_item(t, item, str);
+		return true;
+	case 'g':
+	case 't':
+		if (!get_blob(r, &b))
+			return false;
+		break;
+	}
+
+	switch (conv) {
+	case 'd':
+		/* Stored sign-extended */
+		value_to_string(buf, item->comma, (int64_t)value);
+		break;
+	case 'u':
+		unsigned_to_string(buf, item->comma, value);
+		break;
+	case 'X':
+		item->width = item->lng ? 16 : 8;
+		item->pad = '0';
+		/* fall through */
+	case 'x':
+		value_to_hex(buf, value);
+		break;
+	case 'p':
+		item->width = 16;
+		item->pad = '0';
+		value_to_hex(buf, value);
+		break;
+	case 'c':
+		buf[0] = (char)value;
+		buf[1] = '\0';
+		break;
+	case 'r':
+		str = status_string(value);
+		if (str)
+			snprintf(buf, sizeof(buf), "%s", str);
+		else
+			value_to_hex(buf, value);
+		break;
+	case 'g':
+		snprintf(buf, sizeof(buf),
+			 "%08X-%04X-%04X-%02X%02X-%02X%02X%02X%02X%02X%02X",
+			 get32(b), get16(b + 4), get16(b + 6), b[8], b[9],
+			 b[10], b[11], b[12], b[13], b[14], b[15]);
+		break;
+	case 't':
+		/* EFI_TIME: Year, Month, Day, Hour, Minute, ... */
+		hour = b[4];
+		snprintf(buf, sizeof(buf), "%02u/%02u/%02u  %02u:%02u%c",
+			 b[2], b[3], get16(b) % 100,
+			 hour >= 13 ? hour - 12 : hour, b[5],
+			 hour >= 12 ? 'p' : 'a');
+		break;
+	case '%':
+		snprintf(buf, sizeof(buf), "%%");
+		break;
+	default:
+		/* Attribute or unknown conversion */
+		return true;
+	}
+
+	put_item(t, item, buf);
+	return true;
+}
+
+static bool is_modifier(unsigned int c)
+{
+	return (c >= '0' && c <= '9') || c == '-' || c == ',' ||
+		c == '.' || c == 'l' || c == 'h';
+}
+
+static void format_record(struct text *t, struct image *image,
+			  const unsigned char *rec, size_t size)
+{
+	struct record_reader r = {
+		.data = rec + sizeof(struct log_record),
+		.len = size - sizeof(struct log_record)
+	};
+	struct format fmt = { 0 };
+	struct item item;
+	size_t i, *parse;
+	uint64_t value;
+	bool missing = false;
+	unsigned int c;
+
+	if (rec[3] & LOG_RECORD_INLINE_FMT) {
+		fmt.ascii = get_str(&r);
+		if (!fmt.ascii) {
+			text_puts(t, "<corrupted record>\n");
+			return;
+		}
+		fmt.len = strlen(fmt.ascii);
+	} else {
+		fmt.wide = image_string(image, get32(rec + 4), &fmt.len);
+		if (!fmt.wide) {
+			text_puts(t, "<format string not found in the image>\n");
+			return;
+		}
+	}
+	t->tsc = get64(rec + 8);
+
+	for (i = 0; (c = fmt_char(&fmt, i)); i++) {
+		if (c != '%') {
+			text_putc(t, c);
+			continue;
+		}
+
+		memset(&item, 0, sizeof(item));
+		item.pad = ' ';
+		item.pad_before = true;
+		parse = &item.width;
+		for (i++; (c = fmt_char(&fmt, i)) == '*' || is_modifier(c); i++) {
+			if (c == '0' && parse == &item.width && !item.width) {
+				item.pad = '0';
+				continue;
+			}
+			if (c >= '0' && c <= '9') {
+				*parse = *parse * 10 + c - '0';
+				continue;
+			}
+
+			switch (c) {
+			case '-':
+				item.pad_before = false;
+				break;
+			case ',':
+				item.comma = true;
+				break;
+			case '.':
+				parse = &item.field_width;
+				item.field_width_set = true;
+				break;
+			case 'l':
+				item.lng = true;
+				break;
+			case '*':
+				if (get_value(&r, &value))
+					*parse = value;
+				else
+					missing = true;
+				break;
+			}
+		}
+		if (!c)
+			break;
+		if (missing)
+			continue;
+		if (!format_conversion(t, &r, &item, c)) {
+			missing = true;
+			text_puts(t, "...");
+		}
+	}
+}
+
+static unsigned int parse_level(const char *str)
+{
+	static const char *levels[] = {
+		[LOG_LEVEL_ERROR] = "error",
+		[LOG_LEVEL_INFO] = "info",
+		[LOG_LEVEL_DEBUG] = "debug"
+	};
+	unsigned int i;
+
+	for (i = LOG_LEVEL_ERROR; i < ARRAY_SIZE(levels); i++)
+		if (!strcmp(str, levels[i]))
+			return i;
+
+	usage(EXIT_FAILURE);
+	return 0;
+}
+
+static struct option const long_options[] = {
+	{"image", required_argument, NULL, 'i'},
+	{"level", required_argument, NULL, 'l'},
+	{"output-file", required_argument, NULL, 'o'},
+	{"help", no_argument, NULL, 'h'},
+	{NULL, 0, NULL, 0}
+};
+
+int main(int argc, char **argv)
+{
+	struct image image;
+	struct text t = { .line_start = true };
+	const unsigned char *log, *rec;
+	unsigned char *data;
+	unsigned int level = LOG_LEVEL_DEBUG;
+	const char *ipath = NULL;
+	const char *opath = NULL;
+	size_t size, pos, rec_size, header_size;
+	int c;
+
+	program_name = argv[0];
+
+	while ((c = getopt_long(argc, argv, "i:l:o:h", long_options, NULL)) != -1) {
+		switch (c) {
+		case 'i':
+			ipath = optarg;
+			break;
+		case 'l':
+			level = parse_level(optarg);
+			break;
+		case 'o':
+			opath = optarg;
+			break;
+		case 'h':
+			usage(EXIT_SUCCESS);
+			break;
+		default:
+			usage(EXIT_FAILURE);
+			break;
+		}
+	}
+
+	if (!ipath || optind != argc - 1)
+		usage(EXIT_FAILURE);
+
+	load_image(&image, ipath);
+	data = read_file(argv[optind], &size);
+
+	/* efivarfs files start with the variable attributes */
+	log = data;
+	if (size >= 4 + sizeof(struct log_var_header) &&
+	    get32(data) != LOG_VAR_MAGIC && get32(data + 4) == LOG_VAR_MAGIC) {
+		log += 4;
+		size -= 4;
+	}
+
+	if (size < sizeof(struct log_var_header) || get32(log) != LOG_VAR_MAGIC)
+		fatal("Not a binary log, it may already be text");
+	if (get16(log + 4) != LOG_VAR_VERSION)
+		fatal("Unsupported log version");
+	header_size = get16(log + 6);
+	if (header_size < sizeof(struct log_var_header) || header_size > size)
+		fatal("Corrupted log header");
+	if (get32(log + 8) != image.id)
+		fprintf(stderr, "%s: warning: the log was not written by this image\n",
+			basename(program_name));
+	t.tsc_hz = get64(log + 16);
+
+	t.f = opath ? fopen(opath, "w") : stdout;
+	if (!t.f)
+		error(opath);
+
+	for (pos = header_size; size - pos >= sizeof(struct log_record);
+	     pos += (rec_size + LOG_RECORD_ALIGN - 1) & ~(LOG_RECORD_ALIGN - 1)) {
+		rec = log + pos;
+		rec_size = get16(rec);
+		if (rec_size < sizeof(struct log_record) || rec_size > size - pos) {
+			fprintf(stderr, "%s: corrupted record at offset %zu\n",
+				basename(program_name), pos);
+			break;
+		}
+		if (rec[2] <= level)
+			format_record(&t, &image, rec, rec_size);
+		if (((rec_size + LOG_RECORD_ALIGN - 1) & ~(LOG_RECORD_ALIGN - 1)) >= size - pos)
+			break;
+	}
+
+	if (opath)
+		fclose(t.f);
+	free(image.data);
+	free(data);
+
+	return EXIT_SUCCESS;
+}
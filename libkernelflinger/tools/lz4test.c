@@ -0,0 +1,511 @@
+/*
+ * Copyright (c) 2017, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer
+ *      in the documentation and/or other materials provided with the
+ *      distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+/* Check the LZ4 code of kernelflinger against the lz4 command line
+ * tool, which writes the frames the boot images hold, and feed the
+ * frame decoder with corrupted frames.  The decoder runs on
+ * unauthenticated data, this tool is best built with
+ * -fsanitize=address. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <libgen.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+#include "lz4.h"
+
+#define ARRAY_SIZE(x) (sizeof(x) / sizeof(*x))
+
+/* Largest block size of the frame format */
+#define BLOCK_MAX (4 * 1024 * 1024)
+
+static char *program_name;
+static const char *lz4_program = "lz4";
+static unsigned int failures;
+
+static void usage(int status)
+{
+	printf("Usage: %s [-l PROGRAM] [-n ITERATIONS] [-s SEED] [FILE]...\n",
+	       basename((char *)program_name));
+	printf("\
+Compress each FILE, or generated samples if no FILE is given, with the\n\
+lz4 command line tool and decompress it with kernelflinger, and the\n\
+other way around, then decompress corrupted copies of the frames.\n\
+  -l, --lz4=PROGRAM             lz4 command line tool (default: lz4)\n\
+  -n, --iterations=ITERATIONS   corrupted frames per sample (default: 1000)\n\
+  -s, --seed=SEED               random seed (default: 1)\n\
+  -h, --help                    display this help\n\
+");
+	exit(status);
+}
+
+static void error(const char *s)
+{
+	perror(s);
+	exit(EXIT_FAILURE);
+}
+
+static void fail(const char *name, const char *what)
+{
+	fprintf(stderr, "%s: %s: %s\n", basename(program_name), name, what);
+	failures++;
+}
+
+static unsigned char *read_file(const char *path, size_t *size)
+{
+	unsigned char *data;
+	FILE *fp;
+	long len;
+
+	fp = fopen(path, "rb");
+	if (!fp)
+		error(path);
+
+	if (fseek(fp, 0, SEEK_END) || (len = ftell(fp)) < 0 ||
+	    fseek(fp, 0, SEEK_SET))
+		error(path);
+
+	data = malloc(len ? len : 1);
+	if (!data)
+		error("malloc");
+
+	if (fread(data, 1, len, fp) != (size_t)len)
+		error(path);
+
+	fclose(fp);
+	*size = len;
+	return data;
+}
+
+static void write_file(const char *path, const unsigned char *data, size_t size)
+{
+	FILE *fp;
+
+	fp = fopen(path, "wb");
+	if (!fp)
+		error(path);
+
+	if (fwrite(data, 1, size, fp) != size || fclose(fp))
+		error(path);
+}
+
+static void temp_file(char *path, size_t size)
+{
+	const char *dir = getenv("TMPDIR");
+	int fd;
+
+	snprintf(path, size, "%s/lz4testXXXXXX", dir ? dir : "/tmp");
+	fd = mkstemp(path);
+	if (fd == -1)
+		error(path);
+	close(fd);
+}
+
+static uint32_t get32(const unsigned char *p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void put32(unsigned char *p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+#define PRIME32_1 2654435761U
+#define PRIME32_2 2246822519U
+#define PRIME32_3 3266489917U
+#define PRIME32_4 668265263U
+#define PRIME32_5 374761393U
+
+static uint32_t rotl32(uint32_t v, int r)
+{
+	return v << r | v >> (32 - r);
+}
+
+/* xxHash32, for the frame header checksum the lz4 tool verifies */
+static uint32_t xxh32(const unsigned char *p, size_t len)
+{
+	const unsigned char *end = p + len;
+	uint32_t v[4] = { PRIME32_1 + PRIME32_2, PRIME32_2, 0, -PRIME32_1 };
+	uint32_t h;
+	int i;
+
+	if (len >= 16) {
+		do {
+			for (i = 0; i < 4; i++, p += 4)
+				v[i] = rotl32(v[i] + get32(p) * PRIME32_2, 13) * PRIME32_1;
+		} while (end - p >= 16);
+		h = rotl32(v[0], 1) + rotl32(v[1], 7) +
+			rotl32(v[2], 12) + rotl32(v[3], 18);
+	} else
+		h = PRIME32_5;
+
+	h += len;
+	for (; end - p >= 4; p += 4)
+		h = rotl32(h + get32(p) * PRIME32_3, 17) * PRIME32_4;
+	for (; p < end; p++)
+		h = rotl32(h + *p * PRIME32_5, 11) * PRIME32_1;
+
+	h ^= h >> 15;
+	h *= PRIME32_2;
+	h ^= h >> 13;
+	h *= PRIME32_3;
+	h ^= h >> 16;
+	return h;
+}
+
+/* Write DATA as a frame of independent lz4_compress() blocks, with
+ * the content size and without checksum. */
+static unsigned char *make_frame(const unsigned char *data, size_t size,
+				 size_t *frame_len)
+{
+	unsigned char *frame, *p;
+	size_t block, len, i;
+
+	frame = malloc(15 + size + (size / BLOCK_MAX + 1) * 4 + 4);
+	if (!frame)
+		error("malloc");
+
+	put32(frame, LZ4_FRAME_MAGIC);
+	frame[4] = 0x68;	/* Version 1, independent blocks, size */
+	frame[5] = 0x70;	/* 4 MB blocks */
+	for (i = 0; i < 8; i++)
+		frame[6 + i] = (uint64_t)size >> (8 * i);
+	frame[14] = xxh32(frame + 4, 10) >> 8;
+
+	p = frame + 15;
+	for (i = 0; i < size; i += block) {
+		block = size - i < BLOCK_MAX ? size - i : BLOCK_MAX;
+		len = lz4_compress(data + i, block, p + 4, block - 1);
+		if (len)
+			put32(p, len);
+		else {
+			len = block;
+			put32(p, len | 0x80000000);
+			memcpy(p + 4, data + i, len);
+		}
+		p += 4 + len;
+	}
+	put32(p, 0);
+
+	*frame_len = p + 4 - frame;
+	return frame;
+}
+
+/* Decompress the FRAME_LEN bytes of FRAME into DST_SIZE bytes as if
+ * it was read by random size chunks.  Return the
+ * lz4_frame_decompress() status once the whole frame is available. */
+static int decompress(const unsigned char *frame, size_t frame_len,
+		      unsigned char *dst, size_t dst_size, size_t *out)
+{
+	struct lz4_frame f;
+	size_t avail = 0;
+	int status;
+
+	lz4_frame_init(&f, frame, frame_len, dst, dst_size);
+	do {
+		avail += 1 + rand() % (256 * 1024);
+		if (avail > frame_len)
+			avail = frame_len;
+		status = lz4_frame_decompress(&f, avail);
+	} while (!status && avail < frame_len);
+
+	*out = f.out;
+	return status;
+}
+
+static const char *CLI_OPTIONS[] = {
+	"-B4",
+	"-B4 -BD",
+	"-B5 --content-size",
+	"-B6 -BX",
+	"-B7 -BD -BX --content-size",
+	"-B4 --no-frame-crc -9"
+};
+
+static void check_cli_frames(const char *name, const unsigned char *data,
+			     size_t size, unsigned char **frames, size_t *frames_len)
+{
+	char in[256], out[256], cmd[1024];
+	unsigned char *dst;
+	size_t i, len;
+	uint64_t content_size;
+
+	temp_file(in, sizeof(in));
+	temp_file(out, sizeof(out));
+	write_file(in, data, size);
+
+	dst = malloc(size + 1);
+	if (!dst)
+		error("malloc");
+
+	for (i = 0; i < ARRAY_SIZE(CLI_OPTIONS); i++) {
+		snprintf(cmd, sizeof(cmd), "%s -q -f %s %s %s", lz4_program,
+			 CLI_OPTIONS[i], in, out);
+		if (system(cmd))
+			error(cmd);
+		frames[i] = read_file(out, &frames_len[i]);
+
+		if (decompress(frames[i], frames_len[i], dst, size, &len) != 1 ||
+		    len != size || memcmp(dst, data, size))
+			fail(name, CLI_OPTIONS[i]);
+
+		if (strstr(CLI_OPTIONS[i], "--content-size") &&
+		    (lz4_frame_content_size(frames[i], frames_len[i], &content_size) ||
+		     content_size != size))
+			fail(name, "content size");
+
+		/* One byte short */
+		if (size && decompress(frames[i], frames_len[i], dst, size - 1, &len) != -1)
+			fail(name, "output overflow not detected");
+	}
+
+	free(dst);
+	unlink(in);
+	unlink(out);
+}
+
+static void check_own_frame(const char *name, const unsigned char *data,
+			    size_t size)
+{
+	char in[256], out[256], cmd[1024];
+	unsigned char *frame, *res;
+	size_t frame_len, res_len;
+
+	frame = make_frame(data, size, &frame_len);
+
+	temp_file(in, sizeof(in));
+	temp_file(out, sizeof(out));
+	write_file(in, frame, frame_len);
+
+	snprintf(cmd, sizeof(cmd), "%s -q -d -f %s %s", lz4_program, in, out);
+	if (system(cmd))
+		fail(name, "lz4_compress() frame rejected by the lz4 tool");
+	else {
+		res = read_file(out, &res_len);
+		if (res_len != size || memcmp(res, data, size))
+			fail(name, "lz4_compress() frame mismatch");
+		free(res);
+	}
+
+	unlink(in);
+	unlink(out);
+	free(frame);
+}
+
+/* Header fields the decoder must reject */
+static void check_headers(const char *name, const unsigned char *frame,
+			  size_t frame_len, size_t size)
+{
+	static const struct {
+		size_t offset;
+		unsigned char mask;
+		unsigned char value;
+		const char *what;
+	} FIELDS[] = {
+		{ 4, 0xc0, 0x80, "FLG version" },
+		{ 4, 0x02, 0x02, "FLG reserved bit" },
+		{ 4, 0x01, 0x01, "FLG dictionary ID" },
+		{ 5, 0x80, 0x80, "BD reserved bit" },
+		{ 5, 0x0f, 0x01, "BD reserved bits" },
+		{ 5, 0x70, 0x30, "BD block size 3" }
+	};
+	unsigned char *copy, *dst;
+	size_t i, len;
+
+	copy = malloc(frame_len);
+	dst = malloc(size + 1);
+	if (!copy || !dst)
+		error("malloc");
+
+	for (i = 0; i < ARRAY_SIZE(FIELDS); i++) {
+		memcpy(copy, frame, frame_len);
+		copy[FIELDS[i].offset] &= ~FIELDS[i].mask;
+		copy[FIELDS[i].offset] |= FIELDS[i].value;
+		if (decompress(copy, frame_len, dst, size + 1, &len) != -1)
+			fail(name, FIELDS[i].what);
+	}
+
+	free(copy);
+	free(dst);
+}
+
+static void check_mutations(const char *name, const unsigned char *frame,
+			    size_t frame_len, size_t size, unsigned int iterations)
+{
+	unsigned char *src, *dst;
+	size_t len, dst_size, out;
+	unsigned int i, n;
+	int status;
+
+	for (i = 0; i < iterations; i++) {
+		/* Exact size buffers so that the out of bounds
+		 * accesses are caught by the address sanitizer */
+		len = rand() % 4 ? frame_len : 1 + rand() % frame_len;
+		dst_size = size + rand() % 16;
+		src = malloc(len);
+		dst = malloc(dst_size ? dst_size : 1);
+		if (!src || !dst)
+			error("malloc");
+
+		memcpy(src, frame, len);
+		for (n = 1 + rand() % 4; n; n--)
+			src[rand() % len] = rand();
+
+		status = decompress(src, len, dst, dst_size, &out);
+		if (status == 0)
+			fail(name, "decoder waits for data past the frame end");
+		if (status == 1 && out > dst_size)
+			fail(name, "decoder wrote past the buffer");
+
+		free(src);
+		free(dst);
+	}
+}
+
+static unsigned char *sample(unsigned int type, size_t *size, const char **name)
+{
+	static const char *NAMES[] = { "zeros", "random", "text", "mixed" };
+	static const char *WORDS[] = { "kernel", "ramdisk", "boot ", "slot",
+				       "\n", "image", "verified ", "0x1000" };
+	const char *word;
+	unsigned char *data;
+	size_t i, len;
+
+	*name = NAMES[type];
+	*size = type == 2 ? 5 * 1024 * 1024 + 17 : 300 * 1024 + 3;
+	data = calloc(1, *size);
+	if (!data)
+		error("calloc");
+
+	for (i = 0; type && i < *size; i += len) {
+		if (type == 1 || (type == 3 && (i / 4096) % 3 == 0)) {
+			data[i] = rand();
+			len = 1;
+			continue;
+		}
+		if (type == 3 && (i / 4096) % 3 == 1) {
+			len = 1;
+			continue;
+		}
+		word = WORDS[rand() % ARRAY_SIZE(WORDS)];
+		len = strlen(word);
+		if (len > *size - i)
+			len = *size - i;
+		memcpy(data + i, word, len);
+	}
+
+	return data;
+}
+
+static void check(const char *name, const unsigned char *data, size_t size,
+		  unsigned int iterations)
+{
+	unsigned char *frames[ARRAY_SIZE(CLI_OPTIONS)];
+	size_t frames_len[ARRAY_SIZE(CLI_OPTIONS)];
+	size_t i;
+
+	check_cli_frames(name, data, size, frames, frames_len);
+	check_own_frame(name, data, size);
+
+	for (i = 0; i < ARRAY_SIZE(CLI_OPTIONS); i++) {
+		check_headers(name, frames[i], frames_len[i], size);
+		check_mutations(name, frames[i], frames_len[i], size,
+				iterations / ARRAY_SIZE(CLI_OPTIONS) + 1);
+		free(frames[i]);
+	}
+}
+
+static struct option const long_options[] = {
+	{"lz4", required_argument, NULL, 'l'},
+	{"iterations", required_argument, NULL, 'n'},
+	{"seed", required_argument, NULL, 's'},
+	{"help", no_argument, NULL, 'h'},
+	{NULL, 0, NULL, 0}
+};
+
+int main(int argc, char **argv)
+{
+	unsigned int iterations = 1000, seed = 1, i;
+	unsigned char *data;
+	const char *name;
+	size_t size;
+	int c;
+
+	program_name = argv[0];
+
+	while ((c = getopt_long(argc, argv, "l:n:s:h", long_options, NULL)) != -1) {
+		switch (c) {
+		case 'l':
+			lz4_program = optarg;
+			break;
+		case 'n':
+			iterations = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			seed = strtoul(optarg, NULL, 0);
+			break;
+		case 'h':
+			usage(EXIT_SUCCESS);
+		default:
+			usage(EXIT_FAILURE);
+		}
+	}
+
+	srand(seed);
+
+	if (optind == argc) {
+		for (i = 0; i < 4; i++) {
+			data = sample(i, &size, &name);
+			check(name, data, size, iterations);
+			free(data);
+		}
+	}
+
+	for (; optind < argc; optind++) {
+		data = read_file(argv[optind], &size);
+		check(argv[optind], data, size, iterations);
+		free(data);
+	}
+
+	if (failures) {
+		fprintf(stderr, "%u failure(s)\n", failures);
+		return EXIT_FAILURE;
+	}
+
+	printf("All the checks passed\n");
+	return EXIT_SUCCESS;
+}
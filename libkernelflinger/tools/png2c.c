@@ -43,13 +43,15 @@
 #include <errno.h>
 #include <stdbool.h>
 
+#include "lz4.h"
+
 #define ARRAY_SIZE(x) (sizeof(x) / sizeof(*x))
 
 static char *program_name;
 
 static void usage(int status)
 {
-	printf("Usage: %s -i FILE -o FILE -f FORMAT -p NAME\n",
+	printf("Usage: %s -i FILE -o FILE -f FORMAT -p NAME [-c]\n",
 	       basename((char *)program_name));
 	printf("\
 Transform PNG file to C source data structure.\n\
@@ -57,6 +59,7 @@ Transform PNG file to C source data structure.\n\
   -i, --input-file=FILE         write data into FILE instead of printing it\n\
   -f, --output-format=FORMAT    allowed values are: RGBA, BGRA, GRAY\n\
   -p, --prefix=NAME             prefix name for C content\n\
+  -c, --compress                LZ4 compress the data\n\
   -h, --help                    display this help\n\
 ");
 	exit(status);
@@ -125,6 +128,7 @@ static struct option const long_options[] = {
 	{"output-file", required_argument, NULL, 'o'},
 	{"output-format", required_argument, NULL, 'f'},
 	{"prefix", required_argument, NULL, 'p'},
+	{"compress", no_argument, NULL, 'c'},
 	{"help", no_argument, NULL, 'h'},
 	{NULL, 0, NULL, 0}
 };
@@ -139,11 +143,14 @@ int main(int argc, char **argv)
 	const char *ipath = NULL;
 	const char *opath = NULL;
 	const char *prefix = NULL;
+	bool compress = false;
+	png_bytep lz4_buffer;
+	size_t lz4_size;
 	char c;
 
 	program_name = argv[0];
 
-	while ((c = getopt_long(argc, argv, "i:o:f:p:h", long_options, NULL)) != -1) {
+	while ((c = getopt_long(argc, argv, "i:o:f:p:ch", long_options, NULL)) != -1) {
 		switch (c) {
 		case 'i':
 			ipath = optarg;
@@ -158,6 +165,9 @@ int main(int argc, char **argv)
 			format = get_format_from_string(optarg);
 			format_initialized = true;
 			break;
+		case 'c':
+			compress = true;
+			break;
 		case 'h':
 			usage(EXIT_SUCCESS);
 			break;
@@ -186,6 +196,20 @@ int main(int argc, char **argv)
 	if (!png_image_finish_read(&image, NULL, buffer, 0, NULL))
 		error("Failed to read  PNG file.");
 
+	if (compress) {
+		lz4_size = LZ4_COMPRESS_BOUND(size);
+		lz4_buffer = malloc(lz4_size);
+		if (!lz4_buffer)
+			error("Failed to allocate buffer.");
+
+		size = lz4_compress(buffer, size, lz4_buffer, lz4_size);
+		if (!size)
+			error("Failed to compress data.");
+
+		free(buffer);
+		buffer = lz4_buffer;
+	}
+
 	write_to_c_source(prefix, buffer, size, opath);
 
 	png_image_free(&image);
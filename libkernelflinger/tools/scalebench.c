@@ -0,0 +1,250 @@
+/*
+ * Copyright (c) 2017, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer
+ *      in the documentation and/or other materials provided with the
+ *      distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+/* Benchmark the image scaler of kernelflinger on the host: each
+ * scaling is timed with the portable code and with the SSE4.1 and
+ * AVX2 code the CPU supports, and the outputs are compared since all
+ * the variants must return the same pixels. */
+
+#include <stdio.h>
+#include <string.h>
+#include <libgen.h>
+#include <getopt.h>
+#include <time.h>
+
+#include "lib.h"
+#include "ui.h"
+
+/* The boot splash images are BLT buffers of 4 bytes pixels */
+#define DEPTH	4
+
+struct scaling {
+	int sx, sy;
+	int dx, dy;
+};
+
+static const struct scaling SCALINGS[] = {
+	{ 1024, 768, 2880, 2160 },
+	{ 1920, 1080, 3840, 2160 },
+	{ 3840, 2160, 1280, 720 },
+	{ 300, 200, 1920, 1280 }
+};
+
+static const struct {
+	const char *name;
+	BOOLEAN accelerated;
+	unsigned int features;
+} VARIANTS[] = {
+	{ "portable", FALSE, 0 },
+	{ "SSE4.1", TRUE, 1 << CPU_FEATURE_SSE41 },
+	{ "AVX2", TRUE, 1 << CPU_FEATURE_SSE41 | 1 << CPU_FEATURE_AVX2 }
+};
+
+static char *program_name;
+static unsigned int failures;
+static unsigned int features, host_features;
+
+static void usage(int status)
+{
+	printf("Usage: %s [-n ITERATIONS] [-s SEED] [SXxSY:DXxDY]...\n",
+	       basename(program_name));
+	printf("\
+Scale random SXxSY images to DXxDY, or to a set of boot splash sizes\n\
+if none is given, with each variant of the kernelflinger scaler and\n\
+report the best time of each.\n\
+  -n, --iterations=ITERATIONS   scalings per variant (default: 10)\n\
+  -s, --seed=SEED               random seed (default: 1)\n\
+  -h, --help                    display this help\n\
+");
+	exit(status);
+}
+
+static void die(const char *s)
+{
+	perror(s);
+	exit(EXIT_FAILURE);
+}
+
+static void fail(const char *name, const char *what)
+{
+	fprintf(stderr, "%s: %s: %s\n", basename(program_name), name, what);
+	failures++;
+}
+
+void host_error(const wchar_t *fmt)
+{
+	printf("  ui_scale: %ls\n", fmt);
+}
+
+BOOLEAN cpu_has_feature(cpu_feature_t feature)
+{
+	return !!(features & 1 << feature);
+}
+
+BOOLEAN cpu_avx_state_enabled(void)
+{
+	return !!(features & 1 << CPU_FEATURE_AVX2);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Smooth gradients with some noise, as a photograph would be */
+static unsigned char *sample(int width, int height)
+{
+	unsigned char *image, *p;
+	int x, y, c;
+
+	image = malloc((size_t)width * height * DEPTH);
+	if (!image)
+		die("malloc");
+
+	for (y = 0, p = image; y < height; y++)
+		for (x = 0; x < width; x++)
+			for (c = 0; c < DEPTH; c++)
+				*p++ = (x * (c + 1) + y * (DEPTH - c)) / 4 + rand() % 16;
+
+	return image;
+}
+
+static void check(const struct scaling *s, unsigned int iterations)
+{
+	unsigned char *src, *dst, *ref = NULL;
+	size_t dst_len = (size_t)s->dx * s->dy * DEPTH;
+	double start, elapsed, best;
+	char name[64];
+	unsigned int i, j;
+
+	snprintf(name, sizeof(name), "%dx%d to %dx%d", s->sx, s->sy, s->dx, s->dy);
+	printf("%s:\n", name);
+
+	src = sample(s->sx, s->sy);
+	dst = malloc(dst_len);
+	if (!dst)
+		die("malloc");
+
+	for (i = 0; i < ARRAY_SIZE(VARIANTS); i++) {
+		if ((VARIANTS[i].features & host_features) != VARIANTS[i].features)
+			continue;
+
+		features = VARIANTS[i].features;
+		ui_bilinear_scale_accelerated(VARIANTS[i].accelerated);
+
+		for (j = 0, best = 0; j < iterations; j++) {
+			memset(dst, 0, dst_len);
+			start = now();
+			if (EFI_ERROR(ui_bilinear_scale(src, dst, s->sx, s->sy,
+							s->dx, s->dy, DEPTH))) {
+				fail(name, "scaling failed");
+				break;
+			}
+			elapsed = now() - start;
+			if (!j || elapsed < best)
+				best = elapsed;
+		}
+		printf("  %-8s %8.2f ms\n", VARIANTS[i].name, best * 1e3);
+
+		if (!ref) {
+			ref = dst;
+			dst = malloc(dst_len);
+			if (!dst)
+				die("malloc");
+		} else if (memcmp(ref, dst, dst_len))
+			fail(name, "the variants return different pixels");
+	}
+
+	free(src);
+	free(dst);
+	free(ref);
+}
+
+static struct option const long_options[] = {
+	{"iterations", required_argument, NULL, 'n'},
+	{"seed", required_argument, NULL, 's'},
+	{"help", no_argument, NULL, 'h'},
+	{NULL, 0, NULL, 0}
+};
+
+int main(int argc, char **argv)
+{
+	unsigned int iterations = 10, seed = 1, i;
+	struct scaling s;
+	int c;
+
+	program_name = argv[0];
+
+	while ((c = getopt_long(argc, argv, "n:s:h", long_options, NULL)) != -1) {
+		switch (c) {
+		case 'n':
+			iterations = strtoul(optarg, NULL, 0);
+			if (!iterations)
+				usage(EXIT_FAILURE);
+			break;
+		case 's':
+			seed = strtoul(optarg, NULL, 0);
+			break;
+		case 'h':
+			usage(EXIT_SUCCESS);
+		default:
+			usage(EXIT_FAILURE);
+		}
+	}
+
+	srand(seed);
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse4.1"))
+		host_features |= 1 << CPU_FEATURE_SSE41;
+	if (__builtin_cpu_supports("avx2"))
+		host_features |= 1 << CPU_FEATURE_AVX2;
+
+	if (optind == argc)
+		for (i = 0; i < ARRAY_SIZE(SCALINGS); i++)
+			check(&SCALINGS[i], iterations);
+
+	for (; optind < argc; optind++) {
+		if (sscanf(argv[optind], "%dx%d:%dx%d",
+			   &s.sx, &s.sy, &s.dx, &s.dy) != 4 ||
+		    s.sx <= 0 || s.sy <= 0 || s.dx <= 0 || s.dy <= 0)
+			usage(EXIT_FAILURE);
+		check(&s, iterations);
+	}
+
+	if (failures) {
+		fprintf(stderr, "%u failure(s)\n", failures);
+		return EXIT_FAILURE;
+	}
+
+	printf("All the checks passed\n");
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,503 @@
+/*
+ * Copyright (c) 2017, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer
+ *      in the documentation and/or other materials provided with the
+ *      distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+/* Check scrub.c on the host: threads stand in for the application
+ * processors and a reaper thread for the TPL_NOTIFY timer through
+ * which the MP Services protocol signals the end of a job.  One
+ * processor can be stalled in the middle of a chunk, longer than the
+ * boot processor waits for it, to check that memory_scrub() returns
+ * and clears that chunk itself. */
+
+#include <stdio.h>
+#include <string.h>
+#include <libgen.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "lib.h"
+#include "scrub.h"
+#include "../protocol/MpService.h"
+
+#define PATTERN		0xa5
+#define MAX_APS		63
+
+/* How long the stalled processor sleeps, in microseconds, longer
+ * than the boot processor waits for the application processors */
+#define STALL		(3 * 1000 * 1000)
+
+static char *program_name;
+static unsigned int failures;
+static unsigned int errors;
+
+static BOOLEAN avx2;
+static volatile EFI_TPL tpl = TPL_APPLICATION;
+static UINTN nr_cpus = 4;
+
+/* MP Services state */
+static pthread_t aps[MAX_APS];
+static UINTN **failed_list;
+static volatile BOOLEAN busy, signaled;
+static unsigned int startups;
+
+/* Stalled processor state */
+static __thread UINTN this_cpu;
+static unsigned char *stall_page;
+static volatile UINTN stalled_cpu;
+static volatile BOOLEAN stall_armed;
+
+EFI_BOOT_SERVICES *BS;
+
+static void usage(int status)
+{
+	printf("Usage: %s [-p PROCESSORS]\n", basename(program_name));
+	printf("\
+Clear a memory map with the kernelflinger memory scrubber, threads\n\
+standing in for the processors, and check the result.\n\
+  -p, --processors=PROCESSORS   processors, including the boot one\n\
+                                (default: 4)\n\
+  -h, --help                    display this help\n\
+");
+	exit(status);
+}
+
+static void die(const char *s)
+{
+	perror(s);
+	exit(EXIT_FAILURE);
+}
+
+static void fail(const char *name, const char *what)
+{
+	fprintf(stderr, "%s: %s: %s\n", basename(program_name), name, what);
+	failures++;
+}
+
+void host_error(const wchar_t *fmt)
+{
+	printf("  scrub: %ls\n", fmt);
+	errors++;
+}
+
+BOOLEAN cpu_has_feature(cpu_feature_t feature)
+{
+	return feature == CPU_FEATURE_AVX2 && avx2;
+}
+
+BOOLEAN cpu_avx_state_enabled(void)
+{
+	return avx2;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* The first application processor writing to the stall page sleeps
+ * there.  The boot processor unprotects it once it clears the chunk
+ * itself. */
+static void segv_handler(int sig, siginfo_t *info, void *ucontext)
+{
+	unsigned char *addr = info->si_addr;
+	struct timespec ts = { STALL / 1000000, 0 };
+
+	if (addr < stall_page || addr >= stall_page + EFI_PAGE_SIZE) {
+		signal(SIGSEGV, SIG_DFL);
+		return;
+	}
+
+	if (this_cpu && !stalled_cpu) {
+		stalled_cpu = this_cpu;
+		nanosleep(&ts, NULL);
+	}
+	mprotect(stall_page, EFI_PAGE_SIZE, PROT_READ | PROT_WRITE);
+}
+
+struct ap_start {
+	EFI_AP_PROCEDURE procedure;
+	VOID *argument;
+	UINTN cpu;
+};
+
+static void *ap_thread(void *arg)
+{
+	struct ap_start *start = arg;
+
+	this_cpu = start->cpu;
+	start->procedure(start->argument);
+	free(start);
+	return NULL;
+}
+
+/* Plays the MP Services timer: the event is signaled once all the
+ * processors are done, the timer being blocked while the TPL is
+ * TPL_NOTIFY or above.  A stalled processor is reported as failed,
+ * as if it had been reset after the timeout. */
+static void *reaper_thread(void *arg)
+{
+	UINTN i;
+
+	for (i = 0; i < nr_cpus - 1; i++)
+		pthread_join(aps[i], NULL);
+
+	while (tpl >= TPL_NOTIFY)
+		usleep(1000);
+
+	if (failed_list && stalled_cpu) {
+		*failed_list = malloc(2 * sizeof(**failed_list));
+		if (!*failed_list)
+			die("malloc");
+		(*failed_list)[0] = stalled_cpu;
+		(*failed_list)[1] = END_OF_CPU_LIST;
+	}
+
+	__sync_synchronize();
+	signaled = TRUE;
+	busy = FALSE;
+	return NULL;
+}
+
+static EFI_STATUS startup_all_aps(EFI_MP_SERVICES_PROTOCOL *this,
+				  EFI_AP_PROCEDURE procedure,
+				  BOOLEAN single_thread, EFI_EVENT event,
+				  UINTN timeout, VOID *argument,
+				  UINTN **failed_cpus)
+{
+	struct ap_start *start;
+	pthread_t reaper;
+	UINTN i;
+
+	if (single_thread || !event || !timeout)
+		fail("StartupAllAPs", "unexpected arguments");
+	if (busy)
+		return EFI_NOT_READY;
+
+	busy = TRUE;
+	startups++;
+	failed_list = failed_cpus;
+	if (failed_list)
+		*failed_list = NULL;
+
+	for (i = 0; i < nr_cpus - 1; i++) {
+		start = malloc(sizeof(*start));
+		if (!start)
+			die("malloc");
+		*start = (struct ap_start){ procedure, argument, i + 1 };
+		if (pthread_create(&aps[i], NULL, ap_thread, start))
+			die("pthread_create");
+	}
+
+	if (pthread_create(&reaper, NULL, reaper_thread, NULL))
+		die("pthread_create");
+	pthread_detach(reaper);
+
+	/* Let an application processor take the first chunk */
+	while (stall_armed && !stalled_cpu)
+		usleep(100);
+
+	return EFI_SUCCESS;
+}
+
+static EFI_STATUS get_number_of_processors(EFI_MP_SERVICES_PROTOCOL *this,
+					   UINTN *nr, UINTN *nr_enabled)
+{
+	*nr = *nr_enabled = nr_cpus;
+	return EFI_SUCCESS;
+}
+
+static EFI_MP_SERVICES_PROTOCOL mp_services = {
+	.GetNumberOfProcessors = get_number_of_processors,
+	.StartupAllAPs = startup_all_aps
+};
+
+static EFI_STATUS locate_protocol(EFI_GUID *protocol, VOID *registration,
+				  VOID **interface)
+{
+	*interface = &mp_services;
+	return EFI_SUCCESS;
+}
+
+static EFI_STATUS create_event(UINT32 type, EFI_TPL notify_tpl, VOID *notify,
+			       VOID *context, EFI_EVENT *event)
+{
+	*event = (EFI_EVENT)&signaled;
+	return EFI_SUCCESS;
+}
+
+static EFI_STATUS check_event(EFI_EVENT event)
+{
+	if (!signaled)
+		return EFI_NOT_READY;
+	signaled = FALSE;
+	return EFI_SUCCESS;
+}
+
+/* Busy wait as the firmware does, sleeping would take much longer
+ * than the short stalls asked for */
+static EFI_STATUS stall(UINTN microseconds)
+{
+	double end = now() + microseconds / 1e6;
+
+	while (now() < end)
+		;
+	return EFI_SUCCESS;
+}
+
+static EFI_BOOT_SERVICES boot_services = {
+	.LocateProtocol = locate_protocol,
+	.CreateEvent = create_event,
+	.CheckEvent = check_event,
+	.Stall = stall
+};
+
+/* Conventional and boot services data regions, in pages */
+static const struct {
+	UINT32 type;
+	UINT64 pages;
+} REGIONS[] = {
+	{ EfiConventionalMemory, 3 },
+	{ EfiBootServicesData, 7000 },
+	{ EfiConventionalMemory, 1 },
+	{ EfiBootServicesData, 100 },
+	{ EfiConventionalMemory, 20000 },
+	{ EfiBootServicesData, 5 },
+	{ EfiConventionalMemory, 60000 },
+	{ EfiBootServicesData, 2 },
+	{ EfiConventionalMemory, 16384 },
+	{ EfiBootServicesData, 7 }
+};
+
+static EFI_MEMORY_DESCRIPTOR map[ARRAY_SIZE(REGIONS)];
+static size_t memory_size;
+
+static void build_map(void)
+{
+	unsigned char *memory;
+	size_t i, offset;
+
+	for (i = 0; i < ARRAY_SIZE(REGIONS); i++)
+		memory_size += REGIONS[i].pages * EFI_PAGE_SIZE;
+
+	memory = mmap(NULL, memory_size, PROT_READ | PROT_WRITE,
+		      MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+	if (memory == MAP_FAILED)
+		die("mmap");
+
+	for (i = 0, offset = 0; i < ARRAY_SIZE(REGIONS); i++) {
+		map[i].Type = REGIONS[i].type;
+		map[i].PhysicalStart = (UINTN)memory + offset;
+		map[i].NumberOfPages = REGIONS[i].pages;
+		offset += REGIONS[i].pages * EFI_PAGE_SIZE;
+	}
+
+	/* In the first chunk */
+	stall_page = (unsigned char *)(UINTN)map[4].PhysicalStart;
+}
+
+static void fill_map(void)
+{
+	memset((void *)(UINTN)map[0].PhysicalStart, PATTERN, memory_size);
+}
+
+static void check_map(const char *name)
+{
+	unsigned char expected, *p;
+	size_t i, j, len;
+
+	for (i = 0; i < ARRAY_SIZE(map); i++) {
+		expected = map[i].Type == EfiConventionalMemory ? 0 : PATTERN;
+		p = (unsigned char *)(UINTN)map[i].PhysicalStart;
+		len = map[i].NumberOfPages * EFI_PAGE_SIZE;
+		for (j = 0; j < len; j++)
+			if (p[j] != expected) {
+				fail(name, expected ? "memory outside of the conventional regions cleared" :
+				     "conventional memory left");
+				return;
+			}
+	}
+}
+
+/* Return the time spent in memory_scrub() */
+static double scrub(const char *name, BOOLEAN stall)
+{
+	double start, elapsed;
+
+	fill_map();
+	if (stall) {
+		if (mprotect(stall_page, EFI_PAGE_SIZE, PROT_READ))
+			die("mprotect");
+		stall_armed = TRUE;
+	}
+
+	start = now();
+	if (EFI_ERROR(memory_scrub((CHAR8 *)map, ARRAY_SIZE(map), sizeof(*map))))
+		fail(name, "memory_scrub() failed");
+	elapsed = now() - start;
+	stall_armed = FALSE;
+
+	printf("%s: %.1f ms\n", name, elapsed * 1e3);
+	check_map(name);
+	return elapsed;
+}
+
+/* Lower the TPL so that the event of the last job gets signaled */
+static void settle(void)
+{
+	tpl = TPL_APPLICATION;
+	while (busy)
+		usleep(1000);
+}
+
+static void check_tpl(EFI_TPL level, BOOLEAN parallel)
+{
+	char name[64];
+	unsigned int startups_before = startups;
+
+	snprintf(name, sizeof(name), "%s, %s, TPL %u", avx2 ? "AVX2" : "stosb",
+		 parallel ? "parallel" : "boot processor", (unsigned int)level);
+
+	memory_scrub_parallel(parallel);
+	tpl = level;
+	scrub(name, FALSE);
+	if (startups - startups_before != (parallel && nr_cpus > 1))
+		fail(name, "application processors not started as expected");
+	settle();
+}
+
+/* The application processors are still busy with the last job: the
+ * next one runs on the boot processor only */
+static void check_busy(void)
+{
+	const char *name = "busy processors";
+	unsigned int startups_before;
+
+	memory_scrub_parallel(TRUE);
+	tpl = TPL_NOTIFY;
+	scrub("parallel, TPL_NOTIFY", FALSE);
+	startups_before = startups;
+	scrub(name, FALSE);
+	if (startups != startups_before)
+		fail(name, "application processors started while busy");
+	settle();
+}
+
+static void check_stall(void)
+{
+	const char *name = "stalled processor";
+	unsigned int errors_before = errors, startups_before;
+
+	if (scrub(name, TRUE) >= STALL / 1e6)
+		fail(name, "memory_scrub() waited for the stalled processor");
+	if (errors == errors_before)
+		fail(name, "stalled processor not reported");
+
+	startups_before = startups;
+	scrub("stalled processor, next job", FALSE);
+	if (startups != startups_before)
+		fail(name, "application processors started while stalled");
+
+	settle();
+	errors_before = errors;
+	scrub("stalled processor reset", FALSE);
+	if (errors == errors_before)
+		fail(name, "failed processor list not reported");
+	stalled_cpu = 0;
+	settle();
+}
+
+static struct option const long_options[] = {
+	{"processors", required_argument, NULL, 'p'},
+	{"help", no_argument, NULL, 'h'},
+	{NULL, 0, NULL, 0}
+};
+
+int main(int argc, char **argv)
+{
+	static const EFI_TPL LEVELS[] = { TPL_APPLICATION, TPL_NOTIFY };
+	struct sigaction action;
+	unsigned int i, j;
+	int c;
+
+	program_name = argv[0];
+
+	while ((c = getopt_long(argc, argv, "p:h", long_options, NULL)) != -1) {
+		switch (c) {
+		case 'p':
+			nr_cpus = strtoul(optarg, NULL, 0);
+			if (nr_cpus < 1 || nr_cpus > MAX_APS + 1)
+				usage(EXIT_FAILURE);
+			break;
+		case 'h':
+			usage(EXIT_SUCCESS);
+		default:
+			usage(EXIT_FAILURE);
+		}
+	}
+
+	memset(&action, 0, sizeof(action));
+	action.sa_sigaction = segv_handler;
+	action.sa_flags = SA_SIGINFO;
+	if (sigaction(SIGSEGV, &action, NULL))
+		die("sigaction");
+
+	BS = &boot_services;
+	build_map();
+	memory_scrub_init();
+
+	__builtin_cpu_init();
+	for (i = 0; i < 2; i++) {
+		avx2 = i && __builtin_cpu_supports("avx2");
+		if (i && !avx2)
+			break;
+		for (j = 0; j < ARRAY_SIZE(LEVELS); j++) {
+			check_tpl(LEVELS[j], FALSE);
+			check_tpl(LEVELS[j], TRUE);
+		}
+	}
+
+	if (nr_cpus > 1) {
+		check_busy();
+		check_stall();
+	}
+
+	if (failures) {
+		fprintf(stderr, "%u failure(s)\n", failures);
+		return EXIT_FAILURE;
+	}
+
+	printf("All the checks passed\n");
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2017, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer
+ *      in the documentation and/or other materials provided with the
+ *      distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include <efi.h>
+#include <efilib.h>
+
+#include "lib.h"
+#include "vars.h"
+#include "timer.h"
+#include "trace.h"
+
+/* Spans opened once SPANS is full or deeper than TRACE_MAX_DEPTH are
+ * dropped. */
+#define TRACE_MAX_SPANS		256
+#define TRACE_MAX_DEPTH		16
+/* Keep the variable in the size most firmwares accept */
+#define TRACE_VAR_SIZE		8192
+
+#define NO_SPAN			TRACE_MAX_SPANS
+
+struct trace_span {
+	const char *name;
+	UINT64 begin;
+	UINT64 end;		/* 0 while the span is open */
+	UINTN depth;
+};
+
+static struct trace_span spans[TRACE_MAX_SPANS];
+static UINTN nb_spans;
+static UINTN dropped;
+
+/* Open spans, NO_SPAN for a dropped one */
+static struct {
+	const char *name;
+	UINTN span;
+} stack[TRACE_MAX_DEPTH];
+static UINTN depth;
+
+void trace_begin(const char *name)
+{
+	UINT64 now = read_tsc();
+	UINTN span = NO_SPAN;
+
+	if (depth == TRACE_MAX_DEPTH) {
+		dropped++;
+		return;
+	}
+
+	if (nb_spans < TRACE_MAX_SPANS) {
+		span = nb_spans++;
+		spans[span].name = name;
+		spans[span].begin = now;
+		spans[span].end = 0;
+		spans[span].depth = depth;
+	} else
+		dropped++;
+
+	stack[depth].name = name;
+	stack[depth].span = span;
+	depth++;
+}
+
+void trace_end(const char *name)
+{
+	UINT64 now = read_tsc();
+	UINTN i;
+
+	for (i = depth; i > 0; i--)
+		if (stack[i - 1].name == name ||
+		    !strcmp((CHAR8 *)stack[i - 1].name, (CHAR8 *)name))
+			break;
+	if (!i)
+		return;
+
+	/* Spans left open by an error path end with their parent */
+	while (depth >= i) {
+		depth--;
+		if (stack[depth].span != NO_SPAN)
+			spans[stack[depth].span].end = now;
+	}
+}
+
+EFI_STATUS trace_to_json(CHAR8 **json_p, UINTN *len_p, UINTN max_len)
+{
+	static const char header[] = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	static const char footer[] = "],\"otherData\":{\"tsc_hz\":\"%ld\",\"dropped_spans\":\"%d\"}}";
+	CHAR8 event[192];
+	CHAR8 *json;
+	UINT64 hz, now, begin, dur;
+	UINTN i, size, len, header_len, begin_ns, dur_ns;
+	int n;
+
+	hz = tsc_frequency();
+	now = read_tsc();
+
+	size = sizeof(header) + sizeof(footer) + 64;
+	for (i = 0; i < nb_spans; i++)
+		size += strlen((CHAR8 *)spans[i].name) + sizeof(event);
+	if (max_len)
+		size = min(size, max_len + 1);
+
+	json = AllocatePool(size);
+	if (!json)
+		return EFI_OUT_OF_RESOURCES;
+
+	header_len = sizeof(header) - 1;
+	memcpy(json, header, header_len);
+	len = header_len;
+
+	for (i = 0; i < nb_spans; i++) {
+		/* Microseconds, DivU64x32() as there is no libgcc on ia32 */
+		begin = DivU64x32(tsc_to_ns(spans[i].begin), 1000, &begin_ns);
+		dur = DivU64x32(tsc_to_ns((spans[i].end ? spans[i].end : now) -
+					  spans[i].begin), 1000, &dur_ns);
+		n = efi_snprintf(event, sizeof(event),
+				 (CHAR8 *)"%a{\"name\":\"%a\",\"cat\":\"kernelflinger\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%ld.%03ld,\"dur\":%ld.%03ld}",
+				 len > header_len ? "," : "", spans[i].name,
+				 begin, (UINT64)begin_ns, dur, (UINT64)dur_ns);
+		/* Skip what efi_snprintf() may have truncated */
+		if (n < 0 || (UINTN)n >= sizeof(event) - 1)
+			continue;
+		/* Keep room for the footer */
+		if (len + n + sizeof(footer) + 64 > size)
+			break;
+		memcpy(json + len, event, n);
+		len += n;
+	}
+
+	n = efi_snprintf(json + len, size - len, (CHAR8 *)footer, hz,
+			 dropped + nb_spans - i);
+	if (n < 0) {
+		FreePool(json);
+		return EFI_INVALID_PARAMETER;
+	}
+
+	*json_p = json;
+	*len_p = len + n;
+	return EFI_SUCCESS;
+}
+
+void trace_summary(CHAR8 *buf, UINTN size)
+{
+	CHAR8 item[64];
+	UINT64 now, begin, dur;
+	UINTN i, len = 0;
+	int n;
+
+	if (!size)
+		return;
+	buf[0] = '\0';
+
+	now = read_tsc();
+
+	for (i = 0; i < nb_spans; i++) {
+		if (spans[i].depth > 1)
+			continue;
+
+		begin = DivU64x32(tsc_to_ns(spans[i].begin), 1000000, NULL);
+		dur = DivU64x32(tsc_to_ns((spans[i].end ? spans[i].end : now) -
+					  spans[i].begin), 1000000, NULL);
+		n = efi_snprintf(item, sizeof(item), (CHAR8 *)"%a%a:%ld+%ld",
+				 len ? "," : "", spans[i].name, begin, dur);
+		if (n < 0 || len + n >= size)
+			break;
+		memcpy(buf + len, item, n + 1);
+		len += n;
+	}
+}
+
+EFI_STATUS trace_save_to_var(void)
+{
+	EFI_STATUS ret;
+	CHAR8 *json;
+	UINTN len;
+
+	ret = trace_to_json(&json, &len, TRACE_VAR_SIZE);
+	if (EFI_ERROR(ret))
+		return ret;
+
+	ret = set_efi_variable(&loader_guid, TRACE_VAR, len, json, FALSE, TRUE);
+	FreePool(json);
+	return ret;
+}
@@ -428,7 +428,7 @@ cleanup_tos:
         }
 #endif
         if (*bootimage)
-                FreePool(*bootimage);
+                android_image_free(*bootimage);
         return ret;
 }
 #endif // USE_AVB
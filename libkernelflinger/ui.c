@@ -36,6 +36,8 @@
 #include <efilib.h>
 #include <lib.h>
 #include <ui.h>
+#include "trace.h"
+#include "lz4.h"
 
 #define NOT_READY_USECS	(100 * 1000)
 
@@ -91,7 +93,7 @@ out:
 	return hold_key_stall_time;
 }
 
-EFI_STATUS ui_init(UINTN *width_p, UINTN *height_p)
+static EFI_STATUS ui_setup(UINTN *width_p, UINTN *height_p)
 {
 	UINT32 mode;
 	UINTN info_size;
@@ -101,12 +103,6 @@ EFI_STATUS ui_init(UINTN *width_p, UINTN *height_p)
 	UINTN x, y, margin;
 	ui_font_t *font;
 
-	if (initialized) {
-		*width_p = graphic.width;
-		*height_p = graphic.height;
-		return EFI_SUCCESS;
-	}
-
 	ret = LibLocateProtocol(&GraphicsOutputProtocol, (VOID **)&graphic.output);
 	if (EFI_ERROR(ret)) {
 		efi_perror(ret, L"Unable to locate graphics output protocol, graphic disabled");
@@ -172,6 +168,23 @@ EFI_STATUS ui_init(UINTN *width_p, UINTN *height_p)
 	return EFI_SUCCESS;
 }
 
+EFI_STATUS ui_init(UINTN *width_p, UINTN *height_p)
+{
+	EFI_STATUS ret;
+
+	if (initialized) {
+		*width_p = graphic.width;
+		*height_p = graphic.height;
+		return EFI_SUCCESS;
+	}
+
+	TRACE_BEGIN("ui_init");
+	ret = ui_setup(width_p, height_p);
+	TRACE_END("ui_init");
+
+	return ret;
+}
+
 EFI_STATUS ui_display_vendor_splash(VOID)
 {
 	UINTN width, height, x, y, max_size;
@@ -213,6 +226,9 @@ EFI_STATUS ui_display_vendor_splash(VOID)
 
 void ui_free(void)
 {
+	ui_image_free_cache();
+	ui_textarea_free_glyph_cache();
+
 	if (!default_textarea)
 		return;
 
@@ -249,9 +265,11 @@ EFI_STATUS ui_clear_area(UINTN x, UINTN y, UINTN width, UINTN height)
 
 	ret = ui_fill_area(x, y, width, height, &COLOR_BLACK);
 
-	if (default_textarea)
+	if (default_textarea) {
+		ui_textarea_invalidate(default_textarea);
 		ret = ui_textarea_draw(default_textarea, default_textarea_x,
 				       default_textarea_y);
+	}
 	return ret;
 }
 
@@ -507,6 +525,27 @@ UINT64 ui_get_blt_size(UINTN width, UINTN height)
 	return MultU64x32(size, sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL));
 }
 
+void *ui_decompress(const char *name, const unsigned char *data,
+		    UINTN data_len, UINTN len)
+{
+	void *buf;
+	size_t size = len;
+
+	buf = AllocatePool(len);
+	if (!buf) {
+		efi_perror(EFI_OUT_OF_RESOURCES, L"Failed to allocate %a buffer", name);
+		return NULL;
+	}
+
+	if (lz4_decompress(data, data_len, buf, &size) || size != len) {
+		error(L"Failed to decompress %a resource", name);
+		FreePool(buf);
+		return NULL;
+	}
+
+	return buf;
+}
+
 void ui_get_scaled_dimension(UINTN orig_width, UINTN orig_height,
 			     UINTN max_width, UINTN max_height,
 			     UINTN *width, UINTN *height)
@@ -531,37 +570,3 @@ void ui_get_scaled_dimension(UINTN orig_width, UINTN orig_height,
 	*height = orig_height * max_width / orig_width;
 	*width = max_width;
 }
-
-/*
- * Bilinear interpolation:
- * f(x,y) = (1/(x2-x1)(y2-y1)) * (f(Q11)(x2-x)(y2-y) +
- *				f(Q21)(x-x1)(y2-y) +
- *				f(Q12)(x2-x)(y-y1) +
- *				f(Q22)(x-x1)(y-y1))
- */
-void ui_bilinear_scale(unsigned char *s, unsigned char *d,
-		       int sx, int sy, int dx, int dy,
-		       int depth)
-{
-	double ratio_x = (double)(sx - 1) / dx;
-	double ratio_y = (double)(sy - 1) / dy;
-	int i, j, k;
-	sx *= depth;
-	for (i = 0; i < dy; i++ )
-		for (j = 0; j < dx; j++) {
-			double x = j * ratio_x;
-			double y = i * ratio_y;
-			int x1 = x;
-			int x2 = x1 + 1;
-			int y1 = y;
-			int y2 = y1 + 1;
-			for (k = 0; k < depth; k++) {
-				d[j * depth + i * dx * depth + k] = (1 / ((x2 - x1) * (y2 - y1))) *
-					(s[x1 * depth + y1 * sx + k] * (x2 - x) * (y2 - y) +
-					 s[x2 * depth + y1 * sx + k] * (x - x1) * (y2 - y) +
-					 s[x1 * depth + y2 * sx + k] * (x2 - x) * (y - y1) +
-					 s[x2 * depth + y2 * sx + k] * (x - x1) * (y - y1));
-			}
-		}
-}
-
@@ -56,9 +56,18 @@ ui_font_t *ui_font_get(char *name)
 {
 	UINTN i;
 
-	for (i = 0; i < ARRAY_SIZE(ui_fonts); i++)
-		if (!strcmp((CHAR8 *)ui_fonts[i].name, (CHAR8 *)name))
-			return &ui_fonts[i];
+	for (i = 0; i < ARRAY_SIZE(ui_fonts); i++) {
+		if (strcmp((CHAR8 *)ui_fonts[i].name, (CHAR8 *)name))
+			continue;
+
+		/* Textareas keep a pointer to the font, the texture
+		 * is never freed once decoded. */
+		if (!ui_fonts[i].texture)
+			ui_fonts[i].texture = ui_decompress(name, ui_fonts[i].data,
+							    ui_fonts[i].data_len,
+							    ui_fonts[i].width * ui_fonts[i].height);
+		return ui_fonts[i].texture ? &ui_fonts[i] : NULL;
+	}
 
 	return NULL;
 }
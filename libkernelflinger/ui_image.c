@@ -39,13 +39,107 @@
 
 #include "res/img_res.h"
 
+UINTN ui_images_nb = ARRAY_SIZE(ui_images);
+
+/* Scaled images are kept as the menus and splash screens are drawn
+ * again with the same size each time they are refreshed. */
+#define SCALED_CACHE_SIZE	8
+
+static struct scaled_image {
+	EFI_GRAPHICS_OUTPUT_BLT_PIXEL *orig;
+	UINTN width;
+	UINTN height;
+	EFI_GRAPHICS_OUTPUT_BLT_PIXEL *blt;
+	UINTN last_use;
+} scaled_cache[SCALED_CACHE_SIZE];
+static UINTN scaled_cache_clock;
+
+static EFI_STATUS get_scaled(ui_image_t *image, UINTN width, UINTN height,
+			     EFI_GRAPHICS_OUTPUT_BLT_PIXEL **blt_p)
+{
+	struct scaled_image *entry = &scaled_cache[0];
+	EFI_GRAPHICS_OUTPUT_BLT_PIXEL *blt;
+	EFI_STATUS ret;
+	UINTN i;
+
+	for (i = 0; i < ARRAY_SIZE(scaled_cache); i++) {
+		if (scaled_cache[i].blt && scaled_cache[i].orig == image->blt &&
+		    scaled_cache[i].width == width &&
+		    scaled_cache[i].height == height) {
+			scaled_cache[i].last_use = ++scaled_cache_clock;
+			*blt_p = scaled_cache[i].blt;
+			return EFI_SUCCESS;
+		}
+		if (scaled_cache[i].last_use < entry->last_use)
+			entry = &scaled_cache[i];
+	}
+
+	blt = AllocatePool(ui_get_blt_size(width, height));
+	if (!blt) {
+		efi_perror(EFI_OUT_OF_RESOURCES, L"Failed to allocate buffer");
+		return EFI_OUT_OF_RESOURCES;
+	}
+
+	ret = ui_bilinear_scale((unsigned char *)image->blt,
+				(unsigned char *)blt,
+				image->width, image->height,
+				width, height,
+				sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL));
+	if (EFI_ERROR(ret)) {
+		efi_perror(ret, L"Failed to scale image %a", image->name);
+		FreePool(blt);
+		return ret;
+	}
+
+	if (entry->blt)
+		FreePool(entry->blt);
+	entry->orig = image->blt;
+	entry->width = width;
+	entry->height = height;
+	entry->blt = blt;
+	entry->last_use = ++scaled_cache_clock;
+
+	*blt_p = blt;
+	return EFI_SUCCESS;
+}
+
+void ui_image_free_cache(void)
+{
+	UINTN i;
+
+	for (i = 0; i < ARRAY_SIZE(scaled_cache); i++)
+		if (scaled_cache[i].blt)
+			FreePool(scaled_cache[i].blt);
+	memset(scaled_cache, 0, sizeof(scaled_cache));
+
+	/* They are decoded again if the UI is used after ui_free() */
+	for (i = 0; i < ARRAY_SIZE(ui_images); i++)
+		if (ui_images[i].blt) {
+			FreePool(ui_images[i].blt);
+			ui_images[i].blt = NULL;
+		}
+}
+
+static EFI_STATUS ui_image_decode(ui_image_t *image)
+{
+	if (image->blt)
+		return EFI_SUCCESS;
+
+	image->blt = ui_decompress(image->name, image->data, image->data_len,
+				   ui_get_blt_size(image->width, image->height));
+	return image->blt ? EFI_SUCCESS : EFI_OUT_OF_RESOURCES;
+}
+
 ui_image_t *ui_image_get(const char *name)
 {
 	unsigned int i;
 
 	for (i = 0 ; i < ARRAY_SIZE(ui_images) ; i++)
-		if (!strcmp((CHAR8 *)ui_images[i].name, (CHAR8 *)name))
+		if (!strcmp((CHAR8 *)ui_images[i].name, (CHAR8 *)name)) {
+			if (EFI_ERROR(ui_image_decode(&ui_images[i])))
+				return NULL;
 			return &ui_images[i];
+		}
 
 	return NULL;
 }
@@ -54,6 +148,10 @@ EFI_STATUS ui_image_draw(ui_image_t *image, UINTN x, UINTN y)
 {
 	EFI_STATUS ret;
 
+	ret = ui_image_decode(image);
+	if (EFI_ERROR(ret))
+		return ret;
+
 	ret = ui_draw_blt(image->blt, x, y, image->width, image->height);
 	if (EFI_ERROR(ret))
 		efi_perror(ret, L"Failed to display image %a", image->name);
@@ -63,35 +161,25 @@ EFI_STATUS ui_image_draw(ui_image_t *image, UINTN x, UINTN y)
 
 EFI_STATUS ui_image_draw_scale(ui_image_t *image, UINTN x, UINTN y, UINTN width, UINTN height)
 {
-	EFI_STATUS ret = EFI_SUCCESS;
+	EFI_STATUS ret;
 	ui_image_t to_draw;
 	UINTN new_width, new_height;
 
+	ret = ui_image_decode(image);
+	if (EFI_ERROR(ret))
+		return ret;
+
 	memcpy(&to_draw, image, sizeof(to_draw));
 
 	ui_get_scaled_dimension(to_draw.width, to_draw.height,
 				width, height, &new_width, &new_height);
 
-	to_draw.blt = AllocatePool(ui_get_blt_size(new_width, new_height));
-	if (!to_draw.blt) {
-		ret = EFI_OUT_OF_RESOURCES;
-		efi_perror(ret, L"Failed to allocate buffer");
-		goto out;
-	}
+	ret = get_scaled(image, new_width, new_height, &to_draw.blt);
+	if (EFI_ERROR(ret))
+		return ret;
 
 	to_draw.width = new_width;
 	to_draw.height = new_height;
 
-	ui_bilinear_scale((unsigned char *)image->blt,
-			  (unsigned char *)to_draw.blt,
-			  image->width, image->height,
-			  to_draw.width, to_draw.height,
-			  sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL));
-
-	ret = ui_image_draw(&to_draw, x, y);
-
-out:
-	if (to_draw.blt)
-		FreePool(to_draw.blt);
-	return ret;
+	return ui_image_draw(&to_draw, x, y);
 }
@@ -0,0 +1,305 @@
+/*
+ * Copyright (c) 2017, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer
+ *      in the documentation and/or other materials provided with the
+ *      distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Separable bilinear scaling in fixed point: each source row used is
+ * first interpolated horizontally into a row of 16-bit values, kept
+ * while the next destination rows need it, then two such rows are
+ * interpolated vertically.  The weights are 7-bit so the intermediate
+ * values fit in signed 16-bit integers, which is what the SSE4.1 and
+ * AVX2 variants multiply and add with.  All the variants return the
+ * same pixels.
+ */
+
+#include <efi.h>
+#include <efilib.h>
+#include <immintrin.h>
+#include <lib.h>
+#include <ui.h>
+
+#define SSE41_TARGET __attribute__((target("sse4.1")))
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+#define WEIGHT_BITS	7
+#define WEIGHT_ONE	(1 << WEIGHT_BITS)
+#define POS_BITS	16
+#define ROUND		(1 << (2 * WEIGHT_BITS - 1))
+
+/* The SIMD variants work on 4 bytes pixels only */
+#define PIXEL_DEPTH	4
+
+struct scale_ctx {
+	const UINT8 *src;
+	UINTN src_stride;
+	UINTN src_width;
+	UINTN width;
+	UINTN depth;
+	/* Left source pixel of each destination column */
+	UINT32 *x;
+	/* Left weight for each byte of the left pixel followed by the
+	 * right weight for each byte of the right pixel, per column */
+	INT16 (*weights)[2 * PIXEL_DEPTH];
+	/* Horizontally interpolated source rows */
+	INT16 *rows[2];
+	INTN row_y[2];
+};
+
+typedef void (*hscale_t)(struct scale_ctx *ctx, const UINT8 *src, INT16 *dst);
+typedef void (*vscale_t)(const INT16 *r0, const INT16 *r1, UINT8 *dst,
+			 UINTN len, INT16 w1);
+
+static BOOLEAN use_simd = TRUE;
+
+static void hscale_generic(struct scale_ctx *ctx, const UINT8 *src, INT16 *dst)
+{
+	UINTN j, k, left, right;
+	INT16 w0, w1;
+
+	for (j = 0; j < ctx->width; j++) {
+		left = ctx->x[j] * ctx->depth;
+		right = ctx->x[j] + 1 < ctx->src_width ? left + ctx->depth : left;
+		w0 = ctx->weights[j][0];
+		w1 = ctx->weights[j][PIXEL_DEPTH];
+		for (k = 0; k < ctx->depth; k++)
+			*dst++ = src[left + k] * w0 + src[right + k] * w1;
+	}
+}
+
+static void vscale_generic(const INT16 *r0, const INT16 *r1, UINT8 *dst,
+			   UINTN len, INT16 w1)
+{
+	INT16 w0 = WEIGHT_ONE - w1;
+	UINTN i;
+
+	for (i = 0; i < len; i++)
+		dst[i] = (r0[i] * w0 + r1[i] * w1 + ROUND) >> (2 * WEIGHT_BITS);
+}
+
+/* Both pixels of a column, weighted and summed, in the 4 low words */
+static inline __m128i SSE41_TARGET hscale_pixel_sse41(struct scale_ctx *ctx,
+						      const UINT8 *src, UINTN j)
+{
+	__m128i p;
+
+	p = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *)
+					      (src + ctx->x[j] * PIXEL_DEPTH)));
+	p = _mm_mullo_epi16(p, _mm_loadu_si128((const __m128i *)ctx->weights[j]));
+	return _mm_add_epi16(p, _mm_srli_si128(p, 8));
+}
+
+static void SSE41_TARGET hscale_sse41(struct scale_ctx *ctx, const UINT8 *src,
+				      INT16 *dst)
+{
+	__m128i a, b;
+	UINTN j;
+
+	for (j = 0; j + 2 <= ctx->width; j += 2) {
+		a = hscale_pixel_sse41(ctx, src, j);
+		b = hscale_pixel_sse41(ctx, src, j + 1);
+		_mm_storeu_si128((__m128i *)(dst + j * PIXEL_DEPTH),
+				 _mm_unpacklo_epi64(a, b));
+	}
+	if (j < ctx->width)
+		_mm_storel_epi64((__m128i *)(dst + j * PIXEL_DEPTH),
+				 hscale_pixel_sse41(ctx, src, j));
+}
+
+static void SSE41_TARGET vscale_sse41(const INT16 *r0, const INT16 *r1,
+				      UINT8 *dst, UINTN len, INT16 w1)
+{
+	const __m128i w = _mm_set1_epi32((w1 << 16) | (WEIGHT_ONE - w1));
+	const __m128i round = _mm_set1_epi32(ROUND);
+	__m128i a, b, lo, hi;
+	UINTN i;
+
+	for (i = 0; i + 8 <= len; i += 8) {
+		a = _mm_loadu_si128((const __m128i *)(r0 + i));
+		b = _mm_loadu_si128((const __m128i *)(r1 + i));
+		lo = _mm_madd_epi16(_mm_unpacklo_epi16(a, b), w);
+		hi = _mm_madd_epi16(_mm_unpackhi_epi16(a, b), w);
+		lo = _mm_srai_epi32(_mm_add_epi32(lo, round), 2 * WEIGHT_BITS);
+		hi = _mm_srai_epi32(_mm_add_epi32(hi, round), 2 * WEIGHT_BITS);
+		a = _mm_packus_epi32(lo, hi);
+		_mm_storel_epi64((__m128i *)(dst + i), _mm_packus_epi16(a, a));
+	}
+	vscale_generic(r0 + i, r1 + i, dst + i, len - i, w1);
+}
+
+/* Two columns, J in the low lane and J + 1 in the high lane */
+static inline __m256i AVX2_TARGET hscale_pixels_avx2(struct scale_ctx *ctx,
+						     const UINT8 *src, UINTN j)
+{
+	__m128i p0, p1;
+	__m256i p;
+
+	p0 = _mm_loadl_epi64((const __m128i *)(src + ctx->x[j] * PIXEL_DEPTH));
+	p1 = _mm_loadl_epi64((const __m128i *)(src + ctx->x[j + 1] * PIXEL_DEPTH));
+	p = _mm256_cvtepu8_epi16(_mm_unpacklo_epi64(p0, p1));
+	p = _mm256_mullo_epi16(p, _mm256_loadu_si256((const __m256i *)ctx->weights[j]));
+	return _mm256_add_epi16(p, _mm256_srli_si256(p, 8));
+}
+
+static void AVX2_TARGET hscale_avx2(struct scale_ctx *ctx, const UINT8 *src,
+				    INT16 *dst)
+{
+	__m256i a, b;
+	UINTN j;
+
+	for (j = 0; j + 4 <= ctx->width; j += 4) {
+		a = hscale_pixels_avx2(ctx, src, j);
+		b = hscale_pixels_avx2(ctx, src, j + 2);
+		/* Columns J, J + 2 in the low lane, J + 1, J + 3 in the
+		 * high one */
+		a = _mm256_unpacklo_epi64(a, b);
+		_mm256_storeu_si256((__m256i *)(dst + j * PIXEL_DEPTH),
+				    _mm256_permute4x64_epi64(a, _MM_SHUFFLE(3, 1, 2, 0)));
+	}
+	for (; j < ctx->width; j++)
+		_mm_storel_epi64((__m128i *)(dst + j * PIXEL_DEPTH),
+				 hscale_pixel_sse41(ctx, src, j));
+}
+
+static void AVX2_TARGET vscale_avx2(const INT16 *r0, const INT16 *r1,
+				    UINT8 *dst, UINTN len, INT16 w1)
+{
+	const __m256i w = _mm256_set1_epi32((w1 << 16) | (WEIGHT_ONE - w1));
+	const __m256i round = _mm256_set1_epi32(ROUND);
+	__m256i a, b, lo, hi;
+	UINTN i;
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		a = _mm256_loadu_si256((const __m256i *)(r0 + i));
+		b = _mm256_loadu_si256((const __m256i *)(r1 + i));
+		/* The unpacks and packs all work within each lane so
+		 * the values come back in order, lane per lane */
+		lo = _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), w);
+		hi = _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), w);
+		lo = _mm256_srai_epi32(_mm256_add_epi32(lo, round), 2 * WEIGHT_BITS);
+		hi = _mm256_srai_epi32(_mm256_add_epi32(hi, round), 2 * WEIGHT_BITS);
+		a = _mm256_packus_epi32(lo, hi);
+		a = _mm256_packus_epi16(a, a);
+		a = _mm256_permute4x64_epi64(a, _MM_SHUFFLE(3, 1, 2, 0));
+		_mm_storeu_si128((__m128i *)(dst + i), _mm256_castsi256_si128(a));
+	}
+	vscale_generic(r0 + i, r1 + i, dst + i, len - i, w1);
+}
+
+static const INT16 *get_row(struct scale_ctx *ctx, hscale_t hscale,
+			    INTN y, INTN keep)
+{
+	UINTN slot;
+
+	for (slot = 0; slot < ARRAY_SIZE(ctx->rows); slot++)
+		if (ctx->row_y[slot] == y)
+			return ctx->rows[slot];
+
+	slot = ctx->row_y[0] == keep ? 1 : 0;
+	hscale(ctx, ctx->src + y * ctx->src_stride, ctx->rows[slot]);
+	ctx->row_y[slot] = y;
+	return ctx->rows[slot];
+}
+
+void ui_bilinear_scale_accelerated(BOOLEAN accelerated)
+{
+	use_simd = accelerated;
+}
+
+EFI_STATUS ui_bilinear_scale(unsigned char *s, unsigned char *d,
+			     int sx, int sy, int dx, int dy,
+			     int depth)
+{
+	struct scale_ctx ctx;
+	hscale_t hscale = hscale_generic;
+	vscale_t vscale = vscale_generic;
+	UINT32 step, pos, x;
+	const INT16 *r0, *r1;
+	UINTN row_len;
+	INTN i, y0, y1;
+	UINT8 *buf;
+	int j, k;
+
+	if (sx <= 0 || sy <= 0 || dx <= 0 || dy <= 0 || depth <= 0 ||
+	    depth > PIXEL_DEPTH || sx >= 1 << POS_BITS || sy >= 1 << POS_BITS)
+		return EFI_INVALID_PARAMETER;
+
+	row_len = (UINTN)dx * depth;
+	buf = AllocatePool(dx * (sizeof(*ctx.x) + sizeof(*ctx.weights)) +
+			   2 * row_len * sizeof(**ctx.rows));
+	if (!buf)
+		return EFI_OUT_OF_RESOURCES;
+
+	ctx.src = s;
+	ctx.src_stride = (UINTN)sx * depth;
+	ctx.src_width = sx;
+	ctx.width = dx;
+	ctx.depth = depth;
+	ctx.weights = (INT16 (*)[2 * PIXEL_DEPTH])buf;
+	ctx.x = (UINT32 *)(ctx.weights + dx);
+	ctx.rows[0] = (INT16 *)(ctx.x + dx);
+	ctx.rows[1] = ctx.rows[0] + row_len;
+	ctx.row_y[0] = ctx.row_y[1] = -1;
+
+	/* Column J samples the source at J * (SX - 1) / DX */
+	step = ((UINT32)(sx - 1) << POS_BITS) / dx;
+	for (j = 0, pos = 0; j < dx; j++, pos += step) {
+		x = pos >> POS_BITS;
+		ctx.x[j] = x;
+		for (k = 0; k < PIXEL_DEPTH; k++) {
+			ctx.weights[j][PIXEL_DEPTH + k] =
+				(pos >> (POS_BITS - WEIGHT_BITS)) & (WEIGHT_ONE - 1);
+			ctx.weights[j][k] = WEIGHT_ONE - ctx.weights[j][PIXEL_DEPTH + k];
+		}
+	}
+
+	/* The SIMD variants read both pixels of a column at once, so
+	 * the right one must be in the image */
+	if (use_simd && depth == PIXEL_DEPTH && sx > 1) {
+		if (cpu_has_feature(CPU_FEATURE_AVX2)) {
+			hscale = hscale_avx2;
+			vscale = vscale_avx2;
+		} else if (cpu_has_feature(CPU_FEATURE_SSE41)) {
+			hscale = hscale_sse41;
+			vscale = vscale_sse41;
+		}
+	}
+
+	step = ((UINT32)(sy - 1) << POS_BITS) / dy;
+	for (i = 0, pos = 0; i < dy; i++, pos += step) {
+		y0 = pos >> POS_BITS;
+		y1 = min(y0 + 1, (INTN)sy - 1);
+		r0 = get_row(&ctx, hscale, y0, y1);
+		r1 = get_row(&ctx, hscale, y1, y0);
+		vscale(r0, r1, d + i * row_len, row_len,
+		       (pos >> (POS_BITS - WEIGHT_BITS)) & (WEIGHT_ONE - 1));
+	}
+
+	FreePool(buf);
+	return EFI_SUCCESS;
+}
@@ -38,6 +38,23 @@
 
 #include "ui.h"
 
+/* Dirty flags of a text line */
+#define DIRTY_BLT	(1 << 0)	/* BLT has to be rendered again */
+#define DIRTY_SCREEN	(1 << 1)	/* BLT has to be drawn again */
+
+/* Font textures blended with the text and background colors, so that
+ * rendering a glyph is just copying its rows. */
+#define GLYPH_CACHE_SIZE	4
+
+static struct glyph_cache {
+	ui_font_t *font;
+	EFI_GRAPHICS_OUTPUT_BLT_PIXEL color;
+	EFI_GRAPHICS_OUTPUT_BLT_PIXEL bg_color;
+	EFI_GRAPHICS_OUTPUT_BLT_PIXEL *blt;
+	UINTN last_use;
+} glyph_cache[GLYPH_CACHE_SIZE];
+static UINTN glyph_cache_clock;
+
 static EFI_STATUS ui_textarea_allocate_blt(ui_textarea_t *textarea)
 {
 	UINTN blt_size;
@@ -53,6 +70,15 @@ static EFI_STATUS ui_textarea_allocate_blt(ui_textarea_t *textarea)
 	return EFI_SUCCESS;
 }
 
+static void ui_textarea_mark_dirty(ui_textarea_t *textarea)
+{
+	if (textarea->dirty)
+		SetMem(textarea->dirty, textarea->line_nb, DIRTY_BLT | DIRTY_SCREEN);
+	textarea->blt_scroll = 0;
+	textarea->screen_scroll = 0;
+	textarea->on_screen = FALSE;
+}
+
 ui_textarea_t *ui_textarea_create(UINTN line_nb, UINTN row_nb, ui_font_t *font,
 				  EFI_GRAPHICS_OUTPUT_BLT_PIXEL *color,
 				  EFI_GRAPHICS_OUTPUT_BLT_PIXEL *bg_color)
@@ -83,9 +109,18 @@ ui_textarea_t *ui_textarea_create(UINTN line_nb, UINTN row_nb, ui_font_t *font,
 		return NULL;
 	}
 
+	textarea->dirty = AllocatePool(line_nb);
+	if (!textarea->dirty) {
+		FreePool(textarea->text);
+		FreePool(textarea->blt);
+		FreePool(textarea);
+		return NULL;
+	}
+
 	textarea->current = -1;
 	textarea->color = color;
 	textarea->bg_color = bg_color;
+	ui_textarea_mark_dirty(textarea);
 
 	return textarea;
 }
@@ -124,49 +159,139 @@ static void ui_textarea_copy_char(unsigned char *src_p, UINTN src_row_bytes,
 	}
 }
 
-static void ui_textarea_refresh_blt(ui_textarea_t *textarea)
+/* Return the texture of FONT blended over BG_COLOR with COLOR, or
+ * NULL if it cannot be allocated. */
+static EFI_GRAPHICS_OUTPUT_BLT_PIXEL *get_glyphs(ui_font_t *font,
+						 EFI_GRAPHICS_OUTPUT_BLT_PIXEL *color,
+						 EFI_GRAPHICS_OUTPUT_BLT_PIXEL *bg_color)
 {
-	UINTN cur, i, j, x, y = 0;
-	ui_font_t *font = textarea->font;
-	UINTN pixel_size = sizeof(*textarea->blt);
-	UINTN row_size = textarea->width * pixel_size;
-	EFI_GRAPHICS_OUTPUT_BLT_PIXEL *color;
-	EFI_GRAPHICS_OUTPUT_BLT_PIXEL *bg_color = textarea->bg_color;
-
-	ZeroMem(textarea->blt,
-		textarea->width * textarea->height * sizeof(*textarea->blt));
-
-	for (i = 1; i <= textarea->line_nb; i++) {
-		cur = (textarea->current + i) % textarea->line_nb;
-
-		color = textarea->color;
-		if (textarea->text[cur].color)
-			color = textarea->text[cur].color;
-
-		if (bg_color) {
-			UINTN x1;
-			for (x1 = 0; x1 < textarea->height * textarea->width; x1++)
-				CopyMem(textarea->blt + x1, bg_color,
-					sizeof(bg_color));
+	struct glyph_cache *entry = &glyph_cache[0];
+	EFI_GRAPHICS_OUTPUT_BLT_PIXEL *blt;
+	UINTN i, size;
+
+	for (i = 0; i < ARRAY_SIZE(glyph_cache); i++) {
+		if (glyph_cache[i].blt && glyph_cache[i].font == font &&
+		    !memcmp(&glyph_cache[i].color, color, sizeof(*color)) &&
+		    !memcmp(&glyph_cache[i].bg_color, bg_color, sizeof(*bg_color))) {
+			glyph_cache[i].last_use = ++glyph_cache_clock;
+			return glyph_cache[i].blt;
 		}
+		if (glyph_cache[i].last_use < entry->last_use)
+			entry = &glyph_cache[i];
+	}
 
-		unsigned char *s = (unsigned char *)textarea->text[cur].str;
-		for (x = 0, j = 0; s && *s && j < textarea->row_nb; s++, x += font->cwidth, j++) {
-			if (*s <= 0x20 || *s > 0x7E)
-				continue;
-			if (*s == '\n')
-				break;
+	size = font->width * font->height;
+	blt = AllocatePool(size * sizeof(*blt));
+	if (!blt)
+		return NULL;
+
+	for (i = 0; i < size; i++)
+		blt[i] = *bg_color;
+	ui_textarea_copy_char(font->texture, font->width, (unsigned char *)blt,
+			      font->width * sizeof(*blt), font->width,
+			      font->height, color);
+
+	if (entry->blt)
+		FreePool(entry->blt);
+	entry->font = font;
+	entry->color = *color;
+	entry->bg_color = *bg_color;
+	entry->blt = blt;
+	entry->last_use = ++glyph_cache_clock;
+
+	return blt;
+}
+
+void ui_textarea_free_glyph_cache(void)
+{
+	UINTN i;
 
-			unsigned char* src_p = font->texture + ((*s - 0x20) * font->cwidth)
-				+ (textarea->text[cur].bold ? font->cheight * font->width : 0);
-			unsigned char* dst_p = ((unsigned char *)textarea->blt)
-				+ (y * row_size)
-				+ (x * pixel_size);
+	for (i = 0; i < ARRAY_SIZE(glyph_cache); i++)
+		if (glyph_cache[i].blt)
+			FreePool(glyph_cache[i].blt);
+	memset(glyph_cache, 0, sizeof(glyph_cache));
+}
 
-			ui_textarea_copy_char(src_p, font->width, dst_p, row_size,
+/* Render text line LINE at row ROW of the textarea */
+static void ui_textarea_render_line(ui_textarea_t *textarea, UINTN row, UINTN line)
+{
+	static EFI_GRAPHICS_OUTPUT_BLT_PIXEL no_bg_color;
+	ui_font_t *font = textarea->font;
+	EFI_GRAPHICS_OUTPUT_BLT_PIXEL *bg_color, *color, *glyphs, *dst, *src;
+	UINTN i, j, k, x, glyph_offset;
+	unsigned char *s;
+
+	bg_color = textarea->bg_color ? textarea->bg_color : &no_bg_color;
+	color = textarea->text[line].color ? textarea->text[line].color : textarea->color;
+
+	/* Fill the first pixel row with the background and copy it */
+	dst = textarea->blt + row * font->cheight * textarea->width;
+	for (i = 0; i < textarea->width; i++)
+		dst[i] = *bg_color;
+	for (i = 1; i < font->cheight; i++)
+		CopyMem(dst + i * textarea->width, dst,
+			textarea->width * sizeof(*dst));
+
+	s = (unsigned char *)textarea->text[line].str;
+	if (!s)
+		return;
+
+	glyphs = get_glyphs(font, color, bg_color);
+	glyph_offset = textarea->text[line].bold ? font->cheight * font->width : 0;
+
+	for (x = 0, j = 0; *s && j < textarea->row_nb; s++, x += font->cwidth, j++) {
+		if (*s <= 0x20 || *s > 0x7E)
+			continue;
+
+		if (!glyphs) {
+			ui_textarea_copy_char(font->texture + glyph_offset + (*s - 0x20) * font->cwidth,
+					      font->width, (unsigned char *)(dst + x),
+					      textarea->width * sizeof(*dst),
 					      font->cwidth, font->cheight, color);
+			continue;
 		}
-		y += font->cheight;
+
+		src = glyphs + glyph_offset + (*s - 0x20) * font->cwidth;
+		for (k = 0; k < font->cheight; k++)
+			CopyMem(dst + k * textarea->width + x, src + k * font->width,
+				font->cwidth * sizeof(*dst));
+	}
+}
+
+static inline UINTN ui_textarea_line(ui_textarea_t *textarea, UINTN row)
+{
+	return (textarea->current + 1 + row) % textarea->line_nb;
+}
+
+static void ui_textarea_refresh_blt(ui_textarea_t *textarea)
+{
+	UINTN row, line, scroll, row_pixels;
+
+	if (!textarea->dirty) {
+		for (row = 0; row < textarea->line_nb; row++)
+			ui_textarea_render_line(textarea, row, ui_textarea_line(textarea, row));
+		return;
+	}
+
+	/* Move the rows which are still displayed up rather than
+	 * rendering them again */
+	scroll = textarea->blt_scroll;
+	textarea->blt_scroll = 0;
+	if (scroll >= textarea->line_nb)
+		for (line = 0; line < textarea->line_nb; line++)
+			textarea->dirty[line] |= DIRTY_BLT;
+	else if (scroll) {
+		row_pixels = textarea->font->cheight * textarea->width;
+		CopyMem(textarea->blt, textarea->blt + scroll * row_pixels,
+			(textarea->line_nb - scroll) * row_pixels * sizeof(*textarea->blt));
+	}
+
+	for (row = 0; row < textarea->line_nb; row++) {
+		line = ui_textarea_line(textarea, row);
+		if (!(textarea->dirty[line] & DIRTY_BLT))
+			continue;
+		ui_textarea_render_line(textarea, row, line);
+		textarea->dirty[line] &= ~DIRTY_BLT;
 	}
 }
 
@@ -196,6 +321,8 @@ EFI_STATUS ui_textarea_display_text(const ui_textline_t *text, ui_font_t *font,
 	textarea.bg_color = bg_color;
 	textarea.font = font;
 	textarea.current = -1;
+	textarea.dirty = NULL;
+	ui_textarea_mark_dirty(&textarea);
 
 	ret = ui_textarea_allocate_blt(&textarea);
 	if (EFI_ERROR(ret))
@@ -211,6 +338,7 @@ void ui_textarea_free(ui_textarea_t *textarea)
 	ui_textarea_clear(textarea);
 	FreePool(textarea->blt);
 	FreePool(textarea->text);
+	FreePool(textarea->dirty);
 	FreePool(textarea);
 }
 
@@ -225,6 +353,7 @@ void ui_textarea_clear(ui_textarea_t *textarea)
 		}
 
 	textarea->current = -1;
+	ui_textarea_mark_dirty(textarea);
 }
 
 void ui_textarea_set_line(ui_textarea_t *textarea, UINTN line_nb, char *str,
@@ -233,12 +362,16 @@ void ui_textarea_set_line(ui_textarea_t *textarea, UINTN line_nb, char *str,
 	textarea->text[line_nb].str = str;
 	textarea->text[line_nb].color = color;
 	textarea->text[line_nb].bold = bold;
+	if (textarea->dirty)
+		textarea->dirty[line_nb] |= DIRTY_BLT | DIRTY_SCREEN;
 }
 
 void ui_textarea_newline(ui_textarea_t *textarea, char *str,
 			 EFI_GRAPHICS_OUTPUT_BLT_PIXEL *color, BOOLEAN bold)
 {
 	textarea->current = (textarea->current + 1) % textarea->line_nb;
+	textarea->blt_scroll++;
+	textarea->screen_scroll++;
 
 	if (textarea->text[textarea->current].str)
 		FreePool(textarea->text[textarea->current].str);
@@ -254,6 +387,7 @@ EFI_STATUS ui_textarea_draw_scale(ui_textarea_t *textarea, UINTN x, UINTN *y,
 	EFI_STATUS ret;
 
 	ui_textarea_refresh_blt(textarea);
+	textarea->on_screen = FALSE;
 
 	ui_get_scaled_dimension(textarea->width, textarea->height,
 				width, height, &new_width, &new_height);
@@ -261,20 +395,66 @@ EFI_STATUS ui_textarea_draw_scale(ui_textarea_t *textarea, UINTN x, UINTN *y,
 	if (!scaled_blt)
 		return EFI_OUT_OF_RESOURCES;
 
-	ui_bilinear_scale((unsigned char *)textarea->blt,
-			  (unsigned char *)scaled_blt,
-			  textarea->width, textarea->height,
-			  new_width, new_height,
-			  sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL));
-	ret = ui_draw_blt(scaled_blt, x, *y, new_width, new_height);
+	ret = ui_bilinear_scale((unsigned char *)textarea->blt,
+				(unsigned char *)scaled_blt,
+				textarea->width, textarea->height,
+				new_width, new_height,
+				sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL));
+	if (!EFI_ERROR(ret))
+		ret = ui_draw_blt(scaled_blt, x, *y, new_width, new_height);
 	FreePool(scaled_blt);
 	*y += new_height;
 
 	return ret;
 }
 
+/* Only the changed rows are drawn again unless the textarea moved or
+ * scrolled.  A scrolled textarea is drawn entirely rather than moved
+ * on the screen as reading the frame buffer is slow. */
 EFI_STATUS ui_textarea_draw(ui_textarea_t *textarea, UINTN x, UINTN y)
 {
+	UINTN row, first, line, row_pixels;
+	EFI_STATUS ret = EFI_SUCCESS;
+
 	ui_textarea_refresh_blt(textarea);
-	return ui_draw_blt(textarea->blt, x, y, textarea->width, textarea->height);
+
+	if (!textarea->dirty || !textarea->on_screen || textarea->screen_scroll ||
+	    textarea->screen_x != x || textarea->screen_y != y) {
+		ret = ui_draw_blt(textarea->blt, x, y, textarea->width, textarea->height);
+		textarea->on_screen = !EFI_ERROR(ret);
+		textarea->screen_scroll = 0;
+		textarea->screen_x = x;
+		textarea->screen_y = y;
+		goto out;
+	}
+
+	row_pixels = textarea->font->cheight * textarea->width;
+	for (row = 0; row < textarea->line_nb; row++) {
+		if (!(textarea->dirty[ui_textarea_line(textarea, row)] & DIRTY_SCREEN))
+			continue;
+
+		/* Draw consecutive changed rows at once */
+		for (first = row; row + 1 < textarea->line_nb; row++)
+			if (!(textarea->dirty[ui_textarea_line(textarea, row + 1)] & DIRTY_SCREEN))
+				break;
+
+		ret = ui_draw_blt(textarea->blt + first * row_pixels, x,
+				  y + first * textarea->font->cheight, textarea->width,
+				  (row + 1 - first) * textarea->font->cheight);
+		if (EFI_ERROR(ret)) {
+			textarea->on_screen = FALSE;
+			break;
+		}
+	}
+
+out:
+	if (textarea->dirty)
+		for (line = 0; line < textarea->line_nb; line++)
+			textarea->dirty[line] &= ~DIRTY_SCREEN;
+	return ret;
+}
+
+void ui_textarea_invalidate(ui_textarea_t *textarea)
+{
+	textarea->on_screen = FALSE;
 }
@@ -378,6 +378,10 @@ EFI_STATUS erase_efivars(VOID)
 	EFI_GUID guid;
 	UINTN i;
 
+	/* Deleting a variable restarts the enumeration, the deletion
+	 * must have reached the firmware. */
+	efi_variables_write_back(FALSE);
+
 	bufsize = 64;		/* Initial size large enough to handle
 				   usual variable names length and
 				   avoid the ReallocatePool call as
@@ -3,7 +3,7 @@ LOCAL_PATH := $(call my-dir)
 KERNELFLINGER_SSLSUPPORT_PATH := $(LOCAL_PATH)
 
 include $(CLEAR_VARS)
-LOCAL_SRC_FILES := wrapper.c
+LOCAL_SRC_FILES := wrapper.c cpu.c
 LOCAL_EXPORT_C_INCLUDE_DIRS := $(LOCAL_PATH)
 FIRST_BUILD_ID := $(shell echo $(BUILD_ID) | cut -c 1)
 ifeq ($(FIRST_BUILD_ID),O)
@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2017, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer
+ *      in the documentation and/or other materials provided with the
+ *      distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <efi.h>
+#include <efilib.h>
+
+#include "openssl_cpu.h"
+
+/* Both BoringSSL and OpenSSL define these on x86 when built with
+ * their assembly code. */
+extern UINT32 OPENSSL_ia32cap_P[4];
+void OPENSSL_cpuid_setup(void);
+
+void openssl_cpu_setup(BOOLEAN accelerated)
+{
+	static UINT32 detected[4];
+	static BOOLEAN initialized;
+
+	/* OPENSSL_cpuid_setup() only runs once with OpenSSL, keep a
+	 * copy to be able to restore the capabilities. */
+	if (!initialized) {
+		OPENSSL_cpuid_setup();
+		CopyMem(detected, OPENSSL_ia32cap_P, sizeof(detected));
+		initialized = TRUE;
+	}
+
+	if (accelerated)
+		CopyMem(OPENSSL_ia32cap_P, detected, sizeof(detected));
+	else
+		ZeroMem(OPENSSL_ia32cap_P, sizeof(detected));
+}
@@ -41,6 +41,17 @@
 #include "unittest.h"
 #include "blobstore.h"
 #include "watchdog.h"
+#include "timer.h"
+#include "scrub.h"
+#include "openssl_cpu.h"
+#include "sparse_format.h"
+#include "reader.h"
+#include <openssl/evp.h>
+#ifdef USE_AVB
+#define AVB_COMPILATION
+#include "libavb/avb_rsa.h"
+#include "libavb/avb_sha.h"
+#endif
 
 /*
  * This is the hardware second timeout value
@@ -105,16 +116,721 @@ static VOID test_ux(VOID)
         ux_prompt_user_for_boot_target(NOT_BOOTABLE_CODE);
         ux_display_low_battery(3);
 }
+
+/* Scale the embedded images to fit a 4K panel, as the splash screen
+ * is, with the portable and the accelerated code. */
+static VOID test_ui_scale(VOID)
+{
+        const UINTN max_width = 3840, max_height = 2160;
+        UINT8 *generic, *accelerated;
+        UINT64 start, generic_us, accelerated_us;
+        UINTN i, width, height;
+        ui_image_t *image;
+        EFI_STATUS ret;
+
+        generic = AllocatePool(ui_get_blt_size(max_width, max_height));
+        accelerated = AllocatePool(ui_get_blt_size(max_width, max_height));
+        if (!generic || !accelerated) {
+                Print(L"Failed to allocate the buffers, test Failed\n");
+                goto out;
+        }
+
+        for (i = 0; i < ui_images_nb; i++) {
+                image = ui_image_get(ui_images[i].name);
+                if (!image) {
+                        Print(L"%a: decoding failed, test Failed\n", ui_images[i].name);
+                        continue;
+                }
+                ui_get_scaled_dimension(image->width, image->height,
+                                        max_width, max_height,
+                                        &width, &height);
+
+                ui_bilinear_scale_accelerated(FALSE);
+                start = boottime_in_usec();
+                ret = ui_bilinear_scale((unsigned char *)image->blt, generic,
+                                        image->width, image->height,
+                                        width, height,
+                                        sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL));
+                generic_us = boottime_in_usec() - start;
+                if (EFI_ERROR(ret)) {
+                        Print(L"%a: scaling failed, %r, test Failed\n", image->name, ret);
+                        continue;
+                }
+
+                ui_bilinear_scale_accelerated(TRUE);
+                start = boottime_in_usec();
+                ui_bilinear_scale((unsigned char *)image->blt, accelerated,
+                                  image->width, image->height,
+                                  width, height,
+                                  sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL));
+                accelerated_us = boottime_in_usec() - start;
+
+                Print(L"%a %dx%d -> %dx%d: generic %ld us, accelerated %ld us\n",
+                      image->name, image->width, image->height, width, height,
+                      generic_us, accelerated_us);
+                if (memcmp(generic, accelerated, ui_get_blt_size(width, height)))
+                        Print(L"%a: scaled images differ, test Failed\n", image->name);
+        }
+
+out:
+        if (generic)
+                FreePool(generic);
+        if (accelerated)
+                FreePool(accelerated);
+}
+#endif
+
+#define SHA_BENCH_SIZE (1024 * 1024)
+#define SHA_BENCH_ROUNDS 16
+
+/* Returns the cycles per byte, times 100. */
+static UINT64 sha_bench(const EVP_MD *md, const UINT8 *data, UINT8 *digest)
+{
+        UINT64 start, cycles;
+        UINTN i;
+
+        start = read_tsc();
+        for (i = 0; i < SHA_BENCH_ROUNDS; i++)
+                EVP_Digest(data, SHA_BENCH_SIZE, digest, NULL, md, NULL);
+        cycles = read_tsc() - start;
+
+        return cycles * 100 / ((UINT64)SHA_BENCH_SIZE * SHA_BENCH_ROUNDS);
+}
+
+/* Print the cycles per byte, times 100, of both implementations.
+ * DivU64x32() is used as there is no 64-bit division on ia32. */
+static VOID print_cpb(const CHAR16 *name, UINT64 generic_cpb,
+                      UINT64 accelerated_cpb)
+{
+        UINTN generic_rem, accelerated_rem;
+
+        generic_cpb = DivU64x32(generic_cpb, 100, &generic_rem);
+        accelerated_cpb = DivU64x32(accelerated_cpb, 100, &accelerated_rem);
+        Print(L"%s: generic %ld.%02d cycles/byte, accelerated %ld.%02d cycles/byte\n",
+              name, generic_cpb, (UINT32)generic_rem,
+              accelerated_cpb, (UINT32)accelerated_rem);
+}
+
+static VOID test_sha(VOID)
+{
+        static struct {
+                CHAR16 *name;
+                const EVP_MD *(*get_md)(void);
+        } const DIGESTS[] = {
+                { L"SHA-1", EVP_sha1 },
+                { L"SHA-256", EVP_sha256 }
+        };
+        UINT8 generic[EVP_MAX_MD_SIZE], accelerated[EVP_MAX_MD_SIZE];
+        UINT64 generic_cpb, accelerated_cpb;
+        const EVP_MD *md;
+        UINT8 *data;
+        UINTN i;
+
+        data = AllocatePool(SHA_BENCH_SIZE);
+        if (!data) {
+                Print(L"Failed to allocate the buffer, test Failed\n");
+                return;
+        }
+        for (i = 0; i < SHA_BENCH_SIZE; i++)
+                data[i] = i * 7 + (i >> 8);
+
+        for (i = 0; i < ARRAY_SIZE(DIGESTS); i++) {
+                md = DIGESTS[i].get_md();
+
+                openssl_cpu_setup(FALSE);
+                generic_cpb = sha_bench(md, data, generic);
+                openssl_cpu_setup(TRUE);
+                accelerated_cpb = sha_bench(md, data, accelerated);
+
+                print_cpb(DIGESTS[i].name, generic_cpb, accelerated_cpb);
+                if (memcmp(generic, accelerated, EVP_MD_size(md)))
+                        Print(L"%s digests differ, test Failed\n",
+                              DIGESTS[i].name);
+        }
+
+        FreePool(data);
+}
+
+#ifdef USE_AVB
+/* FIPS 180-2 SHA-512 examples */
+static const struct {
+        const char *msg;
+        UINT8 digest[AVB_SHA512_DIGEST_SIZE];
+} SHA512_KAT[] = {
+        { "",
+          { 0xcf, 0x83, 0xe1, 0x35, 0x7e, 0xef, 0xb8, 0xbd,
+            0xf1, 0x54, 0x28, 0x50, 0xd6, 0x6d, 0x80, 0x07,
+            0xd6, 0x20, 0xe4, 0x05, 0x0b, 0x57, 0x15, 0xdc,
+            0x83, 0xf4, 0xa9, 0x21, 0xd3, 0x6c, 0xe9, 0xce,
+            0x47, 0xd0, 0xd1, 0x3c, 0x5d, 0x85, 0xf2, 0xb0,
+            0xff, 0x83, 0x18, 0xd2, 0x87, 0x7e, 0xec, 0x2f,
+            0x63, 0xb9, 0x31, 0xbd, 0x47, 0x41, 0x7a, 0x81,
+            0xa5, 0x38, 0x32, 0x7a, 0xf9, 0x27, 0xda, 0x3e } },
+        { "abc",
+          { 0xdd, 0xaf, 0x35, 0xa1, 0x93, 0x61, 0x7a, 0xba,
+            0xcc, 0x41, 0x73, 0x49, 0xae, 0x20, 0x41, 0x31,
+            0x12, 0xe6, 0xfa, 0x4e, 0x89, 0xa9, 0x7e, 0xa2,
+            0x0a, 0x9e, 0xee, 0xe6, 0x4b, 0x55, 0xd3, 0x9a,
+            0x21, 0x92, 0x99, 0x2a, 0x27, 0x4f, 0xc1, 0xa8,
+            0x36, 0xba, 0x3c, 0x23, 0xa3, 0xfe, 0xeb, 0xbd,
+            0x45, 0x4d, 0x44, 0x23, 0x64, 0x3c, 0xe8, 0x0e,
+            0x2a, 0x9a, 0xc9, 0x4f, 0xa5, 0x4c, 0xa4, 0x9f } },
+        { "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmn"
+          "hijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu",
+          { 0x8e, 0x95, 0x9b, 0x75, 0xda, 0xe3, 0x13, 0xda,
+            0x8c, 0xf4, 0xf7, 0x28, 0x14, 0xfc, 0x14, 0x3f,
+            0x8f, 0x77, 0x79, 0xc6, 0xeb, 0x9f, 0x7f, 0xa1,
+            0x72, 0x99, 0xae, 0xad, 0xb6, 0x88, 0x90, 0x18,
+            0x50, 0x1d, 0x28, 0x9e, 0x49, 0x00, 0xf7, 0xe4,
+            0x33, 0x1b, 0x99, 0xde, 0xc4, 0xb5, 0x43, 0x3a,
+            0xc7, 0xd3, 0x29, 0xee, 0xb6, 0xdd, 0x26, 0x54,
+            0x5e, 0x96, 0xe5, 0x5b, 0x87, 0x4b, 0xe9, 0x09 } }
+};
+
+/* Hash LEN bytes of DATA, passed to avb_sha512_update() in CHUNK
+ * bytes pieces. */
+static VOID sha512_digest(const UINT8 *data, UINTN len, UINTN chunk,
+                          UINT8 *digest)
+{
+        AvbSHA512Ctx ctx;
+        UINTN n;
+
+        avb_sha512_init(&ctx);
+        for (; len; data += n, len -= n) {
+                n = min(len, chunk);
+                avb_sha512_update(&ctx, data, n);
+        }
+        memcpy(digest, avb_sha512_final(&ctx), AVB_SHA512_DIGEST_SIZE);
+}
+
+/* Returns the cycles per byte, times 100. */
+static UINT64 sha512_bench(const UINT8 *data, UINT8 *digest)
+{
+        UINT64 start, cycles;
+        UINTN i;
+
+        start = read_tsc();
+        for (i = 0; i < SHA_BENCH_ROUNDS; i++)
+                sha512_digest(data, SHA_BENCH_SIZE, SHA_BENCH_SIZE, digest);
+        cycles = read_tsc() - start;
+
+        return cycles * 100 / ((UINT64)SHA_BENCH_SIZE * SHA_BENCH_ROUNDS);
+}
+
+static VOID test_sha512(VOID)
+{
+        static const UINTN CHUNKS[] = { 1, 61, 128, 1000 };
+        UINT8 generic[AVB_SHA512_DIGEST_SIZE];
+        UINT8 accelerated[AVB_SHA512_DIGEST_SIZE];
+        UINT64 generic_cpb, accelerated_cpb;
+        UINT8 *data;
+        UINTN i, len, chunk;
+
+        data = AllocatePool(SHA_BENCH_SIZE);
+        if (!data) {
+                Print(L"Failed to allocate the buffer, test Failed\n");
+                return;
+        }
+        for (i = 0; i < SHA_BENCH_SIZE; i++)
+                data[i] = i * 7 + (i >> 8);
+
+        for (i = 0; i < ARRAY_SIZE(SHA512_KAT); i++) {
+                len = strlen((const CHAR8 *)SHA512_KAT[i].msg);
+                avb_sha512_setup(FALSE);
+                sha512_digest((const UINT8 *)SHA512_KAT[i].msg, len, 7, generic);
+                avb_sha512_setup(TRUE);
+                sha512_digest((const UINT8 *)SHA512_KAT[i].msg, len, 7, accelerated);
+                if (memcmp(generic, SHA512_KAT[i].digest, sizeof(generic)) ||
+                    memcmp(accelerated, SHA512_KAT[i].digest, sizeof(accelerated))) {
+                        Print(L"Known answer %d: wrong digest, test Failed\n", i);
+                        goto out;
+                }
+        }
+
+        /* Lengths around the 128 bytes block and the 112 bytes
+         * padding boundaries, split in various update sizes. */
+        for (len = 0; len <= 1024; len += len < 300 ? 1 : 41) {
+                for (i = 0; i < ARRAY_SIZE(CHUNKS); i++) {
+                        chunk = CHUNKS[i];
+                        avb_sha512_setup(FALSE);
+                        sha512_digest(data + len % 8, len, chunk, generic);
+                        avb_sha512_setup(TRUE);
+                        sha512_digest(data + len % 8, len, chunk, accelerated);
+                        if (memcmp(generic, accelerated, sizeof(generic))) {
+                                Print(L"%d bytes in %d bytes updates: digests differ, test Failed\n",
+                                      len, chunk);
+                                goto out;
+                        }
+                }
+        }
+
+        avb_sha512_setup(FALSE);
+        generic_cpb = sha512_bench(data, generic);
+        avb_sha512_setup(TRUE);
+        accelerated_cpb = sha512_bench(data, accelerated);
+        print_cpb(L"SHA-512", generic_cpb, accelerated_cpb);
+        if (memcmp(generic, accelerated, sizeof(generic)))
+                Print(L"SHA-512 digests differ, test Failed\n");
+
+out:
+        avb_sha512_setup(TRUE);
+        FreePool(data);
+}
+
+/* RSA-2048 key in the AVB format and PKCS#1 v1.5 SHA-256 signature
+ * of RSA_KAT_MSG with its private part, generated offline. */
+#define RSA_KAT_MSG "kernelflinger"
+#define RSA_BENCH_ROUNDS 100
+
+static const UINT8 RSA_KAT_KEY[] = {
+        0x00, 0x00, 0x08, 0x00, 0x0f, 0x50, 0xdd, 0xbf, 0xbc, 0x39, 0xc3, 0xa9,
+        0x08, 0xfd, 0xe7, 0x84, 0x41, 0x97, 0x1a, 0xf7, 0xea, 0x59, 0x5f, 0x47,
+        0x70, 0x67, 0x04, 0xcc, 0x4c, 0xf2, 0x21, 0x33, 0x3c, 0xf7, 0xbe, 0xab,
+        0xfd, 0x87, 0xd1, 0x6c, 0xf5, 0x61, 0xbd, 0x4e, 0x13, 0x65, 0x3f, 0x9f,
+        0x3f, 0x28, 0xb5, 0xfb, 0x78, 0xb4, 0x45, 0xa0, 0x43, 0x08, 0xd1, 0xff,
+        0x45, 0x03, 0xda, 0x42, 0xed, 0x99, 0x04, 0x04, 0xb3, 0x86, 0x05, 0x56,
+        0x40, 0xe9, 0x64, 0xde, 0xc9, 0xed, 0x6c, 0x4f, 0x53, 0xd5, 0xdf, 0x3d,
+        0xf2, 0x54, 0x9c, 0x5e, 0xea, 0x75, 0x18, 0x76, 0x3e, 0x3b, 0x09, 0xc1,
+        0x0f, 0xe4, 0x4e, 0x22, 0x5d, 0x72, 0x48, 0x3b, 0x95, 0xd7, 0xf3, 0x69,
+        0x56, 0x34, 0xf7, 0x13, 0x99, 0x28, 0xa7, 0x2e, 0xd2, 0x9b, 0x21, 0x75,
+        0x77, 0xf3, 0x8c, 0x6a, 0xb1, 0x69, 0x64, 0x05, 0xe8, 0x61, 0xea, 0x41,
+        0x96, 0x0a, 0xf5, 0xda, 0x13, 0x98, 0x88, 0x03, 0x59, 0x92, 0x44, 0xee,
+        0xc4, 0xaf, 0x90, 0x03, 0x5d, 0x64, 0x0f, 0x06, 0x35, 0x55, 0xa6, 0x07,
+        0xd5, 0x5d, 0x38, 0x42, 0x86, 0x08, 0xfd, 0xfd, 0x18, 0x99, 0x35, 0x60,
+        0x4e, 0x4a, 0x5c, 0x36, 0x59, 0x01, 0x76, 0x7d, 0xfe, 0x2d, 0x80, 0xf9,
+        0xba, 0x40, 0x03, 0x47, 0xe0, 0xc1, 0xe6, 0x99, 0x2f, 0xed, 0x0d, 0x13,
+        0x22, 0x18, 0xdb, 0x6f, 0x32, 0x02, 0xc4, 0x8d, 0xd7, 0xfb, 0x66, 0x78,
+        0x6e, 0x64, 0x56, 0x40, 0xd6, 0x33, 0x4c, 0xdc, 0x3f, 0x83, 0x21, 0x44,
+        0x8c, 0x6b, 0x8e, 0xe9, 0x29, 0x3d, 0x42, 0x2a, 0x08, 0xaa, 0x12, 0xaa,
+        0x13, 0xd7, 0x9e, 0xa4, 0xe0, 0x8b, 0xf7, 0xe4, 0x20, 0x70, 0xf7, 0xd3,
+        0x4a, 0xac, 0x28, 0xaf, 0xa7, 0xc9, 0xd9, 0xa0, 0xd1, 0xdb, 0xcb, 0xb4,
+        0x2c, 0x9a, 0x40, 0x02, 0xe3, 0x3b, 0xe2, 0xb2, 0x87, 0x01, 0xed, 0xc1,
+        0x2d, 0x6a, 0xe5, 0xe5, 0xa1, 0x74, 0x7d, 0x35, 0x5a, 0x3d, 0xf1, 0xa6,
+        0xbf, 0xa1, 0xa5, 0x7c, 0xf7, 0x61, 0x40, 0x78, 0x3f, 0x7f, 0x03, 0x2c,
+        0xc1, 0x1f, 0x2a, 0x44, 0xda, 0x70, 0x9b, 0x92, 0x31, 0x5a, 0xb2, 0xaa,
+        0xb1, 0xe7, 0x83, 0xac, 0x2a, 0x71, 0x13, 0x36, 0xef, 0x9f, 0xa4, 0x06,
+        0xc6, 0xfb, 0x2b, 0xfd, 0xd0, 0xfa, 0x55, 0x7c, 0x66, 0x87, 0x61, 0xeb,
+        0xa6, 0x36, 0x0d, 0x47, 0xac, 0xbc, 0x2d, 0xc1, 0x9f, 0x00, 0xaf, 0xda,
+        0xb5, 0x68, 0xf2, 0xb6, 0x21, 0x74, 0x08, 0xc8, 0xf0, 0x6f, 0x7c, 0x99,
+        0xba, 0xbc, 0x38, 0xd4, 0x16, 0x27, 0x62, 0xfd, 0xdf, 0xe0, 0x95, 0xb0,
+        0x4e, 0x9d, 0x29, 0x6b, 0xd3, 0xfc, 0x05, 0x3e, 0x0a, 0x54, 0x94, 0x37,
+        0x56, 0xf0, 0x7d, 0x1f, 0xfa, 0x76, 0x62, 0xff, 0xe3, 0x27, 0x32, 0x43,
+        0x76, 0x1e, 0xb5, 0xcc, 0x1d, 0x02, 0xa6, 0xc2, 0xe1, 0xc2, 0xf1, 0xbc,
+        0x46, 0xd6, 0x74, 0x0b, 0x9e, 0x52, 0xb8, 0x8b, 0xd1, 0x89, 0x08, 0x00,
+        0xd7, 0xf4, 0xb4, 0xfb, 0x69, 0x76, 0x49, 0x0e, 0x7a, 0xc7, 0xf5, 0xe9,
+        0xfb, 0xd2, 0x08, 0xd4, 0x72, 0x36, 0x74, 0x06, 0x43, 0xaa, 0x3e, 0x50,
+        0x2f, 0x6e, 0xc4, 0x3a, 0x1e, 0x2e, 0x9b, 0x21, 0xeb, 0xf1, 0x8b, 0xad,
+        0xce, 0x02, 0xb7, 0x23, 0x27, 0x77, 0xa0, 0x5a, 0x09, 0x17, 0x6b, 0xf8,
+        0x21, 0xbb, 0x4e, 0x34, 0xbd, 0x89, 0x64, 0xdb, 0x3e, 0x63, 0x86, 0x46,
+        0x6e, 0x56, 0xa2, 0x78, 0x87, 0x21, 0xc8, 0x6f, 0x79, 0xd4, 0x47, 0x70,
+        0x2a, 0x03, 0xba, 0xab, 0xfe, 0x5c, 0x7c, 0x86, 0x4e, 0xf0, 0x63, 0x84,
+        0xf0, 0xec, 0x91, 0xe7, 0xf4, 0x3a, 0x8f, 0x98, 0x3b, 0x11, 0x03, 0xec,
+        0x10, 0x39, 0xef, 0x40, 0x4a, 0x4a, 0xd2, 0xcb, 0x12, 0x57, 0x9b, 0x55,
+        0x54, 0xa9, 0xf6, 0x88,
+};
+
+static const UINT8 RSA_KAT_SIG[] = {
+        0x80, 0x58, 0x4b, 0x48, 0x34, 0x27, 0x49, 0x79, 0xad, 0x18, 0xc7, 0xec,
+        0x02, 0x4c, 0x0b, 0x9c, 0x6a, 0xf2, 0x9d, 0x84, 0x74, 0x53, 0x5b, 0xca,
+        0x77, 0x17, 0x6e, 0x85, 0xed, 0x91, 0x2c, 0xc2, 0x15, 0xaf, 0x91, 0xb7,
+        0xb0, 0xbf, 0x8d, 0xc1, 0x00, 0xc5, 0x31, 0xc3, 0xaa, 0x1e, 0x43, 0x5a,
+        0xce, 0xfb, 0x67, 0x0d, 0xed, 0x03, 0x4c, 0xde, 0x71, 0x66, 0xf9, 0x16,
+        0xd5, 0x13, 0xf6, 0x2a, 0x6e, 0x8c, 0xa2, 0xca, 0x37, 0x24, 0x3e, 0xd6,
+        0xb9, 0x58, 0x6f, 0x52, 0xf2, 0xa2, 0xa2, 0x6d, 0xab, 0x27, 0xf8, 0x08,
+        0xe4, 0xe5, 0x70, 0x98, 0x6f, 0xd6, 0x8c, 0xe5, 0xad, 0xca, 0xe0, 0x60,
+        0x71, 0x20, 0x30, 0xfd, 0x15, 0x52, 0x63, 0x74, 0xa5, 0xc0, 0x3f, 0x5d,
+        0x16, 0x55, 0x66, 0x16, 0x47, 0x44, 0xb9, 0x89, 0x09, 0x6a, 0x70, 0xd4,
+        0x6a, 0x2b, 0x75, 0x64, 0x19, 0x5e, 0x96, 0xde, 0x09, 0xf9, 0xbc, 0x0f,
+        0x70, 0x5f, 0x12, 0x4b, 0x11, 0x91, 0xf6, 0x8f, 0xfb, 0x30, 0xbd, 0x67,
+        0x18, 0x03, 0x2b, 0x49, 0x92, 0x75, 0x72, 0xac, 0x2f, 0x86, 0x90, 0x77,
+        0x1d, 0xb2, 0x32, 0x6a, 0xcf, 0xc1, 0x67, 0xee, 0xe1, 0x03, 0x49, 0x5b,
+        0x07, 0xed, 0xa2, 0xd0, 0x0a, 0xd8, 0x0b, 0xe7, 0x06, 0xa0, 0xf6, 0x97,
+        0xb4, 0xc4, 0x48, 0x44, 0x4b, 0xd7, 0x3d, 0x76, 0xc8, 0xcb, 0xe2, 0x23,
+        0x26, 0xf6, 0x44, 0xc5, 0x44, 0x6d, 0xc7, 0xfd, 0xed, 0xbc, 0x3f, 0x13,
+        0x33, 0xe4, 0x2e, 0xcd, 0xba, 0x5e, 0xca, 0x7b, 0x10, 0xa9, 0x62, 0xae,
+        0x76, 0x66, 0x35, 0x0a, 0xe6, 0x36, 0xed, 0xe4, 0xc8, 0x61, 0x76, 0xaa,
+        0x9f, 0x96, 0x96, 0x73, 0x67, 0x96, 0xa3, 0x26, 0x2c, 0x61, 0x20, 0xff,
+        0x02, 0x1a, 0x20, 0xa8, 0x0b, 0x9d, 0xe0, 0x64, 0xae, 0x21, 0x77, 0xf9,
+        0x81, 0x6d, 0x95, 0x36,
+};
+
+static bool rsa_verify(const UINT8 *sig, const UINT8 *hash)
+{
+        const AvbAlgorithmData *alg;
+
+        alg = avb_get_algorithm_data(AVB_ALGORITHM_TYPE_SHA256_RSA2048);
+        return avb_rsa_verify(RSA_KAT_KEY, sizeof(RSA_KAT_KEY),
+                              sig, sizeof(RSA_KAT_SIG),
+                              hash, AVB_SHA256_DIGEST_SIZE,
+                              alg->padding, alg->padding_len);
+}
+
+/* On 32-bit builds, all the implementations fall back to the 32-bit
+ * limbs one. */
+static VOID test_rsa(VOID)
+{
+        static const struct {
+                CHAR16 *name;
+                bool u64;
+                bool adx;
+        } IMPLS[] = {
+                { L"32-bit limbs", false, false },
+                { L"64-bit limbs", true, false },
+                { L"64-bit limbs and ADX", true, true }
+        };
+        UINT8 hash[AVB_SHA256_DIGEST_SIZE];
+        UINT8 sig[sizeof(RSA_KAT_SIG)];
+        AvbSHA256Ctx ctx;
+        UINT64 start;
+        UINTN i, j;
+        bool ok;
+
+        avb_sha256_init(&ctx);
+        avb_sha256_update(&ctx, (const UINT8 *)RSA_KAT_MSG,
+                          sizeof(RSA_KAT_MSG) - 1);
+        memcpy(hash, avb_sha256_final(&ctx), sizeof(hash));
+
+        for (i = 0; i < ARRAY_SIZE(IMPLS); i++) {
+                avb_rsa_setup(IMPLS[i].u64, IMPLS[i].adx);
+
+                if (!rsa_verify(RSA_KAT_SIG, hash)) {
+                        Print(L"%s: valid signature rejected, test Failed\n",
+                              IMPLS[i].name);
+                        break;
+                }
+
+                memcpy(sig, RSA_KAT_SIG, sizeof(sig));
+                sig[sizeof(sig) / 3] ^= 0x10;
+                if (rsa_verify(sig, hash)) {
+                        Print(L"%s: corrupted signature accepted, test Failed\n",
+                              IMPLS[i].name);
+                        break;
+                }
+
+                hash[sizeof(hash) - 1] ^= 0x01;
+                ok = rsa_verify(RSA_KAT_SIG, hash);
+                hash[sizeof(hash) - 1] ^= 0x01;
+                if (ok) {
+                        Print(L"%s: wrong hash accepted, test Failed\n",
+                              IMPLS[i].name);
+                        break;
+                }
+
+                ok = true;
+                start = boottime_in_usec();
+                for (j = 0; j < RSA_BENCH_ROUNDS; j++)
+                        ok &= rsa_verify(RSA_KAT_SIG, hash);
+                Print(L"%s: %ld us per verification\n", IMPLS[i].name,
+                      DivU64x32(boottime_in_usec() - start,
+                                RSA_BENCH_ROUNDS, NULL));
+                if (!ok) {
+                        Print(L"%s: verification failed, test Failed\n",
+                              IMPLS[i].name);
+                        break;
+                }
+        }
+
+        avb_rsa_setup(true, true);
+}
 #endif
 
+#define SCRUB_TEST_SIZE (256 * 1024 * 1024)
+
+/* Clear a buffer disguised as a conventional memory region with the
+ * calling processor only, then with all of them. */
+static VOID test_scrub(VOID)
+{
+        static const CHAR16 *MODES[] = { L"one processor", L"all processors" };
+        EFI_MEMORY_DESCRIPTOR entry = {
+                .Type = EfiConventionalMemory,
+                .NumberOfPages = EFI_SIZE_TO_PAGES(SCRUB_TEST_SIZE)
+        };
+        UINT64 start, *data;
+        EFI_STATUS ret;
+        UINTN i, j;
+
+        memory_scrub_init();
+
+        ret = uefi_call_wrapper(BS->AllocatePages, 4, AllocateAnyPages,
+                                EfiLoaderData, entry.NumberOfPages,
+                                &entry.PhysicalStart);
+        if (EFI_ERROR(ret)) {
+                Print(L"Failed to allocate the buffer, test Failed\n");
+                return;
+        }
+        data = (UINT64 *)(UINTN)entry.PhysicalStart;
+
+        for (i = 0; i < ARRAY_SIZE(MODES); i++) {
+                SetMem(data, SCRUB_TEST_SIZE, 0xa5);
+                memory_scrub_parallel(i == 1);
+                start = boottime_in_usec();
+                ret = memory_scrub((CHAR8 *)&entry, 1, sizeof(entry));
+                Print(L"%s: %ld us\n", MODES[i], boottime_in_usec() - start);
+                if (EFI_ERROR(ret)) {
+                        Print(L"%s: scrubbing failed, %r, test Failed\n", MODES[i], ret);
+                        continue;
+                }
+
+                for (j = 0; j < SCRUB_TEST_SIZE / sizeof(*data); j++)
+                        if (data[j]) {
+                                Print(L"%s: memory not cleared, test Failed\n", MODES[i]);
+                                break;
+                        }
+        }
+
+        memory_scrub_parallel(TRUE);
+        uefi_call_wrapper(BS->FreePages, 2, entry.PhysicalStart, entry.NumberOfPages);
+}
+
+/* The tested sizes go past the 2 KB REP MOVSB/STOSB threshold and the
+ * buffers leave room for a copy overlapping half of its source. */
+#define MEM_TEST_SIZE 4096
+#define MEM_BUF_SIZE (MEM_TEST_SIZE + MEM_TEST_SIZE / 2 + 128)
+#define MEM_BENCH_SIZE (4 * 1024 * 1024)
+
+static UINT8 mem_pattern(UINTN i)
+{
+        return i * 7 + (i >> 8);
+}
+
+/* Check memmove, memset and memcmp of N bytes at the SRC and DST
+ * offsets of BUF against the values they must produce. */
+static BOOLEAN mem_check(UINT8 *buf, UINT8 *ref, UINTN n, UINTN src, UINTN dst)
+{
+        UINTN i, len = max(src, dst) + n + 64;
+
+        for (i = 0; i < len; i++)
+                buf[i] = mem_pattern(i);
+
+        memmove(buf + dst, buf + src, n);
+        for (i = 0; i < len; i++)
+                if (buf[i] != (i >= dst && i < dst + n ?
+                               mem_pattern(i - dst + src) : mem_pattern(i)))
+                        return FALSE;
+
+        memset(buf + src, n, n);
+        for (i = 0; i < len; i++) {
+                ref[i] = buf[i];
+                if (i >= src && i < src + n && buf[i] != (UINT8)n)
+                        return FALSE;
+        }
+
+        if (memcmp(buf + dst, ref + dst, n))
+                return FALSE;
+        if (n) {
+                i = dst + n / 3;
+                ref[i]++;
+                if (memcmp(buf + dst, ref + dst, n) != (int)buf[i] - (int)ref[i])
+                        return FALSE;
+        }
+
+        return TRUE;
+}
+
+/* Returns the cycles per byte, times 100. */
+static UINT64 mem_bench(BOOLEAN accelerated, UINT8 *dst, UINT8 *src)
+{
+        UINT64 start = read_tsc();
+
+        if (accelerated)
+                memcpy(dst + 1, src, MEM_BENCH_SIZE);
+        else
+                CopyMem(dst + 1, src, MEM_BENCH_SIZE);
+
+        return (read_tsc() - start) * 100 / MEM_BENCH_SIZE;
+}
+
+/* Every size up to 300 bytes and around the REP MOVSB/STOSB
+ * threshold, sparser sizes otherwise. */
+static UINTN mem_next_size(UINTN n)
+{
+        if (n < 300 || (n >= 2040 && n < 2056))
+                return n + 1;
+        if (n < 2040 && n + 61 > 2040)
+                return 2040;
+        return n + 61;
+}
+
+static VOID test_mem(VOID)
+{
+        UINT8 *buf, *ref, *src, *dst;
+        UINT64 generic_cpb, accelerated_cpb;
+        UINTN n, s, d, half;
+
+        buf = AllocatePool(MEM_BUF_SIZE);
+        ref = AllocatePool(MEM_BUF_SIZE);
+        src = AllocatePool(MEM_BENCH_SIZE + 64);
+        dst = AllocatePool(MEM_BENCH_SIZE + 64);
+        if (!buf || !ref || !src || !dst) {
+                Print(L"Failed to allocate the buffers, test Failed\n");
+                goto out;
+        }
+
+        for (n = 0; n <= MEM_TEST_SIZE; n = mem_next_size(n)) {
+                for (s = 0; s < 64; s += 7)
+                        for (d = 0; d < 64; d += 5)
+                                if (!mem_check(buf, ref, n, s, d)) {
+                                        Print(L"%d bytes from %d to %d: wrong result, test Failed\n",
+                                              n, s, d);
+                                        goto out;
+                                }
+
+                /* Forward and backward copies overlapping half of
+                 * the source. */
+                half = n / 2 + 3;
+                if (!mem_check(buf, ref, n, half, 0) ||
+                    !mem_check(buf, ref, n, 0, half)) {
+                        Print(L"%d bytes overlapping by half: wrong result, test Failed\n",
+                              n);
+                        goto out;
+                }
+        }
+
+        SetMem(src, MEM_BENCH_SIZE, 0x5a);
+        generic_cpb = mem_bench(FALSE, dst, src);
+        accelerated_cpb = mem_bench(TRUE, dst, src);
+        print_cpb(L"memcpy", generic_cpb, accelerated_cpb);
+
+out:
+        if (buf)
+                FreePool(buf);
+        if (ref)
+                FreePool(ref);
+        if (src)
+                FreePool(src);
+        if (dst)
+                FreePool(dst);
+}
+
+/* The RAM pull test region spans several 64 KB RAM reader segments
+ * and is read with the requests the adb sync service makes. */
+#define PULL_TEST_SIZE (3 * 64 * 1024 + EFI_PAGE_SIZE)
+#define PULL_READ_SIZE (64 * 1024)
+/* Sparse stream upper bound: one RAW chunk per page at most */
+#define PULL_STREAM_SIZE (sizeof(struct sparse_header) + PULL_TEST_SIZE + \
+                          EFI_SIZE_TO_PAGES(PULL_TEST_SIZE) * \
+                          sizeof(struct chunk_header))
+
+static UINT8 pull_pattern(UINTN i)
+{
+        UINT8 value = i * 3 + (i >> 12);
+
+        return value ? value : 1;
+}
+
+static VOID test_pull(VOID)
+{
+        EFI_PHYSICAL_ADDRESS start;
+        UINTN pages = EFI_SIZE_TO_PAGES(PULL_TEST_SIZE);
+        reader_ctx_t ctx;
+        struct sparse_header *sheader;
+        struct chunk_header *chunk;
+        unsigned char *stream, *buf, *data;
+        UINT64 len, size, pos = 0;
+        UINTN i, cur = 0;
+        CHAR8 args[64];
+        EFI_STATUS ret;
+
+        /* The stream buffer is allocated while the pattern pages are
+         * still in use so that it cannot land in them. */
+        stream = AllocatePool(PULL_STREAM_SIZE);
+        if (!stream) {
+                Print(L"Failed to allocate the stream buffer, test Failed\n");
+                return;
+        }
+
+        ret = uefi_call_wrapper(BS->AllocatePages, 4, AllocateAnyPages,
+                                EfiLoaderData, pages, &start);
+        if (EFI_ERROR(ret)) {
+                Print(L"Failed to allocate the buffer, test Failed\n");
+                FreePool(stream);
+                return;
+        }
+        data = (unsigned char *)(UINTN)start;
+        for (i = 0; i < PULL_TEST_SIZE; i++)
+                data[i] = pull_pattern(i);
+
+        /* Only conventional memory is sent by the RAM reader.  The
+         * RAM reader does not allocate memory. */
+        uefi_call_wrapper(BS->FreePages, 2, start, pages);
+
+        efi_snprintf(args, sizeof(args), (CHAR8 *)"ram:%lx:%lx",
+                     start, (UINT64)PULL_TEST_SIZE);
+        ret = reader_open(&ctx, (char *)args);
+        if (EFI_ERROR(ret)) {
+                Print(L"Failed to open the RAM reader, %r, test Failed\n", ret);
+                FreePool(stream);
+                return;
+        }
+
+        if (ctx.len > PULL_STREAM_SIZE) {
+                Print(L"%ld bytes stream, more than %ld, test Failed\n",
+                      ctx.len, (UINT64)PULL_STREAM_SIZE);
+                goto out;
+        }
+
+        for (;;) {
+                len = PULL_READ_SIZE;
+                ret = reader_read(&ctx, &buf, &len);
+                if (EFI_ERROR(ret)) {
+                        Print(L"Read failed at %ld, %r, test Failed\n", ctx.cur, ret);
+                        goto out;
+                }
+                if (len == 0)
+                        break;
+                memcpy(stream + cur, buf, len);
+                cur += len;
+        }
+
+        sheader = (struct sparse_header *)stream;
+        if (cur < sizeof(*sheader) || sheader->magic != SPARSE_HEADER_MAGIC ||
+            sheader->total_blks != pages) {
+                Print(L"Invalid sparse header, test Failed\n");
+                goto out;
+        }
+
+        for (i = sizeof(*sheader); i < cur; i += chunk->total_sz) {
+                chunk = (struct chunk_header *)(stream + i);
+                size = chunk->chunk_sz * EFI_PAGE_SIZE;
+                if (chunk->chunk_type != CHUNK_TYPE_RAW ||
+                    chunk->total_sz != sizeof(*chunk) + size ||
+                    i + chunk->total_sz > cur) {
+                        Print(L"Unexpected chunk at %ld, test Failed\n", pos);
+                        goto out;
+                }
+                for (data = stream + i + sizeof(*chunk); size; size--, pos++)
+                        if (*data++ != pull_pattern(pos)) {
+                                Print(L"Data mismatch at %ld, test Failed\n", pos);
+                                goto out;
+                        }
+        }
+
+        if (pos != PULL_TEST_SIZE)
+                Print(L"%ld bytes pulled instead of %ld, test Failed\n",
+                      pos, (UINT64)PULL_TEST_SIZE);
+
+out:
+        FreePool(stream);
+        reader_close(&ctx);
+}
+
 static struct test_suite {
         CHAR16 *name;
         VOID (*fun)(VOID);
 } TEST_SUITES[] = {
 #ifdef USE_UI
         { L"ux", test_ux },
+        { L"ui_scale", test_ui_scale },
 #endif
         { L"keys", test_keys },
+        { L"sha", test_sha },
+#ifdef USE_AVB
+        { L"sha512", test_sha512 },
+        { L"rsa", test_rsa },
+#endif
+        { L"scrub", test_scrub },
+        { L"mem", test_mem },
+        { L"pull", test_pull },
         { L"watchdog", test_watchdog }
 };
 